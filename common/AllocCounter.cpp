@@ -0,0 +1,93 @@
+#include <stdlib.h>
+#include <new>
+
+#include "AllocCounter.hpp"
+
+// Every allocation made through operator new, ever
+static volatile unsigned long alloc_counter_total = 0;
+
+#if __cplusplus >= 201103L
+#define ALLOC_COUNTER_THROW_BAD_ALLOC
+#define ALLOC_COUNTER_NOTHROW noexcept
+#else
+#define ALLOC_COUNTER_THROW_BAD_ALLOC throw(std::bad_alloc)
+#define ALLOC_COUNTER_NOTHROW throw()
+#endif
+
+/**
+* Count an allocation of \a size bytes, and make it.
+* @return The memory, or NULL if there isn't any
+*/
+static void * alloc_counter_allocate(std::size_t size) {
+    __sync_fetch_and_add(&alloc_counter_total, 1);
+    return malloc(size > 0 ? size : 1);
+}
+
+void * operator new(std::size_t size) ALLOC_COUNTER_THROW_BAD_ALLOC {
+    void * memory = alloc_counter_allocate(size);
+    if(memory == NULL) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void * operator new[](std::size_t size) ALLOC_COUNTER_THROW_BAD_ALLOC {
+    void * memory = alloc_counter_allocate(size);
+    if(memory == NULL) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void * operator new(std::size_t size, const std::nothrow_t&) ALLOC_COUNTER_NOTHROW {
+    return alloc_counter_allocate(size);
+}
+
+void * operator new[](std::size_t size, const std::nothrow_t&) ALLOC_COUNTER_NOTHROW {
+    return alloc_counter_allocate(size);
+}
+
+void operator delete(void * memory) ALLOC_COUNTER_NOTHROW {
+    free(memory);
+}
+
+void operator delete[](void * memory) ALLOC_COUNTER_NOTHROW {
+    free(memory);
+}
+
+void operator delete(void * memory, const std::nothrow_t&) ALLOC_COUNTER_NOTHROW {
+    free(memory);
+}
+
+void operator delete[](void * memory, const std::nothrow_t&) ALLOC_COUNTER_NOTHROW {
+    free(memory);
+}
+
+/**
+* Start counting from now.
+*/
+AllocCounter::AllocCounter() {
+    this->reset();
+}
+
+/**
+* Start counting again from now.
+*/
+void AllocCounter::reset() {
+    this->start = AllocCounter::get_total();
+}
+
+/**
+* How many allocations (by any thread) there have been since we last reset.
+*/
+unsigned long AllocCounter::get_count() const {
+    return AllocCounter::get_total() - this->start;
+}
+
+/**
+* How many allocations there have been since the program started.
+*/
+unsigned long AllocCounter::get_total() {
+    __sync_synchronize();
+    return alloc_counter_total;
+}
@@ -0,0 +1,28 @@
+#ifndef ALLOCCOUNTER_HPP_
+#define ALLOCCOUNTER_HPP_
+
+/**
+ * Counts heap allocations, so a loop that's meant to run without any (like
+ * the surface's, once it's streaming) can check that it does.  Linking
+ * AllocCounter.cpp into a program replaces the global operator new and
+ * delete with ones that count every allocation, on any thread, and then
+ * call malloc() and free() as usual.
+ *
+ * Make one at the top of the loop (or reset() it there), and see what
+ * get_count() says at the bottom.  Buffers from PTP::FrameBufferPool don't
+ * go through operator new; check its get_system_allocations() for those.
+ */
+class AllocCounter {
+public:
+    AllocCounter();
+
+    void reset();
+    unsigned long get_count() const;
+
+    static unsigned long get_total();
+
+private:
+    unsigned long start;    // get_total() when we last reset
+};
+
+#endif /* ALLOCCOUNTER_HPP_ */
@@ -0,0 +1,59 @@
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Backoff.hpp"
+
+/**
+* Create a backoff that starts at \a min_ms and doubles up to \a max_ms.
+*/
+Backoff::Backoff(int min_ms, int max_ms) {
+    this->min_ms = min_ms;
+    this->max_ms = max_ms;
+    this->seed = (unsigned int)time(NULL) ^ ((unsigned int)getpid() << 8);
+    this->reset();
+}
+
+/**
+* Returns how long to wait before the next attempt, and counts an attempt.
+* The delay is picked at random between half and all of the current backoff.
+*/
+int Backoff::next_delay() {
+    int half = this->delay_ms / 2;
+    int delay = half + (half > 0 ? rand_r(&this->seed) % (half + 1) : 0);
+
+    this->attempts++;
+    this->delay_ms *= 2;
+    if(this->delay_ms > this->max_ms) {
+        this->delay_ms = this->max_ms;
+    }
+
+    return delay;
+}
+
+/**
+* Sleep for the next delay.
+*/
+void Backoff::wait() {
+    usleep(this->next_delay() * 1000);
+}
+
+/**
+* Start over from the minimum delay (call after a successful attempt).
+*/
+void Backoff::reset() {
+    this->delay_ms = this->min_ms;
+    this->attempts = 0;
+}
+
+int Backoff::get_attempts() {
+    return this->attempts;
+}
+
+/**
+* Returns true on the first failure and every power of two after that, so a
+* retry loop can log without flooding the log.
+*/
+bool Backoff::should_report() {
+    return (this->attempts & (this->attempts - 1)) == 0;
+}
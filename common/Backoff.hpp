@@ -0,0 +1,27 @@
+#ifndef BACKOFF_HPP_
+#define BACKOFF_HPP_
+
+/**
+ * Exponential backoff with jitter for retry loops.  Each failed attempt
+ * doubles the delay (up to a cap), and each delay is randomized so the two
+ * Pis don't retry in lockstep.
+ */
+class Backoff {
+public:
+    Backoff(int min_ms, int max_ms);
+
+    int next_delay();
+    void wait();
+    void reset();
+    int get_attempts();
+    bool should_report();
+
+private:
+    int min_ms;
+    int max_ms;
+    int delay_ms;
+    int attempts;
+    unsigned int seed;
+};
+
+#endif /* BACKOFF_HPP_ */
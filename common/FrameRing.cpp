@@ -0,0 +1,237 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <new>
+
+#include "FrameRing.hpp"
+
+#define FRAMERING_ALIGN 64
+
+/**
+* Allocate \a capacity slots of \a slot_bytes each (which may be 0, to only
+* record() frames).  The memory is touched now, so the writer doesn't page it
+* in one frame at a time later.
+* @param[in] first_generation Where each slot's generation starts (rounded
+*                             down to even), so a test can start it just
+*                             short of wrapping
+*/
+FrameRing::FrameRing(const int capacity, const int slot_bytes, const uint32_t first_generation) {
+    this->capacity = capacity > 0 ? capacity : 1;
+    this->slot_bytes = slot_bytes > 0 ? slot_bytes : 0;
+    this->stride = (this->slot_bytes + FRAMERING_ALIGN - 1) & ~(FRAMERING_ALIGN - 1);
+    this->latest = 0;
+    this->writing = -1;
+
+    void * slots = NULL;
+    void * data = NULL;
+    if(posix_memalign(&slots, FRAMERING_ALIGN, this->capacity * sizeof(Slot)) != 0 ||
+       (this->stride > 0 && posix_memalign(&data, FRAMERING_ALIGN, this->capacity * this->stride) != 0)) {
+        free(slots);
+        throw std::bad_alloc();
+    }
+    this->slots = (Slot *)slots;
+    this->data = (uint8_t *)data;
+    memset(this->slots, 0, this->capacity * sizeof(Slot));
+    for(int i = 0; i < this->capacity; i++) {
+        this->slots[i].generation = first_generation & ~1U;
+    }
+    if(this->data != NULL) {
+        memset(this->data, 0, this->capacity * this->stride);
+    }
+}
+
+FrameRing::~FrameRing() {
+    free(this->slots);
+    free(this->data);
+}
+
+int FrameRing::get_capacity() const {
+    return this->capacity;
+}
+
+int FrameRing::get_slot_bytes() const {
+    return this->slot_bytes;
+}
+
+/**
+* Start writing frame \a sequence, overwriting the oldest frame.  Readers
+* looking at that one will find out when they validate.
+* @param[in] sequence The frame's sequence number: one more than the last one
+*                     (gaps are fine, but it may not be 0)
+* @param[in] size How many bytes the frame takes
+* @return Where to write the frame, or NULL if it doesn't fit in a slot (or
+*         the ring keeps no data -- use record())
+*/
+uint8_t * FrameRing::begin_write(const uint32_t sequence, const int size) {
+    if(sequence == 0 || size < 0 || size > this->slot_bytes || this->data == NULL) {
+        return NULL;
+    }
+
+    return this->data + this->start(sequence) * this->stride;
+}
+
+/**
+* Finish writing the frame begun with begin_write(), and make it the latest.
+* @param[in] info What to record with the frame.  Its sequence is ignored (the
+*                 one given to begin_write() is kept).
+*/
+void FrameRing::commit(const FrameInfo& info) {
+    if(this->writing < 0) {
+        return;
+    }
+
+    Slot& slot = this->slots[this->writing];
+    uint32_t sequence = slot.info.sequence;
+    slot.info = info;
+    slot.info.sequence = sequence;
+    __sync_synchronize();
+    slot.generation = slot.generation + 1;
+    __sync_synchronize();
+    this->latest = sequence;
+    this->writing = -1;
+}
+
+/**
+* Record frame \a info.sequence without its data: only \a info is kept, with
+* its size set to 0.  Like begin_write() and commit() in one.
+*/
+void FrameRing::record(const FrameInfo& info) {
+    if(info.sequence == 0) {
+        return;
+    }
+
+    this->start(info.sequence);
+    FrameInfo kept = info;
+    kept.size = 0;
+    this->commit(kept);
+}
+
+/**
+* The last frame committed, or 0 if there isn't one yet.  Older frames are
+* (at most) get_capacity() - 1 sequence numbers behind it.
+*/
+uint32_t FrameRing::get_latest() const {
+    __sync_synchronize();
+    return this->latest;
+}
+
+/**
+* Look at frame \a sequence, where it is.  Call validate() when done with it.
+* @param[out] info What was recorded with the frame (may be NULL)
+* @param[out] ticket To pass to validate()
+* @return The frame's data, or NULL if it isn't in the ring (any more), or is
+*         being written right now
+*/
+const uint8_t * FrameRing::peek(const uint32_t sequence, FrameInfo * info, uint32_t * ticket) const {
+    if(this->data == NULL || this->snapshot(sequence, info, ticket) == false) {
+        return NULL;
+    }
+
+    return this->data + (sequence % this->capacity) * this->stride;
+}
+
+/**
+* Get what was recorded with frame \a sequence.
+* @return false if it isn't in the ring (any more), or is being written right
+*         now
+*/
+bool FrameRing::get_info(const uint32_t sequence, FrameInfo * info) const {
+    uint32_t generation;
+    return this->snapshot(sequence, info, &generation);
+}
+
+/**
+* Whether frame \a sequence is still what it was when peek() gave out
+* \a ticket, i.e. whether anything read from it since can be trusted.
+*/
+bool FrameRing::validate(const uint32_t sequence, const uint32_t ticket) const {
+    __sync_synchronize();
+    return this->slots[sequence % this->capacity].generation == ticket;
+}
+
+/**
+* Copy frame \a sequence out of the ring.
+* @param[out] info What was recorded with the frame (may be NULL)
+* @param[out] out Where to copy the frame
+* @param[in] out_size How many bytes fit in \a out
+* @return false if the frame isn't in the ring, doesn't fit in \a out, or was
+*         overwritten while we copied it
+*/
+bool FrameRing::read(const uint32_t sequence, FrameInfo * info, uint8_t * out, const int out_size) const {
+    FrameInfo frame_info;
+    uint32_t ticket;
+    const uint8_t * frame = this->peek(sequence, &frame_info, &ticket);
+    if(frame == NULL || frame_info.size > out_size) {
+        return false;
+    }
+
+    memcpy(out, frame, frame_info.size);
+    if(this->validate(sequence, ticket) == false) {
+        return false;
+    }
+
+    if(info != NULL) {
+        *info = frame_info;
+    }
+    return true;
+}
+
+/**
+* Start overwriting the slot frame \a sequence goes in.
+* @return The slot's index
+*/
+int FrameRing::start(const uint32_t sequence) {
+    int index = sequence % this->capacity;
+    Slot& slot = this->slots[index];
+    // Odd from now until commit(). If the last write to this slot was never
+    //  committed, it's odd already -- move it on anyway, so a reader that
+    //  looked at it then can tell.
+    slot.generation = (slot.generation | 1) + ((slot.generation & 1) ? 2 : 0);
+    slot.info.sequence = sequence;
+    slot.info.size = 0;
+    __sync_synchronize();
+
+    this->writing = index;
+    return index;
+}
+
+/**
+* Copy what was recorded with frame \a sequence, and the slot's generation,
+* making sure the writer didn't change either meanwhile.
+* @param[out] info Where to copy it (may be NULL)
+* @return false if the frame isn't in the ring, or is being written
+*/
+bool FrameRing::snapshot(const uint32_t sequence, FrameInfo * info, uint32_t * generation) const {
+    if(sequence == 0) {
+        return false;
+    }
+
+    const Slot& slot = this->slots[sequence % this->capacity];
+    uint32_t before = slot.generation;
+    __sync_synchronize();
+    if(before & 1) {
+        return false;
+    }
+
+    FrameInfo copy = slot.info;
+    __sync_synchronize();
+    if(slot.generation != before || copy.sequence != sequence) {
+        return false;
+    }
+
+    if(info != NULL) {
+        *info = copy;
+    }
+    *generation = before;
+    return true;
+}
+
+/**
+* The monotonic clock, in ns.  Only good for telling how long ago something
+* happened on this machine.
+*/
+uint64_t FrameRing::now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
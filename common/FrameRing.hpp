@@ -0,0 +1,78 @@
+#ifndef FRAMERING_HPP_
+#define FRAMERING_HPP_
+
+#include <stdint.h>
+#include <libptp++/libptp++.hpp>
+
+/**
+ * The last few live view frames, each with when it was captured.  One thread
+ * writes frames; any number of others may look at them at the same time
+ * (the HUD, a recorder, latency probes) without copying them, and without
+ * ever holding the writer up.
+ *
+ * The slots are allocated up front, aligned to cache lines, and reused.
+ * Each has a generation counter (a seqlock): it's odd while the writer is
+ * filling the slot in, and changes whenever it does.  A reader notes the
+ * generation when it looks at a frame (peek), and checks it hasn't changed
+ * once it's done with it (validate).  If it has, the writer came round to
+ * that slot again, and whatever the reader made of the frame must be thrown
+ * away.
+ *
+ * A ring made with no slot bytes keeps only what's known about each frame
+ * (record() and get_info()), for when the frames themselves live elsewhere.
+ */
+class FrameRing {
+public:
+    struct FrameInfo {
+        uint32_t sequence;                  // Set by the writer, counts up from 1
+        uint64_t capture_ns;                // When it was fetched (CLOCK_MONOTONIC, see now_ns())
+        PTP::lv_framebuffer_desc desc;      // The camera's viewport, as captured
+        uint32_t width;
+        uint32_t height;
+        uint32_t encoding;                  // SD_LV_ENCODINGS
+        int size;                           // Bytes of data in the slot
+    };
+
+    FrameRing(const int capacity, const int slot_bytes, const uint32_t first_generation=0);
+    ~FrameRing();
+
+    int get_capacity() const;
+    int get_slot_bytes() const;
+
+    // Writer
+    uint8_t * begin_write(const uint32_t sequence, const int size);
+    void commit(const FrameInfo& info);
+    void record(const FrameInfo& info);
+
+    // Readers
+    uint32_t get_latest() const;
+    bool get_info(const uint32_t sequence, FrameInfo * info) const;
+    const uint8_t * peek(const uint32_t sequence, FrameInfo * info, uint32_t * ticket) const;
+    bool validate(const uint32_t sequence, const uint32_t ticket) const;
+    bool read(const uint32_t sequence, FrameInfo * info, uint8_t * out, const int out_size) const;
+
+    static uint64_t now_ns();
+
+private:
+    struct Slot {
+        volatile uint32_t generation;   // Odd while being written
+        FrameInfo info;
+    } __attribute__((aligned(64)));
+
+    Slot * slots;
+    uint8_t * data;
+    int capacity;
+    int slot_bytes;
+    int stride;                     // slot_bytes, rounded up to a cache line
+    volatile uint32_t latest;       // The last sequence committed, 0 if none
+    int writing;                    // The slot being written, -1 if none
+
+    int start(const uint32_t sequence);
+    bool snapshot(const uint32_t sequence, FrameInfo * info, uint32_t * generation) const;
+
+    // Not copyable
+    FrameRing(const FrameRing&);
+    FrameRing& operator=(const FrameRing&);
+};
+
+#endif /* FRAMERING_HPP_ */
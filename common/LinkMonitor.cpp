@@ -0,0 +1,150 @@
+#include <time.h>
+#include <iostream>
+#include <libptp++/libptp++.hpp>
+
+#include "LinkMonitor.hpp"
+
+/**
+* Create a monitor for a link that isn't connected yet.
+* @param[in] heartbeat_ms How often the other end is expected to talk to us
+* @param[in] timeout_ms How long the other end may be silent before the link
+*                       is considered lost
+*/
+LinkMonitor::LinkMonitor(int heartbeat_ms, int timeout_ms) {
+    this->state = LINK_DOWN;
+    this->heartbeat_ms = heartbeat_ms;
+    this->timeout_ms = timeout_ms;
+    this->last_heard = 0;
+    this->last_sent = 0;
+}
+
+/**
+* Change the heartbeat interval (e.g. when the surface asks for a new one).
+* The timeout never drops below two heartbeats.
+*/
+void LinkMonitor::set_heartbeat(int heartbeat_ms) {
+    if(heartbeat_ms <= 0) return;
+
+    this->heartbeat_ms = heartbeat_ms;
+    if(this->timeout_ms < 2 * heartbeat_ms) {
+        this->timeout_ms = 2 * heartbeat_ms;
+    }
+}
+
+int LinkMonitor::get_heartbeat() {
+    return this->heartbeat_ms;
+}
+
+int LinkMonitor::get_timeout() {
+    return this->timeout_ms;
+}
+
+/**
+* Called when a connection to the other end was just made.
+*/
+void LinkMonitor::connected() {
+    this->last_heard = LinkMonitor::now_ms();
+    this->last_sent = this->last_heard;
+    this->set_state(LINK_UP);
+}
+
+/**
+* Called whenever we receive anything from the other end.
+*/
+void LinkMonitor::heard() {
+    this->last_heard = LinkMonitor::now_ms();
+    if(this->state != LINK_DOWN) {
+        this->set_state(LINK_UP);
+    }
+}
+
+/**
+* Called whenever we send anything to the other end.
+*/
+void LinkMonitor::sent() {
+    this->last_sent = LinkMonitor::now_ms();
+}
+
+/**
+* Called when the connection failed outright (e.g. a send or receive error).
+*/
+void LinkMonitor::lost() {
+    this->set_state(LINK_LOST);
+}
+
+/**
+* Returns true if we haven't sent anything for a heartbeat interval, and
+* should send a heartbeat to keep the other end from giving up on us.
+*/
+bool LinkMonitor::heartbeat_due() {
+    return (LinkMonitor::now_ms() - this->last_sent) >= this->heartbeat_ms;
+}
+
+/**
+* Returns the number of milliseconds since we last heard from the other end.
+*/
+long LinkMonitor::silence_ms() {
+    return LinkMonitor::now_ms() - this->last_heard;
+}
+
+/**
+* Re-evaluate the link state based on how long the other end has been silent.
+* @return The new link state
+*/
+LinkMonitor::LinkState LinkMonitor::update() {
+    if(this->state == LINK_DOWN || this->state == LINK_LOST) {
+        return this->state;
+    }
+
+    long silence = this->silence_ms();
+    if(silence >= this->timeout_ms) {
+        this->set_state(LINK_LOST);
+    } else if(silence >= 2 * this->heartbeat_ms) {
+        this->set_state(LINK_SUSPECT);
+    }
+
+    return this->state;
+}
+
+LinkMonitor::LinkState LinkMonitor::get_state() {
+    return this->state;
+}
+
+/**
+* Apply our timeouts to a freshly connected socket, so that a dead tether
+* makes reads and writes fail instead of blocking forever.
+*/
+void LinkMonitor::tune(PTP::PTPNetwork& net) {
+    try {
+        net.set_timeout(this->timeout_ms);
+        // Keepalive only has one second resolution -- it's a backup for
+        //  heartbeats, which catch the link going down much sooner
+        net.set_keepalive(1, 1, 3, this->timeout_ms);
+    } catch(PTP::PTPNetwork::NetworkErrors e) {
+        std::cout << "Link: unable to set socket options: " << e << std::endl;
+    }
+}
+
+/**
+* Returns a monotonic timestamp in milliseconds.  Unlike gettimeofday, this
+* doesn't jump when the Pi sets its clock.
+*/
+long LinkMonitor::now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+void LinkMonitor::set_state(LinkState new_state) {
+    if(new_state == this->state) return;
+
+    if(new_state == LINK_SUSPECT) {
+        std::cout << "Link: missed heartbeats (" << this->silence_ms() << " ms)" << std::endl;
+    } else if(new_state == LINK_LOST) {
+        std::cout << "Link: lost" << std::endl;
+    } else if(new_state == LINK_UP && this->state != LINK_SUSPECT) {
+        std::cout << "Link: up" << std::endl;
+    }
+
+    this->state = new_state;
+}
@@ -0,0 +1,53 @@
+#ifndef LINKMONITOR_HPP_
+#define LINKMONITOR_HPP_
+
+#include "SDDefines.hpp"
+
+namespace PTP {
+    class PTPNetwork;
+}
+
+/**
+ * Keeps track of the state of the tether between the surface and the
+ * submarine.  Each end tells the monitor whenever it hears from, or talks to,
+ * the other end, and checks it periodically to find out if the link was lost.
+ */
+class LinkMonitor {
+public:
+    enum LinkState {
+        LINK_DOWN = 0,  // Not connected (yet)
+        LINK_UP,        // Heard from the other end recently
+        LINK_SUSPECT,   // Missed a couple of heartbeats
+        LINK_LOST       // Missed heartbeats for longer than the timeout
+    };
+
+    LinkMonitor(int heartbeat_ms=SD_HEARTBEAT_MS, int timeout_ms=SD_LINK_TIMEOUT_MS);
+
+    void set_heartbeat(int heartbeat_ms);
+    int get_heartbeat();
+    int get_timeout();
+
+    void connected();
+    void heard();
+    void sent();
+    void lost();
+
+    bool heartbeat_due();
+    long silence_ms();
+    LinkState update();
+    LinkState get_state();
+    void tune(PTP::PTPNetwork& net);
+
+    static long now_ms();
+
+private:
+    LinkState state;
+    int heartbeat_ms;
+    int timeout_ms;
+    long last_heard;
+    long last_sent;
+
+    void set_state(LinkState new_state);
+};
+
+#endif /* LINKMONITOR_HPP_ */
@@ -2,6 +2,23 @@
 #define SDDEFINES_HPP_
 
 #define SD_MAGIC 0xF061
+#define SD_PORT 50000
+
+// How often the surface must talk to the submarine, even when it has nothing
+//  to say.  The surface sends this to the submarine with SD_REQ_CONNECTED and
+//  SD_RESUME, so only the surface needs to be rebuilt to change it.
+#define SD_HEARTBEAT_MS 100
+// How long either end waits without hearing from the other before declaring
+//  the link lost (stopping the motors, reconnecting)
+#define SD_LINK_TIMEOUT_MS 400
+// Reconnect attempts start this often, and back off to at most every
+//  SD_CONNECT_BACKOFF_MAX_MS while the submarine is down
+#define SD_CONNECT_BACKOFF_MIN_MS 10
+#define SD_CONNECT_BACKOFF_MAX_MS 250
+// How long a single connection attempt may take
+#define SD_CONNECT_TIMEOUT_MS 1000
+// Setting up the camera (SD_REQ_CONNECTED) takes the submarine several seconds
+#define SD_CAMERA_SETUP_MS 10000
 
 enum SD_COMMANDS {
     SD_REQ_CONNECTED = 1,
@@ -13,6 +30,99 @@ enum SD_COMMANDS {
     SD_UPDATE,
     SD_OK,
     SD_ERROR,
+    SD_HEARTBEAT,
+    SD_RESUME,
+    SD_JOYDATA_LV,  // SD_JOYDATA, answered with SD_LVDATA's data and response
+    SD_LV_UNCHANGED,    // Instead of SD_OK, with no data: the camera hasn't refreshed its frame
+};
+
+// Flags for SD_LVDATA and SD_JOYDATA_LV, sent as the command's second parameter
+enum SD_LV_FLAGS {
+    SD_LV_OVERLAY = 0x01,   // Blend the camera's own display (OSD) onto the frame
+    SD_LV_RAW = 0x02,       // Send the camera's YUV viewport, and let the surface convert it
+    SD_LV_DELTA = 0x04,     // Only send the tiles that changed (PTP::LVDeltaCodec)
+    SD_LV_KEYFRAME = 0x08,  // The surface lost track of the deltas -- send a keyframe
+    SD_LV_DCT = 0x10,       // With SD_LV_RAW, compress the viewport (PTP::LVDCTCodec) instead of SD_LV_DELTA
+    SD_LV_SKIP_UNCHANGED = 0x20,    // The surface still shows the last frame, so answer SD_LV_UNCHANGED
+                                    //  rather than send the same one again
+    SD_LV_LUMA = 0x40,      // Only send the viewport's luma (SD_LV_Y8), for when the tether can't keep up with
+                            //  colour. Takes precedence over SD_LV_RAW, and the OSD isn't blended in.
+    SD_LV_HALF = 0x80,      // With SD_LV_LUMA, halve the frame in each direction
+    SD_LV_ROI = 0x100,      // Only send a region of the frame, at the viewport's full resolution (no skip), and
+                            //  without the OSD. The region is the command's fifth parameter (SD_LV_ROI_PACK).
+    SD_LV_STATS = 0x200,    // Also send statistics of the frame's luma, for exposure and focus hints, after the
+                            //  response's other parameters (SD_LV_STATS_PARAMS)
+};
+// The SD_LV_FLAGS that change how a frame is made, rather than how it's sent
+#define SD_LV_FRAME_FLAGS (SD_LV_OVERLAY | SD_LV_RAW | SD_LV_LUMA | SD_LV_HALF | SD_LV_ROI | SD_LV_STATS)
+// With SD_LV_ROI, the region to send, in 256ths of the frame: x, y, width and
+//  height, a byte each, from the top byte down
+#define SD_LV_ROI_PACK(x, y, width, height) (((uint32_t)(x) << 24) | ((uint32_t)(y) << 16) | \
+                                             ((uint32_t)(width) << 8) | (uint32_t)(height))
+#define SD_LV_ROI_X(roi) (((roi) >> 24) & 0xFF)
+#define SD_LV_ROI_Y(roi) (((roi) >> 16) & 0xFF)
+#define SD_LV_ROI_WIDTH(roi) (((roi) >> 8) & 0xFF)
+#define SD_LV_ROI_HEIGHT(roi) ((roi) & 0xFF)
+// The region the surface inspects: the middle quarter of the frame
+#define SD_LV_INSPECT_ROI SD_LV_ROI_PACK(64, 64, 128, 128)
+// The submarine fingerprints one viewport row in this many to tell a new
+//  frame from the last one
+#define SD_LV_FINGERPRINT_ROW_STEP 4
+// The submarine fetches live view on a thread of its own. How long SD_LVDATA
+//  waits for its first frame (keep it well inside SD_LINK_TIMEOUT_MS), how
+//  long the thread waits after the camera hands back the same frame, and
+//  after failing to fetch one, in ms
+#define SD_LV_FIRST_FRAME_MS 200
+#define SD_LV_POLL_MS 5
+#define SD_LV_RETRY_MS 100
+// How many of its latest frames the submarine remembers capturing (see
+//  FrameRing), to tell how old the frames it sends are
+#define SD_LV_HISTORY_FRAMES 8
+// The most a live view frame can take once decoded: RGB565 at the largest
+//  size CHDK sends. The surface sizes its buffers for this up front.
+#define SD_LV_MAX_FRAME_BYTES (720 * 480 * 2)
+// With SD_LV_DELTA, how much a tile may change and still be skipped (mean
+//  absolute difference per byte), sent as the command's third parameter
+#define SD_LV_DELTA_THRESHOLD 2
+// With SD_LV_DELTA, send a keyframe at least this often, in frames
+#define SD_LV_KEYFRAME_INTERVAL 60
+// With SD_LV_DCT, the quality to compress at (1-100, as for JPEG), sent as the
+//  command's fourth parameter
+#define SD_LV_DCT_QUALITY 75
+
+// With SD_LV_STATS, the response's parameters from the tenth on: the luma's
+//  mean, minimum and maximum, how many samples are clipped black and white
+//  (see PTP::LVStats::CLIPPED_LOW and CLIPPED_HIGH), how sharp it is (in
+//  256ths, see PTP::LVStats::get_sharpness), how many samples there are, and
+//  then a histogram of SD_LV_STATS_BINS bins. Taken from the region sent
+//  with SD_LV_ROI, and always from the camera's picture, never the OSD.
+enum SD_LV_STATS_PARAMS {
+    SD_LV_STATS_MEAN = 9,
+    SD_LV_STATS_MIN,
+    SD_LV_STATS_MAX,
+    SD_LV_STATS_CLIPPED_LOW,
+    SD_LV_STATS_CLIPPED_HIGH,
+    SD_LV_STATS_SHARPNESS,
+    SD_LV_STATS_COUNT,
+    SD_LV_STATS_HISTOGRAM,
+};
+#define SD_LV_STATS_BINS 16
+
+// How SD_LVDATA's data is encoded, sent as the fifth parameter of its response.
+//  Submarines that don't send one only know SD_LV_RGB565.
+enum SD_LV_ENCODINGS {
+    SD_LV_RGB565 = 0,       // width x height RGB565 pixels, native byte order
+    SD_LV_YUV,              // A live view payload for PTP::LVData (see LVData::get_viewport)
+    SD_LV_Y8,               // width x height 8-bit luma samples (see LVData::get_luma)
+};
+
+// How SD_LVDATA's data is compressed, sent as the sixth parameter of its
+//  response, followed by the bytes sent, the number of tiles and the number of
+//  tiles sent (for tuning SD_LV_DELTA_THRESHOLD)
+enum SD_LV_CODECS {
+    SD_LV_CODEC_NONE = 0,
+    SD_LV_CODEC_DELTA,      // PTP::LVDeltaCodec, around the encoding above
+    SD_LV_CODEC_DCT,        // PTP::LVDCTCodec, around SD_LV_YUV
 };
 
 #endif /* SDDEFINES_HPP_ */
@@ -0,0 +1,86 @@
+#ifndef TRIPLEBUFFER_HPP_
+#define TRIPLEBUFFER_HPP_
+
+/**
+ * A mailbox between one producer thread and one consumer thread, where the
+ * consumer only ever wants the latest item.  There are three slots: the
+ * producer fills its own, then swaps it with the one in the middle; the
+ * consumer swaps the middle one for its own whenever there's something new.
+ * Nothing is queued (an item the consumer didn't get to in time is simply
+ * overwritten) and neither side ever waits for the other.
+ *
+ * The slots are reused, so an item that owns buffers (like a PTPContainer)
+ * keeps them between items instead of reallocating.
+ */
+template<typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : back(0), middle(1), front(2), have_front(false) {}
+
+    /**
+     * The producer's slot, to fill in before calling publish()
+     */
+    T& get_back() {
+        return this->slots[this->back];
+    }
+
+    /**
+     * Hand the producer's slot to the consumer, replacing whatever it hasn't
+     * picked up yet.  The producer gets a free slot back.
+     */
+    void publish() {
+        this->back = this->swap_middle(this->back | FRESH) & INDEX;
+    }
+
+    /**
+     * Pick up the latest item, if there's a new one.  The consumer may use it
+     * until its next call.
+     * @return The latest item (the same one as last time, if nothing new was
+     *         published), or NULL if nothing has been published yet
+     */
+    T * acquire() {
+        if(this->middle & FRESH) {
+            this->front = this->swap_middle(this->front) & INDEX;
+            this->have_front = true;
+        }
+        return this->have_front ? &this->slots[this->front] : NULL;
+    }
+
+    /**
+     * Whether there's an item the consumer hasn't picked up yet
+     */
+    bool is_fresh() const {
+        return (this->middle & FRESH) != 0;
+    }
+
+private:
+    enum {
+        INDEX = 0x03,
+        FRESH = 0x04    // Set in middle when the producer published it, cleared when the consumer takes it
+    };
+
+    T slots[3];
+    int back;               // Only touched by the producer
+    volatile int middle;    // Swapped by both, atomically
+    int front;              // Only touched by the consumer
+    bool have_front;
+
+    /**
+     * Put value in the middle, and return what was there.  A full barrier, so
+     * the producer's writes to its slot are visible before the consumer can
+     * take it.
+     */
+    int swap_middle(const int value) {
+        int old;
+        do {
+            old = this->middle;
+        } while(__sync_val_compare_and_swap(&this->middle, old, value) != old);
+        return old;
+    }
+
+    // Not copyable
+    TripleBuffer(const TripleBuffer&);
+    TripleBuffer& operator=(const TripleBuffer&);
+};
+
+#endif /* TRIPLEBUFFER_HPP_ */
@@ -9,15 +9,21 @@
  */
  
 #include <cstring>
-#include <fstream>
 // Needed for usleep() in script wait
 #include <unistd.h>
 #include <stdint.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
  
 #include "libptp++.hpp"
 #include "CHDKCamera.hpp"
 #include "PTPContainer.hpp"
 #include "LVData.hpp"
+#include "ITransferProgress.hpp"
+#include "IDataSink.hpp"
+#include "FDDataSink.hpp"
 
 namespace PTP {
 
@@ -25,7 +31,7 @@ namespace PTP {
  * Creates an empty \c CHDKCamera, without connecting to a camera.
  */
 CHDKCamera::CHDKCamera() : CameraBase() {
-    ;
+    pthread_mutex_init(&this->download_lock, NULL);
 }
 
 /**
@@ -35,7 +41,11 @@ CHDKCamera::CHDKCamera() : CameraBase() {
  * @see CameraBase::CameraBase(libusb_device * dev)
  */
 CHDKCamera::CHDKCamera(IPTPComm * protocol) : CameraBase(protocol) {
-    ;
+    pthread_mutex_init(&this->download_lock, NULL);
+}
+
+CHDKCamera::~CHDKCamera() {
+    pthread_mutex_destroy(&this->download_lock);
 }
 
 /**
@@ -200,12 +210,7 @@ void CHDKCamera::get_live_view_data(LVData& data_out, const bool liveview, const
     PTPContainer data, out_resp, out_data;
     this->ptp_transaction(cmd, data, true, out_resp, out_data);
     
-    int payload_size;
-    unsigned char * payload = out_data.get_payload(&payload_size);
-    
-    data_out.read(payload, payload_size);    // The LVData class will completely handle the LV data
-    
-    delete[] payload;
+    data_out.read(out_data);    // The LVData class will completely handle the LV data
 }
 
 /**
@@ -256,75 +261,275 @@ std::vector<std::string> CHDKCamera::_wait_for_script_return(const int timeout)
 }
 
 /**
- * @brief Reads in a file and packs data for uploading.
- * 
+ * @brief Map \a filename read-only
+ *
+ * @param[in]  filename The path and name of the local file
+ * @param[out] size     The size of the file
+ * @return The first byte of the file, or NULL if it couldn't be mapped.  Give it back with \c chdk_unmap_file.
+ */
+static const uint8_t * chdk_map_file(const std::string filename, uint32_t * size) {
+    static const uint8_t empty = 0;     // Empty files can't be mapped, but there's nothing to read anyway
+    struct stat info;
+    
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0) {
+        return NULL;
+    }
+    if(fstat(fd, &info) != 0 || (uint64_t)info.st_size > 0xFFFF0000ULL) {     // Too big for a PTP container
+        close(fd);
+        return NULL;
+    }
+    
+    *size = info.st_size;
+    void * data = (void *)&empty;
+    if(*size > 0) {
+        data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);      // The mapping stays
+    if(data == MAP_FAILED) {
+        return NULL;
+    }
+    if(*size > 0) {
+        madvise(data, *size, MADV_SEQUENTIAL);  // It's read once, front to back
+    }
+    return (const uint8_t *)data;
+}
+
+/**
+ * @brief Give back a file mapped by \c chdk_map_file
+ */
+static void chdk_unmap_file(const uint8_t * data, const uint32_t size) {
+    if(size > 0) {
+        munmap((void *)data, size);
+    }
+}
+
+static const uint64_t chdk_hash_seed = 0xCBF29CE484222325ULL;
+
+/**
+ * @brief Hash \a size bytes of \a data (64-bit FNV-1a), carrying on from \a hash
+ */
+static uint64_t chdk_hash(const uint8_t * data, const uint32_t size, uint64_t hash) {
+    for(uint32_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+namespace {
+
+/**
+ * @brief An \c IDataSink that only hashes the data, for \c CHDKCamera::upload_file_if_changed
+ */
+class HashDataSink : public IDataSink {
+    public:
+        HashDataSink() : hash(chdk_hash_seed), size(0) { }
+        virtual bool write(const unsigned char * data, const int length) {
+            this->hash = chdk_hash(data, length, this->hash);
+            this->size += length;
+            return true;
+        }
+        uint64_t hash;
+        uint32_t size;
+};
+
+} /* anonymous namespace */
+
+/**
+ * @brief Upload \a size bytes of \a data to the camera, as \a remote_filename
+ *
  * From CHDK source code, the correct format for the uploaded file is:
  *  -# Four bytes of length of filename
  *  -# Filename
  *  -# Contents of file
- * 
- * @warning The caller is responsible for free()ing the memory allocated by this
- *          function.
- * 
- * @param[out] out_size The size of the resulting data structure
- * @param[in] local_filename The path and name of the local file to be read
- * @param[in] remote_filename The path and name of the location on the camera to place the file
- * @return A pointer to the first byte of the resulting data
+ *
+ * The first two go in the data container, and \a data is sent after them,
+ * straight from where it is (see \c CameraBase::ptp_transaction).
+ *
  * @see CHDKCamera::upload_file
  */
-uint8_t * CHDKCamera::_pack_file_for_upload(uint32_t * out_size, const std::string local_filename, const std::string remote_filename) {
-    uint32_t file_size;
-    uint8_t * out;
-    int name_length;
-    
-    name_length = remote_filename.length();
-    
-	std::ifstream stream_local(local_filename.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
-    // Open file for reading, binary type of file, place pointer at end of file
-    
-    file_size = stream_local.tellg(); // Retrives the position of the input stream
-    // Since we asked to open the file at the end, this is the length of the file
-    stream_local.seekg(0, std::ios::beg);
-    
-	out = new uint8_t[4 + name_length + file_size];   // Allocate memory for the packed file
-    
-    std::memcpy(out, &file_size, 4);        // Copy four bytes of file size to output
-	const char * r_filename = remote_filename.data();
-    std::memcpy(out + 4, r_filename, name_length);      // Copy the file name in
-    stream_local.read((char *)(out+4+name_length), file_size);    // Copy the file contents in
+bool CHDKCamera::_upload_data(const uint8_t * data, const uint32_t size, const std::string remote_filename, const int timeout, ITransferProgress * progress) {
+    PTPContainer cmd(PTPContainer::CONTAINER_TYPE_COMMAND, 0x9999);
+    PTPContainer prefix(PTPContainer::CONTAINER_TYPE_DATA, 0x9999);
+    PTPContainer resp;
+    uint32_t name_length = remote_filename.length();
     
-    stream_local.close(); // Close the opened file stream
+    cmd.add_param(PTP::PTP_CHDK_UploadFile);
+    unsigned char * payload = prefix.resize_payload(4 + name_length);
+    std::memcpy(payload, &name_length, 4);      // Four bytes of file name length
+    std::memcpy(payload + 4, remote_filename.data(), name_length);  // Then the file name
     
-    *out_size = 4 + name_length + file_size; // Output the size of the result
+    this->ptp_transaction(cmd, prefix, data, size, resp, progress, timeout);
     
-    return out; // Return the packed file. Caller is responsible for free()ing this
+    return (resp.code == PTP::CHDK_PTP_RC_OK);
 }
 
 /**
  * @brief Public method to upload a local file to the camera.
+ *
+ * The file is mapped, and sent straight from the mapping a chunk at a time,
+ * so it's never copied, however big it is.
  * 
  * @param[in] local_filename The local path and filename to send
  * @param[in] remote_filename The path and filename to store the file on the camera
  * @param[in] timeout (optional) The timeout for each PTP call
- * @return True on success
+ * @param[in] progress (optional) Told the progress after each chunk is sent
+ * @return True on success, false if the local file couldn't be read, or the camera couldn't write it
+ * @exception PTP::ERR_CANNOT_SEND If the file couldn't all be sent.  The camera hasn't answered, so it may
+ *                                 be waiting for the rest, or have given up on the transfer.
  */
-bool CHDKCamera::upload_file(const std::string local_filename, const std::string remote_filename, const int timeout) {
-    uint8_t * packed;
-    uint32_t packed_size;
+bool CHDKCamera::upload_file(const std::string local_filename, const std::string remote_filename, const int timeout, ITransferProgress * progress) {
+    uint32_t size;
+    const uint8_t * data = chdk_map_file(local_filename, &size);
+    if(data == NULL) {
+        return false;
+    }
+    
+    bool ok;
+    try {
+        ok = this->_upload_data(data, size, remote_filename, timeout, progress);
+    } catch(...) {
+        chdk_unmap_file(data, size);
+        throw;
+    }
+    chdk_unmap_file(data, size);
+    
+    return ok;
+}
+
+/**
+ * @brief Upload a local file to the camera, unless the camera already has the same file
+ *
+ * The camera's copy is downloaded (a chunk at a time, and only hashed) and
+ * compared to the local file's hash, so files that haven't changed (like a
+ * script uploaded on every boot) aren't written to the camera's card again.
+ * Reading them back is quicker than writing them, and it's always checked
+ * against what the camera really has, whatever happened to its card.
+ *
+ * @param[in]  local_filename  The local path and filename to send
+ * @param[in]  remote_filename The path and filename to store the file on the camera
+ * @param[out] uploaded        (optional) Whether the file had to be uploaded
+ * @param[in]  timeout         (optional) The timeout for each PTP call
+ * @param[in]  progress        (optional) Told the progress after each chunk is sent, if it's uploaded
+ * @return True if the camera has the file now, false if the local file couldn't be read, or the camera couldn't write it
+ * @exception PTP::ERR_CANNOT_SEND If the file couldn't all be sent (see \c CHDKCamera::upload_file)
+ * @see CHDKCamera::upload_file
+ */
+bool CHDKCamera::upload_file_if_changed(const std::string local_filename, const std::string remote_filename, bool * uploaded, const int timeout, ITransferProgress * progress) {
+    uint32_t size;
+    const uint8_t * data = chdk_map_file(local_filename, &size);
+    if(data == NULL) {
+        return false;
+    }
+    
+    bool ok = true;
+    try {
+        HashDataSink remote;
+        bool same = this->download_file(remote_filename, remote, timeout) && remote.size == size &&
+                    remote.hash == chdk_hash(data, size, chdk_hash_seed);
+        if(uploaded != NULL) *uploaded = !same;
+        if(same == false) {
+            ok = this->_upload_data(data, size, remote_filename, timeout, progress);
+        }
+    } catch(...) {
+        chdk_unmap_file(data, size);
+        throw;
+    }
+    chdk_unmap_file(data, size);
+    
+    return ok;
+}
+
+/**
+ * @brief Download a file from the camera, a chunk at a time, into \a sink
+ *
+ * CHDK is told which file to send (\c PTP_CHDK_TempData), then sends it
+ * (\c PTP_CHDK_DownloadFile), and each chunk goes to \a sink as it's read,
+ * so even a large photo is never held in memory whole.  \a sink is told the
+ * progress after every chunk, too (see \c IDataSink::progress).
+ *
+ * Live view can still be fetched from another thread between the two steps,
+ * and waits at most for the file's data phase.  Downloads wait for each
+ * other, so the file named is always the one sent.
+ *
+ * @param[in] remote_filename The path and filename of the file on the camera (e.g. A/DCIM/100CANON/IMG_0001.JPG)
+ * @param[in] sink            Where the file's contents go
+ * @param[in] timeout         (optional) The timeout for each PTP call
+ * @return True on success, false if the camera couldn't send the file (say, it doesn't exist)
+ * @exception PTP::ERR_DATASINK_FAILED If \a sink didn't take all of the file
+ * @see CHDKCamera::upload_file
+ */
+bool CHDKCamera::download_file(const std::string remote_filename, IDataSink& sink, const int timeout) {
     PTPContainer cmd(PTPContainer::CONTAINER_TYPE_COMMAND, 0x9999);
     PTPContainer data(PTPContainer::CONTAINER_TYPE_DATA, 0x9999);
     PTPContainer resp, out_data;
+    bool ok = false;
+    
+    pthread_mutex_lock(&this->download_lock);
+    try {
+        // Tell CHDK which file we want
+        cmd.add_param(PTP::PTP_CHDK_TempData);
+        cmd.add_param(PTP_CHDK_TD_DOWNLOAD);
+        data.set_payload(remote_filename.data(), remote_filename.length());
+        this->ptp_transaction(cmd, data, false, resp, out_data, timeout);
+        
+        if(resp.code == PTP::CHDK_PTP_RC_OK) {
+            // Then have it send the file
+            cmd.reset(PTPContainer::CONTAINER_TYPE_COMMAND, 0x9999);
+            cmd.add_param(PTP::PTP_CHDK_DownloadFile);
+            data.reset();
+            this->ptp_transaction(cmd, data, sink, resp, timeout);
+            ok = (resp.code == PTP::CHDK_PTP_RC_OK);
+        }
+    } catch(...) {
+        pthread_mutex_unlock(&this->download_lock);
+        throw;
+    }
+    pthread_mutex_unlock(&this->download_lock);
     
-    packed = CHDKCamera::_pack_file_for_upload(&packed_size, local_filename, remote_filename);
-    
-    cmd.add_param(PTP::PTP_CHDK_UploadFile);
-    data.set_payload(packed, packed_size);
-    
-    this->ptp_transaction(cmd, data, false, resp, out_data);
+    return ok;
+}
+
+/**
+ * @brief Download a file from the camera straight to a local file
+ *
+ * See \c CHDKCamera::download_file(const std::string, IDataSink&, const int).
+ * If the download fails, no local file is left behind.
+ *
+ * @param[in] remote_filename The path and filename of the file on the camera
+ * @param[in] local_filename  The local path and filename to write it to.  Overwritten if it exists.
+ * @param[in] timeout         (optional) The timeout for each PTP call
+ * @return True on success, false if the camera couldn't send the file, or it couldn't be written
+ */
+bool CHDKCamera::download_file(const std::string remote_filename, const std::string local_filename, const int timeout) {
+    int fd = open(local_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        return false;
+    }
     
-    delete[] packed;
+    FDDataSink sink(fd);
+    bool ok = false;
+    try {
+        ok = this->download_file(remote_filename, sink, timeout);
+    } catch(LIBPTP_PP_ERRORS e) {
+        if(e != ERR_DATASINK_FAILED) {
+            close(fd);
+            unlink(local_filename.c_str());
+            throw;
+        }
+    } catch(...) {
+        close(fd);
+        unlink(local_filename.c_str());
+        throw;
+    }
     
-    return (resp.get_param_n(0) == PTP::CHDK_PTP_RC_OK);
+    if(close(fd) != 0) {
+        ok = false;
+    }
+    if(ok == false) {
+        unlink(local_filename.c_str());
+    }
+    return ok;
 }
 
 } /* namespace PTP */
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <vector>
+#include <pthread.h>
 #include "CameraBase.hpp"
 
 namespace PTP {
@@ -10,19 +11,25 @@ namespace PTP {
     class PTPContainer;
     class LVData;
     class IPTPComm;
+    class IDataSink;
+    class ITransferProgress;
 
     class CHDKCamera : public CameraBase {
-        static uint8_t * _pack_file_for_upload(uint32_t * out_size, const std::string local_filename, const std::string remote_filename);
+        bool _upload_data(const uint8_t * data, const uint32_t size, const std::string remote_filename, const int timeout, ITransferProgress * progress);
+        pthread_mutex_t download_lock;  // Held from naming a file to downloading it
         public:
             CHDKCamera();
             CHDKCamera(IPTPComm * protocol);
+            ~CHDKCamera();
             float get_chdk_version(void);
             uint32_t check_script_status(void);
             uint32_t execute_lua(const std::string script, uint32_t * script_error, const bool block=false);
             void read_script_message(PTPContainer& out_data, PTPContainer& out_resp);
             uint32_t write_script_message(const std::string message, const uint32_t script_id=0);
-            bool upload_file(const std::string local_filename, const std::string remote_filename, int timeout=0);
-            char * download_file(const std::string filename, const int timeout);
+            bool upload_file(const std::string local_filename, const std::string remote_filename, const int timeout=0, ITransferProgress * progress=NULL);
+            bool upload_file_if_changed(const std::string local_filename, const std::string remote_filename, bool * uploaded=NULL, const int timeout=0, ITransferProgress * progress=NULL);
+            bool download_file(const std::string remote_filename, IDataSink& sink, const int timeout=0);
+            bool download_file(const std::string remote_filename, const std::string local_filename, const int timeout=0);
             void get_live_view_data(LVData& data_out, const bool liveview=true, const bool overlay=false, const bool palette=false);
             std::vector<std::string> _wait_for_script_return(const int timeout);
     };
@@ -11,14 +11,29 @@
  
 #include <cstring>
 #include <stdint.h>
+#include <pthread.h>
+#include <sys/time.h>
 //#include <iostream>
 
 #include "libptp++.hpp"
 #include "CameraBase.hpp"
 #include "PTPContainer.hpp"
 #include "IPTPComm.hpp"
+#include "ITransferProgress.hpp"
+#include "IDataSink.hpp"
 
 namespace PTP {
+
+static const int camera_stream_chunk = 128 * 1024;  // How much of a streamed data phase is read or written at a time
+
+/**
+ * @brief Retrieve the number of milliseconds since \a start
+ */
+static uint32_t camera_elapsed_ms(const struct timeval& start) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start.tv_sec) * 1000 + (now.tv_usec - start.tv_usec) / 1000;
+}
  
 /**
  * Creates a new, empty \c CameraBase object.  Can then call
@@ -42,7 +57,7 @@ CameraBase::CameraBase(IPTPComm * protocol) {
  * will release the interface, and close the handle.
  */
 CameraBase::~CameraBase() {
-    
+    pthread_mutex_destroy(&this->transaction_lock);
 }
 
 /**
@@ -51,6 +66,7 @@ CameraBase::~CameraBase() {
 void CameraBase::init() {
     this->protocol = NULL;
     this->_transaction_id = 0;
+    pthread_mutex_init(&this->transaction_lock, NULL);
 }
 
 void CameraBase::set_protocol(IPTPComm * protocol) {
@@ -71,20 +87,91 @@ int CameraBase::send_ptp_message(const PTPContainer& cmd, const int timeout) {
         return -1;
     }
     
-    unsigned char * packed = cmd.pack();
-    int ret = this->protocol->_bulk_write(packed, cmd.get_length(), timeout);
-    delete[] packed;
+    // Send straight from the container's buffer if it has one (see PTPContainer::get_packed)
+    FrameBuffer packed;
+    const unsigned char * data = cmd.get_packed();
+    if(data == NULL) {
+        data = cmd.pack(packed);
+    }
+    int ret = this->protocol->_bulk_write(data, cmd.get_length(), timeout);
     
     return ret;
 }
 
+/**
+ * @brief Send \a data, with \a tail_length more bytes of payload from \a tail after its own
+ *
+ * For payloads too big to want to copy into a \c PTPContainer (a file,
+ * say, straight from \c mmap).  \a data's payload is a prefix, and \a tail
+ * follows it, sent a chunk at a time straight from where it is.
+ *
+ * Every write but the last is a whole number of \c IPTPComm::get_min_read
+ * bytes, since over USB, a short write ends the data phase.  So the start of
+ * \a tail goes out with the header and prefix, to fill them out.
+ *
+ * @param[in] data        The \c PTPContainer with the header and the start of the payload.
+ * @param[in] tail        The rest of the payload.
+ * @param[in] tail_length The number of bytes in \a tail.
+ * @param[in] progress    (optional) Told after each chunk is sent.
+ * @param[in] timeout     The maximum number of seconds to attempt to send each chunk for.
+ * @return True if every chunk was sent.  If one wasn't, the data phase was
+ *         cut short, and the camera won't answer it.
+ * @see CameraBase::send_ptp_message
+ */
+bool CameraBase::send_ptp_message(const PTPContainer& data, const unsigned char * tail, const uint32_t tail_length, ITransferProgress * progress, const int timeout) {
+    if(this->protocol == NULL || this->protocol->is_open() == false) {
+        throw ERR_NOT_OPEN;
+        return false;
+    }
+    
+    int min_read = this->protocol->get_min_read();
+    uint32_t head = data.get_length();
+    uint32_t length = head + tail_length;
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    
+    // The header and prefix, filled out to a whole number of min_read with the start of tail
+    uint32_t first = ((head + min_read - 1) / min_read) * min_read;
+    if(first > length) first = length;
+    FrameBuffer packed, staged;
+    const unsigned char * message = data.get_packed();
+    if(message == NULL) {
+        message = data.pack(packed);
+    }
+    unsigned char * buffer = staged.reserve(first);
+    std::memcpy(buffer, message, head);
+    if(first > head) {
+        std::memcpy(buffer + head, tail, first - head);
+    }
+    std::memcpy(buffer, &length, 4);    // The length covers tail, too
+    if(this->protocol->_bulk_write(buffer, first, timeout) == false) {
+        return false;
+    }
+    
+    // Then the rest of tail, where it is
+    uint32_t sent = first - head;
+    uint32_t chunk = (camera_stream_chunk / min_read) * min_read;
+    if(progress != NULL) progress->progress(sent, tail_length, camera_elapsed_ms(start));
+    while(sent < tail_length) {
+        uint32_t segment = tail_length - sent < chunk ? tail_length - sent : chunk;
+        if(this->protocol->_bulk_write(tail + sent, segment, timeout) == false) {
+            return false;
+        }
+        sent += segment;
+        if(progress != NULL) progress->progress(sent, tail_length, camera_elapsed_ms(start));
+    }
+    
+    return true;
+}
+
 /**
  * @brief Recives a \c PTPContainer from the camera and returns it.
  *
  * This function works by first reading in a buffer of 512 bytes from the camera
- * to determine the length of the PTP message it will receive.  If necessary, it
- * then makes another \c CameraBase::_bulk_read call to read in the rest of the
- * data.  Finally, \c PTPContainer::unpack is called to place the data in \a out.
+ * to determine the length of the PTP message it will receive.  The header is
+ * unpacked into \a out (see \c PTPContainer::unpack_header), and the rest of
+ * the message is read straight into its payload, so a frame isn't copied on
+ * the way in, and a reused \a out doesn't allocate.
  *
  * @warning \a timeout is passed to each call to \c CameraBase::_bulk_read.  Therefore,
  *          this function could take up to 2 * \a timeout seconds to return.
@@ -99,40 +186,162 @@ void CameraBase::recv_ptp_message(PTPContainer& out, const int timeout) {
         return;
     }
     
+    int min_read = this->protocol->get_min_read();
+    FrameBuffer primer;     // From the pool, so it's reused from one message to the next
+    unsigned char * buffer = primer.reserve(min_read > 12 ? min_read : 12);
+    uint32_t size;
+    int primed = this->recv_header(buffer, &size, timeout);
+    
+    this->recv_payload(out, buffer, primed, size, timeout);
+}
+
+/**
+ * @brief Recives a \c PTPContainer from the camera, streaming a data container's payload to \a sink
+ *
+ * A data container's payload is handed to \a sink a chunk at a time as it's
+ * read (see \c IDataSink), and never held in memory whole, so \a out only
+ * gets its header.  Anything else (usually the response, when the camera has
+ * no data to send) is received into \a out, as by
+ * \c CameraBase::recv_ptp_message(PTPContainer&, const int).
+ *
+ * @param[out] out     A PTPContainer that will store the read PTP message, or a data container's header.
+ * @param[in]  sink    Where a data container's payload goes.
+ * @param[in]  timeout The maximum number of seconds to wait to read each time.
+ * @return True if it was a data container, and its payload went to \a sink
+ * @exception PTP::ERR_DATASINK_FAILED If \a sink didn't take all of the payload.  The rest of it was still
+ *            read, so the response can be, too.
+ */
+bool CameraBase::recv_ptp_message(PTPContainer& out, IDataSink& sink, const int timeout) {
+    if(this->protocol == NULL || this->protocol->is_open() == false) {
+        throw ERR_NOT_OPEN;
+        return false;
+    }
+    
+    const int header_size = 12;
+    int min_read = this->protocol->get_min_read();
+    FrameBuffer chunk;
+    unsigned char * buffer = chunk.reserve(camera_stream_chunk > min_read ? camera_stream_chunk : min_read);
+    uint32_t size;
+    int primed = this->recv_header(buffer, &size, timeout);
+    
+    uint16_t type;
+    std::memcpy(&type, buffer + 4, 2);
+    if(type != PTPContainer::CONTAINER_TYPE_DATA) {
+        this->recv_payload(out, buffer, primed, size, timeout);
+        return false;
+    }
+    
+    // Just the header goes into out
+    uint16_t code;
+    std::memcpy(&code, buffer + 6, 2);
+    out.reset(type, code);
+    std::memcpy(&out.transaction_id, buffer + 8, 4);
+    
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    uint32_t total = size - header_size;
+    uint32_t done = primed < (int)size ? primed - header_size : total;
+    bool sunk = true;
+    sink.begin(total);
+    if(done > 0) {
+        sunk = sink.write(buffer + header_size, done);
+        if(sunk) sink.progress(done, total, camera_elapsed_ms(start));
+    }
+    
+    // Then the rest, a chunk at a time. Keep reading even if the sink gives
+    //  up, or the response would be stuck behind the rest of the data.
+    int read = 0;
+    while(done < total) {
+        uint32_t want = total - done;
+        if(want > chunk.get_capacity()) want = chunk.get_capacity();
+        if(this->protocol->_bulk_read(buffer, want, &read, timeout) == false || read <= 0) {
+            // Don't spin on a transfer that failed -- the rest isn't coming
+            throw PTP::ERR_CANNOT_RECV;
+            return false;
+        }
+        if(sunk) {
+            sunk = sink.write(buffer, read);
+        }
+        done += read;
+        if(sunk) sink.progress(done, total, camera_elapsed_ms(start));
+    }
+    
+    if(sunk == false) {
+        throw PTP::ERR_DATASINK_FAILED;
+        return true;
+    }
+    return true;
+}
+
+/**
+ * @brief Reads at least the 12 byte header of the next message into \a buffer
+ *
+ * \a buffer must hold \c IPTPComm::get_min_read bytes, and at least 12.  Some
+ * of the payload may be read, too.
+ *
+ * @param[out] buffer  Where the header is read into.
+ * @param[out] size    The length of the message, header included.
+ * @param[in]  timeout The maximum number of seconds to wait to read each time.
+ * @return The number of bytes read into \a buffer
+ */
+int CameraBase::recv_header(unsigned char * buffer, uint32_t * size, const int timeout) {
     // Determine size we need to read
-	unsigned char * buffer = new unsigned char[this->protocol->get_min_read()];
+    const int header_size = 12;
+    int min_read = this->protocol->get_min_read();
     int read = 0;
-    this->protocol->_bulk_read(buffer, this->protocol->get_min_read(), &read, timeout); // TODO: Error checking on response
+    bool ok = this->protocol->_bulk_read(buffer, min_read, &read, timeout);
     //std::cout << "Primed read." << std::endl;
-    uint32_t size = 0;
-    if(read < 4) {
+    if(ok == false || read < 4) {
         // If we actually read less than four bytes, we can't copy four bytes out of the buffer.
         // Also, something went very, very wrong
         //std::cout << "Only read: " << read << std::endl;
         throw PTP::ERR_CANNOT_RECV;
-        return;
+        return 0;
     }
-    std::memcpy(&size, buffer, 4);      // The first four bytes of the buffer are the size
-    
-    // Copy our first part into the output buffer -- so we can reuse buffer
-    unsigned char * out_buf = new unsigned char[size];
-    if(size <= this->protocol->get_min_read()) {
-        std::memcpy(out_buf, buffer, size);
-    } else {
-        std::memcpy(out_buf, buffer, read);
-        // We've already read 512 bytes... read the rest!
-        int to_read = size-read;
-        while(to_read > 0) {
-            this->protocol->_bulk_read(&out_buf[size-to_read], to_read, &read, timeout);
-            to_read = to_read - read;
-            //std::cout << "Second read. Wanted: " << size-read << " ; Read: " << read << std::endl;
-        }
+    std::memcpy(size, buffer, 4);       // The first four bytes of the buffer are the size
+    if(*size < (uint32_t)header_size) {
+        throw PTP::ERR_CANNOT_RECV;
+        return 0;
     }
     
-    out.unpack(out_buf);
+    // Some protocols (the network) only read the size at first
+    int primed = read;
+    while(primed < header_size) {
+        if(this->protocol->_bulk_read(buffer + primed, header_size - primed, &read, timeout) == false || read <= 0) {
+            throw PTP::ERR_CANNOT_RECV;
+            return 0;
+        }
+        primed += read;
+    }
+    return primed;
+}
+
+/**
+ * @brief Unpacks the header in \a buffer into \a out, and reads the rest of the message into its payload
+ *
+ * @param[out] out     A PTPContainer that will store the read PTP message.
+ * @param[in]  buffer  The first \a primed bytes of the message (see \c CameraBase::recv_header).
+ * @param[in]  primed  The number of bytes already read into \a buffer.
+ * @param[in]  size    The length of the message, header included.
+ * @param[in]  timeout The maximum number of seconds to wait to read each time.
+ */
+void CameraBase::recv_payload(PTPContainer& out, const unsigned char * buffer, const int primed, const uint32_t size, const int timeout) {
+    const int header_size = 12;
     
-    delete[] out_buf;
-    delete[] buffer;
+    // Whatever we've read of the payload goes into out, then the rest is read straight after it
+    unsigned char * payload = out.unpack_header(buffer);
+    int first = primed < (int)size ? primed : size;
+    std::memcpy(payload, buffer + header_size, first - header_size);
+    int to_read = size - first;
+    int read = 0;
+    while(to_read > 0) {
+        if(this->protocol->_bulk_read(payload + (size - header_size - to_read), to_read, &read, timeout) == false || read <= 0) {
+            throw PTP::ERR_CANNOT_RECV;
+            return;
+        }
+        to_read = to_read - read;
+        //std::cout << "Second read. Wanted: " << size-read << " ; Read: " << read << std::endl;
+    }
 }
 
 /**
@@ -150,6 +359,9 @@ void CameraBase::recv_ptp_message(PTPContainer& out, const int timeout) {
  * If provided, \a out_resp will be populated with the command response, even if
  * \a receiving is false.
  *
+ * Transactions are serialized, so several threads can share one camera (say,
+ * one fetching live view while another sends script messages).
+ *
  * @warning \c CameraBase::_bulk_read and \c CameraBase::_bulk_write are called multiple
  *          times during the execution of this function, and \a timeout is passed to each
  *          of them individually.  Therefore, this function could take much more than
@@ -165,6 +377,93 @@ void CameraBase::recv_ptp_message(PTPContainer& out, const int timeout) {
  * @see CameraBase::send_ptp_message, CameraBase::recv_ptp_message
  */
 void CameraBase::ptp_transaction(PTPContainer& cmd, PTPContainer& data, const bool receiving, PTPContainer& out_resp, PTPContainer& out_data, const int timeout) {
+    pthread_mutex_lock(&this->transaction_lock);
+    try {
+        this->locked_transaction(cmd, data, receiving, out_resp, out_data, NULL, timeout);
+    } catch(...) {
+        pthread_mutex_unlock(&this->transaction_lock);
+        throw;
+    }
+    pthread_mutex_unlock(&this->transaction_lock);
+}
+
+/**
+ * @brief Perform a complete PTP transaction, streaming the camera's data phase to \a sink
+ *
+ * Like \c CameraBase::ptp_transaction with \a receiving set, except that the
+ * data is handed to \a sink as it arrives (see
+ * \c CameraBase::recv_ptp_message(PTPContainer&, IDataSink&, const int)),
+ * rather than collected in a \c PTPContainer, so it can be far bigger than
+ * would fit in memory.
+ *
+ * Other threads' transactions wait for the whole data phase, since PTP can't
+ * break one up.
+ *
+ * @param[in]  cmd      A \c PTPContainer containing the command to send to the camera.
+ * @param[in]  data     (optional) A \c PTPContainer containing the data to be sent with the command.
+ * @param[in]  sink     Where the camera's data goes.
+ * @param[out] out_resp A \c PTPContainer where the camera's response will be placed.
+ * @param[in]  timeout  The maximum number of seconds each \c CameraBase::_bulk_read or \c CameraBase::_bulk_write
+ *                      should attempt to communicate for.
+ * @exception PTP::ERR_DATASINK_FAILED If \a sink didn't take all of the data.  \a out_resp still holds the response.
+ */
+void CameraBase::ptp_transaction(PTPContainer& cmd, PTPContainer& data, IDataSink& sink, PTPContainer& out_resp, const int timeout) {
+    PTPContainer out_data;  // Unused, the data goes to sink
+    
+    pthread_mutex_lock(&this->transaction_lock);
+    try {
+        this->locked_transaction(cmd, data, true, out_resp, out_data, &sink, timeout);
+    } catch(...) {
+        pthread_mutex_unlock(&this->transaction_lock);
+        throw;
+    }
+    pthread_mutex_unlock(&this->transaction_lock);
+}
+
+/**
+ * @brief Perform a complete PTP transaction, sending \a tail_length more bytes of data from \a tail after \a data's payload
+ *
+ * Like \c CameraBase::ptp_transaction with \a receiving unset, except that
+ * the data phase is sent by
+ * \c CameraBase::send_ptp_message(const PTPContainer&, const unsigned char *, const uint32_t, ITransferProgress *, const int),
+ * so \a tail is never copied.
+ *
+ * Other threads' transactions wait for the whole data phase, since PTP can't
+ * break one up.
+ *
+ * @param[in]  cmd         A \c PTPContainer containing the command to send to the camera.
+ * @param[in]  data        A \c PTPContainer with the start of the data to send.
+ * @param[in]  tail        The rest of the data to send.
+ * @param[in]  tail_length The number of bytes in \a tail.
+ * @param[out] out_resp    A \c PTPContainer where the camera's response will be placed.
+ * @param[in]  progress    (optional) Told after each chunk of the data is sent.
+ * @param[in]  timeout     The maximum number of seconds each \c CameraBase::_bulk_read or \c CameraBase::_bulk_write
+ *                         should attempt to communicate for.
+ * @exception PTP::ERR_CANNOT_SEND If the data couldn't all be sent.  No response is read for it.
+ */
+void CameraBase::ptp_transaction(PTPContainer& cmd, PTPContainer& data, const unsigned char * tail, const uint32_t tail_length, PTPContainer& out_resp, ITransferProgress * progress, const int timeout) {
+    pthread_mutex_lock(&this->transaction_lock);
+    try {
+        cmd.transaction_id = this->get_and_increment_transaction_id();
+        this->send_ptp_message(cmd, timeout);
+        data.transaction_id = cmd.transaction_id;
+        if(this->send_ptp_message(data, tail, tail_length, progress, timeout) == false) {
+            throw ERR_CANNOT_SEND;    // No response is coming for a data phase cut short
+        }
+        this->recv_ptp_message(out_resp, timeout);
+    } catch(...) {
+        pthread_mutex_unlock(&this->transaction_lock);
+        throw;
+    }
+    pthread_mutex_unlock(&this->transaction_lock);
+}
+
+/**
+ * @brief The body of \c CameraBase::ptp_transaction, run with \c CameraBase::transaction_lock held
+ *
+ * If \a sink isn't NULL, the data goes to it instead of \a out_data.
+ */
+void CameraBase::locked_transaction(PTPContainer& cmd, PTPContainer& data, const bool receiving, PTPContainer& out_resp, PTPContainer& out_data, IDataSink * sink, const int timeout) {
     bool received_data = false;
     bool received_resp = false;
 
@@ -178,20 +477,28 @@ void CameraBase::ptp_transaction(PTPContainer& cmd, PTPContainer& data, const bo
         this->send_ptp_message(data, timeout);
     }
     
-    if(receiving) {
-        PTPContainer out;
-        this->recv_ptp_message(out, timeout);
-        if(out.type == PTPContainer::CONTAINER_TYPE_DATA) {
+    if(receiving && sink != NULL) {
+        try {
+            received_data = this->recv_ptp_message(out_resp, *sink, timeout);
+        } catch(LIBPTP_PP_ERRORS e) {
+            if(e == ERR_DATASINK_FAILED) {
+                // The data was all read anyway, so stay in step with the camera
+                this->recv_ptp_message(out_resp, timeout);
+            }
+            throw;
+        }
+        received_resp = (received_data == false && out_resp.type == PTPContainer::CONTAINER_TYPE_RESPONSE);
+    } else if(receiving) {
+        // Usually data, so read it straight into out_data, and swap it over if it's the response
+        this->recv_ptp_message(out_data, timeout);
+        if(out_data.type == PTPContainer::CONTAINER_TYPE_DATA) {
             received_data = true;
-            // TODO: It occurs to me that pack() and unpack() might be inefficient. Let's try to find a better way to do this.
-            unsigned char * packed = out.pack();
-            out_data.unpack(packed);
-            delete[] packed;
-        } else if(out.type == PTPContainer::CONTAINER_TYPE_RESPONSE) {
-            received_resp = true;
-            unsigned char * packed = out.pack();
-            out_resp.unpack(packed);
-            delete[] packed;
+        } else {
+            if(out_data.type == PTPContainer::CONTAINER_TYPE_RESPONSE) {
+                received_resp = true;
+                out_resp.swap(out_data);
+            }
+            out_data.reset();
         }
     }
     
@@ -2,17 +2,24 @@
 #define LIBPTP_PP_CAMERABASE_H_
 
 #include <libusb-1.0/libusb.h>
+#include <pthread.h>
 
 namespace PTP {
     
     class PTPContainer;
     class IPTPComm;
+    class IDataSink;
+    class ITransferProgress;
 
     class CameraBase {
         private:
             IPTPComm * protocol;
             uint32_t _transaction_id;
+            pthread_mutex_t transaction_lock;   // Held for the whole of each ptp_transaction
             void init();
+            void locked_transaction(PTPContainer& cmd, PTPContainer& data, const bool receiving, PTPContainer& out_resp, PTPContainer& out_data, IDataSink * sink, const int timeout);
+            int recv_header(unsigned char * buffer, uint32_t * size, const int timeout);
+            void recv_payload(PTPContainer& out, const unsigned char * buffer, const int primed, const uint32_t size, const int timeout);
             
         protected:
             int get_and_increment_transaction_id(); // What a beautiful name for a function
@@ -24,8 +31,12 @@ namespace PTP {
             void set_protocol(IPTPComm * protocol);
             bool reopen();
             int send_ptp_message(const PTPContainer& cmd, const int timeout=0);
+            bool send_ptp_message(const PTPContainer& data, const unsigned char * tail, const uint32_t tail_length, ITransferProgress * progress=NULL, const int timeout=0);
             void recv_ptp_message(PTPContainer& out, const int timeout=0);
+            bool recv_ptp_message(PTPContainer& out, IDataSink& sink, const int timeout=0);
             void ptp_transaction(PTPContainer& cmd, PTPContainer& data, const bool receiving, PTPContainer& out_resp, PTPContainer& out_data, const int timeout=0);
+            void ptp_transaction(PTPContainer& cmd, PTPContainer& data, IDataSink& sink, PTPContainer& out_resp, const int timeout=0);
+            void ptp_transaction(PTPContainer& cmd, PTPContainer& data, const unsigned char * tail, const uint32_t tail_length, PTPContainer& out_resp, ITransferProgress * progress=NULL, const int timeout=0);
     };
 }
 
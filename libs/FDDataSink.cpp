@@ -0,0 +1,55 @@
+/**
+ * @file FDDataSink.cpp
+ *
+ * @brief Streams a data phase to a file descriptor
+ */
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "FDDataSink.hpp"
+
+namespace PTP {
+
+/**
+ * @brief Create a sink that writes to \a fd, which must be open for writing
+ */
+FDDataSink::FDDataSink(const int fd) {
+    this->fd = fd;
+    this->written = 0;
+}
+
+/**
+ * @brief Start counting the bytes written afresh, so the sink can be reused
+ */
+void FDDataSink::begin(const uint32_t /*size*/) {
+    this->written = 0;
+}
+
+/**
+ * @brief Write all \a length bytes of \a data to the file descriptor
+ *
+ * @return false if the file descriptor wouldn't take them (the disk is full,
+ *         say)
+ */
+bool FDDataSink::write(const unsigned char * data, const int length) {
+    int left = length;
+
+    while(left > 0) {
+        ssize_t ret = ::write(this->fd, data + (length - left), left);
+        if(ret < 0 && errno == EINTR) continue;
+        if(ret <= 0) return false;
+        left -= ret;
+        this->written += ret;
+    }
+    return true;
+}
+
+/**
+ * @brief Retrieve the number of bytes written so far
+ */
+uint32_t FDDataSink::get_written() const {
+    return this->written;
+}
+
+} /* namespace PTP */
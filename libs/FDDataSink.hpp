@@ -0,0 +1,31 @@
+#ifndef LIBPTP_PP_FDDATASINK_H_
+#define LIBPTP_PP_FDDATASINK_H_
+
+#include <stdint.h>
+#include "IDataSink.hpp"
+
+namespace PTP {
+
+    /**
+     * @class FDDataSink
+     * @brief An \c IDataSink that writes the data to a file descriptor
+     *
+     * Works for files, pipes and sockets alike.  The descriptor is left open
+     * for the caller to close.  Subclass it and override
+     * \c IDataSink::progress to follow a download along.
+     */
+    class FDDataSink : public IDataSink {
+        public:
+            FDDataSink(const int fd);
+            virtual void begin(const uint32_t size);
+            virtual bool write(const unsigned char * data, const int length);
+            uint32_t get_written() const;
+
+        private:
+            int fd;
+            uint32_t written;   // Bytes written since IDataSink::begin
+    };
+
+}
+
+#endif /* LIBPTP_PP_FDDATASINK_H_ */
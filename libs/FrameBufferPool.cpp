@@ -0,0 +1,374 @@
+/**
+ * @file FrameBufferPool.cpp
+ *
+ * @brief A pool of cache-aligned, pre-faulted buffers for live view frames
+ *
+ * Every frame of live view goes through several buffers of the same few
+ * sizes, big enough that the C++ heap would map each one from the system,
+ * and unmap it again when it's freed.  The pool hands the same buffers out
+ * frame after frame instead.
+ */
+
+#include <cstring>
+#include <new>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "FrameBufferPool.hpp"
+
+namespace PTP {
+
+static const size_t frame_pool_huge_page = 2 * 1024 * 1024;    // What the Pi's (and most x86) kernels use
+
+/**
+ * @brief Retrieve the system's page size
+ */
+static size_t frame_pool_page_size() {
+    static size_t page = 0;
+
+    if(page == 0) {
+        long size = sysconf(_SC_PAGESIZE);
+        page = size > 0 ? size : 4096;
+    }
+    return page;
+}
+
+/**
+ * @brief Create an empty pool
+ *
+ * @param[in] huge_pages If true, back buffers of a huge page or more with huge pages
+ * @see FrameBufferPool::set_huge_pages
+ */
+FrameBufferPool::FrameBufferPool(const bool huge_pages) {
+    for(int i = 0; i <= MAX_CLASS; i++) {
+        this->free_lists[i] = NULL;
+        this->free_counts[i] = 0;
+    }
+    pthread_mutex_init(&this->lock, NULL);
+    this->huge_pages = huge_pages;
+    this->system_allocations = 0;
+}
+
+/**
+ * @brief Gives every free buffer back to the system
+ *
+ * @warning Buffers still out when the pool goes away must not be released to it.
+ */
+FrameBufferPool::~FrameBufferPool() {
+    this->trim();
+    pthread_mutex_destroy(&this->lock);
+}
+
+/**
+ * @brief Take a buffer of at least \a size bytes from the pool
+ *
+ * Reuses a free buffer of the right size class if there is one, and
+ * allocates one from the system if not.
+ *
+ * @param[in]  size     The number of bytes needed
+ * @param[out] capacity The number of bytes the buffer really holds.  Pass it
+ *                      back to \c FrameBufferPool::release.
+ * @return The first byte of the buffer, aligned to \c FrameBufferPool::ALIGNMENT
+ * @exception std::bad_alloc If the system is out of memory
+ */
+uint8_t * FrameBufferPool::acquire(const size_t size, size_t * capacity) {
+    int n = FrameBufferPool::get_class(size);
+    *capacity = FrameBufferPool::get_capacity(size);
+
+    pthread_mutex_lock(&this->lock);
+    if(n <= MAX_CLASS && this->free_lists[n] != NULL) {
+        FreeBuffer * buffer = this->free_lists[n];
+        this->free_lists[n] = buffer->next;
+        this->free_counts[n]--;
+        pthread_mutex_unlock(&this->lock);
+        return (uint8_t *)buffer;
+    }
+    this->system_allocations++;
+    bool huge_pages = this->huge_pages;
+    pthread_mutex_unlock(&this->lock);
+
+    return FrameBufferPool::allocate(*capacity, huge_pages);
+}
+
+/**
+ * @brief Give a buffer from \c FrameBufferPool::acquire back to the pool
+ *
+ * It's kept for the next \c FrameBufferPool::acquire of its size class,
+ * unless the pool already has \c FrameBufferPool::MAX_FREE of them.
+ *
+ * @param[in] buffer   The buffer, or NULL to do nothing
+ * @param[in] capacity The capacity \c FrameBufferPool::acquire gave for it
+ */
+void FrameBufferPool::release(uint8_t * buffer, const size_t capacity) {
+    if(buffer == NULL) return;
+
+    int n = FrameBufferPool::get_class(capacity);
+    if(n <= MAX_CLASS) {
+        pthread_mutex_lock(&this->lock);
+        if(this->free_counts[n] < MAX_FREE) {
+            FreeBuffer * free = (FreeBuffer *)buffer;
+            free->next = this->free_lists[n];
+            this->free_lists[n] = free;
+            this->free_counts[n]++;
+            pthread_mutex_unlock(&this->lock);
+            return;
+        }
+        pthread_mutex_unlock(&this->lock);
+    }
+
+    FrameBufferPool::deallocate(buffer, capacity);
+}
+
+/**
+ * @brief Make sure the pool has \a count free buffers of at least \a size bytes
+ *
+ * Call this at startup with the biggest frame expected, so even the first
+ * frames don't wait on the system.  At most \c FrameBufferPool::MAX_FREE
+ * are kept.
+ */
+void FrameBufferPool::reserve(const size_t size, const int count) {
+    FreeBuffer * taken = NULL;
+    size_t capacity = 0;
+
+    // Take them all out first, so we don't get the same one back every time
+    for(int i = 0; i < count && i < MAX_FREE; i++) {
+        FreeBuffer * buffer = (FreeBuffer *)this->acquire(size > sizeof(FreeBuffer) ? size : sizeof(FreeBuffer), &capacity);
+        buffer->next = taken;
+        taken = buffer;
+    }
+    while(taken != NULL) {
+        FreeBuffer * next = taken->next;
+        this->release((uint8_t *)taken, capacity);
+        taken = next;
+    }
+}
+
+/**
+ * @brief Give every free buffer back to the system
+ */
+void FrameBufferPool::trim() {
+    pthread_mutex_lock(&this->lock);
+    for(int n = 0; n <= MAX_CLASS; n++) {
+        while(this->free_lists[n] != NULL) {
+            FreeBuffer * buffer = this->free_lists[n];
+            this->free_lists[n] = buffer->next;
+            FrameBufferPool::deallocate((uint8_t *)buffer, (size_t)1 << n);
+        }
+        this->free_counts[n] = 0;
+    }
+    pthread_mutex_unlock(&this->lock);
+}
+
+/**
+ * @brief Choose whether new buffers of a huge page (2 MB) or more are backed by huge pages
+ *
+ * Uses \c MAP_HUGETLB if the system has huge pages set aside, and otherwise
+ * asks for transparent huge pages.  Only buffers allocated from now on are
+ * affected.
+ */
+void FrameBufferPool::set_huge_pages(const bool huge_pages) {
+    pthread_mutex_lock(&this->lock);
+    this->huge_pages = huge_pages;
+    pthread_mutex_unlock(&this->lock);
+}
+
+/**
+ * @brief Retrieve whether new buffers may be backed by huge pages
+ */
+bool FrameBufferPool::get_huge_pages() const {
+    return this->huge_pages;
+}
+
+/**
+ * @brief Retrieve how many buffers this pool has allocated from the system
+ *
+ * Stops going up once the pool has seen every size it's asked for.
+ */
+unsigned long FrameBufferPool::get_system_allocations() const {
+    return this->system_allocations;
+}
+
+/**
+ * @brief Retrieve how many bytes a buffer of at least \a size bytes really holds
+ *
+ * That's its size class, or for buffers too big to keep, \a size rounded
+ * up to a page.
+ */
+size_t FrameBufferPool::get_capacity(const size_t size) {
+    int n = FrameBufferPool::get_class(size);
+
+    if(n > MAX_CLASS) {
+        size_t page = frame_pool_page_size();
+        return (size + page - 1) & ~(page - 1);
+    }
+    return (size_t)1 << n;
+}
+
+/**
+ * @brief Retrieve the pool shared by the whole library
+ *
+ * It's never destroyed, so buffers held by static objects can still go back
+ * to it as the program exits.
+ */
+FrameBufferPool& FrameBufferPool::get_default() {
+    static FrameBufferPool * pool = new FrameBufferPool();
+    return *pool;
+}
+
+/**
+ * @brief Retrieve the size class of a buffer of \a size bytes, or MAX_CLASS + 1 if it's too big to keep
+ */
+int FrameBufferPool::get_class(const size_t size) {
+    int n = MIN_CLASS;
+
+    while(n <= MAX_CLASS && ((size_t)1 << n) < size) {
+        n++;
+    }
+    return n;
+}
+
+/**
+ * @brief Allocate a buffer of \a capacity bytes from the system
+ *
+ * Buffers smaller than a page come from the heap.  The rest are mapped, and
+ * every page of them is touched, so they're faulted in now rather than by
+ * whoever writes the first frame into them.
+ */
+uint8_t * FrameBufferPool::allocate(const size_t capacity, const bool huge_pages) {
+    size_t page = frame_pool_page_size();
+
+    if(capacity < page) {
+        void * buffer = NULL;
+        if(posix_memalign(&buffer, ALIGNMENT, capacity) != 0) {
+            throw std::bad_alloc();
+        }
+        return (uint8_t *)buffer;
+    }
+
+    bool huge = huge_pages && capacity % frame_pool_huge_page == 0;
+    void * buffer = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if(huge) {
+        buffer = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+#endif
+    if(buffer == MAP_FAILED) {
+        buffer = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(buffer == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+#ifdef MADV_HUGEPAGE
+        if(huge) {
+            madvise(buffer, capacity, MADV_HUGEPAGE);   // Before touching it, so it's faulted in as huge pages
+        }
+#endif
+    }
+
+    volatile uint8_t * bytes = (volatile uint8_t *)buffer;
+    for(size_t i = 0; i < capacity; i += page) {
+        bytes[i] = 0;
+    }
+
+    return (uint8_t *)buffer;
+}
+
+/**
+ * @brief Give a buffer from \c FrameBufferPool::allocate back to the system
+ */
+void FrameBufferPool::deallocate(uint8_t * buffer, const size_t capacity) {
+    if(capacity < frame_pool_page_size()) {
+        free(buffer);
+    } else {
+        munmap(buffer, capacity);
+    }
+}
+
+/**
+ * @brief Create an empty buffer, which will come from \a pool (or the default pool, if NULL)
+ */
+FrameBuffer::FrameBuffer(FrameBufferPool * pool) {
+    this->pool = pool;
+    this->data = NULL;
+    this->capacity = 0;
+}
+
+/**
+ * @brief Gives the buffer back to its pool
+ */
+FrameBuffer::~FrameBuffer() {
+    this->release();
+}
+
+/**
+ * @brief Make sure the buffer holds at least \a size bytes
+ *
+ * Does nothing if it already does.  Otherwise the buffer is swapped for a
+ * bigger one from the pool, and the first \a keep bytes copied over.
+ *
+ * @param[in] size The number of bytes needed
+ * @param[in] keep The number of bytes to keep if the buffer has to grow
+ * @return The first byte of the buffer
+ * @exception std::bad_alloc If the system is out of memory
+ */
+uint8_t * FrameBuffer::reserve(const size_t size, const size_t keep) {
+    if(this->data != NULL && size <= this->capacity) {
+        return this->data;
+    }
+
+    FrameBufferPool& pool = this->pool != NULL ? *this->pool : FrameBufferPool::get_default();
+    size_t capacity;
+    uint8_t * data = pool.acquire(size, &capacity);
+    if(this->data != NULL && keep > 0) {
+        std::memcpy(data, this->data, keep < this->capacity ? keep : this->capacity);
+    }
+
+    this->release();
+    this->data = data;
+    this->capacity = capacity;
+    return data;
+}
+
+/**
+ * @brief Give the buffer back to its pool, leaving this one empty
+ */
+void FrameBuffer::release() {
+    if(this->data == NULL) return;
+
+    FrameBufferPool& pool = this->pool != NULL ? *this->pool : FrameBufferPool::get_default();
+    pool.release(this->data, this->capacity);
+    this->data = NULL;
+    this->capacity = 0;
+}
+
+/**
+ * @brief Trade buffers (and pools) with \a other, without copying either
+ */
+void FrameBuffer::swap(FrameBuffer& other) {
+    FrameBufferPool * pool = this->pool;
+    uint8_t * data = this->data;
+    size_t capacity = this->capacity;
+
+    this->pool = other.pool;
+    this->data = other.data;
+    this->capacity = other.capacity;
+    other.pool = pool;
+    other.data = data;
+    other.capacity = capacity;
+}
+
+/**
+ * @brief Retrieve the first byte of the buffer, or NULL if nothing's been reserved
+ */
+uint8_t * FrameBuffer::get() const {
+    return this->data;
+}
+
+/**
+ * @brief Retrieve how many bytes the buffer holds
+ */
+size_t FrameBuffer::get_capacity() const {
+    return this->capacity;
+}
+
+} /* namespace PTP */
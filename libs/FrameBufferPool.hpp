@@ -0,0 +1,105 @@
+#ifndef LIBPTP_PP_FRAMEBUFFERPOOL_H_
+#define LIBPTP_PP_FRAMEBUFFERPOOL_H_
+
+#include <cstddef>
+#include <stdint.h>
+#include <pthread.h>
+
+namespace PTP {
+
+    /**
+     * @class FrameBufferPool
+     * @brief Keeps freed frame-sized buffers around to hand out again
+     *
+     * Live view goes through the same few buffer sizes on every frame (the
+     * camera's payload, the converted frame, what's sent over the tether),
+     * and at 100-700 KB each, \c new[] would map and unmap most of them
+     * afresh every time, taking a page fault on every page they touch.  The
+     * pool keeps them instead.
+     *
+     * Buffers are rounded up to a power of two (their size class), and
+     * aligned to a cache line.  Those of a page or more are mapped straight
+     * from the system, and pre-faulted, so the first frame written into one
+     * doesn't fault either.  With huge pages on, those of a huge page or more
+     * are mapped from huge pages where the system has any (and otherwise
+     * asked to be backed by them, see \c MADV_HUGEPAGE).  Released buffers
+     * go on a free list for their class (up to \c FrameBufferPool::MAX_FREE
+     * of them), so once streaming has seen each size it uses, it stops
+     * calling the system at all.
+     *
+     * It's safe to share between threads.  Most code wants the shared
+     * \c FrameBufferPool::get_default, by way of a \c FrameBuffer.
+     */
+    class FrameBufferPool {
+        public:
+            enum {
+                ALIGNMENT = 64,         // Every buffer starts on a cache line
+                MIN_CLASS = 6,          // The smallest buffer is 1 << MIN_CLASS bytes
+                MAX_CLASS = 26,         // Buffers bigger than 1 << MAX_CLASS bytes aren't kept
+                MAX_FREE = 8            // Buffers kept per size class
+            };
+
+            FrameBufferPool(const bool huge_pages=false);
+            ~FrameBufferPool();
+            uint8_t * acquire(const size_t size, size_t * capacity);
+            void release(uint8_t * buffer, const size_t capacity);
+            void reserve(const size_t size, const int count);
+            void trim();
+            void set_huge_pages(const bool huge_pages);
+            bool get_huge_pages() const;
+            unsigned long get_system_allocations() const;
+            static size_t get_capacity(const size_t size);
+            static FrameBufferPool& get_default();
+
+        private:
+            struct FreeBuffer {
+                FreeBuffer * next;
+            };
+
+            FreeBuffer * free_lists[MAX_CLASS + 1];
+            int free_counts[MAX_CLASS + 1];
+            pthread_mutex_t lock;
+            bool huge_pages;
+            unsigned long system_allocations;   // Buffers allocated from the system, ever
+
+            static int get_class(const size_t size);
+            static uint8_t * allocate(const size_t capacity, const bool huge_pages);
+            static void deallocate(uint8_t * buffer, const size_t capacity);
+
+            // Not copyable
+            FrameBufferPool(const FrameBufferPool&);
+            FrameBufferPool& operator=(const FrameBufferPool&);
+    };
+
+    /**
+     * @class FrameBuffer
+     * @brief A buffer from a \c FrameBufferPool, which goes back to it when done with
+     *
+     * Starts out empty, and grows with \c FrameBuffer::reserve, which only
+     * goes to the pool when the buffer's too small.  So a \c FrameBuffer that's
+     * reused for every frame settles on one buffer, and one that's made and
+     * dropped every frame takes the same one from the pool each time.
+     */
+    class FrameBuffer {
+        public:
+            FrameBuffer(FrameBufferPool * pool=NULL);
+            ~FrameBuffer();
+            uint8_t * reserve(const size_t size, const size_t keep=0);
+            void release();
+            void swap(FrameBuffer& other);
+            uint8_t * get() const;
+            size_t get_capacity() const;
+
+        private:
+            FrameBufferPool * pool;     // NULL for the default pool
+            uint8_t * data;             // NULL until something's reserved
+            size_t capacity;
+
+            // Not copyable
+            FrameBuffer(const FrameBuffer&);
+            FrameBuffer& operator=(const FrameBuffer&);
+    };
+
+}
+
+#endif /* LIBPTP_PP_FRAMEBUFFERPOOL_H_ */
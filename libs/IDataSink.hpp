@@ -0,0 +1,43 @@
+#ifndef LIBPTP_PP_IDATASINK_H_
+#define LIBPTP_PP_IDATASINK_H_
+
+#include <stdint.h>
+#include "ITransferProgress.hpp"
+
+namespace PTP {
+
+    /**
+     * @class IDataSink
+     * @brief An interface for somewhere to put a data phase as it arrives
+     *
+     * Files on the camera run to several MB, more than is worth holding in
+     * memory at once.  \c CameraBase::ptp_transaction can hand the data phase
+     * to an \c IDataSink a chunk at a time instead, as it's read from the
+     * camera.  \c FDDataSink writes it to a file descriptor.  It's told the
+     * progress after each chunk, too (see \c ITransferProgress).
+     *
+     * @see CHDKCamera::download_file
+     */
+    class IDataSink : public ITransferProgress {
+        public:
+            virtual ~IDataSink() { }
+            /**
+             * @brief Get ready for \a size bytes of data
+             *
+             * Called once, before the first chunk.
+             */
+            virtual void begin(const uint32_t /*size*/) { }
+            /**
+             * @brief Take the next \a length bytes of data
+             *
+             * @return true if they were taken.  If not, the rest of the data is
+             *         read and thrown away (so the camera can still send its
+             *         response), and the transaction fails with
+             *         \c ERR_DATASINK_FAILED.
+             */
+            virtual bool write(const unsigned char * data, const int length) = 0;
+    };
+
+}
+
+#endif /* LIBPTP_PP_IDATASINK_H_ */
@@ -0,0 +1,35 @@
+#ifndef LIBPTP_PP_ITRANSFERPROGRESS_H_
+#define LIBPTP_PP_ITRANSFERPROGRESS_H_
+
+#include <stdint.h>
+
+namespace PTP {
+
+    /**
+     * @class ITransferProgress
+     * @brief An interface for following a long data phase along
+     *
+     * Uploads and downloads of files run to several MB, and take seconds over
+     * USB.  They're sent and received a chunk at a time, and whatever
+     * implements this is told after each one.
+     *
+     * @see CHDKCamera::upload_file, IDataSink
+     */
+    class ITransferProgress {
+        public:
+            virtual ~ITransferProgress() { }
+            /**
+             * @brief Called after each chunk is sent or received
+             *
+             * \a done / \a elapsed_ms is the throughput so far.
+             *
+             * @param[in] done       The number of bytes transferred so far
+             * @param[in] size       The number of bytes in all
+             * @param[in] elapsed_ms Milliseconds since the data phase started
+             */
+            virtual void progress(const uint32_t /*done*/, const uint32_t /*size*/, const uint32_t /*elapsed_ms*/) { }
+    };
+
+}
+
+#endif /* LIBPTP_PP_ITRANSFERPROGRESS_H_ */
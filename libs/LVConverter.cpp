@@ -0,0 +1,1109 @@
+/**
+ * @file LVConverter.cpp
+ *
+ * @brief Row kernels for converting live view data from YUV to RGB565
+ *
+ * All kernels use the same 12-bit fixed point formula (see
+ * \c LVConverter::convert_row_scalar), so they produce identical output.  The
+ * vector kernels work on eight UYVYYY groups at a time, one group per lane:
+ * chroma is computed once per group, and then combined with each of its four
+ * Y samples.  Any groups left over at the end of a row go through the table
+ * driven kernel.
+ */
+
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <stdint.h>
+
+#include "LVConverter.hpp"
+#include "LVStats.hpp"
+#include "WorkerPool.hpp"
+#include "libptp++.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#include <immintrin.h>
+#define LV_X86 1
+#define LV_TARGET_SSE2 __attribute__((target("sse2")))
+#define LV_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace PTP {
+
+// Coefficients of the YUV to RGB conversion, scaled by 4096
+enum LV_COEFFICIENTS {
+    LV_COEF_RV = 5743,      // 1.402
+    LV_COEF_GU = -1411,     // -0.34414
+    LV_COEF_GV = -2925,     // -0.71414
+    LV_COEF_BU = 7258,      // 1.772
+    LV_COEF_ROUND = 2048    // 0.5
+};
+
+LVConverter::Kernel LVConverter::kernel = LVConverter::KERNEL_AUTO;
+LVConverter::RowFunction LVConverter::row_function = NULL;
+LVConverter::LumaRowFunction LVConverter::luma_function = NULL;
+
+static WorkerPool lv_pool;          // Serial until LVConverter::set_threads says otherwise
+static const int lv_min_band = 16;  // Rows -- smaller bands aren't worth a wakeup
+static pthread_mutex_t lv_stats_lock = PTHREAD_MUTEX_INITIALIZER;   // Bands merging their LVStats
+
+/**
+ * @brief Everything a band of \c LVConverter::convert_frame needs
+ */
+struct LVJob {
+    LVConverter::PackedRowFunction row_function;
+    LVConverter::Format format;
+    const uint8_t * yuv;
+    int yuv_stride;
+    uint8_t * out;          // Packed formats
+    int out_pitch;
+    uint8_t * planes[3];    // Planar formats
+    int pitches[3];
+    int groups;
+    int rows;
+    bool skip;
+    LVStats * stats;        // Gather statistics too, if not NULL
+};
+
+/**
+ * @brief A helper function to clip an int to a uint8_t
+ */
+static inline uint8_t lv_clip(const int v) {
+    if (v<0) return 0;
+    if (v>255) return 255;
+    return v;
+}
+
+/**
+ * @brief Combine a Y sample with its group's chroma terms into an RGB565 pixel
+ */
+static inline uint16_t lv_pixel(const int y, const int cr, const int cg, const int cb) {
+    int y12 = y << 12;
+    uint8_t red = lv_clip((y12 + cr) >> 12);
+    uint8_t green = lv_clip((y12 + cg) >> 12);
+    uint8_t blue = lv_clip((y12 + cb) >> 12);
+
+    return ((red & 0xF8) << 8) | ((green & 0xFC) << 3) | (blue >> 3);
+}
+
+/**
+ * @brief Convert a row of UYVYYY groups to RGB565 using plain C++
+ *
+ * This is the reference every other kernel must match:
+ *  - R = clip(((Y << 12) + V*5743 + 2048) >> 12)
+ *  - G = clip(((Y << 12) - U*1411 - V*2925 + 2048) >> 12)
+ *  - B = clip(((Y << 12) + U*7258 + 2048) >> 12)
+ *
+ * @param[in]  yuv    The first byte of the first group
+ * @param[out] rgb    Where to write the pixels: 4 per group, or 2 if \a skip
+ * @param[in]  groups The number of groups (four pixels each) to convert
+ * @param[in]  skip   If true, only convert Y0 and Y1 of each group
+ * @see http://www.fourcc.org/fccyvrgb.php
+ */
+void LVConverter::convert_row_scalar(const uint8_t * yuv, uint16_t * rgb, const int groups, const bool skip) {
+    for(int i = 0; i < groups; i++, yuv += 6) {
+        int u = (int8_t)yuv[0];
+        int v = (int8_t)yuv[2];
+        int cr = v * LV_COEF_RV + LV_COEF_ROUND;
+        int cg = u * LV_COEF_GU + v * LV_COEF_GV + LV_COEF_ROUND;
+        int cb = u * LV_COEF_BU + LV_COEF_ROUND;
+
+        *(rgb++) = lv_pixel(yuv[1], cr, cg, cb);
+        *(rgb++) = lv_pixel(yuv[3], cr, cg, cb);
+
+        if(skip) continue;  // If we skip two, go to the next group
+
+        *(rgb++) = lv_pixel(yuv[4], cr, cg, cb);
+        *(rgb++) = lv_pixel(yuv[5], cr, cg, cb);
+    }
+}
+
+/**
+ * @brief Copy the Y samples out of a row of UYVYYY groups
+ *
+ * This is the reference for the SIMD luma kernels: they produce exactly the
+ * same output.
+ *
+ * @param[in]  yuv    The first byte of the first group
+ * @param[out] luma   Where to write the samples: 4 per group, or 2 if \a skip,
+ *                    and half that if \a half
+ * @param[in]  groups The number of groups (four pixels each) to copy
+ * @param[in]  skip   If true, only copy Y0 and Y1 of each group
+ * @param[in]  half   If true, average each pair of samples into one
+ */
+void LVConverter::extract_luma_row_scalar(const uint8_t * yuv, uint8_t * luma, const int groups, const bool skip, const bool half) {
+    for(int i = 0; i < groups; i++, yuv += 6) {
+        if(half) {
+            *(luma++) = (yuv[1] + yuv[3] + 1) >> 1;
+            if(skip) continue;
+            *(luma++) = (yuv[4] + yuv[5] + 1) >> 1;
+            continue;
+        }
+
+        *(luma++) = yuv[1];
+        *(luma++) = yuv[3];
+
+        if(skip) continue;
+
+        *(luma++) = yuv[4];
+        *(luma++) = yuv[5];
+    }
+}
+
+/*
+ * Tables for the LUT kernel.  Since (Y << 12) is a multiple of 4096,
+ * ((Y << 12) + c) >> 12 == Y + (c >> 12), so each group's chroma reduces to
+ * three small offsets, and each pixel to three lookups in tables that clip
+ * and pack into RGB565 at the same time.
+ */
+#define LV_LUT_BIAS 256     // Offsets never take Y + offset below -256 or above 511
+
+struct LVTables {
+    int red[256];           // (V*5743 + 2048) >> 12, indexed by the raw V byte
+    int green_u[256];       // U*-1411, indexed by the raw U byte
+    int green_v[256];       // V*-2925 + 2048
+    int blue[256];          // (U*7258 + 2048) >> 12
+    uint16_t red565[768];   // Clipped value i - LV_LUT_BIAS, packed into place
+    uint16_t green565[768];
+    uint16_t blue565[768];
+    uint8_t clip[768];      // Clipped value i - LV_LUT_BIAS
+
+    LVTables() {
+        for(int i = 0; i < 256; i++) {
+            int c = (int8_t)i;
+            this->red[i] = (c * LV_COEF_RV + LV_COEF_ROUND) >> 12;
+            this->green_u[i] = c * LV_COEF_GU;
+            this->green_v[i] = c * LV_COEF_GV + LV_COEF_ROUND;
+            this->blue[i] = (c * LV_COEF_BU + LV_COEF_ROUND) >> 12;
+        }
+        for(int i = 0; i < 768; i++) {
+            uint8_t value = lv_clip(i - LV_LUT_BIAS);
+            this->red565[i] = (value & 0xF8) << 8;
+            this->green565[i] = (value & 0xFC) << 3;
+            this->blue565[i] = value >> 3;
+            this->clip[i] = value;
+        }
+    }
+};
+
+static const LVTables lv_tables;    // Built when the library loads
+
+/**
+ * @brief Convert a row of UYVYYY groups to RGB565 using lookup tables
+ *
+ * This is the fallback when there is no SIMD: no floating point, no
+ * multiplies and no branches per pixel.
+ *
+ * @see LVConverter::convert_row_scalar
+ */
+void LVConverter::convert_row_lut(const uint8_t * yuv, uint16_t * rgb, const int groups, const bool skip) {
+    const LVTables& t = lv_tables;
+
+    for(int i = 0; i < groups; i++, yuv += 6) {
+        const uint16_t * r = t.red565 + LV_LUT_BIAS + t.red[yuv[2]];
+        const uint16_t * g = t.green565 + LV_LUT_BIAS + ((t.green_u[yuv[0]] + t.green_v[yuv[2]]) >> 12);
+        const uint16_t * b = t.blue565 + LV_LUT_BIAS + t.blue[yuv[0]];
+
+        *(rgb++) = r[yuv[1]] | g[yuv[1]] | b[yuv[1]];
+        *(rgb++) = r[yuv[3]] | g[yuv[3]] | b[yuv[3]];
+
+        if(skip) continue;
+
+        *(rgb++) = r[yuv[4]] | g[yuv[4]] | b[yuv[4]];
+        *(rgb++) = r[yuv[5]] | g[yuv[5]] | b[yuv[5]];
+    }
+}
+
+
+/*
+ * Pixel writers for the other output formats.  Each is given a pixel's Y and
+ * its group's chroma offsets (as in the LUT kernel), and writes BYTES bytes.
+ * The row loop is a template over the writer, so every format gets its own
+ * copy of the loop with the packing inlined, and nothing is decided per
+ * pixel.
+ */
+struct LVWriteRGB565LE {
+    enum { BYTES = 2 };
+    static inline void write(uint8_t * out, const LVTables& t, const int y, const int dr, const int dg, const int db) {
+        uint16_t pixel = t.red565[LV_LUT_BIAS + y + dr] | t.green565[LV_LUT_BIAS + y + dg] | t.blue565[LV_LUT_BIAS + y + db];
+        out[0] = pixel & 0xFF;
+        out[1] = pixel >> 8;
+    }
+};
+
+struct LVWriteRGB565BE {
+    enum { BYTES = 2 };
+    static inline void write(uint8_t * out, const LVTables& t, const int y, const int dr, const int dg, const int db) {
+        uint16_t pixel = t.red565[LV_LUT_BIAS + y + dr] | t.green565[LV_LUT_BIAS + y + dg] | t.blue565[LV_LUT_BIAS + y + db];
+        out[0] = pixel >> 8;
+        out[1] = pixel & 0xFF;
+    }
+};
+
+struct LVWriteRGB888 {
+    enum { BYTES = 3 };
+    static inline void write(uint8_t * out, const LVTables& t, const int y, const int dr, const int dg, const int db) {
+        out[0] = t.clip[LV_LUT_BIAS + y + dr];
+        out[1] = t.clip[LV_LUT_BIAS + y + dg];
+        out[2] = t.clip[LV_LUT_BIAS + y + db];
+    }
+};
+
+struct LVWriteBGRA8888 {
+    enum { BYTES = 4 };
+    static inline void write(uint8_t * out, const LVTables& t, const int y, const int dr, const int dg, const int db) {
+        out[0] = t.clip[LV_LUT_BIAS + y + db];
+        out[1] = t.clip[LV_LUT_BIAS + y + dg];
+        out[2] = t.clip[LV_LUT_BIAS + y + dr];
+        out[3] = 0xFF;
+    }
+};
+
+template <class Writer>
+static void lv_convert_row_packed(const uint8_t * yuv, uint8_t * out, const int groups, const bool skip) {
+    const LVTables& t = lv_tables;
+
+    for(int i = 0; i < groups; i++, yuv += 6) {
+        int dr = t.red[yuv[2]];
+        int dg = (t.green_u[yuv[0]] + t.green_v[yuv[2]]) >> 12;
+        int db = t.blue[yuv[0]];
+
+        Writer::write(out, t, yuv[1], dr, dg, db);
+        Writer::write(out + Writer::BYTES, t, yuv[3], dr, dg, db);
+        out += 2 * Writer::BYTES;
+
+        if(skip) continue;
+
+        Writer::write(out, t, yuv[4], dr, dg, db);
+        Writer::write(out + Writer::BYTES, t, yuv[5], dr, dg, db);
+        out += 2 * Writer::BYTES;
+    }
+}
+
+/**
+ * @brief Y8, with the fastest luma kernel available
+ */
+static void lv_extract_luma_full(const uint8_t * yuv, uint8_t * out, const int groups, const bool skip) {
+    LVConverter::extract_luma_row(yuv, out, groups, skip, false);
+}
+
+/**
+ * @brief RGB565 in the CPU's byte order, with the fastest kernel available
+ */
+static void lv_convert_row_native(const uint8_t * yuv, uint8_t * out, const int groups, const bool skip) {
+    LVConverter::convert_row(yuv, (uint16_t *)out, groups, skip);
+}
+
+/*
+ * Chroma writers for the 4:2:0 formats: sample i of a chroma row.
+ */
+struct LVChromaI420 {
+    static inline void write(uint8_t * u, uint8_t * v, const int i, const uint8_t cu, const uint8_t cv) {
+        u[i] = cu;
+        v[i] = cv;
+    }
+};
+
+struct LVChromaNV12 {
+    static inline void write(uint8_t * uv, uint8_t * unused, const int i, const uint8_t cu, const uint8_t cv) {
+        uv[2 * i] = cu;
+        uv[2 * i + 1] = cv;
+    }
+};
+
+/**
+ * @brief Write one row of 4:2:0 chroma from two rows of UYVYYY groups
+ *
+ * Each group covers four pixels (two if \a skip), so it gives two chroma
+ * samples (or one).  U and V are averaged over the two rows; \a bottom may be
+ * the same as \a top at the end of an odd height frame.
+ */
+template <class Chroma>
+static void lv_convert_chroma_420(const uint8_t * top, const uint8_t * bottom, uint8_t * u, uint8_t * v,
+                                  const int groups, const bool skip) {
+    int sample = 0;
+
+    for(int i = 0; i < groups; i++, top += 6, bottom += 6) {
+        uint8_t cu = (((int8_t)top[0] + (int8_t)bottom[0] + 1) >> 1) + 128;
+        uint8_t cv = (((int8_t)top[2] + (int8_t)bottom[2] + 1) >> 1) + 128;
+
+        Chroma::write(u, v, sample++, cu, cv);
+        if(skip) continue;
+        Chroma::write(u, v, sample++, cu, cv);
+    }
+}
+
+#ifdef LV_X86
+
+// LV_COEF_GU and LV_COEF_GV as 16-bit pairs for _mm_madd_epi16, packed unsigned
+//  since they're negative
+static const int32_t lv_coef_g_pair = (int32_t)(((uint32_t)LV_COEF_GV << 16) | ((uint32_t)LV_COEF_GU & 0xFFFF));
+
+/*
+ * Eight groups are 24 16-bit words: (U,Y0) (V,Y1) (Y2,Y3), repeated.  Masking
+ * three loads picks out every third word, but in the group order
+ * 0,3,6,1,4,7,2,5 (after rotating the second and third set into line).  The
+ * math doesn't care about the order, and the stores put each group back in
+ * its place.
+ */
+#define LV_GROUP_ORDER { 0, 3, 6, 1, 4, 7, 2, 5 }
+
+LV_TARGET_SSE2 static inline __m128i lv_sse2_channel(const __m128i y_lo, const __m128i y_hi, const __m128i c_lo, const __m128i c_hi) {
+    __m128i lo = _mm_srai_epi32(_mm_add_epi32(y_lo, c_lo), 12);
+    __m128i hi = _mm_srai_epi32(_mm_add_epi32(y_hi, c_hi), 12);
+    __m128i x = _mm_packs_epi32(lo, hi);
+    return _mm_min_epi16(_mm_max_epi16(x, _mm_setzero_si128()), _mm_set1_epi16(255));
+}
+
+LV_TARGET_SSE2 static inline __m128i lv_sse2_pixels(const __m128i y, const __m128i * chroma) {
+    __m128i y_lo = _mm_slli_epi32(_mm_unpacklo_epi16(y, _mm_setzero_si128()), 12);
+    __m128i y_hi = _mm_slli_epi32(_mm_unpackhi_epi16(y, _mm_setzero_si128()), 12);
+
+    __m128i r = lv_sse2_channel(y_lo, y_hi, chroma[0], chroma[1]);
+    __m128i g = lv_sse2_channel(y_lo, y_hi, chroma[2], chroma[3]);
+    __m128i b = lv_sse2_channel(y_lo, y_hi, chroma[4], chroma[5]);
+
+    r = _mm_slli_epi16(_mm_and_si128(r, _mm_set1_epi16(0xF8)), 8);
+    g = _mm_slli_epi16(_mm_and_si128(g, _mm_set1_epi16(0xFC)), 3);
+    b = _mm_srli_epi16(b, 3);
+    return _mm_or_si128(_mm_or_si128(r, g), b);
+}
+
+/**
+ * @brief Compute the R, G and B chroma terms (lo and hi halves) of 8 groups
+ */
+LV_TARGET_SSE2 static inline void lv_sse2_chroma(const __m128i u, const __m128i v, __m128i * chroma) {
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i coef_r = _mm_set1_epi32((LV_COEF_ROUND << 16) | LV_COEF_RV);
+    const __m128i coef_g = _mm_set1_epi32(lv_coef_g_pair);
+    const __m128i coef_b = _mm_set1_epi32((LV_COEF_ROUND << 16) | LV_COEF_BU);
+    const __m128i round = _mm_set1_epi32(LV_COEF_ROUND);
+
+    chroma[0] = _mm_madd_epi16(_mm_unpacklo_epi16(v, one), coef_r);
+    chroma[1] = _mm_madd_epi16(_mm_unpackhi_epi16(v, one), coef_r);
+    chroma[2] = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(u, v), coef_g), round);
+    chroma[3] = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(u, v), coef_g), round);
+    chroma[4] = _mm_madd_epi16(_mm_unpacklo_epi16(u, one), coef_b);
+    chroma[5] = _mm_madd_epi16(_mm_unpackhi_epi16(u, one), coef_b);
+}
+
+/**
+ * @brief Split 8 groups (three loads of 16 bytes) into (U,Y0), (V,Y1) and (Y2,Y3) words
+ */
+LV_TARGET_SSE2 static inline void lv_sse2_deinterleave(const __m128i x0, const __m128i x1, const __m128i x2, __m128i * a, __m128i * b, __m128i * c) {
+    const __m128i m0 = _mm_set_epi16(0, -1, 0, 0, -1, 0, 0, -1);    // Words 0, 3, 6
+    const __m128i m1 = _mm_set_epi16(-1, 0, 0, -1, 0, 0, -1, 0);    // Words 1, 4, 7
+    const __m128i m2 = _mm_set_epi16(0, 0, -1, 0, 0, -1, 0, 0);     // Words 2, 5
+
+    *a = _mm_or_si128(_mm_or_si128(_mm_and_si128(x0, m0), _mm_and_si128(x1, m1)), _mm_and_si128(x2, m2));
+    __m128i bb = _mm_or_si128(_mm_or_si128(_mm_and_si128(x0, m1), _mm_and_si128(x1, m2)), _mm_and_si128(x2, m0));
+    __m128i cc = _mm_or_si128(_mm_or_si128(_mm_and_si128(x0, m2), _mm_and_si128(x1, m0)), _mm_and_si128(x2, m1));
+    // Rotate b by one word and c by two, so all three line up with a
+    *b = _mm_or_si128(_mm_srli_si128(bb, 2), _mm_slli_si128(bb, 14));
+    *c = _mm_or_si128(_mm_srli_si128(cc, 4), _mm_slli_si128(cc, 12));
+}
+
+/**
+ * @brief Convert 8 deinterleaved groups, and store them in their places
+ */
+LV_TARGET_SSE2 static inline void lv_sse2_block(const __m128i a, const __m128i b, const __m128i c, uint16_t * rgb, const bool skip) {
+    static const int order[8] = LV_GROUP_ORDER;
+    __m128i chroma[6];
+
+    __m128i u = _mm_srai_epi16(_mm_slli_epi16(a, 8), 8);    // Sign extend the low bytes
+    __m128i v = _mm_srai_epi16(_mm_slli_epi16(b, 8), 8);
+    lv_sse2_chroma(u, v, chroma);
+
+    __m128i p0 = lv_sse2_pixels(_mm_srli_epi16(a, 8), chroma);
+    __m128i p1 = lv_sse2_pixels(_mm_srli_epi16(b, 8), chroma);
+
+    if(skip) {
+        uint32_t pairs[8];
+        _mm_storeu_si128((__m128i *)pairs, _mm_unpacklo_epi16(p0, p1));
+        _mm_storeu_si128((__m128i *)(pairs + 4), _mm_unpackhi_epi16(p0, p1));
+        for(int i = 0; i < 8; i++) {
+            std::memcpy(rgb + 2 * order[i], &pairs[i], 4);
+        }
+        return;
+    }
+
+    __m128i p2 = lv_sse2_pixels(_mm_and_si128(c, _mm_set1_epi16(0xFF)), chroma);
+    __m128i p3 = lv_sse2_pixels(_mm_srli_epi16(c, 8), chroma);
+
+    __m128i t0 = _mm_unpacklo_epi16(p0, p1);
+    __m128i t1 = _mm_unpacklo_epi16(p2, p3);
+    __m128i t2 = _mm_unpackhi_epi16(p0, p1);
+    __m128i t3 = _mm_unpackhi_epi16(p2, p3);
+    __m128i out[4];
+    out[0] = _mm_unpacklo_epi32(t0, t1);   // Lanes 0, 1
+    out[1] = _mm_unpackhi_epi32(t0, t1);   // Lanes 2, 3
+    out[2] = _mm_unpacklo_epi32(t2, t3);   // Lanes 4, 5
+    out[3] = _mm_unpackhi_epi32(t2, t3);   // Lanes 6, 7
+    for(int i = 0; i < 4; i++) {
+        _mm_storel_epi64((__m128i *)(rgb + 4 * order[2 * i]), out[i]);
+        _mm_storel_epi64((__m128i *)(rgb + 4 * order[2 * i + 1]), _mm_unpackhi_epi64(out[i], out[i]));
+    }
+}
+
+/**
+ * @brief Convert a row of UYVYYY groups to RGB565 using SSE2
+ * @see LVConverter::convert_row_scalar
+ */
+LV_TARGET_SSE2 void LVConverter::convert_row_sse2(const uint8_t * yuv, uint16_t * rgb, const int groups, const bool skip) {
+    int per_group = skip ? 2 : 4;
+    int i = 0;
+
+    for(; i + 8 <= groups; i += 8, yuv += 48, rgb += 8 * per_group) {
+        __m128i a, b, c;
+        lv_sse2_deinterleave(_mm_loadu_si128((const __m128i *)yuv),
+            _mm_loadu_si128((const __m128i *)(yuv + 16)),
+            _mm_loadu_si128((const __m128i *)(yuv + 32)), &a, &b, &c);
+        lv_sse2_block(a, b, c, rgb, skip);
+    }
+
+    LVConverter::convert_row_lut(yuv, rgb, groups - i, skip);
+}
+
+/**
+ * @brief Copy the Y samples out of a row of UYVYYY groups using SSE2
+ *
+ * Splits eight groups at a time as the conversion kernel does, so each
+ * group's samples end up in one lane, then scatters the lanes back into
+ * group order.
+ *
+ * @see LVConverter::extract_luma_row_scalar
+ */
+LV_TARGET_SSE2 void LVConverter::extract_luma_row_sse2(const uint8_t * yuv, uint8_t * luma, const int groups, const bool skip, const bool half) {
+    static const int order[8] = LV_GROUP_ORDER;
+    const __m128i low = _mm_set1_epi16(0xFF);
+    int per_group = (skip ? 2 : 4) / (half ? 2 : 1);
+    int i = 0;
+
+    for(; i + 8 <= groups; i += 8, yuv += 48, luma += 8 * per_group) {
+        __m128i a, b, c;
+        lv_sse2_deinterleave(_mm_loadu_si128((const __m128i *)yuv),
+            _mm_loadu_si128((const __m128i *)(yuv + 16)),
+            _mm_loadu_si128((const __m128i *)(yuv + 32)), &a, &b, &c);
+
+        // One word per group: (Y0, Y1), or their average, and (Y2, Y3)
+        __m128i y01, y23;
+        if(half) {
+            y01 = _mm_avg_epu16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+            y23 = _mm_avg_epu16(_mm_and_si128(c, low), _mm_srli_epi16(c, 8));
+        } else {
+            y01 = _mm_or_si128(_mm_srli_epi16(a, 8), _mm_andnot_si128(low, b));
+            y23 = c;
+        }
+
+        if(skip && half) {
+            uint8_t samples[16];
+            _mm_storeu_si128((__m128i *)samples, _mm_packus_epi16(y01, y01));
+            for(int j = 0; j < 8; j++) {
+                luma[order[j]] = samples[j];
+            }
+        } else if(skip || half) {
+            // Two bytes per group
+            uint16_t words[8];
+            __m128i packed = skip ? y01 : _mm_or_si128(y01, _mm_slli_epi16(y23, 8));
+            _mm_storeu_si128((__m128i *)words, packed);
+            for(int j = 0; j < 8; j++) {
+                std::memcpy(luma + 2 * order[j], &words[j], 2);
+            }
+        } else {
+            uint32_t quads[8];
+            _mm_storeu_si128((__m128i *)quads, _mm_unpacklo_epi16(y01, y23));
+            _mm_storeu_si128((__m128i *)(quads + 4), _mm_unpackhi_epi16(y01, y23));
+            for(int j = 0; j < 8; j++) {
+                std::memcpy(luma + 4 * order[j], &quads[j], 4);
+            }
+        }
+    }
+
+    LVConverter::extract_luma_row_scalar(yuv, luma, groups - i, skip, half);
+}
+
+/*
+ * The AVX2 kernel runs the SSE2 algorithm on two blocks of eight groups at
+ * once, one in each 128-bit lane.  Every operation used stays within its lane.
+ */
+
+LV_TARGET_AVX2 static inline __m256i lv_avx2_channel(const __m256i y_lo, const __m256i y_hi, const __m256i c_lo, const __m256i c_hi) {
+    __m256i lo = _mm256_srai_epi32(_mm256_add_epi32(y_lo, c_lo), 12);
+    __m256i hi = _mm256_srai_epi32(_mm256_add_epi32(y_hi, c_hi), 12);
+    __m256i x = _mm256_packs_epi32(lo, hi);
+    return _mm256_min_epi16(_mm256_max_epi16(x, _mm256_setzero_si256()), _mm256_set1_epi16(255));
+}
+
+LV_TARGET_AVX2 static inline __m256i lv_avx2_pixels(const __m256i y, const __m256i * chroma) {
+    __m256i y_lo = _mm256_slli_epi32(_mm256_unpacklo_epi16(y, _mm256_setzero_si256()), 12);
+    __m256i y_hi = _mm256_slli_epi32(_mm256_unpackhi_epi16(y, _mm256_setzero_si256()), 12);
+
+    __m256i r = lv_avx2_channel(y_lo, y_hi, chroma[0], chroma[1]);
+    __m256i g = lv_avx2_channel(y_lo, y_hi, chroma[2], chroma[3]);
+    __m256i b = lv_avx2_channel(y_lo, y_hi, chroma[4], chroma[5]);
+
+    r = _mm256_slli_epi16(_mm256_and_si256(r, _mm256_set1_epi16(0xF8)), 8);
+    g = _mm256_slli_epi16(_mm256_and_si256(g, _mm256_set1_epi16(0xFC)), 3);
+    b = _mm256_srli_epi16(b, 3);
+    return _mm256_or_si256(_mm256_or_si256(r, g), b);
+}
+
+LV_TARGET_AVX2 static inline __m256i lv_avx2_load(const uint8_t * yuv) {
+    // Same offset in both blocks: the second block starts 48 bytes later
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)yuv)),
+        _mm_loadu_si128((const __m128i *)(yuv + 48)), 1);
+}
+
+LV_TARGET_AVX2 static inline void lv_avx2_store(const __m256i pixels, uint16_t * rgb, const int index) {
+    _mm_storel_epi64((__m128i *)(rgb + index), _mm256_castsi256_si128(pixels));
+}
+
+/**
+ * @brief Convert a row of UYVYYY groups to RGB565 using AVX2
+ * @see LVConverter::convert_row_scalar
+ */
+LV_TARGET_AVX2 void LVConverter::convert_row_avx2(const uint8_t * yuv, uint16_t * rgb, const int groups, const bool skip) {
+    static const int order[8] = LV_GROUP_ORDER;
+    const __m256i m0 = _mm256_set_epi16(0, -1, 0, 0, -1, 0, 0, -1, 0, -1, 0, 0, -1, 0, 0, -1);
+    const __m256i m1 = _mm256_set_epi16(-1, 0, 0, -1, 0, 0, -1, 0, -1, 0, 0, -1, 0, 0, -1, 0);
+    const __m256i m2 = _mm256_set_epi16(0, 0, -1, 0, 0, -1, 0, 0, 0, 0, -1, 0, 0, -1, 0, 0);
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i coef_r = _mm256_set1_epi32((LV_COEF_ROUND << 16) | LV_COEF_RV);
+    const __m256i coef_g = _mm256_set1_epi32(lv_coef_g_pair);
+    const __m256i coef_b = _mm256_set1_epi32((LV_COEF_ROUND << 16) | LV_COEF_BU);
+    const __m256i round = _mm256_set1_epi32(LV_COEF_ROUND);
+    int per_group = skip ? 2 : 4;
+    int i = 0;
+
+    for(; i + 16 <= groups; i += 16, yuv += 96, rgb += 16 * per_group) {
+        __m256i x0 = lv_avx2_load(yuv);
+        __m256i x1 = lv_avx2_load(yuv + 16);
+        __m256i x2 = lv_avx2_load(yuv + 32);
+
+        __m256i a = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(x0, m0), _mm256_and_si256(x1, m1)), _mm256_and_si256(x2, m2));
+        __m256i b = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(x0, m1), _mm256_and_si256(x1, m2)), _mm256_and_si256(x2, m0));
+        __m256i c = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(x0, m2), _mm256_and_si256(x1, m0)), _mm256_and_si256(x2, m1));
+        b = _mm256_or_si256(_mm256_srli_si256(b, 2), _mm256_slli_si256(b, 14));
+        c = _mm256_or_si256(_mm256_srli_si256(c, 4), _mm256_slli_si256(c, 12));
+
+        __m256i u = _mm256_srai_epi16(_mm256_slli_epi16(a, 8), 8);
+        __m256i v = _mm256_srai_epi16(_mm256_slli_epi16(b, 8), 8);
+        __m256i chroma[6];
+        chroma[0] = _mm256_madd_epi16(_mm256_unpacklo_epi16(v, one), coef_r);
+        chroma[1] = _mm256_madd_epi16(_mm256_unpackhi_epi16(v, one), coef_r);
+        chroma[2] = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(u, v), coef_g), round);
+        chroma[3] = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(u, v), coef_g), round);
+        chroma[4] = _mm256_madd_epi16(_mm256_unpacklo_epi16(u, one), coef_b);
+        chroma[5] = _mm256_madd_epi16(_mm256_unpackhi_epi16(u, one), coef_b);
+
+        __m256i p0 = lv_avx2_pixels(_mm256_srli_epi16(a, 8), chroma);
+        __m256i p1 = lv_avx2_pixels(_mm256_srli_epi16(b, 8), chroma);
+
+        if(skip) {
+            uint32_t pairs[16];
+            __m256i lo = _mm256_unpacklo_epi16(p0, p1);
+            __m256i hi = _mm256_unpackhi_epi16(p0, p1);
+            _mm_storeu_si128((__m128i *)pairs, _mm256_castsi256_si128(lo));
+            _mm_storeu_si128((__m128i *)(pairs + 4), _mm256_castsi256_si128(hi));
+            _mm_storeu_si128((__m128i *)(pairs + 8), _mm256_extracti128_si256(lo, 1));
+            _mm_storeu_si128((__m128i *)(pairs + 12), _mm256_extracti128_si256(hi, 1));
+            for(int j = 0; j < 8; j++) {
+                std::memcpy(rgb + 2 * order[j], &pairs[j], 4);
+                std::memcpy(rgb + 2 * (order[j] + 8), &pairs[j + 8], 4);
+            }
+            continue;
+        }
+
+        __m256i p2 = lv_avx2_pixels(_mm256_and_si256(c, _mm256_set1_epi16(0xFF)), chroma);
+        __m256i p3 = lv_avx2_pixels(_mm256_srli_epi16(c, 8), chroma);
+
+        __m256i t0 = _mm256_unpacklo_epi16(p0, p1);
+        __m256i t1 = _mm256_unpacklo_epi16(p2, p3);
+        __m256i t2 = _mm256_unpackhi_epi16(p0, p1);
+        __m256i t3 = _mm256_unpackhi_epi16(p2, p3);
+        __m256i out[4];
+        out[0] = _mm256_unpacklo_epi32(t0, t1);
+        out[1] = _mm256_unpackhi_epi32(t0, t1);
+        out[2] = _mm256_unpacklo_epi32(t2, t3);
+        out[3] = _mm256_unpackhi_epi32(t2, t3);
+        for(int j = 0; j < 4; j++) {
+            // Second block of groups is in the high lane
+            __m256i high = _mm256_permute2x128_si256(out[j], out[j], 0x11);
+            lv_avx2_store(out[j], rgb, 4 * order[2 * j]);
+            lv_avx2_store(_mm256_unpackhi_epi64(out[j], out[j]), rgb, 4 * order[2 * j + 1]);
+            lv_avx2_store(high, rgb, 4 * (order[2 * j] + 8));
+            lv_avx2_store(_mm256_unpackhi_epi64(high, high), rgb, 4 * (order[2 * j + 1] + 8));
+        }
+    }
+
+    // Finish off with SSE2, which also takes care of the scalar tail
+    LVConverter::convert_row_sse2(yuv, rgb, groups - i, skip);
+}
+
+#else
+
+void LVConverter::convert_row_sse2(const uint8_t * yuv, uint16_t * rgb, const int groups, const bool skip) {
+    LVConverter::convert_row_lut(yuv, rgb, groups, skip);
+}
+
+void LVConverter::convert_row_avx2(const uint8_t * yuv, uint16_t * rgb, const int groups, const bool skip) {
+    LVConverter::convert_row_lut(yuv, rgb, groups, skip);
+}
+
+void LVConverter::extract_luma_row_sse2(const uint8_t * yuv, uint8_t * luma, const int groups, const bool skip, const bool half) {
+    LVConverter::extract_luma_row_scalar(yuv, luma, groups, skip, half);
+}
+
+#endif /* LV_X86 */
+
+/**
+ * @brief Convert a row of UYVYYY groups to RGB565 with the selected kernel
+ *
+ * @param[in]  yuv    The first byte of the first group
+ * @param[out] rgb    Where to write the pixels: 4 per group, or 2 if \a skip
+ * @param[in]  groups The number of groups (four pixels each) to convert
+ * @param[in]  skip   If true, only convert Y0 and Y1 of each group
+ * @see LVConverter::convert_row_scalar, LVConverter::set_kernel
+ */
+void LVConverter::convert_row(const uint8_t * yuv, uint16_t * rgb, const int groups, const bool skip) {
+    if(LVConverter::row_function == NULL) {
+        LVConverter::set_kernel(KERNEL_AUTO);
+    }
+
+    LVConverter::row_function(yuv, rgb, groups, skip);
+}
+
+/**
+ * @brief Copy the Y samples out of a row of UYVYYY groups with the fastest luma kernel
+ *
+ * The luma kernel follows the conversion kernel: SSE2 for \c KERNEL_SSE2 and
+ * \c KERNEL_AVX2, NEON for \c KERNEL_NEON, and scalar otherwise.
+ *
+ * @see LVConverter::extract_luma_row_scalar, LVConverter::set_kernel
+ */
+void LVConverter::extract_luma_row(const uint8_t * yuv, uint8_t * luma, const int groups, const bool skip, const bool half) {
+    if(LVConverter::row_function == NULL) {
+        LVConverter::set_kernel(KERNEL_AUTO);
+    }
+
+    LVConverter::luma_function(yuv, luma, groups, skip, half);
+}
+
+/**
+ * @brief Copy the Y samples out of a frame of UYVYYY groups, as 8-bit grayscale
+ *
+ * If \a half, each pair of samples in a row is averaged into one, and only
+ * every other row is read, so the frame comes out half the size each way
+ * (rounded up).  This runs on the calling thread: it's little more than a
+ * copy, and not worth waking the workers for.  \a stats, if given, are taken
+ * from the output, so they're of the halved frame if \a half.
+ *
+ * @param[in]  yuv        The first byte of the first row
+ * @param[in]  yuv_stride The number of bytes from one row of groups to the next
+ * @param[out] luma       The first byte of the first output row
+ * @param[in]  luma_pitch The number of bytes from one output row to the next
+ * @param[in]  groups     The number of groups in each row
+ * @param[in]  rows       The number of rows to read
+ * @param[in]  skip       If true, only copy Y0 and Y1 of each group
+ * @param[in]  half       If true, halve the frame in each direction
+ * @param[out] stats      If not NULL, add the luma to these statistics
+ */
+void LVConverter::extract_luma(const uint8_t * yuv, const int yuv_stride, uint8_t * luma, const int luma_pitch,
+                               const int groups, const int rows, const bool skip, const bool half, LVStats * stats) {
+    int step = half ? 2 : 1;
+    int width = groups * (skip ? 2 : 4) / step;
+
+    for(int row = 0; row < rows; row += step, yuv += (long)step * yuv_stride, luma += luma_pitch) {
+        LVConverter::extract_luma_row(yuv, luma, groups, skip, half);
+        if(stats != NULL) {
+            stats->add_luma(luma, width);
+        }
+    }
+}
+
+/**
+ * @brief Add the statistics a band gathered to the job's
+ */
+static void lv_merge_stats(const LVJob * job, const LVStats& band) {
+    pthread_mutex_lock(&lv_stats_lock);
+    job->stats->merge(band);
+    pthread_mutex_unlock(&lv_stats_lock);
+}
+
+static void lv_convert_band(void * context, const int start, const int end) {
+    const LVJob * job = (const LVJob *)context;
+    const uint8_t * yuv = job->yuv + (long)start * job->yuv_stride;
+    uint8_t * out = job->out + (long)start * job->out_pitch;
+
+    if(job->stats == NULL) {
+        for(int row = start; row < end; row++, yuv += job->yuv_stride, out += job->out_pitch) {
+            job->row_function(yuv, out, job->groups, job->skip);
+        }
+        return;
+    }
+
+    LVStats band;
+    for(int row = start; row < end; row++, yuv += job->yuv_stride, out += job->out_pitch) {
+        job->row_function(yuv, out, job->groups, job->skip);
+        band.add_row(yuv, job->groups, job->skip);
+    }
+    lv_merge_stats(job, band);
+}
+
+/**
+ * @brief Convert chroma rows [start, end), and the pairs of luma rows under them
+ */
+static void lv_convert_band_planar(void * context, const int start, const int end) {
+    const LVJob * job = (const LVJob *)context;
+    int width = job->groups * (job->skip ? 2 : 4);
+    LVStats band;
+
+    for(int row = start; row < end; row++) {
+        const uint8_t * top = job->yuv + (long)(2 * row) * job->yuv_stride;
+        const uint8_t * bottom = 2 * row + 1 < job->rows ? top + job->yuv_stride : top;
+        uint8_t * luma = job->planes[0] + (long)(2 * row) * job->pitches[0];
+        uint8_t * u = job->planes[1] + (long)row * job->pitches[1];
+        uint8_t * v = job->format == LVConverter::FORMAT_I420 ? job->planes[2] + (long)row * job->pitches[2] : NULL;
+
+        lv_extract_luma_full(top, luma, job->groups, job->skip);
+        if(job->stats != NULL) band.add_luma(luma, width);
+        if(bottom != top) {
+            lv_extract_luma_full(bottom, luma + job->pitches[0], job->groups, job->skip);
+            if(job->stats != NULL) band.add_luma(luma + job->pitches[0], width);
+        }
+
+        if(job->format == LVConverter::FORMAT_I420) {
+            lv_convert_chroma_420<LVChromaI420>(top, bottom, u, v, job->groups, job->skip);
+        } else {
+            lv_convert_chroma_420<LVChromaNV12>(top, bottom, u, v, job->groups, job->skip);
+        }
+    }
+
+    if(job->stats != NULL) {
+        lv_merge_stats(job, band);
+    }
+}
+
+/**
+ * @brief Convert a frame of UYVYYY rows to RGB565, in parallel if enabled
+ *
+ * Every row is converted exactly as \c LVConverter::convert_row would, so the
+ * output doesn't depend on the number of threads.
+ *
+ * @param[in]  yuv        The first byte of the first row
+ * @param[in]  yuv_stride The number of bytes from the start of one row to the next
+ * @param[out] rgb        The first pixel of the first output row
+ * @param[in]  rgb_stride The number of pixels from the start of one output row to the next
+ * @param[in]  groups     The number of groups (four pixels each) to convert per row
+ * @param[in]  rows       The number of rows to convert
+ * @param[in]  skip       If true, only convert Y0 and Y1 of each group
+ * @param[out] stats      If not NULL, add the luma to these statistics, as each row is converted
+ * @see LVConverter::set_threads
+ */
+void LVConverter::convert_frame(const uint8_t * yuv, const int yuv_stride, uint16_t * rgb, const int rgb_stride,
+                                const int groups, const int rows, const bool skip, LVStats * stats) {
+    LVJob job;
+    job.row_function = lv_convert_row_native;
+    job.yuv = yuv;
+    job.yuv_stride = yuv_stride;
+    job.out = (uint8_t *)rgb;
+    job.out_pitch = rgb_stride * 2;
+    job.groups = groups;
+    job.skip = skip;
+    job.stats = stats;
+
+    LVConverter::get_kernel();      // Pick a kernel now, rather than racing to in the bands
+    lv_pool.run(lv_convert_band, &job, rows, lv_min_band);
+}
+
+/**
+ * @brief Convert a frame of UYVYYY rows to a packed pixel \a format
+ *
+ * @param[in]  format     Any format but \c FORMAT_I420 and \c FORMAT_NV12
+ * @param[in]  yuv        The first byte of the first row
+ * @param[in]  yuv_stride The number of bytes from the start of one row to the next
+ * @param[out] out        The first byte of the first output row
+ * @param[in]  out_pitch  The number of bytes from the start of one output row to the next
+ * @param[in]  groups     The number of groups (four pixels each) to convert per row
+ * @param[in]  rows       The number of rows to convert
+ * @param[in]  skip       If true, only convert Y0 and Y1 of each group
+ * @param[out] stats      If not NULL, add the luma to these statistics, as each row is converted
+ * @exception ERR_LVDATA_BAD_FORMAT If \a format is planar
+ * @see LVConverter::convert_frame_planar
+ */
+void LVConverter::convert_frame(const Format format, const uint8_t * yuv, const int yuv_stride, uint8_t * out,
+                                const int out_pitch, const int groups, const int rows, const bool skip,
+                                LVStats * stats) {
+    LVJob job;
+    job.row_function = LVConverter::get_packed_row_function(format);
+    job.yuv = yuv;
+    job.yuv_stride = yuv_stride;
+    job.out = out;
+    job.out_pitch = out_pitch;
+    job.groups = groups;
+    job.skip = skip;
+    job.stats = stats;
+
+    LVConverter::get_kernel();
+    lv_pool.run(lv_convert_band, &job, rows, lv_min_band);
+}
+
+/**
+ * @brief Convert a frame of UYVYYY rows to a 4:2:0 planar \a format
+ *
+ * @param[in]  format     \c FORMAT_I420 or \c FORMAT_NV12
+ * @param[in]  yuv        The first byte of the first row
+ * @param[in]  yuv_stride The number of bytes from the start of one row to the next
+ * @param[out] planes     The Y, U and V planes for I420, or the Y and UV planes
+ *                        for NV12.  Chroma planes have (rows + 1) / 2 rows.
+ * @param[in]  pitches    The number of bytes from one row to the next, for each plane
+ * @param[in]  groups     The number of groups (four pixels each) to convert per row
+ * @param[in]  rows       The number of rows to convert
+ * @param[in]  skip       If true, only convert Y0 and Y1 of each group
+ * @param[out] stats      If not NULL, add the Y plane to these statistics, as it's written
+ * @exception ERR_LVDATA_BAD_FORMAT If \a format isn't planar
+ */
+void LVConverter::convert_frame_planar(const Format format, const uint8_t * yuv, const int yuv_stride,
+                                       uint8_t * const planes[3], const int pitches[3],
+                                       const int groups, const int rows, const bool skip, LVStats * stats) {
+    if(LVConverter::is_planar(format) == false) {
+        throw ERR_LVDATA_BAD_FORMAT;
+        return;
+    }
+
+    LVJob job;
+    job.format = format;
+    job.yuv = yuv;
+    job.yuv_stride = yuv_stride;
+    for(int i = 0; i < 3; i++) {
+        job.planes[i] = planes[i];
+        job.pitches[i] = pitches[i];
+    }
+    job.groups = groups;
+    job.rows = rows;
+    job.skip = skip;
+    job.stats = stats;
+
+    LVConverter::get_kernel();
+    lv_pool.run(lv_convert_band_planar, &job, (rows + 1) / 2, lv_min_band / 2);
+}
+
+/**
+ * @brief Retrieve the row loop for a packed \a format
+ *
+ * @exception ERR_LVDATA_BAD_FORMAT If \a format is planar (or unknown)
+ */
+LVConverter::PackedRowFunction LVConverter::get_packed_row_function(const Format format) {
+    switch(format) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        case FORMAT_RGB565_LE:  return lv_convert_row_packed<LVWriteRGB565LE>;
+        case FORMAT_RGB565_BE:  return lv_convert_row_native;
+#else
+        case FORMAT_RGB565_LE:  return lv_convert_row_native;
+        case FORMAT_RGB565_BE:  return lv_convert_row_packed<LVWriteRGB565BE>;
+#endif
+        case FORMAT_RGB888:     return lv_convert_row_packed<LVWriteRGB888>;
+        case FORMAT_BGRA8888:   return lv_convert_row_packed<LVWriteBGRA8888>;
+        case FORMAT_Y8:         return lv_extract_luma_full;
+        default:
+            throw ERR_LVDATA_BAD_FORMAT;
+            return NULL;
+    }
+}
+
+/**
+ * @brief Convert a single Y, U, V sample to 8 bit R, G and B
+ *
+ * Uses the same arithmetic as \c LVConverter::convert_row_scalar, before it
+ * is reduced to RGB565.  Used for palette entries (see \c LVOverlay), which
+ * aren't worth a row kernel.
+ *
+ * @param[in]  y   The luma sample
+ * @param[in]  u   The signed U sample
+ * @param[in]  v   The signed V sample
+ * @param[out] rgb Red, green and blue, in that order
+ */
+void LVConverter::convert_pixel(const uint8_t y, const int8_t u, const int8_t v, uint8_t rgb[3]) {
+    int y12 = y << 12;
+
+    rgb[0] = lv_clip((y12 + v * LV_COEF_RV + LV_COEF_ROUND) >> 12);
+    rgb[1] = lv_clip((y12 + u * LV_COEF_GU + v * LV_COEF_GV + LV_COEF_ROUND) >> 12);
+    rgb[2] = lv_clip((y12 + u * LV_COEF_BU + LV_COEF_ROUND) >> 12);
+}
+
+/**
+ * @brief Retrieve the bytes per pixel of a packed \a format, or of the Y plane of a planar one
+ */
+int LVConverter::get_bytes_per_pixel(const Format format) {
+    switch(format) {
+        case FORMAT_RGB565_LE:
+        case FORMAT_RGB565_BE:  return 2;
+        case FORMAT_RGB888:     return 3;
+        case FORMAT_BGRA8888:   return 4;
+        default:                return 1;
+    }
+}
+
+/**
+ * @brief Check if \a format is written as separate planes
+ */
+bool LVConverter::is_planar(const Format format) {
+    return format == FORMAT_I420 || format == FORMAT_NV12;
+}
+
+/**
+ * @brief Retrieve a printable name for \a format
+ */
+const char * LVConverter::get_format_name(const Format format) {
+    switch(format) {
+        case FORMAT_RGB565_LE:  return "rgb565le";
+        case FORMAT_RGB565_BE:  return "rgb565be";
+        case FORMAT_RGB888:     return "rgb888";
+        case FORMAT_BGRA8888:   return "bgra8888";
+        case FORMAT_Y8:         return "y8";
+        case FORMAT_I420:       return "i420";
+        case FORMAT_NV12:       return "nv12";
+        default:                return "unknown";
+    }
+}
+
+/**
+ * @brief Set how many threads \c LVConverter::convert_frame uses
+ *
+ * @param[in] threads The number of threads, counting the caller.  1 (the
+ *                    default) converts on the calling thread only; 0 uses one
+ *                    thread per CPU.
+ * @note Worker threads are created here, not per frame.
+ */
+void LVConverter::set_threads(const int threads) {
+    lv_pool.set_threads(threads);
+}
+
+/**
+ * @brief Retrieve how many threads \c LVConverter::convert_frame uses
+ */
+int LVConverter::get_threads() {
+    return lv_pool.get_threads();
+}
+
+/**
+ * @brief Check if this build and CPU can run \a kernel
+ */
+bool LVConverter::is_supported(const Kernel kernel) {
+    switch(kernel) {
+        case KERNEL_AUTO:
+        case KERNEL_SCALAR:
+        case KERNEL_LUT:
+            return true;
+#ifdef LV_X86
+#ifdef __x86_64__
+        case KERNEL_SSE2:
+            return true;    // Part of x86-64
+#else
+        case KERNEL_SSE2:
+            return __builtin_cpu_supports("sse2");
+#endif
+        case KERNEL_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        case KERNEL_NEON: {
+            if(LVConverter::neon_built() == false) return false;
+#ifdef __aarch64__
+            return true;
+#else
+            // The Pi 1 is ARMv6, without NEON -- check what the kernel reports
+            std::ifstream cpuinfo("/proc/cpuinfo");
+            std::string line;
+            while(std::getline(cpuinfo, line)) {
+                if(line.compare(0, 8, "Features") == 0 && line.find(" neon") != std::string::npos) {
+                    return true;
+                }
+            }
+            return false;
+#endif
+        }
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Pick the kernel used by \c LVConverter::convert_row
+ *
+ * @param[in] kernel The kernel to use, or \c KERNEL_AUTO for the fastest one
+ *                   this CPU supports.  Unsupported kernels fall back to
+ *                   \c KERNEL_AUTO.
+ */
+void LVConverter::set_kernel(const Kernel kernel) {
+    Kernel selected = kernel;
+    if(selected == KERNEL_AUTO || LVConverter::is_supported(selected) == false) {
+        selected = LVConverter::detect();
+    }
+
+    LVConverter::kernel = selected;
+    LVConverter::row_function = LVConverter::get_row_function(selected);
+    LVConverter::luma_function = LVConverter::get_luma_function(selected);
+}
+
+/**
+ * @brief Retrieve the kernel \c LVConverter::convert_row uses
+ */
+LVConverter::Kernel LVConverter::get_kernel() {
+    if(LVConverter::row_function == NULL) {
+        LVConverter::set_kernel(KERNEL_AUTO);
+    }
+
+    return LVConverter::kernel;
+}
+
+/**
+ * @brief Retrieve a printable name for \a kernel
+ */
+const char * LVConverter::get_kernel_name(const Kernel kernel) {
+    switch(kernel) {
+        case KERNEL_AUTO:   return "auto";
+        case KERNEL_SCALAR: return "scalar";
+        case KERNEL_LUT:    return "lut";
+        case KERNEL_SSE2:   return "sse2";
+        case KERNEL_AVX2:   return "avx2";
+        case KERNEL_NEON:   return "neon";
+        default:            return "unknown";
+    }
+}
+
+/**
+ * @brief Find the fastest kernel this CPU supports
+ */
+LVConverter::Kernel LVConverter::detect() {
+    static const Kernel preferred[] = { KERNEL_AVX2, KERNEL_NEON, KERNEL_SSE2 };
+
+    for(unsigned int i = 0; i < sizeof(preferred) / sizeof(preferred[0]); i++) {
+        if(LVConverter::is_supported(preferred[i])) {
+            return preferred[i];
+        }
+    }
+
+    return KERNEL_LUT;
+}
+
+LVConverter::RowFunction LVConverter::get_row_function(const Kernel kernel) {
+    switch(kernel) {
+        case KERNEL_LUT:    return LVConverter::convert_row_lut;
+        case KERNEL_SSE2:   return LVConverter::convert_row_sse2;
+        case KERNEL_AVX2:   return LVConverter::convert_row_avx2;
+        case KERNEL_NEON:   return LVConverter::convert_row_neon;
+        default:            return LVConverter::convert_row_scalar;
+    }
+}
+
+LVConverter::LumaRowFunction LVConverter::get_luma_function(const Kernel kernel) {
+    switch(kernel) {
+        case KERNEL_SSE2:
+        case KERNEL_AVX2:   return LVConverter::extract_luma_row_sse2;
+        case KERNEL_NEON:   return LVConverter::extract_luma_row_neon;
+        default:            return LVConverter::extract_luma_row_scalar;
+    }
+}
+
+} /* namespace PTP */
@@ -0,0 +1,114 @@
+#ifndef LIBPTP_PP_LVCONVERTER_H_
+#define LIBPTP_PP_LVCONVERTER_H_
+
+#include <cstddef>
+#include <stdint.h>
+
+namespace PTP {
+
+    class LVStats;
+
+    /**
+     * @class LVConverter
+     * @brief Kernels converting CHDK's UYVYYY viewport data to RGB565
+     *
+     * The viewport stores four pixels in six bytes: U, Y0, V, Y1, Y2, Y3, with
+     * U and V signed.  Each kernel converts one row of these groups to native
+     * endian RGB565 pixels, and every kernel produces exactly the same output
+     * as \c LVConverter::convert_row_scalar.
+     *
+     * The fastest kernel the CPU supports is picked the first time a row is
+     * converted.  Without SIMD, that is the table driven \c KERNEL_LUT.
+     * \c LVConverter::set_kernel can override this (for testing or
+     * benchmarking).
+     *
+     * \c LVConverter::convert_frame can also split a frame into bands of rows
+     * and convert them in parallel; see \c LVConverter::set_threads.  It can
+     * also write other pixel formats (see \c LVConverter::Format), each from
+     * its own instance of one templated row loop.
+     *
+     * \c LVConverter::extract_luma copies out just the Y samples, optionally
+     * halved in each direction, for grayscale live view.  It has its own
+     * SSE2 and NEON row kernels, picked along with the conversion kernel.
+     *
+     * Each frame function can also gather \c LVStats on the luma as it goes,
+     * a row at a time while the row is in cache, rather than in a second pass.
+     */
+    class LVConverter {
+        public:
+            enum Kernel {
+                KERNEL_AUTO = 0,
+                KERNEL_SCALAR,
+                KERNEL_LUT,
+                KERNEL_SSE2,
+                KERNEL_AVX2,
+                KERNEL_NEON,
+                KERNEL_COUNT
+            };
+            /**
+             * Output formats for \c LVConverter::convert_frame.  The packed
+             * formats are written a row at a time; I420 (Y, U and V planes)
+             * and NV12 (Y plane, then interleaved UV) have chroma at half
+             * resolution both ways, with U and V offset by 128.
+             */
+            enum Format {
+                FORMAT_RGB565_LE = 0,
+                FORMAT_RGB565_BE,
+                FORMAT_RGB888,
+                FORMAT_BGRA8888,
+                FORMAT_Y8,
+                FORMAT_I420,
+                FORMAT_NV12,
+                FORMAT_COUNT
+            };
+            typedef void (*RowFunction)(const uint8_t * yuv, uint16_t * rgb, const int groups, const bool skip);
+            typedef void (*PackedRowFunction)(const uint8_t * yuv, uint8_t * out, const int groups, const bool skip);
+            typedef void (*LumaRowFunction)(const uint8_t * yuv, uint8_t * luma, const int groups, const bool skip, const bool half);
+
+            static void convert_row(const uint8_t * yuv, uint16_t * rgb, const int groups, const bool skip);
+            static void convert_pixel(const uint8_t y, const int8_t u, const int8_t v, uint8_t rgb[3]);
+            static void convert_frame(const uint8_t * yuv, const int yuv_stride, uint16_t * rgb, const int rgb_stride,
+                                      const int groups, const int rows, const bool skip, LVStats * stats=NULL);
+            static void convert_frame(const Format format, const uint8_t * yuv, const int yuv_stride, uint8_t * out,
+                                      const int out_pitch, const int groups, const int rows, const bool skip,
+                                      LVStats * stats=NULL);
+            static void convert_frame_planar(const Format format, const uint8_t * yuv, const int yuv_stride,
+                                             uint8_t * const planes[3], const int pitches[3],
+                                             const int groups, const int rows, const bool skip, LVStats * stats=NULL);
+            static void extract_luma_row(const uint8_t * yuv, uint8_t * luma, const int groups, const bool skip, const bool half);
+            static void extract_luma(const uint8_t * yuv, const int yuv_stride, uint8_t * luma, const int luma_pitch,
+                                     const int groups, const int rows, const bool skip, const bool half,
+                                     LVStats * stats=NULL);
+            static PackedRowFunction get_packed_row_function(const Format format);
+            static int get_bytes_per_pixel(const Format format);
+            static bool is_planar(const Format format);
+            static const char * get_format_name(const Format format);
+            static void set_threads(const int threads);
+            static int get_threads();
+            static bool is_supported(const Kernel kernel);
+            static void set_kernel(const Kernel kernel);
+            static Kernel get_kernel();
+            static const char * get_kernel_name(const Kernel kernel);
+
+            static void convert_row_scalar(const uint8_t * yuv, uint16_t * rgb, const int groups, const bool skip);
+            static void convert_row_lut(const uint8_t * yuv, uint16_t * rgb, const int groups, const bool skip);
+            static void convert_row_sse2(const uint8_t * yuv, uint16_t * rgb, const int groups, const bool skip);
+            static void convert_row_avx2(const uint8_t * yuv, uint16_t * rgb, const int groups, const bool skip);
+            static void convert_row_neon(const uint8_t * yuv, uint16_t * rgb, const int groups, const bool skip);
+            static void extract_luma_row_scalar(const uint8_t * yuv, uint8_t * luma, const int groups, const bool skip, const bool half);
+            static void extract_luma_row_sse2(const uint8_t * yuv, uint8_t * luma, const int groups, const bool skip, const bool half);
+            static void extract_luma_row_neon(const uint8_t * yuv, uint8_t * luma, const int groups, const bool skip, const bool half);
+            static bool neon_built();
+
+        private:
+            static Kernel kernel;
+            static RowFunction row_function;
+            static LumaRowFunction luma_function;
+            static Kernel detect();
+            static RowFunction get_row_function(const Kernel kernel);
+            static LumaRowFunction get_luma_function(const Kernel kernel);
+    };
+
+}
+
+#endif /* LIBPTP_PP_LVCONVERTER_H_ */
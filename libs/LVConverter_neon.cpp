@@ -0,0 +1,168 @@
+/**
+ * @file LVConverter_neon.cpp
+ *
+ * @brief NEON row kernels for converting live view data from YUV to RGB565,
+ * and for copying out its luma
+ *
+ * This lives in its own file so that it can be built with \c -mfpu=neon on
+ * the Pi 2 and later, without letting the compiler use NEON anywhere else in
+ * the library (the Pi 1 doesn't have it).  If the file is built without NEON,
+ * the kernels are reported as unavailable.
+ */
+
+#include <stdint.h>
+
+#include "LVConverter.hpp"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define LV_NEON 1
+#endif
+
+namespace PTP {
+
+#ifdef LV_NEON
+
+/**
+ * @brief Convert one channel: clip((Y << 12) + chroma) >> 12) for 8 pixels
+ */
+static inline uint8x8_t lv_neon_channel(const int16x8_t y, const int32x4_t c_lo, const int32x4_t c_hi) {
+    int32x4_t lo = vshrq_n_s32(vaddq_s32(vshll_n_s16(vget_low_s16(y), 12), c_lo), 12);
+    int32x4_t hi = vshrq_n_s32(vaddq_s32(vshll_n_s16(vget_high_s16(y), 12), c_hi), 12);
+    return vqmovun_s16(vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+}
+
+static inline uint16x8_t lv_neon_pixels(const uint8x8_t y8, const int32x4_t * chroma) {
+    int16x8_t y = vreinterpretq_s16_u16(vmovl_u8(y8));
+
+    uint16x8_t pixels = vshll_n_u8(lv_neon_channel(y, chroma[0], chroma[1]), 8);
+    pixels = vsriq_n_u16(pixels, vshll_n_u8(lv_neon_channel(y, chroma[2], chroma[3]), 8), 5);
+    pixels = vsriq_n_u16(pixels, vshll_n_u8(lv_neon_channel(y, chroma[4], chroma[5]), 8), 11);
+    return pixels;
+}
+
+/**
+ * @brief Convert a row of UYVYYY groups to RGB565 using NEON
+ * @see LVConverter::convert_row_scalar
+ */
+void LVConverter::convert_row_neon(const uint8_t * yuv, uint16_t * rgb, const int groups, const bool skip) {
+    const int32x4_t round = vdupq_n_s32(2048);
+    int i = 0;
+
+    for(; i + 8 <= groups; i += 8, yuv += 48) {
+        // Triplets alternate (U, Y0, V) and (Y1, Y2, Y3)
+        uint8x16x3_t in = vld3q_u8(yuv);
+        uint8x8x2_t uy1 = vuzp_u8(vget_low_u8(in.val[0]), vget_high_u8(in.val[0]));
+        uint8x8x2_t y0y2 = vuzp_u8(vget_low_u8(in.val[1]), vget_high_u8(in.val[1]));
+        uint8x8x2_t vy3 = vuzp_u8(vget_low_u8(in.val[2]), vget_high_u8(in.val[2]));
+
+        int16x8_t u = vmovl_s8(vreinterpret_s8_u8(uy1.val[0]));
+        int16x8_t v = vmovl_s8(vreinterpret_s8_u8(vy3.val[0]));
+        int32x4_t chroma[6];
+        chroma[0] = vmlal_n_s16(round, vget_low_s16(v), 5743);
+        chroma[1] = vmlal_n_s16(round, vget_high_s16(v), 5743);
+        chroma[2] = vmlal_n_s16(vmlal_n_s16(round, vget_low_s16(u), -1411), vget_low_s16(v), -2925);
+        chroma[3] = vmlal_n_s16(vmlal_n_s16(round, vget_high_s16(u), -1411), vget_high_s16(v), -2925);
+        chroma[4] = vmlal_n_s16(round, vget_low_s16(u), 7258);
+        chroma[5] = vmlal_n_s16(round, vget_high_s16(u), 7258);
+
+        if(skip) {
+            uint16x8x2_t out;
+            out.val[0] = lv_neon_pixels(y0y2.val[0], chroma);
+            out.val[1] = lv_neon_pixels(uy1.val[1], chroma);
+            vst2q_u16(rgb, out);
+            rgb += 16;
+            continue;
+        }
+
+        uint16x8x4_t out;
+        out.val[0] = lv_neon_pixels(y0y2.val[0], chroma);
+        out.val[1] = lv_neon_pixels(uy1.val[1], chroma);
+        out.val[2] = lv_neon_pixels(y0y2.val[1], chroma);
+        out.val[3] = lv_neon_pixels(vy3.val[1], chroma);
+        vst4q_u16(rgb, out);
+        rgb += 32;
+    }
+
+    LVConverter::convert_row_lut(yuv, rgb, groups - i, skip);
+}
+
+/**
+ * @brief Copy the Y samples out of a row of UYVYYY groups using NEON
+ *
+ * The same three-way load as the conversion kernel, then one interleaving
+ * store of just the Y lanes.
+ *
+ * @see LVConverter::extract_luma_row_scalar
+ */
+void LVConverter::extract_luma_row_neon(const uint8_t * yuv, uint8_t * luma, const int groups, const bool skip, const bool half) {
+    int i = 0;
+
+    for(; i + 8 <= groups; i += 8, yuv += 48) {
+        // Triplets alternate (U, Y0, V) and (Y1, Y2, Y3)
+        uint8x16x3_t in = vld3q_u8(yuv);
+        uint8x8x2_t uy1 = vuzp_u8(vget_low_u8(in.val[0]), vget_high_u8(in.val[0]));
+        uint8x8x2_t y0y2 = vuzp_u8(vget_low_u8(in.val[1]), vget_high_u8(in.val[1]));
+        uint8x8x2_t vy3 = vuzp_u8(vget_low_u8(in.val[2]), vget_high_u8(in.val[2]));
+
+        if(half) {
+            uint8x8_t y01 = vrhadd_u8(y0y2.val[0], uy1.val[1]);
+            if(skip) {
+                vst1_u8(luma, y01);
+                luma += 8;
+                continue;
+            }
+
+            uint8x8x2_t out;
+            out.val[0] = y01;
+            out.val[1] = vrhadd_u8(y0y2.val[1], vy3.val[1]);
+            vst2_u8(luma, out);
+            luma += 16;
+            continue;
+        }
+
+        if(skip) {
+            uint8x8x2_t out;
+            out.val[0] = y0y2.val[0];
+            out.val[1] = uy1.val[1];
+            vst2_u8(luma, out);
+            luma += 16;
+            continue;
+        }
+
+        uint8x8x4_t out;
+        out.val[0] = y0y2.val[0];
+        out.val[1] = uy1.val[1];
+        out.val[2] = y0y2.val[1];
+        out.val[3] = vy3.val[1];
+        vst4_u8(luma, out);
+        luma += 32;
+    }
+
+    LVConverter::extract_luma_row_scalar(yuv, luma, groups - i, skip, half);
+}
+
+/**
+ * @brief Check if the NEON kernel was compiled in
+ */
+bool LVConverter::neon_built() {
+    return true;
+}
+
+#else
+
+void LVConverter::convert_row_neon(const uint8_t * yuv, uint16_t * rgb, const int groups, const bool skip) {
+    LVConverter::convert_row_lut(yuv, rgb, groups, skip);
+}
+
+void LVConverter::extract_luma_row_neon(const uint8_t * yuv, uint8_t * luma, const int groups, const bool skip, const bool half) {
+    LVConverter::extract_luma_row_scalar(yuv, luma, groups, skip, half);
+}
+
+bool LVConverter::neon_built() {
+    return false;
+}
+
+#endif /* LV_NEON */
+
+} /* namespace PTP */
@@ -0,0 +1,508 @@
+/**
+ * @file LVDCTCodec.cpp
+ *
+ * @brief A small JPEG style codec for live view payloads
+ *
+ * Raw viewport keyframes are too big to send often over the tether.  This
+ * codec compresses the viewport's Y, U and V samples directly (no RGB round
+ * trip), without depending on an image library on either Pi.
+ */
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+
+#include "LVDCTCodec.hpp"
+#include "LVFrameView.hpp"
+#include "libptp++.hpp"
+
+namespace PTP {
+
+static const uint32_t lv_dct_max_size = 64 * 1024 * 1024;  // Anything bigger isn't a live view frame
+// The most bytes a block can take: a count, a DC difference, and 63 (run, level) pairs
+static const int lv_dct_max_block_bytes = 320;
+
+// Coefficient order, from low frequencies to high
+static const uint8_t lv_zigzag[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10,
+    17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34,
+    27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36,
+    29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46,
+    53, 60, 61, 54, 47, 55, 62, 63
+};
+
+// The JPEG standard's example quantization tables (Annex K), for quality 50
+static const uint8_t lv_luma_steps[64] = {
+    16, 11, 10, 16,  24,  40,  51,  61,
+    12, 12, 14, 19,  26,  58,  60,  55,
+    14, 13, 16, 24,  40,  57,  69,  56,
+    14, 17, 22, 29,  51,  87,  80,  62,
+    18, 22, 37, 56,  68, 109, 103,  77,
+    24, 35, 55, 64,  81, 104, 113,  92,
+    49, 64, 78, 87, 103, 121, 120, 101,
+    72, 92, 95, 98, 112, 100, 103,  99
+};
+static const uint8_t lv_chroma_steps[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99,
+    18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99,
+    47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99
+};
+
+/**
+ * @brief The DCT basis, built when the library loads
+ */
+struct LVDCTTables {
+    float basis[8][8];      // basis[u][x]: orthonormal DCT-II
+
+    LVDCTTables() {
+        for(int u = 0; u < 8; u++) {
+            float scale = u == 0 ? std::sqrt(1.0 / 8) : std::sqrt(2.0 / 8);
+            for(int x = 0; x < 8; x++) {
+                this->basis[u][x] = scale * std::cos((2 * x + 1) * u * M_PI / 16);
+            }
+        }
+    }
+};
+
+static const LVDCTTables lv_dct_tables;
+
+/**
+ * @brief Writes Exp-Golomb codes, most significant bit first
+ */
+struct LVBitWriter {
+    uint8_t * out;
+    uint64_t bits;
+    int count;
+
+    LVBitWriter(uint8_t * out) : out(out), bits(0), count(0) {}
+
+    void put(const uint32_t value, const int length) {
+        this->bits = (this->bits << length) | value;
+        this->count += length;
+        while(this->count >= 8) {
+            this->count -= 8;
+            *(this->out++) = this->bits >> this->count;
+        }
+    }
+
+    void put_unsigned(const uint32_t value) {
+        uint32_t v = value + 1;
+        int length = 0;
+        while((v >> length) > 1) length++;
+        this->put(0, length);
+        this->put(v, length + 1);
+    }
+
+    void put_signed(const int value) {
+        this->put_unsigned(value > 0 ? 2 * value - 1 : -2 * value);
+    }
+
+    void flush() {
+        if(this->count > 0) {
+            *(this->out++) = this->bits << (8 - this->count);
+            this->count = 0;
+        }
+    }
+};
+
+/**
+ * @brief Reads what \c LVBitWriter wrote, throwing rather than reading past the end
+ */
+struct LVBitReader {
+    const uint8_t * in;
+    const uint8_t * end;
+    uint64_t bits;
+    int count;
+
+    LVBitReader(const uint8_t * in, const uint8_t * end) : in(in), end(end), bits(0), count(0) {}
+
+    uint32_t get(const int length) {
+        while(this->count < length) {
+            if(this->in == this->end) {
+                throw ERR_LVDCT_BAD_DATA;
+                return 0;
+            }
+            this->bits = (this->bits << 8) | *(this->in++);
+            this->count += 8;
+        }
+        this->count -= length;
+        return (this->bits >> this->count) & ((1ULL << length) - 1);
+    }
+
+    uint32_t get_unsigned() {
+        int length = 0;
+        while(this->get(1) == 0) {
+            if(++length > 24) {     // Longer than anything we write
+                throw ERR_LVDCT_BAD_DATA;
+                return 0;
+            }
+        }
+        return ((1U << length) | this->get(length)) - 1;
+    }
+
+    int get_signed() {
+        uint32_t v = this->get_unsigned();
+        return (v & 1) ? (int)((v + 1) / 2) : -(int)(v / 2);
+    }
+};
+
+/**
+ * @brief Forward 8x8 DCT, one dimension at a time
+ */
+static void lv_fdct(const float * in, float * out) {
+    float rows[64];
+
+    for(int y = 0; y < 8; y++) {
+        for(int u = 0; u < 8; u++) {
+            float sum = 0;
+            for(int x = 0; x < 8; x++) sum += in[y * 8 + x] * lv_dct_tables.basis[u][x];
+            rows[y * 8 + u] = sum;
+        }
+    }
+    for(int v = 0; v < 8; v++) {
+        for(int u = 0; u < 8; u++) {
+            float sum = 0;
+            for(int y = 0; y < 8; y++) sum += rows[y * 8 + u] * lv_dct_tables.basis[v][y];
+            out[v * 8 + u] = sum;
+        }
+    }
+}
+
+/**
+ * @brief Inverse 8x8 DCT, one dimension at a time
+ */
+static void lv_idct(const float * in, float * out) {
+    float rows[64];
+
+    for(int y = 0; y < 8; y++) {
+        for(int u = 0; u < 8; u++) {
+            float sum = 0;
+            for(int v = 0; v < 8; v++) sum += in[v * 8 + u] * lv_dct_tables.basis[v][y];
+            rows[y * 8 + u] = sum;
+        }
+    }
+    for(int y = 0; y < 8; y++) {
+        for(int x = 0; x < 8; x++) {
+            float sum = 0;
+            for(int u = 0; u < 8; u++) sum += rows[y * 8 + u] * lv_dct_tables.basis[u][x];
+            out[y * 8 + x] = sum;
+        }
+    }
+}
+
+static inline int lv_round(const float v) {
+    return (int)(v < 0 ? v - 0.5f : v + 0.5f);
+}
+
+/**
+ * @brief Code one plane, block by block.  Blocks past the edge repeat the last row and column.
+ */
+static void lv_encode_plane(const int16_t * plane, const int width, const int height, const float * quantize, LVBitWriter& bits) {
+    float block[64], coefficients[64];
+    int levels[64];
+    int last_dc = 0;
+
+    for(int by = 0; by < height; by += 8) {
+        for(int bx = 0; bx < width; bx += 8) {
+            for(int y = 0; y < 8; y++) {
+                const int16_t * row = plane + (long)(by + y < height ? by + y : height - 1) * width;
+                for(int x = 0; x < 8; x++) {
+                    block[y * 8 + x] = row[bx + x < width ? bx + x : width - 1];
+                }
+            }
+            lv_fdct(block, coefficients);
+
+            int count = 0;
+            for(int i = 0; i < 64; i++) {
+                levels[i] = lv_round(coefficients[lv_zigzag[i]] * quantize[i]);
+                if(i > 0 && levels[i] != 0) count++;
+            }
+
+            bits.put_unsigned(count);
+            bits.put_signed(levels[0] - last_dc);
+            last_dc = levels[0];
+            for(int i = 1, run = 0; i < 64; i++) {
+                if(levels[i] == 0) {
+                    run++;
+                } else {
+                    bits.put_unsigned(run);
+                    bits.put_signed(levels[i]);
+                    run = 0;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Decode a plane written by \c lv_encode_plane
+ */
+static void lv_decode_plane(int16_t * plane, const int width, const int height, const float * dequantize, LVBitReader& bits) {
+    float block[64], coefficients[64];
+    int last_dc = 0;
+
+    for(int by = 0; by < height; by += 8) {
+        for(int bx = 0; bx < width; bx += 8) {
+            std::memset(coefficients, 0, sizeof(coefficients));
+
+            uint32_t count = bits.get_unsigned();
+            if(count > 63) {
+                throw ERR_LVDCT_BAD_DATA;
+                return;
+            }
+            last_dc += bits.get_signed();
+            coefficients[0] = last_dc * dequantize[0];
+            for(uint32_t i = 0, position = 0; i < count; i++) {
+                position += bits.get_unsigned() + 1;
+                if(position > 63) {
+                    throw ERR_LVDCT_BAD_DATA;
+                    return;
+                }
+                coefficients[lv_zigzag[position]] = bits.get_signed() * dequantize[position];
+            }
+            lv_idct(coefficients, block);
+
+            for(int y = 0; y < 8 && by + y < height; y++) {
+                int16_t * row = plane + (long)(by + y) * width;
+                for(int x = 0; x < 8 && bx + x < width; x++) {
+                    row[bx + x] = lv_round(block[y * 8 + x]);
+                }
+            }
+        }
+    }
+}
+
+static inline uint8_t lv_clip_sample(const int v, const int low, const int high) {
+    return v < low ? low : (v > high ? high : v);
+}
+
+/**
+ * @brief Initialize a codec
+ *
+ * @param[in] quality The quality to encode at, from 1 (smallest) to 100 (best)
+ */
+LVDCTCodec::LVDCTCodec(const int quality) {
+    this->table_quality = 0;
+    this->set_quality(quality);
+}
+
+/**
+ * @brief Set the quality to encode at, from 1 (smallest) to 100 (best)
+ *
+ * Can be changed between any two frames; each frame carries its quality.
+ */
+void LVDCTCodec::set_quality(const int quality) {
+    this->quality = quality < 1 ? 1 : (quality > 100 ? 100 : quality);
+}
+
+/**
+ * @brief Retrieve the quality frames are encoded at
+ */
+int LVDCTCodec::get_quality() const {
+    return this->quality;
+}
+
+/**
+ * @brief Scale the JPEG tables to \a quality, the same way libjpeg does
+ */
+void LVDCTCodec::build_tables(const int quality) {
+    if(quality == this->table_quality) {
+        return;
+    }
+
+    int scale = quality < 50 ? 5000 / quality : 200 - 2 * quality;
+    for(int i = 0; i < 64; i++) {
+        int n = lv_zigzag[i];
+        int luma = (lv_luma_steps[n] * scale + 50) / 100;
+        int chroma = (lv_chroma_steps[n] * scale + 50) / 100;
+        luma = luma < 1 ? 1 : (luma > 255 ? 255 : luma);
+        chroma = chroma < 1 ? 1 : (chroma > 255 ? 255 : chroma);
+
+        this->quantize[0][i] = 1.0f / luma;
+        this->quantize[1][i] = 1.0f / chroma;
+        this->dequantize[0][i] = luma;
+        this->dequantize[1][i] = chroma;
+    }
+    this->table_quality = quality;
+}
+
+/**
+ * @brief Find the viewport in a live view payload
+ *
+ * @exception ERR_LVDATA_NOT_ENOUGH_DATA If the viewport isn't inside the payload
+ * @see LVFrameView::parse for the other checks
+ */
+void LVDCTCodec::parse(const uint8_t * payload, const int payload_size, Header * head) {
+    if(payload_size > (int)lv_dct_max_size) {
+        throw ERR_LVDATA_NOT_ENOUGH_DATA;
+        return;
+    }
+    LVFrameView view(payload, payload_size);
+
+    head->size = payload_size;
+    head->data_start = view.get_viewport_desc().data_start;
+    head->stride = view.get_viewport_pitch();
+    head->groups = view.get_viewport_groups();
+    head->rows = view.get_viewport_rows();
+}
+
+/**
+ * @brief Retrieve the most bytes \c LVDCTCodec::encode can write for \a payload
+ *
+ * @exception ERR_LVDATA_NOT_ENOUGH_DATA If the viewport isn't inside the payload
+ */
+int LVDCTCodec::get_max_size(const uint8_t * payload, const int payload_size) const {
+    Header head;
+    LVDCTCodec::parse(payload, payload_size, &head);
+
+    int block_rows = (head.rows + 7) / 8;
+    int blocks = ((head.groups * 4 + 7) / 8) * block_rows + 2 * ((head.groups + 7) / 8) * block_rows;
+    return sizeof(Header) + payload_size + blocks * lv_dct_max_block_bytes;
+}
+
+/**
+ * @brief Encode a live view payload
+ *
+ * @param[in]  payload      A live view payload, like \c LVData::read takes
+ * @param[in]  payload_size The number of bytes in \a payload
+ * @param[out] out          Where to write the encoded frame (\c LVDCTCodec::get_max_size bytes)
+ * @return The number of bytes written to \a out
+ * @exception ERR_LVDATA_NOT_ENOUGH_DATA If the viewport isn't inside the payload
+ * @see LVFrameView::parse for the other checks
+ */
+int LVDCTCodec::encode(const uint8_t * payload, const int payload_size, uint8_t * out) {
+    Header head;
+    LVDCTCodec::parse(payload, payload_size, &head);
+    head.quality = this->quality;
+    this->build_tables(this->quality);
+
+    // Split the viewport into planes
+    int width = head.groups * 4;
+    this->planes[0].resize(width * head.rows);
+    this->planes[1].resize(head.groups * head.rows);
+    this->planes[2].resize(head.groups * head.rows);
+    for(uint32_t row = 0; row < head.rows; row++) {
+        const uint8_t * yuv = payload + head.data_start + (long)row * head.stride;
+        int16_t * y = &this->planes[0][row * width];
+        int16_t * u = &this->planes[1][row * head.groups];
+        int16_t * v = &this->planes[2][row * head.groups];
+        for(uint32_t i = 0; i < head.groups; i++, yuv += 6) {
+            u[i] = (int8_t)yuv[0];
+            v[i] = (int8_t)yuv[2];
+            y[i * 4 + 0] = yuv[1] - 128;
+            y[i * 4 + 1] = yuv[3] - 128;
+            y[i * 4 + 2] = yuv[4] - 128;
+            y[i * 4 + 3] = yuv[5] - 128;
+        }
+    }
+
+    uint8_t * position = out + sizeof(Header);
+    std::memcpy(position, payload, head.data_start);
+    position += head.data_start;
+
+    LVBitWriter bits(position);
+    if(head.rows > 0 && head.groups > 0) {
+        lv_encode_plane(&this->planes[0][0], width, head.rows, this->quantize[0], bits);
+        lv_encode_plane(&this->planes[1][0], head.groups, head.rows, this->quantize[1], bits);
+        lv_encode_plane(&this->planes[2][0], head.groups, head.rows, this->quantize[1], bits);
+    }
+    bits.flush();
+    head.coded_size = bits.out - position;
+    position = bits.out;
+
+    int suffix = head.size - head.data_start - head.rows * head.stride;
+    std::memcpy(position, payload + head.size - suffix, suffix);
+    position += suffix;
+
+    std::memcpy(out, &head, sizeof(Header));
+    return position - out;
+}
+
+/**
+ * @brief Retrieve the size of the payload \c LVDCTCodec::decode will write
+ *
+ * @exception ERR_LVDCT_BAD_DATA If \a in isn't a valid encoded frame
+ */
+int LVDCTCodec::get_decoded_size(const uint8_t * in, const int in_size) const {
+    Header head;
+
+    if(in_size < (int)sizeof(Header)) {
+        throw ERR_LVDCT_BAD_DATA;
+        return 0;
+    }
+    std::memcpy(&head, in, sizeof(Header));
+
+    uint64_t viewport = (uint64_t)head.rows * head.stride;
+    if(head.quality < 1 || head.quality > 100 || head.size > lv_dct_max_size || (uint64_t)head.groups * 6 > head.stride ||
+       head.data_start + viewport > head.size ||
+       sizeof(Header) + (uint64_t)head.coded_size + head.size - viewport > (uint64_t)in_size) {
+        throw ERR_LVDCT_BAD_DATA;
+        return 0;
+    }
+
+    return head.size;
+}
+
+/**
+ * @brief Decode a frame written by \c LVDCTCodec::encode
+ *
+ * @param[in]  in      The encoded frame
+ * @param[in]  in_size The number of bytes in \a in
+ * @param[out] out     Where to write the decoded payload (\c LVDCTCodec::get_decoded_size bytes).
+ *                     Any padding at the end of viewport rows is zeroed.
+ * @exception ERR_LVDCT_BAD_DATA If \a in isn't a valid encoded frame
+ */
+void LVDCTCodec::decode(const uint8_t * in, const int in_size, uint8_t * out) {
+    Header head;
+
+    this->get_decoded_size(in, in_size);
+    std::memcpy(&head, in, sizeof(Header));
+    this->build_tables(head.quality);
+
+    const uint8_t * position = in + sizeof(Header);
+    std::memcpy(out, position, head.data_start);
+    position += head.data_start;
+
+    int width = head.groups * 4;
+    this->planes[0].resize(width * head.rows);
+    this->planes[1].resize(head.groups * head.rows);
+    this->planes[2].resize(head.groups * head.rows);
+    LVBitReader bits(position, position + head.coded_size);
+    if(head.rows > 0 && head.groups > 0) {
+        lv_decode_plane(&this->planes[0][0], width, head.rows, this->dequantize[0], bits);
+        lv_decode_plane(&this->planes[1][0], head.groups, head.rows, this->dequantize[1], bits);
+        lv_decode_plane(&this->planes[2][0], head.groups, head.rows, this->dequantize[1], bits);
+    }
+    position += head.coded_size;
+
+    // Put the planes back together as UYVYYY
+    for(uint32_t row = 0; row < head.rows; row++) {
+        uint8_t * yuv = out + head.data_start + (long)row * head.stride;
+        const int16_t * y = &this->planes[0][row * width];
+        const int16_t * u = &this->planes[1][row * head.groups];
+        const int16_t * v = &this->planes[2][row * head.groups];
+        for(uint32_t i = 0; i < head.groups; i++, yuv += 6) {
+            yuv[0] = (int8_t)lv_clip_sample(u[i], -128, 127);
+            yuv[1] = lv_clip_sample(y[i * 4 + 0] + 128, 0, 255);
+            yuv[2] = (int8_t)lv_clip_sample(v[i], -128, 127);
+            yuv[3] = lv_clip_sample(y[i * 4 + 1] + 128, 0, 255);
+            yuv[4] = lv_clip_sample(y[i * 4 + 2] + 128, 0, 255);
+            yuv[5] = lv_clip_sample(y[i * 4 + 3] + 128, 0, 255);
+        }
+        std::memset(yuv, 0, head.stride - head.groups * 6);
+    }
+
+    int suffix = head.size - head.data_start - head.rows * head.stride;
+    std::memcpy(out + head.size - suffix, position, suffix);
+}
+
+} /* namespace PTP */
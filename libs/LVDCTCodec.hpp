@@ -0,0 +1,58 @@
+#ifndef LIBPTP_PP_LVDCTCODEC_H_
+#define LIBPTP_PP_LVDCTCODEC_H_
+
+#include <vector>
+#include <stdint.h>
+
+namespace PTP {
+
+    /**
+     * @class LVDCTCodec
+     * @brief A small lossy codec for live view payloads, compressing the viewport's YUV directly
+     *
+     * The viewport is split into Y, U and V planes (straight from UYVYYY, so
+     * chroma stays at a quarter of the horizontal resolution), and each plane
+     * is coded JPEG style: 8x8 DCT, quantization with the JPEG tables scaled by
+     * the quality (1-100, as in libjpeg), zigzag order, then Exp-Golomb codes
+     * for the DC differences and (run, level) pairs.  Everything else in the
+     * payload (header, descriptors, palette, bitmap) is copied as is, so the
+     * decoded payload can be read by \c LVData like the original.
+     *
+     * Encoded frames are a \c LVDCTCodec::Header, the payload up to the
+     * viewport data, the coded planes, and the payload after the viewport.
+     * An \c LVDCTCodec keeps its tables and plane buffers between frames.
+     */
+    class LVDCTCodec {
+        public:
+            struct Header {
+                uint32_t quality;
+                uint32_t size;          // Bytes in the decoded payload
+                uint32_t data_start;    // Where the viewport starts, and the number of bytes before it
+                uint32_t stride;        // Bytes from one viewport row to the next
+                uint32_t groups;        // Visible UYVYYY groups in each row
+                uint32_t rows;
+                uint32_t coded_size;    // Bytes of coded planes
+            };
+
+            LVDCTCodec(const int quality=75);
+            void set_quality(const int quality);
+            int get_quality() const;
+            int get_max_size(const uint8_t * payload, const int payload_size) const;
+            int encode(const uint8_t * payload, const int payload_size, uint8_t * out);
+            int get_decoded_size(const uint8_t * in, const int in_size) const;
+            void decode(const uint8_t * in, const int in_size, uint8_t * out);
+
+        private:
+            int quality;
+            int table_quality;              // The quality the tables were built for
+            float quantize[2][64];          // 1 / step, for luma and chroma, in zigzag order
+            float dequantize[2][64];        // Step, for luma and chroma, in zigzag order
+            std::vector<int16_t> planes[3]; // Y (less 128), U and V
+
+            void build_tables(const int quality);
+            static void parse(const uint8_t * payload, const int payload_size, Header * head);
+    };
+
+}
+
+#endif /* LIBPTP_PP_LVDCTCODEC_H_ */
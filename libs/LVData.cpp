@@ -12,6 +12,10 @@
 #include <stdint.h>
 
 #include "LVData.hpp"
+#include "LVConverter.hpp"
+#include "LVScaler.hpp"
+#include "LVOverlay.hpp"
+#include "LVStats.hpp"
 #include "PTPContainer.hpp"
 #include "libptp++.hpp"
  
@@ -37,54 +41,40 @@ LVData::LVData(const uint8_t * payload, const int payload_size) {
 }
 
 /**
- * @brief Frees up memory malloc()ed by \c LVData
- */
-LVData::~LVData() {
-    delete this->vp_head;
-    delete this->fb_desc;
-    delete this->payload;
-}
-
-/**
- * @brief Initializes \c LVData variables by malloc()ing space of \c LVData::vp_head and \c LVData::fb_desc
+ * @brief Initializes \c LVData variables, with no payload
  */
 void LVData::init() {
-	this->vp_head = new lv_data_header;
-	this->fb_desc = new lv_framebuffer_desc;
-    this->payload = NULL;
+    this->roi_set = false;
+    this->roi_x = this->roi_y = this->roi_width = this->roi_height = 0;
+    this->stats = NULL;
 }
 
 /**
  * @brief Read data from \a payload into the live view data structures
  *
- * Parases \a payload for the necessary parts of the payload and places them
- * in our internal structures.  Also stores a copy of the complete payload
- * for later use in retrieving data.  This way, we only spend CPU time on the
- * data retrieval we NEED to make.
+ * Stores a copy of the complete payload, and checks it (see
+ * \c LVFrameView::parse) so later retrieval can trust it.  This way, we only
+ * spend CPU time on the data retrieval we NEED to make.  Reading into the
+ * same \c LVData again reuses its buffer, as long as the new payload fits.
+ * If \a payload doesn't check out, this \c LVData is left empty.
  *
  * @param[in] payload The address of the first byte of a PTP payload
  * @param[in] payload_size The number of bytes in the payload
- * @exception LVDATA_NOT_ENOUGH_DATA If payload_size given cannot possibly be large
- *              enough to actually contain live view data.
- * @todo The casting here is pretty bad. How can I clean this up?
+ * @exception ERR_LVDATA_NOT_ENOUGH_DATA If anything the header points to is outside the payload
+ * @exception ERR_LVDATA_BAD_FORMAT If the viewport isn't YUV, or its size doesn't make sense
+ * @exception ERR_LVDATA_MISALIGNED If a descriptor isn't aligned
+ * @see LVData::read_in_place to skip the copy
  */
 void LVData::read(const uint8_t * payload, const int payload_size) {
-    if(payload_size < (sizeof(lv_data_header) + sizeof(lv_framebuffer_desc))) {
+    this->view.clear();
+    if(payload_size < (int)sizeof(lv_data_header)) {
         throw ERR_LVDATA_NOT_ENOUGH_DATA;
+        return;
     }
     
-    if(this->payload != NULL) {
-        delete[] this->payload; // Free up the payload if we're overwriting this object
-        this->payload = NULL;
-    }
-    
-	this->payload = new uint8_t[payload_size];
-    
-    std::memcpy(this->payload, payload, payload_size);	// Copy the payload we're reading in into OUR payload
-    
-    // Parse the payload data into vp_head and fb_desc
-    std::memcpy(this->vp_head, this->payload, sizeof(lv_data_header));
-    std::memcpy(this->fb_desc, this->payload + this->vp_head->vp_desc_start, sizeof(lv_framebuffer_desc));
+    uint8_t * copy = this->payload.reserve(payload_size);   // From the frame pool, if it's too small
+    std::memcpy(copy, payload, payload_size);	// Copy the payload we're reading in into OUR payload
+    this->view.parse(copy, payload_size);
 }
 
 /**
@@ -100,13 +90,147 @@ void LVData::read(const uint8_t * payload, const int payload_size) {
  */
 void LVData::read(PTPContainer& container) {
     int payload_size;
-    unsigned char * payload;
+    const unsigned char * payload;
     
-    payload = container.get_payload(&payload_size);
+    payload = container.get_payload_pointer(&payload_size);
     
     this->read(payload, payload_size);
+}
+
+/**
+ * @brief Read live view data from \a payload, without copying it
+ *
+ * Like \c LVData::read, but this \c LVData reads from \a payload itself,
+ * so nothing is copied or allocated.  \a payload must stay valid and
+ * unchanged until this \c LVData reads something else (such as the payload
+ * of a received \c PTPContainer, while the frame is drawn).
+ *
+ * @param[in] payload The address of the first byte of a PTP payload
+ * @param[in] payload_size The number of bytes in the payload
+ * @exception ERR_LVDATA_NOT_ENOUGH_DATA If anything the header points to is outside the payload
+ * @exception ERR_LVDATA_BAD_FORMAT If the viewport isn't YUV, or its size doesn't make sense
+ * @exception ERR_LVDATA_MISALIGNED If the header or a descriptor isn't aligned
+ */
+void LVData::read_in_place(const uint8_t * payload, const int payload_size) {
+    this->view.parse(payload, payload_size);
+}
+
+/**
+ * @brief Retrieve the checked view of the payload this \c LVData reads from
+ */
+const LVFrameView& LVData::get_view() const {
+    return this->view;
+}
+
+/**
+ * @brief Only convert (and copy) a region of the viewport from now on
+ *
+ * Every conversion, \c LVData::get_rgb_size and \c LVData::get_viewport then
+ * work on just this rectangle, as if it were the whole viewport, so their cost
+ * scales with its size rather than the frame's.  The region stays set across
+ * \c LVData::read s, and is clipped to each viewport as it's used.
+ *
+ * Its left and right edges are widened to whole groups of four pixels.  The
+ * bitmap overlay covers the whole frame, so it's left out while a region is
+ * set.  Use it without skip to see the region at the viewport's full
+ * resolution.
+ *
+ * @param[in] x      The left edge, in pixels of the viewport without skip
+ * @param[in] y      The top row
+ * @param[in] width  The width, in pixels.  0 or less clears the region.
+ * @param[in] height The height, in rows.  0 or less clears the region.
+ */
+void LVData::set_roi(const int x, const int y, const int width, const int height) {
+    if(width <= 0 || height <= 0) {
+        this->clear_roi();
+        return;
+    }
     
-    delete[] payload;
+    this->roi_set = true;
+    this->roi_x = x > 0 ? x : 0;
+    this->roi_y = y > 0 ? y : 0;
+    this->roi_width = width;
+    this->roi_height = height;
+}
+
+/**
+ * @brief Go back to converting the whole viewport
+ */
+void LVData::clear_roi() {
+    this->roi_set = false;
+}
+
+/**
+ * @brief Get the region of interest, as clipped to the current viewport
+ *
+ * @param[out] x      The left edge, in pixels of the viewport without skip
+ * @param[out] y      The top row
+ * @param[out] width  The width, in pixels (a multiple of four)
+ * @param[out] height The height, in rows
+ * @return False (and the whole viewport) if no region is set
+ */
+bool LVData::get_roi(int * x, int * y, int * width, int * height) const {
+    int groups, rows;
+    const uint8_t * window = this->get_window(&groups, &rows);
+    int pitch = this->view.get_viewport_pitch();
+    long offset = window - this->view.get_viewport_data();
+    
+    *y = pitch > 0 ? offset / pitch : 0;
+    *x = pitch > 0 ? (offset % pitch) / 6 * 4 : 0;
+    *width = groups * 4;
+    *height = rows;
+    return this->roi_set;
+}
+
+/**
+ * @brief Gather luma statistics while converting, rather than in a pass of their own
+ *
+ * While set, \c LVData::get_rgb, \c LVData::get_pixels, \c LVData::get_planes,
+ * \c LVData::get_luma and \c LVData::get_viewport add the luma of every row
+ * they read (of the region of interest, if one is set) to \a stats, as they
+ * go.  They add to what's there: \c LVStats::reset it before each frame.
+ * \c LVData::get_rgb_scaled doesn't, as the scaler may not read every row.
+ *
+ * @param[in] stats Where to gather statistics, or NULL to stop.  It must
+ *                  outlive the conversions.
+ * @see LVStats
+ */
+void LVData::set_stats(LVStats * stats) {
+    this->stats = stats;
+}
+
+/**
+ * @brief Retrieve where statistics are being gathered, or NULL if they aren't
+ */
+LVStats * LVData::get_stats() const {
+    return this->stats;
+}
+
+/**
+ * @brief Find the part of the viewport to work on: the region of interest, or all of it
+ *
+ * @param[out] groups The number of groups of four pixels in each row
+ * @param[out] rows   The number of rows
+ * @return The first byte of the first group
+ */
+const uint8_t * LVData::get_window(int * groups, int * rows) const {
+    const uint8_t * data = this->view.get_viewport_data();
+    *groups = this->view.get_viewport_groups();
+    *rows = this->view.get_viewport_rows();
+    if(this->roi_set == false) {
+        return data;
+    }
+    
+    int first = this->roi_x / 4;
+    int last = (this->roi_x + this->roi_width + 3) / 4;
+    if(first > *groups) first = *groups;
+    if(last > *groups) last = *groups;
+    int top = this->roi_y < *rows ? this->roi_y : *rows;
+    int bottom = this->roi_y + this->roi_height < *rows ? this->roi_y + this->roi_height : *rows;
+    
+    *groups = last - first;
+    *rows = bottom - top;
+    return data + (long)top * this->view.get_viewport_pitch() + first * 6;
 }
 
 /**
@@ -117,92 +241,412 @@ void LVData::read(PTPContainer& container) {
  * from the payload and converts it to RGB so that it can actually be used.  The
  * \a skip parameter will depend on which camera is used.  Size, width, and height
  * are calculated from properties of the live view data, to hide the underlying structure.
+ * The conversion itself is done a row at a time by \c LVConverter, using SIMD
+ * where the CPU has it.  The result is RGB565, in native byte order.
  *
- * @warning This function malloc()s space for the resulting data. Be sure to free() it!
+ * @warning This function allocates space for the resulting data. Be sure to delete[] it!
  *
  * @param[out] out_size The size of the resulting RGB data
  * @param[out] out_width The width of the resulting RGB image
  * @param[out] out_height The height of the resulting RGB image
  * @param[in]  skip If true, skips two pixels of every four (required on some cameras)
  * @return The address of the first byte of the resulting RGB image
- * @see http://chdk.wikia.com/wiki/Frame_buffers#Viewport, http://trac.assembla.com/chdk/browser/trunk/tools/yuvconvert.c
+ * @see http://chdk.wikia.com/wiki/Frame_buffers#Viewport, LVConverter::convert_row_scalar,
+ *      LVData::get_rgb(uint8_t * out, const int out_pitch, const bool skip) to avoid the allocation
  */
 uint8_t * LVData::get_rgb(int * out_size, int * out_width, int * out_height, const bool skip) const {
-    uint8_t * vp_data;
-    int vp_size;
-    vp_size = (this->fb_desc->buffer_width * this->fb_desc->visible_height * 12) / 8; // 12 bpp
-	vp_data = new uint8_t[vp_size];    // Allocate memory for YUV data 
-    std::memcpy(vp_data, this->payload + this->fb_desc->data_start, vp_size);   // Copy YUV data into vp_data
-    
-    int par = skip?2:1; // If skip, par = 2 ; else, par = 1
+    this->get_rgb_size(out_width, out_height, skip);
+    *out_size = *out_width * *out_height * 2;               // RGB output size -- 16 bpp
     
-    *out_width = this->fb_desc->visible_width / par;           // Vertical width of output
-    unsigned int dispsize = *out_width * (this->fb_desc->visible_height);   // Size of output
-    *out_size = dispsize*2;                                             // RGB output size -- 16 bpp
+    uint8_t * out = new uint8_t[*out_size];  // Allocate space for RGB output
+    this->get_rgb(out, *out_width * 2, skip);
     
-	uint8_t * out = new uint8_t[*out_size];  // Allocate space for RGB output
+    return out;     // It's up to the caller to delete[] this when done
+}
+
+/**
+ * @brief Get live view data in RGB format, written into a buffer the caller provides
+ *
+ * Reads the YUV data straight out of the payload, and writes RGB565 rows
+ * \a out_pitch bytes apart, so the output can go directly into something like
+ * an \c SDL_Surface (\c pixels and \c pitch) or a \c PTPContainer payload.
+ * Nothing is allocated.
+ *
+ * @param[out] out       The first byte of the first output row.  Must have room
+ *                       for the size given by \c LVData::get_rgb_size.
+ * @param[in]  out_pitch The number of bytes from the start of one output row to
+ *                       the next.  Must be even, and at least twice the width.
+ * @param[in]  skip      If true, skips two pixels of every four (required on some cameras)
+ * @exception ERR_LVDATA_BAD_PITCH If \a out_pitch can't hold a row of output
+ * @see LVData::get_rgb_size, LVConverter::convert_frame
+ */
+void LVData::get_rgb(uint8_t * out, const int out_pitch, const bool skip) const {
+    int width, height;
     
-    uint8_t * prgb_data = out; // Pointer we can manipulate to transverse RGB output memory
-    uint8_t * p_yuv = vp_data; // Pointer we can manipulate to transverse YUV input memory
+    this->get_rgb_size(&width, &height, skip);
+    if(out_pitch < width * 2 || (out_pitch & 1) != 0) {
+        throw ERR_LVDATA_BAD_PITCH;
+        return;
+    }
     
-    int i;
-    // Transverse input and output. For each four RGB pixels, we increment 6 YUV bytes
+    // Each group of four RGB pixels comes from 6 YUV bytes.  Skip over any
+    //  padding at the end of the row.  This may run on several threads.
     //  See: http://chdk.wikia.com/wiki/Frame_buffers#Viewport
-    // This magical code borrowed from http://trac.assembla.com/chdk/browser/trunk/tools/yuvconvert.c
-    for(i = 0; i < (this->fb_desc->buffer_width * this->fb_desc->visible_height); i += 4, p_yuv += 6) {
-        this->yuv_to_rgb(&prgb_data, p_yuv[1], p_yuv[0], p_yuv[2]);
-        this->yuv_to_rgb(&prgb_data, p_yuv[3], p_yuv[0], p_yuv[2]);
-        
-        if(skip) continue;  // If we skip two, go to the next iteration
-        
-        this->yuv_to_rgb(&prgb_data, p_yuv[4], p_yuv[0], p_yuv[2]);
-        this->yuv_to_rgb(&prgb_data, p_yuv[5], p_yuv[0], p_yuv[2]);
+    int groups, rows;
+    const uint8_t * yuv = this->get_window(&groups, &rows);
+    LVConverter::convert_frame(yuv, this->view.get_viewport_pitch(), (uint16_t *)out, out_pitch / 2, groups, height, skip,
+                               this->stats);
+}
+
+/**
+ * @brief Get live view data in a packed pixel \a format, written into a buffer the caller provides
+ *
+ * Like \c LVData::get_rgb(uint8_t * out, const int out_pitch, const bool skip),
+ * but for any of the packed \c LVConverter::Format s, so recorders and
+ * analysis tools can take the format they need without converting twice.
+ *
+ * @param[in]  format    The format to write (not \c FORMAT_I420 or \c FORMAT_NV12)
+ * @param[out] out       The first byte of the first output row
+ * @param[in]  out_pitch The number of bytes from the start of one output row to the next
+ * @param[in]  skip      If true, skips two pixels of every four (required on some cameras)
+ * @exception ERR_LVDATA_BAD_FORMAT If \a format is planar
+ * @exception ERR_LVDATA_BAD_PITCH If \a out_pitch can't hold a row of output
+ * @see LVData::get_rgb_size, LVData::get_planes
+ */
+void LVData::get_pixels(const LVConverter::Format format, uint8_t * out, const int out_pitch, const bool skip) const {
+    int width, height;
+    
+    if(LVConverter::is_planar(format)) {
+        throw ERR_LVDATA_BAD_FORMAT;
+        return;
+    }
+    
+    this->get_rgb_size(&width, &height, skip);
+    if(out_pitch < width * LVConverter::get_bytes_per_pixel(format)) {
+        throw ERR_LVDATA_BAD_PITCH;
+        return;
+    }
+    
+    int groups, rows;
+    const uint8_t * yuv = this->get_window(&groups, &rows);
+    LVConverter::convert_frame(format, yuv, this->view.get_viewport_pitch(), out, out_pitch, groups, height, skip,
+                               this->stats);
+}
+
+/**
+ * @brief Get live view data as 4:2:0 planes (I420 or NV12), written into buffers the caller provides
+ *
+ * The Y plane is the size given by \c LVData::get_rgb_size.  The chroma
+ * planes are half that in each direction (rounded up), with U and V averaged
+ * over each pair of rows.
+ *
+ * @param[in]  format  \c FORMAT_I420 (Y, U and V planes) or \c FORMAT_NV12 (Y and interleaved UV planes)
+ * @param[out] planes  The first byte of each plane.  The third is ignored for NV12.
+ * @param[in]  pitches The number of bytes from the start of one row to the next, for each plane
+ * @param[in]  skip    If true, skips two pixels of every four (required on some cameras)
+ * @exception ERR_LVDATA_BAD_FORMAT If \a format isn't planar
+ * @exception ERR_LVDATA_BAD_PITCH If a pitch can't hold a row of its plane
+ */
+void LVData::get_planes(const LVConverter::Format format, uint8_t * const planes[3], const int pitches[3], const bool skip) const {
+    int width, height;
+    
+    if(LVConverter::is_planar(format) == false) {
+        throw ERR_LVDATA_BAD_FORMAT;
+        return;
+    }
+    
+    this->get_rgb_size(&width, &height, skip);
+    if(pitches[0] < width || pitches[1] < width / 2 * (format == LVConverter::FORMAT_NV12 ? 2 : 1) ||
+       (format == LVConverter::FORMAT_I420 && pitches[2] < width / 2)) {
+        throw ERR_LVDATA_BAD_PITCH;
+        return;
     }
     
-    *out_height = this->fb_desc->visible_height;
+    int groups, rows;
+    const uint8_t * yuv = this->get_window(&groups, &rows);
+    LVConverter::convert_frame_planar(format, yuv, this->view.get_viewport_pitch(), planes, pitches, groups, height, skip,
+                                     this->stats);
+}
+
+/**
+ * @brief Get just the luma of the live view, as 8-bit grayscale, written into a buffer the caller provides
+ *
+ * About half the size of the viewport itself, or an eighth if \a half.  Used
+ * when the tether can't keep up with colour.
+ *
+ * @param[out] out       The first byte of the first output row.  Must have room
+ *                       for the size given by \c LVData::get_luma_size.
+ * @param[in]  out_pitch The number of bytes from the start of one output row to the next
+ * @param[in]  half      If true, halve the frame in each direction (see \c LVConverter::extract_luma)
+ * @param[in]  skip      If true, skips two pixels of every four (required on some cameras)
+ * @exception ERR_LVDATA_BAD_PITCH If \a out_pitch can't hold a row of output
+ */
+void LVData::get_luma(uint8_t * out, const int out_pitch, const bool half, const bool skip) const {
+    int width, height;
     
-	delete[] vp_data;;  // We don't need this anymore
+    this->get_luma_size(&width, &height, half, skip);
+    if(out_pitch < width) {
+        throw ERR_LVDATA_BAD_PITCH;
+        return;
+    }
     
-    return out;     // It's up to the caller to free() this when done
+    int groups, rows;
+    const uint8_t * yuv = this->get_window(&groups, &rows);
+    LVConverter::extract_luma(yuv, this->view.get_viewport_pitch(), out, out_pitch, groups, rows, skip, half,
+                              this->stats);
+}
+
+/**
+ * @brief Get the size of the frame \c LVData::get_luma writes, in pixels
+ */
+void LVData::get_luma_size(int * out_width, int * out_height, const bool half, const bool skip) const {
+    this->get_rgb_size(out_width, out_height, skip);
+    if(half) {
+        *out_width /= 2;
+        *out_height = (*out_height + 1) / 2;
+    }
 }
 
 /**
- * @brief A helper function to clip an int to a uint8_t
+ * @brief Where \c LVData::get_rgb_scaled reads its rows from
+ */
+struct LVScaleSource {
+    const uint8_t * yuv;
+    int row_bytes;
+    int groups;
+    bool skip;
+};
+
+static const uint16_t * lv_convert_source_row(void * context, const int row, uint16_t * scratch) {
+    const LVScaleSource * source = (const LVScaleSource *)context;
+    LVConverter::convert_row(source->yuv + (long)row * source->row_bytes, scratch, source->groups, source->skip);
+    return scratch;
+}
+
+/**
+ * @brief Get live view data in RGB format, scaled to \a out_width x \a out_height
  *
- * @param[in] v The integer to clip
- * @return A 8-bit unsigned integer between 0 and 255
+ * Converts and scales in one pass: each source row is converted just before
+ * \a scaler uses it, and each output pixel is written once, so the result can
+ * go straight into the screen.
+ *
+ * @param[out] out        The first byte of the first output row
+ * @param[in]  out_pitch  The number of bytes from the start of one output row to the next
+ * @param[in]  out_width  The width to scale to, in pixels
+ * @param[in]  out_height The height to scale to, in pixels
+ * @param[in]  scaler     The \c LVScaler to use (and its filter).  Reuse it
+ *                        between frames to avoid reallocating its buffers.
+ * @param[in]  skip       If true, skips two pixels of every four (required on some cameras)
+ * @exception ERR_LVDATA_BAD_PITCH If \a out_pitch can't hold a row of output
+ * @see LVScaler
  */
-uint8_t LVData::clip(const int v) {
-    if (v<0) return 0;
-    if (v>255) return 255;
-    return v;
+void LVData::get_rgb_scaled(uint8_t * out, const int out_pitch, const int out_width, const int out_height,
+                            LVScaler& scaler, const bool skip) const {
+    int width, height;
+    LVScaleSource source;
+    
+    if(out_pitch < out_width * 2 || (out_pitch & 1) != 0) {
+        throw ERR_LVDATA_BAD_PITCH;
+        return;
+    }
+    
+    this->get_rgb_size(&width, &height, skip);
+    source.yuv = this->get_window(&source.groups, &height);
+    source.row_bytes = this->view.get_viewport_pitch();
+    source.skip = skip;
+    
+    scaler.scale(lv_convert_source_row, &source, width, height, out, out_width, out_height, out_pitch);
 }
 
 /**
- * @brief Convert a YUV triplet to RGB values.
+ * @brief Get the size of the RGB image \c LVData::get_rgb will produce
  *
- * @note This modifies the \a dest pointer passed in.
- * @param[in] dest A pointer to the address of the first byte of the resulting data
- * @param[in] y The Y value to convert
- * @param[in] u The U value to convert
- * @param[in] v The V value to convert
- * @see http://www.fourcc.org/fccyvrgb.php
+ * @param[out] out_width  The width of the RGB image, in pixels
+ * @param[out] out_height The height of the RGB image, in pixels
+ * @param[in]  skip       If true, skips two pixels of every four
  */
-void LVData::yuv_to_rgb(uint8_t **dest, const uint8_t y, const int8_t u, const int8_t v) {
-    /*
-    *((*dest)++) = LVData::clip(((y<<12) +          v*5743 + 2048)>>12);
-    *((*dest)++) = LVData::clip(((y<<12) - u*1411 - v*2925 + 2048)>>12);
-    *((*dest)++) = LVData::clip(((y<<12) + u*7258          + 2048)>>12);
-    */
-    // Testing alternative formula:
-    uint8_t red = LVData::clip(y                     + 1.402   * v);
-    uint8_t green = LVData::clip(y - 0.34414 * u - 0.71414 * v);
-    uint8_t blue = LVData::clip(y + 1.772   * u);
+void LVData::get_rgb_size(int * out_width, int * out_height, const bool skip) const {
+    int par = skip?2:1; // If skip, par = 2 ; else, par = 1
+    int groups;
     
-    //*((*dest)++) = (0xF8 & red) | ((0xE0 & green) >> 5); // The upper 5 bits from red, with the upper bits of green filling out to 8
-    //*((*dest)++) = ((0x1C & green) << 3) | ((0xF8 & blue) >>3);
-    *((*dest)++) = ((0x1C & green) << 3) | ((0xF8 & blue) >>3);
-    *((*dest)++) = (0xF8 & red) | ((0xE0 & green) >> 5); // The upper 5 bits from red, with the upper bits of green filling out to 8
+    this->get_window(&groups, out_height);
+    *out_width = (groups * 4) / par;  // Whole groups of four pixels only
+}
+
+/**
+ * @brief Check if this payload has a bitmap overlay, and a palette to decode it with
+ *
+ * Both are only sent if they were asked for (see
+ * \c CHDKCamera::get_live_view_data), and the camera may not have them even
+ * then.
+ */
+bool LVData::has_overlay() const {
+    // The view already checked both fit in the payload
+    const lv_framebuffer_desc * bm = this->view.get_bitmap_desc();
+    return this->view.get_bitmap_data() != NULL && this->view.get_palette() != NULL &&
+           bm->visible_width > 0 && bm->visible_height > 0;
+}
+
+/**
+ * @brief Get the size of the bitmap overlay, in pixels
+ *
+ * @param[out] out_width  The visible width of the overlay, or 0 if there isn't one
+ * @param[out] out_height The visible height of the overlay, or 0 if there isn't one
+ */
+void LVData::get_overlay_size(int * out_width, int * out_height) const {
+    if(this->has_overlay() == false) {
+        *out_width = 0;
+        *out_height = 0;
+        return;
+    }
+    
+    *out_width = this->view.get_bitmap_desc()->visible_width;
+    *out_height = this->view.get_bitmap_desc()->visible_height;
+}
+
+/**
+ * @brief Blend the camera's bitmap overlay (its on screen display) onto an RGB565 frame
+ *
+ * The overlay is scaled to cover the whole frame, so this works on the output
+ * of \c LVData::get_rgb and of \c LVData::get_rgb_scaled alike.
+ *
+ * @param[in,out] out        The first byte of the first frame row, RGB565 in native byte order
+ * @param[in]     out_pitch  The number of bytes from the start of one frame row to the next
+ * @param[in]     out_width  The width of the frame, in pixels
+ * @param[in]     out_height The height of the frame, in pixels
+ * @param[in]     overlay    The \c LVOverlay to decode with.  Reuse it between
+ *                           frames, so the palette is only decoded when it changes.
+ * @return False (leaving \a out alone) if there is no overlay, or a region of interest is set
+ * @exception ERR_LVDATA_BAD_PITCH If \a out_pitch can't hold a row of output
+ * @see LVData::has_overlay
+ */
+bool LVData::composite_overlay(uint8_t * out, const int out_pitch, const int out_width, const int out_height,
+                               LVOverlay& overlay) const {
+    if(out_pitch < out_width * 2 || (out_pitch & 1) != 0) {
+        throw ERR_LVDATA_BAD_PITCH;
+        return false;
+    }
+    
+    if(this->has_overlay() == false || this->roi_set) {
+        return false;
+    }
+    
+    const lv_framebuffer_desc * bm = this->view.get_bitmap_desc();
+    overlay.set_palette(this->view.get_header().palette_type, this->view.get_palette());
+    overlay.composite(this->view.get_bitmap_data(), bm->visible_width, bm->visible_height, bm->buffer_width,
+                      out, out_width, out_height, out_pitch);
+    return true;
+}
+
+/**
+ * @brief Get the size of the payload \c LVData::get_viewport will write
+ *
+ * @param[in] with_overlay If true, include the bitmap overlay and palette (if there are any)
+ * @param[in] skip         If true, only keep the pixels \c LVData::get_rgb would with skip
+ * @return The size of the compact payload, in bytes
+ */
+int LVData::get_viewport_size(const bool with_overlay, const bool skip) const {
+    int groups, rows;
+    this->get_window(&groups, &rows);
+    if(skip) groups /= 2;   // Two skipped groups are packed into one
+    int size = sizeof(lv_data_header) + sizeof(lv_framebuffer_desc) + groups * 6 * rows;
+    
+    if(with_overlay && this->has_overlay() && this->roi_set == false) {
+        const lv_framebuffer_desc * bm = this->view.get_bitmap_desc();
+        size += sizeof(lv_framebuffer_desc) + this->view.get_palette_size();
+        size += bm->visible_width * bm->visible_height;
+    }
+    
+    return size;
+}
+
+/**
+ * @brief Write a compact copy of this live view data, for relaying it somewhere else
+ *
+ * The result is a live view payload in its own right (\c LVData::read can
+ * parse it), holding only the visible part of the viewport: each row is
+ * trimmed to whole groups of visible pixels, so there's no padding to send.
+ * It is 12 bpp, three quarters the size of \c LVData::get_rgb 's output, and
+ * leaves the conversion to whoever reads it.
+ *
+ * With \a skip, the Y samples skip would throw away are dropped here, and
+ * each pair of groups is packed into one (U and V averaged), so the copy is
+ * still 12 bpp of what's displayed.  It should then be converted without
+ * skip.  An odd group at the end of each row is dropped.
+ *
+ * @param[out] out          Where to write the payload (\c LVData::get_viewport_size bytes)
+ * @param[in]  with_overlay If true, include the bitmap overlay and palette (if
+ *                          there are any), also trimmed to what's visible
+ * @param[in]  skip         If true, only keep the pixels \c LVData::get_rgb would with skip
+ */
+void LVData::get_viewport(uint8_t * out, const bool with_overlay, const bool skip) const {
+    lv_data_header head = this->view.get_header();
+    lv_framebuffer_desc vp = this->view.get_viewport_desc();
+    bool overlay = with_overlay && this->has_overlay() && this->roi_set == false;
+    lv_framebuffer_desc bm = overlay ? *this->view.get_bitmap_desc() : lv_framebuffer_desc();
+    int palette_size = overlay ? this->view.get_palette_size() : 0;
+    int src_row_bytes = this->view.get_viewport_pitch();
+    int offset = sizeof(lv_data_header) + sizeof(lv_framebuffer_desc);
+    
+    // Only whole groups of four pixels are ever converted
+    int groups, rows;
+    const uint8_t * window = this->get_window(&groups, &rows);
+    if(skip) groups /= 2;
+    vp.visible_width = groups * 4;
+    vp.visible_height = rows;
+    vp.buffer_width = vp.visible_width;
+    int row_bytes = groups * 6;
+    
+    head.vp_desc_start = sizeof(lv_data_header);
+    head.bm_desc_start = 0;
+    head.palette_data_start = 0;
+    if(overlay) {
+        head.bm_desc_start = offset;
+        offset += sizeof(lv_framebuffer_desc);
+        head.palette_data_start = offset;
+        std::memcpy(out + offset, this->view.get_palette(), palette_size);
+        offset += palette_size;
+    } else {
+        head.palette_type = 0;
+    }
+    
+    vp.data_start = offset;
+    for(int row = 0; row < vp.visible_height; row++) {
+        const uint8_t * src = window + (long)row * src_row_bytes;
+        if(this->stats != NULL) {
+            // The samples kept, from the row while it's in cache
+            this->stats->add_row(src, skip ? groups * 2 : groups, skip);
+        }
+        if(skip) {
+            // U, Y0, V, Y1 of two groups become U, Y0, V, Y1, Y0', Y1'
+            uint8_t * dst = out + offset;
+            for(int i = 0; i < groups; i++, src += 12, dst += 6) {
+                dst[0] = ((int8_t)src[0] + (int8_t)src[6] + 1) >> 1;
+                dst[1] = src[1];
+                dst[2] = ((int8_t)src[2] + (int8_t)src[8] + 1) >> 1;
+                dst[3] = src[3];
+                dst[4] = src[7];
+                dst[5] = src[9];
+            }
+        } else {
+            std::memcpy(out + offset, src, row_bytes);
+        }
+        offset += row_bytes;
+    }
+    
+    if(overlay) {
+        bm.data_start = offset;
+        bm.buffer_width = bm.visible_width;
+        for(int row = 0; row < bm.visible_height; row++) {
+            std::memcpy(out + offset, this->view.get_bitmap_data() + (long)row * this->view.get_bitmap_desc()->buffer_width,
+                        bm.visible_width);
+            offset += bm.visible_width;
+        }
+        std::memcpy(out + head.bm_desc_start, &bm, sizeof(lv_framebuffer_desc));
+    }
+    
+    std::memcpy(out, &head, sizeof(lv_data_header));
+    std::memcpy(out + head.vp_desc_start, &vp, sizeof(lv_framebuffer_desc));
 }
 
 /**
@@ -210,12 +654,10 @@ void LVData::yuv_to_rgb(uint8_t **dest, const uint8_t y, const int8_t u, const i
  *
  * @note Expects the minor version number to be one digit.
  *
- * @return The version of this live view data
+ * @return The version of this live view data, or -1 if there isn't any
  */
 float LVData::get_lv_version() const {
-    if(this->vp_head == NULL) return -1;
-    
-    return this->vp_head->version_major + this->vp_head->version_minor / 10.0;
+    return this->view.get_lv_version();
 }
 
 } /* namespace PTP */
@@ -1,27 +1,54 @@
 #ifndef LIBPTP_PP_LVDATA_H_
 #define LIBPTP_PP_LVDATA_H_
 
+#include "LVConverter.hpp"
+#include "LVFrameView.hpp"
+#include "FrameBufferPool.hpp"
+
 namespace PTP {
-#include "chdk/live_view.h"
     
     class PTPContainer; // Forward delcaration for this is enough
+    class LVScaler;
+    class LVOverlay;
+    class LVStats;
     
     class LVData {
         private:
-            PTP::lv_data_header * vp_head;
-            PTP::lv_framebuffer_desc * fb_desc;
-            uint8_t * payload;
+            LVFrameView view;           // Of our own copy, or of the caller's payload
+            FrameBuffer payload;        // Our own copy, if we made one (its buffer goes back to its pool with us)
+            bool roi_set;               // Only convert and copy the region of interest
+            int roi_x, roi_y, roi_width, roi_height;
+            LVStats * stats;            // Gathered during conversions, if not NULL
             void init();
-            static uint8_t clip(const int v);
-            static void yuv_to_rgb(uint8_t **dest, const uint8_t y, const int8_t u, const int8_t v);
+            const uint8_t * get_window(int * groups, int * rows) const;
             
         public:
             LVData();
             LVData(const uint8_t * payload, const int payload_size);
-            ~LVData();
             void read(const uint8_t * payload, const int payload_size);
             void read(PTPContainer& container);    // Could this make life easier?
+            void read_in_place(const uint8_t * payload, const int payload_size);
+            const LVFrameView& get_view() const;
+            void set_roi(const int x, const int y, const int width, const int height);
+            void clear_roi();
+            bool get_roi(int * x, int * y, int * width, int * height) const;
+            void set_stats(LVStats * stats);
+            LVStats * get_stats() const;
             uint8_t * get_rgb(int * out_size, int * out_width, int * out_height, const bool skip=false) const;    // Some cameras don't require skip
+            void get_rgb(uint8_t * out, const int out_pitch, const bool skip=false) const;
+            void get_rgb_size(int * out_width, int * out_height, const bool skip=false) const;
+            void get_pixels(const LVConverter::Format format, uint8_t * out, const int out_pitch, const bool skip=false) const;
+            void get_planes(const LVConverter::Format format, uint8_t * const planes[3], const int pitches[3], const bool skip=false) const;
+            void get_luma(uint8_t * out, const int out_pitch, const bool half=false, const bool skip=false) const;
+            void get_luma_size(int * out_width, int * out_height, const bool half=false, const bool skip=false) const;
+            void get_rgb_scaled(uint8_t * out, const int out_pitch, const int out_width, const int out_height,
+                                LVScaler& scaler, const bool skip=false) const;
+            bool has_overlay() const;
+            void get_overlay_size(int * out_width, int * out_height) const;
+            bool composite_overlay(uint8_t * out, const int out_pitch, const int out_width, const int out_height,
+                                   LVOverlay& overlay) const;
+            int get_viewport_size(const bool with_overlay=false, const bool skip=false) const;
+            void get_viewport(uint8_t * out, const bool with_overlay=false, const bool skip=false) const;
             float get_lv_version() const;
     };
     
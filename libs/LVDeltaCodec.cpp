@@ -0,0 +1,372 @@
+/**
+ * @file LVDeltaCodec.cpp
+ *
+ * @brief Tile based delta coding of live view frames
+ *
+ * Underwater, the picture often doesn't change for long stretches.  Rather
+ * than sending every frame in full, \c LVDeltaCodec sends the tiles that
+ * changed since the receiver's copy, and keyframes now and then in case a
+ * frame is lost.
+ */
+
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+
+#include "LVDeltaCodec.hpp"
+#include "LVConverter.hpp"
+#include "libptp++.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#define LV_X86 1
+#define LV_TARGET_SSE2 __attribute__((target("sse2")))
+#endif
+
+namespace PTP {
+
+static const uint32_t lv_delta_max_size = 64 * 1024 * 1024;    // Anything bigger isn't a live view frame
+
+/**
+ * @brief Initialize a codec, with an empty reference frame
+ *
+ * Use one \c LVDeltaCodec to encode a stream, and another to decode it.
+ *
+ * @param[in] threshold         How much a tile may change (mean absolute difference per byte) and still be skipped.
+ *                              0 sends every change.
+ * @param[in] keyframe_interval Send every tile at least once every this many frames
+ * @param[in] tile_width        Tile width, in bytes.  48 bytes is 32 pixels of \c LVData viewport (UYVYYY).
+ * @param[in] tile_height       Tile height, in rows
+ */
+LVDeltaCodec::LVDeltaCodec(const int threshold, const int keyframe_interval, const int tile_width, const int tile_height) {
+    this->threshold = threshold;
+    this->keyframe_interval = keyframe_interval;
+    this->tile_width = tile_width;
+    this->tile_height = tile_height;
+    this->row_bytes = 0;
+    this->frame = 0;
+    this->frames_since_keyframe = 0;
+    this->keyframe_requested = false;
+    this->have_reference = false;
+    std::memset(&this->stats, 0, sizeof(this->stats));
+}
+
+/**
+ * @brief Set how much a tile may change and still be skipped
+ *
+ * @param[in] threshold The mean absolute difference per byte of a tile, from
+ *                      its reference, that still counts as unchanged
+ */
+void LVDeltaCodec::set_threshold(const int threshold) {
+    this->threshold = threshold < 0 ? 0 : threshold;
+}
+
+/**
+ * @brief Retrieve how much a tile may change and still be skipped
+ */
+int LVDeltaCodec::get_threshold() const {
+    return this->threshold;
+}
+
+/**
+ * @brief Set how often a keyframe is sent, in frames
+ */
+void LVDeltaCodec::set_keyframe_interval(const int frames) {
+    this->keyframe_interval = frames < 1 ? 1 : frames;
+}
+
+/**
+ * @brief Make the next frame \c LVDeltaCodec::encode writes a keyframe
+ *
+ * Call this when the decoder has lost track (\c ERR_LVDELTA_NEED_KEYFRAME).
+ */
+void LVDeltaCodec::request_keyframe() {
+    this->keyframe_requested = true;
+}
+
+/**
+ * @brief Retrieve the most bytes \c LVDeltaCodec::encode can write for a frame
+ *
+ * @param[in] size      The size of the frame, in bytes
+ * @param[in] row_bytes The length of a row of the frame, in bytes
+ */
+int LVDeltaCodec::get_max_size(const int size, const int row_bytes) const {
+    int rows = size / row_bytes;
+    int tiles = ((row_bytes + this->tile_width - 1) / this->tile_width) * ((rows + this->tile_height - 1) / this->tile_height);
+
+    return sizeof(Header) + (tiles + 7) / 8 + size;
+}
+
+/**
+ * @brief Encode a frame, against what the decoder has
+ *
+ * @param[in]  frame     The frame to encode
+ * @param[in]  size      The size of \a frame, in bytes
+ * @param[in]  row_bytes The length of a row of \a frame, in bytes.  Anything
+ *                       after the last full row is always sent.
+ * @param[out] out       Where to write the encoded frame (\c LVDeltaCodec::get_max_size bytes)
+ * @return The number of bytes written to \a out
+ * @exception ERR_LVDELTA_BAD_DATA If \a size or \a row_bytes isn't positive
+ * @see LVDeltaCodec::get_stats
+ */
+int LVDeltaCodec::encode(const uint8_t * frame, const int size, const int row_bytes, uint8_t * out) {
+    if(size <= 0 || row_bytes <= 0) {
+        throw ERR_LVDELTA_BAD_DATA;
+        return 0;
+    }
+
+    int rows = size / row_bytes;
+    int tiles_x = (row_bytes + this->tile_width - 1) / this->tile_width;
+    int tiles_y = (rows + this->tile_height - 1) / this->tile_height;
+    int tiles = tiles_x * tiles_y;
+    bool keyframe = this->have_reference == false || this->keyframe_requested || (int)this->reference.size() != size ||
+                    this->row_bytes != row_bytes || this->frames_since_keyframe + 1 >= this->keyframe_interval;
+
+    if(keyframe) {
+        this->reference.resize(size);
+        this->row_bytes = row_bytes;
+        this->frames_since_keyframe = 0;
+        this->keyframe_requested = false;
+        this->have_reference = true;
+    } else {
+        this->frames_since_keyframe++;
+    }
+    this->frame++;
+
+    uint8_t * mask = out + sizeof(Header);
+    uint8_t * data = mask + (tiles + 7) / 8;
+    uint8_t * reference = &this->reference[0];
+    int sent = 0;
+    std::memset(mask, 0, (tiles + 7) / 8);
+
+    for(int ty = 0; ty < tiles_y; ty++) {
+        int y = ty * this->tile_height;
+        int height = rows - y < this->tile_height ? rows - y : this->tile_height;
+
+        for(int tx = 0; tx < tiles_x; tx++) {
+            int x = tx * this->tile_width;
+            int width = row_bytes - x < this->tile_width ? row_bytes - x : this->tile_width;
+            long offset = (long)y * row_bytes + x;
+
+            if(keyframe == false) {
+                uint32_t sad = LVDeltaCodec::tile_sad(frame + offset, reference + offset, row_bytes, width, height);
+                if(sad <= (uint32_t)this->threshold * width * height) {
+                    continue;   // Close enough to what the decoder has
+                }
+            }
+
+            int tile = ty * tiles_x + tx;
+            mask[tile >> 3] |= 1 << (tile & 7);
+            for(int row = 0; row < height; row++, offset += row_bytes) {
+                std::memcpy(data, frame + offset, width);
+                std::memcpy(reference + offset, frame + offset, width);
+                data += width;
+            }
+            sent++;
+        }
+    }
+
+    // Whatever doesn't make a full row
+    int tail = size - rows * row_bytes;
+    std::memcpy(data, frame + rows * row_bytes, tail);
+    std::memcpy(reference + rows * row_bytes, frame + rows * row_bytes, tail);
+    data += tail;
+
+    Header head;
+    head.frame = this->frame;
+    head.flags = keyframe ? FLAG_KEYFRAME : 0;
+    head.size = size;
+    head.row_bytes = row_bytes;
+    head.tile_width = this->tile_width;
+    head.tile_height = this->tile_height;
+    head.tiles_sent = sent;
+    std::memcpy(out, &head, sizeof(Header));
+
+    this->stats.bytes = data - out;
+    this->stats.tiles = tiles;
+    this->stats.tiles_sent = sent;
+    this->stats.keyframe = keyframe;
+    return this->stats.bytes;
+}
+
+/**
+ * @brief Decode a frame written by \c LVDeltaCodec::encode
+ *
+ * @param[in]  in       The encoded frame
+ * @param[in]  in_size  The size of \a in, in bytes
+ * @param[out] out_size The size of the decoded frame, in bytes
+ * @return The decoded frame.  It belongs to the codec, and is only valid until the next call.
+ * @exception ERR_LVDELTA_BAD_DATA If \a in isn't a valid encoded frame.  A keyframe is needed afterwards.
+ * @exception ERR_LVDELTA_NEED_KEYFRAME If \a in is a delta from a frame we don't have (one was lost)
+ */
+const uint8_t * LVDeltaCodec::decode(const uint8_t * in, const int in_size, int * out_size) {
+    Header head;
+
+    if(in_size < (int)sizeof(Header)) {
+        throw ERR_LVDELTA_BAD_DATA;
+        return NULL;
+    }
+    std::memcpy(&head, in, sizeof(Header));
+    if(head.size == 0 || head.size > lv_delta_max_size || head.row_bytes == 0 || head.row_bytes > lv_delta_max_size ||
+       head.tile_width == 0 || head.tile_height == 0) {
+        throw ERR_LVDELTA_BAD_DATA;
+        return NULL;
+    }
+
+    bool keyframe = (head.flags & FLAG_KEYFRAME) != 0;
+    if(keyframe == false && (this->have_reference == false || this->reference.size() != head.size ||
+                             this->row_bytes != (int)head.row_bytes || head.frame != this->frame + 1)) {
+        throw ERR_LVDELTA_NEED_KEYFRAME;
+        return NULL;
+    }
+
+    int size = head.size;
+    int row_bytes = head.row_bytes;
+    int rows = size / row_bytes;
+    int tiles_x = (row_bytes + head.tile_width - 1) / head.tile_width;
+    int tiles_y = (rows + head.tile_height - 1) / head.tile_height;
+    int tiles = tiles_x * tiles_y;
+    const uint8_t * mask = in + sizeof(Header);
+    const uint8_t * data = mask + (tiles + 7) / 8;
+    const uint8_t * end = in + in_size;
+
+    if(data > end) {
+        throw ERR_LVDELTA_BAD_DATA;
+        return NULL;
+    }
+
+    // From here on, a bad frame leaves the reference half updated
+    this->have_reference = false;
+    if(keyframe) {
+        this->reference.resize(size);
+        this->row_bytes = row_bytes;
+    }
+    uint8_t * reference = &this->reference[0];
+    int sent = 0;
+
+    for(int ty = 0; ty < tiles_y; ty++) {
+        int y = ty * head.tile_height;
+        int height = rows - y < head.tile_height ? rows - y : head.tile_height;
+
+        for(int tx = 0; tx < tiles_x; tx++) {
+            int tile = ty * tiles_x + tx;
+            if((mask[tile >> 3] & (1 << (tile & 7))) == 0) {
+                continue;
+            }
+
+            int x = tx * head.tile_width;
+            int width = row_bytes - x < head.tile_width ? row_bytes - x : head.tile_width;
+            long offset = (long)y * row_bytes + x;
+            if(end - data < (long)width * height) {
+                throw ERR_LVDELTA_BAD_DATA;
+                return NULL;
+            }
+
+            for(int row = 0; row < height; row++, offset += row_bytes) {
+                std::memcpy(reference + offset, data, width);
+                data += width;
+            }
+            sent++;
+        }
+    }
+
+    int tail = size - rows * row_bytes;
+    if(end - data < tail) {
+        throw ERR_LVDELTA_BAD_DATA;
+        return NULL;
+    }
+    std::memcpy(reference + rows * row_bytes, data, tail);
+    data += tail;
+
+    this->have_reference = true;
+    this->frame = head.frame;
+    this->stats.bytes = data - in;
+    this->stats.tiles = tiles;
+    this->stats.tiles_sent = sent;
+    this->stats.keyframe = keyframe;
+
+    *out_size = size;
+    return reference;
+}
+
+/**
+ * @brief Retrieve what the last frame encoded or decoded took
+ */
+const LVDeltaCodec::Stats& LVDeltaCodec::get_stats() const {
+    return this->stats;
+}
+
+/**
+ * @brief Sum the absolute differences of two tiles, with the fastest code this CPU supports
+ *
+ * @param[in] a      The first byte of the first tile
+ * @param[in] b      The first byte of the second tile
+ * @param[in] pitch  The number of bytes from the start of one row to the next, in both
+ * @param[in] width  The width of the tiles, in bytes
+ * @param[in] rows   The height of the tiles, in rows
+ * @see LVDeltaCodec::tile_sad_scalar
+ */
+uint32_t LVDeltaCodec::tile_sad(const uint8_t * a, const uint8_t * b, const int pitch, const int width, const int rows) {
+    typedef uint32_t (*SADFunction)(const uint8_t *, const uint8_t *, const int, const int, const int);
+    static SADFunction sad = NULL;
+
+    if(sad == NULL) {
+        if(LVConverter::is_supported(LVConverter::KERNEL_NEON)) {
+            sad = LVDeltaCodec::tile_sad_neon;
+        } else if(LVConverter::is_supported(LVConverter::KERNEL_SSE2)) {
+            sad = LVDeltaCodec::tile_sad_sse2;
+        } else {
+            sad = LVDeltaCodec::tile_sad_scalar;
+        }
+    }
+
+    return sad(a, b, pitch, width, rows);
+}
+
+/**
+ * @brief Sum the absolute differences of two tiles using plain C++
+ */
+uint32_t LVDeltaCodec::tile_sad_scalar(const uint8_t * a, const uint8_t * b, const int pitch, const int width, const int rows) {
+    uint32_t sum = 0;
+
+    for(int row = 0; row < rows; row++, a += pitch, b += pitch) {
+        for(int x = 0; x < width; x++) {
+            sum += a[x] > b[x] ? a[x] - b[x] : b[x] - a[x];
+        }
+    }
+
+    return sum;
+}
+
+#ifdef LV_X86
+
+/**
+ * @brief Sum the absolute differences of two tiles using SSE2
+ * @see LVDeltaCodec::tile_sad_scalar
+ */
+LV_TARGET_SSE2 uint32_t LVDeltaCodec::tile_sad_sse2(const uint8_t * a, const uint8_t * b, const int pitch, const int width, const int rows) {
+    __m128i total = _mm_setzero_si128();
+    uint32_t sum = 0;
+
+    for(int row = 0; row < rows; row++, a += pitch, b += pitch) {
+        int x = 0;
+        for(; x + 16 <= width; x += 16) {
+            __m128i sad = _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(a + x)), _mm_loadu_si128((const __m128i *)(b + x)));
+            total = _mm_add_epi64(total, sad);
+        }
+        sum += LVDeltaCodec::tile_sad_scalar(a + x, b + x, pitch, width - x, 1);
+    }
+
+    // Two 64 bit sums, either of which fits in 32 bits
+    return sum + _mm_cvtsi128_si32(total) + _mm_cvtsi128_si32(_mm_srli_si128(total, 8));
+}
+
+#else
+
+uint32_t LVDeltaCodec::tile_sad_sse2(const uint8_t * a, const uint8_t * b, const int pitch, const int width, const int rows) {
+    return LVDeltaCodec::tile_sad_scalar(a, b, pitch, width, rows);
+}
+
+#endif /* LV_X86 */
+
+} /* namespace PTP */
@@ -0,0 +1,83 @@
+#ifndef LIBPTP_PP_LVDELTACODEC_H_
+#define LIBPTP_PP_LVDELTACODEC_H_
+
+#include <vector>
+#include <stdint.h>
+
+namespace PTP {
+
+    /**
+     * @class LVDeltaCodec
+     * @brief Sends only the parts of a live view frame that changed
+     *
+     * A frame (any buffer of bytes, such as an RGB565 frame or a payload from
+     * \c LVData::get_viewport) is treated as rows of \a row_bytes, and split
+     * into tiles.  The encoder compares each tile with its reference frame
+     * (what the decoder has), and only sends tiles that differ by more than
+     * the threshold.  Both ends update their reference with the tiles that
+     * were sent, so they always agree.  Keyframes send every tile, and are
+     * sent periodically, when the frame size changes, or when asked for by
+     * \c LVDeltaCodec::request_keyframe (after the decoder lost a frame).
+     *
+     * Tiles are compared with SSE2 or NEON where available.
+     *
+     * Encoded frames are a \c LVDeltaCodec::Header, a bit per tile (set if
+     * the tile was sent), the tiles that were sent (a row at a time), and
+     * any bytes after the last full row.
+     */
+    class LVDeltaCodec {
+        public:
+            enum Flags {
+                FLAG_KEYFRAME = 0x01
+            };
+            struct Header {
+                uint32_t frame;         // Sequence number
+                uint32_t flags;
+                uint32_t size;          // Bytes in the decoded frame
+                uint32_t row_bytes;
+                uint16_t tile_width;    // In bytes
+                uint16_t tile_height;   // In rows
+                uint32_t tiles_sent;
+            };
+            /**
+             * What the last frame encoded or decoded took
+             */
+            struct Stats {
+                int bytes;          // Size of the encoded frame
+                int tiles;
+                int tiles_sent;
+                bool keyframe;
+            };
+
+            LVDeltaCodec(const int threshold=2, const int keyframe_interval=60, const int tile_width=48, const int tile_height=16);
+            void set_threshold(const int threshold);
+            int get_threshold() const;
+            void set_keyframe_interval(const int frames);
+            void request_keyframe();
+            int get_max_size(const int size, const int row_bytes) const;
+            int encode(const uint8_t * frame, const int size, const int row_bytes, uint8_t * out);
+            const uint8_t * decode(const uint8_t * in, const int in_size, int * out_size);
+            const Stats& get_stats() const;
+
+            static uint32_t tile_sad(const uint8_t * a, const uint8_t * b, const int pitch, const int width, const int rows);
+            static uint32_t tile_sad_scalar(const uint8_t * a, const uint8_t * b, const int pitch, const int width, const int rows);
+            static uint32_t tile_sad_sse2(const uint8_t * a, const uint8_t * b, const int pitch, const int width, const int rows);
+            static uint32_t tile_sad_neon(const uint8_t * a, const uint8_t * b, const int pitch, const int width, const int rows);
+
+        private:
+            int threshold;              // Mean absolute difference per byte a tile may have and still be skipped
+            int keyframe_interval;
+            int tile_width;
+            int tile_height;
+            std::vector<uint8_t> reference;
+            int row_bytes;
+            uint32_t frame;             // The last frame encoded or decoded
+            int frames_since_keyframe;
+            bool keyframe_requested;
+            bool have_reference;
+            Stats stats;
+    };
+
+}
+
+#endif /* LIBPTP_PP_LVDELTACODEC_H_ */
@@ -0,0 +1,51 @@
+/**
+ * @file LVDeltaCodec_neon.cpp
+ *
+ * @brief NEON tile comparison for \c LVDeltaCodec
+ *
+ * Built with \c -mfpu=neon like LVConverter_neon.cpp, and only used when
+ * \c LVConverter reports NEON is available.
+ */
+
+#include <stdint.h>
+
+#include "LVDeltaCodec.hpp"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define LV_NEON 1
+#endif
+
+namespace PTP {
+
+#ifdef LV_NEON
+
+/**
+ * @brief Sum the absolute differences of two tiles using NEON
+ * @see LVDeltaCodec::tile_sad_scalar
+ */
+uint32_t LVDeltaCodec::tile_sad_neon(const uint8_t * a, const uint8_t * b, const int pitch, const int width, const int rows) {
+    uint32x4_t total = vdupq_n_u32(0);
+    uint32_t sum = 0;
+
+    for(int row = 0; row < rows; row++, a += pitch, b += pitch) {
+        int x = 0;
+        for(; x + 16 <= width; x += 16) {
+            uint8x16_t difference = vabdq_u8(vld1q_u8(a + x), vld1q_u8(b + x));
+            total = vpadalq_u16(total, vpaddlq_u8(difference));
+        }
+        sum += LVDeltaCodec::tile_sad_scalar(a + x, b + x, pitch, width - x, 1);
+    }
+
+    return sum + vgetq_lane_u32(total, 0) + vgetq_lane_u32(total, 1) + vgetq_lane_u32(total, 2) + vgetq_lane_u32(total, 3);
+}
+
+#else
+
+uint32_t LVDeltaCodec::tile_sad_neon(const uint8_t * a, const uint8_t * b, const int pitch, const int width, const int rows) {
+    return LVDeltaCodec::tile_sad_scalar(a, b, pitch, width, rows);
+}
+
+#endif /* LV_NEON */
+
+} /* namespace PTP */
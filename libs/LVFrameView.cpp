@@ -0,0 +1,416 @@
+/**
+ * @file LVFrameView.cpp
+ *
+ * @brief Checks a live view payload in place, for reading it without a copy
+ *
+ * Payloads come straight off the network or USB, so nothing in them is
+ * trusted: \c LVData and the codecs only look at a payload through a view
+ * that checked it first.
+ */
+
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+
+#include "LVFrameView.hpp"
+#include "LVConverter.hpp"
+#include "LVOverlay.hpp"
+#include "libptp++.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#define LV_X86 1
+#define LV_TARGET_SSE2 __attribute__((target("sse2")))
+#endif
+
+namespace PTP {
+
+static const uint32_t lv_hash_multiplier = 0x9E3779B1;  // Odd, so each step can't lose information
+
+// What the accessors return for a view of nothing, so an empty LVData converts to 0x0
+static const lv_data_header lv_no_header = { 0, 0, 0, 0, 0, 0, 0 };
+static const lv_framebuffer_desc lv_no_desc = { 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+/**
+ * @brief Check that a descriptor or header of \a size bytes at \a offset is inside the payload
+ *
+ * @exception ERR_LVDATA_NOT_ENOUGH_DATA If it isn't
+ * @exception ERR_LVDATA_MISALIGNED If it can't be read where it is
+ */
+static void lv_check_struct(const uint8_t * payload, const int payload_size, const int offset, const int size) {
+    if(offset < 0 || offset > payload_size - size) {
+        throw ERR_LVDATA_NOT_ENOUGH_DATA;
+        return;
+    }
+    // The camera aligns these.  Reading ints from an unaligned address faults on some ARMs.
+    if(((uintptr_t)(payload + offset) & (sizeof(int) - 1)) != 0) {
+        throw ERR_LVDATA_MISALIGNED;
+        return;
+    }
+}
+
+/**
+ * @brief Initialize a view of nothing
+ */
+LVFrameView::LVFrameView() {
+    this->clear();
+}
+
+/**
+ * @brief Initialize a view of \a payload
+ *
+ * @see LVFrameView::parse
+ */
+LVFrameView::LVFrameView(const uint8_t * payload, const int payload_size) {
+    this->clear();
+    this->parse(payload, payload_size);
+}
+
+/**
+ * @brief Check \a payload, and view it
+ *
+ * The viewport has to be YUV, and fit in the payload with all its rows.  The
+ * bitmap and palette are optional (the camera only sends them if asked), but
+ * if their offsets are set, they have to fit too.  Nothing is copied.  If the
+ * payload doesn't check out, the view is left empty.
+ *
+ * @param[in] payload      The address of the first byte of a live view payload
+ * @param[in] payload_size The number of bytes in \a payload
+ * @exception ERR_LVDATA_NOT_ENOUGH_DATA If anything the header points to is outside the payload
+ * @exception ERR_LVDATA_BAD_FORMAT If the viewport isn't YUV, or its size doesn't make sense
+ * @exception ERR_LVDATA_MISALIGNED If the header or a descriptor isn't aligned
+ */
+void LVFrameView::parse(const uint8_t * payload, const int payload_size) {
+    this->clear();
+
+    if(payload == NULL) {
+        throw ERR_LVDATA_NOT_ENOUGH_DATA;
+        return;
+    }
+    lv_check_struct(payload, payload_size, 0, sizeof(lv_data_header));
+    const lv_data_header * head = (const lv_data_header *)payload;
+
+    lv_check_struct(payload, payload_size, head->vp_desc_start, sizeof(lv_framebuffer_desc));
+    const lv_framebuffer_desc * vp = (const lv_framebuffer_desc *)(payload + head->vp_desc_start);
+    if(vp->fb_type != LV_FB_YUV8 || vp->visible_width < 0 || vp->visible_height < 0 || vp->buffer_width < vp->visible_width) {
+        throw ERR_LVDATA_BAD_FORMAT;
+        return;
+    }
+    if(vp->data_start < 0 || vp->data_start + (int64_t)vp->buffer_width * 12 / 8 * vp->visible_height > payload_size) {
+        throw ERR_LVDATA_NOT_ENOUGH_DATA;
+        return;
+    }
+
+    const lv_framebuffer_desc * bm = NULL;
+    const uint8_t * bitmap = NULL;
+    if(head->bm_desc_start != 0) {
+        lv_check_struct(payload, payload_size, head->bm_desc_start, sizeof(lv_framebuffer_desc));
+        bm = (const lv_framebuffer_desc *)(payload + head->bm_desc_start);
+
+        // The bitmap is 8 bpp, buffer_width bytes a row.  It's only there if it has somewhere to start.
+        if(bm->fb_type == LV_FB_PAL8 && bm->data_start > 0) {
+            if(bm->visible_width < 0 || bm->visible_height < 0 || bm->buffer_width < bm->visible_width) {
+                throw ERR_LVDATA_BAD_FORMAT;
+                return;
+            }
+            if(bm->data_start + (int64_t)bm->buffer_width * bm->visible_height > payload_size) {
+                throw ERR_LVDATA_NOT_ENOUGH_DATA;
+                return;
+            }
+            bitmap = payload + bm->data_start;
+        }
+    }
+
+    // Palettes we don't know are ignored, like the bitmap would be without one
+    int palette_size = LVOverlay::get_palette_size(head->palette_type);
+    const uint8_t * palette = NULL;
+    if(head->palette_data_start > 0 && palette_size > 0) {
+        if(head->palette_data_start > payload_size - palette_size) {
+            throw ERR_LVDATA_NOT_ENOUGH_DATA;
+            return;
+        }
+        palette = payload + head->palette_data_start;
+    }
+
+    this->payload = payload;
+    this->payload_size = payload_size;
+    this->head = head;
+    this->vp_desc = vp;
+    this->bm_desc = bm;
+    this->bitmap = bitmap;
+    this->palette = palette;
+    this->palette_size = palette ? palette_size : 0;
+}
+
+/**
+ * @brief Stop viewing the payload
+ */
+void LVFrameView::clear() {
+    this->payload = NULL;
+    this->payload_size = 0;
+    this->head = &lv_no_header;
+    this->vp_desc = &lv_no_desc;
+    this->bm_desc = NULL;
+    this->bitmap = NULL;
+    this->palette = NULL;
+    this->palette_size = 0;
+}
+
+/**
+ * @brief Check if this view has a payload
+ */
+bool LVFrameView::is_valid() const {
+    return this->payload != NULL;
+}
+
+/**
+ * @brief Retrieve the payload, or NULL if there isn't one
+ */
+const uint8_t * LVFrameView::get_payload() const {
+    return this->payload;
+}
+
+/**
+ * @brief Retrieve the number of bytes in the payload
+ */
+int LVFrameView::get_payload_size() const {
+    return this->payload_size;
+}
+
+/**
+ * @brief Retrieve the payload's header (zeroed if there is no payload)
+ */
+const lv_data_header& LVFrameView::get_header() const {
+    return *this->head;
+}
+
+/**
+ * @brief Retrieve the viewport's descriptor (zeroed if there is no payload)
+ */
+const lv_framebuffer_desc& LVFrameView::get_viewport_desc() const {
+    return *this->vp_desc;
+}
+
+/**
+ * @brief Retrieve the first byte of the first viewport row
+ *
+ * There are \c LVFrameView::get_viewport_rows rows, each with
+ * \c LVFrameView::get_viewport_groups groups of six UYVYYY bytes, and
+ * \c LVFrameView::get_viewport_pitch bytes apart.
+ */
+const uint8_t * LVFrameView::get_viewport_data() const {
+    return this->payload ? this->payload + this->vp_desc->data_start : NULL;
+}
+
+/**
+ * @brief Retrieve the number of bytes from one viewport row to the next
+ */
+int LVFrameView::get_viewport_pitch() const {
+    return (this->vp_desc->buffer_width * 12) / 8;   // 12 bpp -- the buffer may be wider than what's visible
+}
+
+/**
+ * @brief Retrieve the number of whole groups of four visible pixels in each viewport row
+ */
+int LVFrameView::get_viewport_groups() const {
+    return this->vp_desc->visible_width / 4;
+}
+
+/**
+ * @brief Retrieve the number of viewport rows
+ */
+int LVFrameView::get_viewport_rows() const {
+    return this->vp_desc->visible_height;
+}
+
+/**
+ * @brief Retrieve the bitmap's descriptor, or NULL if the camera didn't send one
+ */
+const lv_framebuffer_desc * LVFrameView::get_bitmap_desc() const {
+    return this->bm_desc;
+}
+
+/**
+ * @brief Retrieve the first byte of the bitmap, or NULL if it isn't in the payload
+ */
+const uint8_t * LVFrameView::get_bitmap_data() const {
+    return this->bitmap;
+}
+
+/**
+ * @brief Retrieve the palette, or NULL if it isn't in the payload (or is a type we don't know)
+ */
+const uint8_t * LVFrameView::get_palette() const {
+    return this->palette;
+}
+
+/**
+ * @brief Retrieve the number of bytes in the palette, or 0 if there isn't one
+ */
+int LVFrameView::get_palette_size() const {
+    return this->palette_size;
+}
+
+/**
+ * @brief Retrieve the live view version from the header
+ *
+ * @note Expects the minor version number to be one digit.
+ *
+ * @return The version of the payload, or -1 if there isn't one
+ */
+float LVFrameView::get_lv_version() const {
+    if(this->payload == NULL) return -1;
+
+    return this->head->version_major + this->head->version_minor / 10.0;
+}
+
+/**
+ * @brief Fingerprint the viewport, to notice when the camera hasn't refreshed it
+ *
+ * Hashes every \a row_step th visible viewport row (and the bitmap and
+ * palette, with \a with_overlay).  A live picture has sensor noise in every
+ * row, so a sample is enough to tell a new frame from the same one fetched
+ * twice, at a fraction of the cost of converting it.
+ *
+ * @param[in] with_overlay If true, include the bitmap overlay and palette (if there are any)
+ * @param[in] row_step     Hash one row in this many
+ * @return The fingerprint, or 0 if there is no payload
+ */
+uint64_t LVFrameView::get_fingerprint(const bool with_overlay, const int row_step) const {
+    uint32_t lanes[4] = { 0x243F6A88, 0x85A308D3, 0x13198A2E, 0x03707344 };
+    int step = row_step < 1 ? 1 : row_step;
+
+    if(this->payload == NULL) {
+        return 0;
+    }
+
+    int rows = this->get_viewport_rows();
+    LVFrameView::hash_rows(this->get_viewport_data(), this->get_viewport_pitch() * step, this->get_viewport_groups() * 6,
+                           (rows + step - 1) / step, lanes);
+    lanes[0] ^= this->get_viewport_groups();
+    lanes[1] ^= rows;
+
+    if(with_overlay && this->bitmap != NULL && this->palette != NULL) {
+        const lv_framebuffer_desc * bm = this->bm_desc;
+        LVFrameView::hash_rows(this->bitmap, bm->buffer_width * step, bm->visible_width, (bm->visible_height + step - 1) / step, lanes);
+        LVFrameView::hash_bytes(this->palette, this->palette_size, lanes);
+        lanes[2] ^= bm->visible_width;
+        lanes[3] ^= bm->visible_height;
+    }
+
+    // Mix the lanes together, so every input bit can reach every output bit
+    uint64_t hash = ((uint64_t)lanes[0] << 32 | lanes[1]) ^ (((uint64_t)lanes[2] << 32 | lanes[3]) * 0x9E3779B97F4A7C15ULL);
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/**
+ * @brief Hash \a rows rows of \a bytes bytes, \a pitch bytes apart, into \a lanes
+ *
+ * Uses the fastest of the functions below this CPU has.  They all give the same result.
+ *
+ * @param[in]     data  The first byte of the first row
+ * @param[in]     pitch The number of bytes from the start of one row to the next
+ * @param[in]     bytes The number of bytes to hash in each row
+ * @param[in]     rows  The number of rows
+ * @param[in,out] lanes The hash state, four 32 bit lanes
+ * @see LVFrameView::hash_rows_scalar
+ */
+void LVFrameView::hash_rows(const uint8_t * data, const int pitch, const int bytes, const int rows, uint32_t lanes[4]) {
+    typedef void (*HashFunction)(const uint8_t *, const int, const int, const int, uint32_t *);
+    static HashFunction hash = NULL;
+
+    if(hash == NULL) {
+        if(LVConverter::is_supported(LVConverter::KERNEL_NEON)) {
+            hash = LVFrameView::hash_rows_neon;
+        } else if(LVConverter::is_supported(LVConverter::KERNEL_SSE2)) {
+            hash = LVFrameView::hash_rows_sse2;
+        } else {
+            hash = LVFrameView::hash_rows_scalar;
+        }
+    }
+
+    hash(data, pitch, bytes, rows, lanes);
+}
+
+/**
+ * @brief Hash a few bytes into \a lanes, a byte at a time
+ *
+ * Used for whatever is left of a row after the last 16 byte block, so every
+ * version of \c LVFrameView::hash_rows agrees.
+ */
+void LVFrameView::hash_bytes(const uint8_t * data, const int bytes, uint32_t lanes[4]) {
+    for(int i = 0; i < bytes; i++) {
+        uint32_t h = (lanes[i & 3] ^ data[i]) * lv_hash_multiplier;
+        lanes[i & 3] = h ^ (h >> 15);
+    }
+}
+
+/**
+ * @brief Hash rows using plain C++
+ *
+ * Each 16 byte block is four 32 bit words (in native byte order), one per
+ * lane.  Each lane is xored with its word, multiplied by an odd constant, and
+ * its high bits folded down.
+ */
+void LVFrameView::hash_rows_scalar(const uint8_t * data, const int pitch, const int bytes, const int rows, uint32_t lanes[4]) {
+    for(int row = 0; row < rows; row++, data += pitch) {
+        int x = 0;
+        for(; x + 16 <= bytes; x += 16) {
+            uint32_t words[4];
+            std::memcpy(words, data + x, 16);
+            for(int i = 0; i < 4; i++) {
+                uint32_t h = (lanes[i] ^ words[i]) * lv_hash_multiplier;
+                lanes[i] = h ^ (h >> 15);
+            }
+        }
+        LVFrameView::hash_bytes(data + x, bytes - x, lanes);
+    }
+}
+
+#ifdef LV_X86
+
+/**
+ * @brief Hash rows using SSE2
+ *
+ * SSE2 can only multiply 32 bit lanes into 64 bit results, so the even and
+ * odd lanes are multiplied separately and the low halves put back together.
+ *
+ * @see LVFrameView::hash_rows_scalar
+ */
+LV_TARGET_SSE2 void LVFrameView::hash_rows_sse2(const uint8_t * data, const int pitch, const int bytes, const int rows, uint32_t lanes[4]) {
+    const __m128i multiplier = _mm_set1_epi32(lv_hash_multiplier);
+    __m128i h = _mm_loadu_si128((const __m128i *)lanes);
+
+    for(int row = 0; row < rows; row++, data += pitch) {
+        int x = 0;
+        for(; x + 16 <= bytes; x += 16) {
+            h = _mm_xor_si128(h, _mm_loadu_si128((const __m128i *)(data + x)));
+            __m128i even = _mm_mul_epu32(h, multiplier);
+            __m128i odd = _mm_mul_epu32(_mm_srli_epi64(h, 32), multiplier);
+            h = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+            h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+        }
+        if(x < bytes) {
+            _mm_storeu_si128((__m128i *)lanes, h);
+            LVFrameView::hash_bytes(data + x, bytes - x, lanes);
+            h = _mm_loadu_si128((const __m128i *)lanes);
+        }
+    }
+
+    _mm_storeu_si128((__m128i *)lanes, h);
+}
+
+#else
+
+void LVFrameView::hash_rows_sse2(const uint8_t * data, const int pitch, const int bytes, const int rows, uint32_t lanes[4]) {
+    LVFrameView::hash_rows_scalar(data, pitch, bytes, rows, lanes);
+}
+
+#endif /* LV_X86 */
+
+} /* namespace PTP */
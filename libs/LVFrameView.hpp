@@ -0,0 +1,64 @@
+#ifndef LIBPTP_PP_LVFRAMEVIEW_H_
+#define LIBPTP_PP_LVFRAMEVIEW_H_
+
+#include <stdint.h>
+
+namespace PTP {
+#include "chdk/live_view.h"
+
+    /**
+     * @class LVFrameView
+     * @brief A checked look at a live view payload someone else owns
+     *
+     * \c LVFrameView::parse checks the header and the descriptors where they
+     * are, without copying or allocating anything: every offset and size has
+     * to land inside the payload, so the accessors can be trusted.  The
+     * payload must outlive the view, and stay unchanged while it's used.
+     *
+     * \c LVFrameView::get_fingerprint hashes a sample of the viewport's rows
+     * (with SSE2 or NEON where available), to tell whether the camera has
+     * refreshed it since the last frame.
+     */
+    class LVFrameView {
+        public:
+            LVFrameView();
+            LVFrameView(const uint8_t * payload, const int payload_size);
+            void parse(const uint8_t * payload, const int payload_size);
+            void clear();
+            bool is_valid() const;
+            const uint8_t * get_payload() const;
+            int get_payload_size() const;
+            const lv_data_header& get_header() const;
+            const lv_framebuffer_desc& get_viewport_desc() const;
+            const uint8_t * get_viewport_data() const;
+            int get_viewport_pitch() const;
+            int get_viewport_groups() const;
+            int get_viewport_rows() const;
+            const lv_framebuffer_desc * get_bitmap_desc() const;
+            const uint8_t * get_bitmap_data() const;
+            const uint8_t * get_palette() const;
+            int get_palette_size() const;
+            float get_lv_version() const;
+            uint64_t get_fingerprint(const bool with_overlay=false, const int row_step=4) const;
+
+            static void hash_rows(const uint8_t * data, const int pitch, const int bytes, const int rows, uint32_t lanes[4]);
+            static void hash_rows_scalar(const uint8_t * data, const int pitch, const int bytes, const int rows, uint32_t lanes[4]);
+            static void hash_rows_sse2(const uint8_t * data, const int pitch, const int bytes, const int rows, uint32_t lanes[4]);
+            static void hash_rows_neon(const uint8_t * data, const int pitch, const int bytes, const int rows, uint32_t lanes[4]);
+
+        private:
+            const uint8_t * payload;
+            int payload_size;
+            const lv_data_header * head;
+            const lv_framebuffer_desc * vp_desc;
+            const lv_framebuffer_desc * bm_desc;    // NULL if the camera didn't send one
+            const uint8_t * bitmap;                 // NULL if there's no bitmap in the payload
+            const uint8_t * palette;                // NULL if there's no palette we know in the payload
+            int palette_size;
+
+            static void hash_bytes(const uint8_t * data, const int bytes, uint32_t lanes[4]);
+    };
+
+}
+
+#endif /* LIBPTP_PP_LVFRAMEVIEW_H_ */
@@ -0,0 +1,55 @@
+/**
+ * @file LVFrameView_neon.cpp
+ *
+ * @brief NEON fingerprinting for \c LVFrameView
+ *
+ * Built with \c -mfpu=neon like LVConverter_neon.cpp, and only used when
+ * \c LVConverter reports NEON is available.
+ */
+
+#include <stdint.h>
+
+#include "LVFrameView.hpp"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define LV_NEON 1
+#endif
+
+namespace PTP {
+
+#ifdef LV_NEON
+
+/**
+ * @brief Hash rows using NEON
+ * @see LVFrameView::hash_rows_scalar
+ */
+void LVFrameView::hash_rows_neon(const uint8_t * data, const int pitch, const int bytes, const int rows, uint32_t lanes[4]) {
+    const uint32x4_t multiplier = vdupq_n_u32(0x9E3779B1);
+    uint32x4_t h = vld1q_u32(lanes);
+
+    for(int row = 0; row < rows; row++, data += pitch) {
+        int x = 0;
+        for(; x + 16 <= bytes; x += 16) {
+            h = vmulq_u32(veorq_u32(h, vreinterpretq_u32_u8(vld1q_u8(data + x))), multiplier);
+            h = veorq_u32(h, vshrq_n_u32(h, 15));
+        }
+        if(x < bytes) {
+            vst1q_u32(lanes, h);
+            LVFrameView::hash_bytes(data + x, bytes - x, lanes);
+            h = vld1q_u32(lanes);
+        }
+    }
+
+    vst1q_u32(lanes, h);
+}
+
+#else
+
+void LVFrameView::hash_rows_neon(const uint8_t * data, const int pitch, const int bytes, const int rows, uint32_t lanes[4]) {
+    LVFrameView::hash_rows_scalar(data, pitch, bytes, rows, lanes);
+}
+
+#endif /* LV_NEON */
+
+} /* namespace PTP */
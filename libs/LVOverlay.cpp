@@ -0,0 +1,313 @@
+/**
+ * @file LVOverlay.cpp
+ *
+ * @brief Decoding and blending of CHDK's paletted bitmap overlay
+ *
+ * The overlay is what the camera draws over its own live view: focus boxes,
+ * exposure settings, CHDK's OSD.  CHDK sends it as an 8 bit paletted bitmap,
+ * with a palette in one of several camera specific formats.
+ */
+
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+
+#include "LVOverlay.hpp"
+#include "LVConverter.hpp"
+#include "libptp++.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#define LV_X86 1
+#define LV_TARGET_SSE2 __attribute__((target("sse2")))
+#endif
+
+namespace PTP {
+
+// Palette type 4's 2 bit alpha, as the cameras that use it display it
+static const uint8_t lv_alpha2[4] = { 128, 171, 214, 255 };
+
+/**
+ * @brief Initialize an overlay with no palette
+ */
+LVOverlay::LVOverlay() {
+    this->palette_type = 0;
+    this->bm_width = 0;
+    this->out_width = 0;
+    std::memset(this->palette, 0, sizeof(this->palette));
+    std::memset(this->rgba, 0, sizeof(this->rgba));
+    std::memset(this->color, 0, sizeof(this->color));
+    std::memset(this->alpha, 0, sizeof(this->alpha));
+}
+
+/**
+ * @brief Retrieve the number of bytes in a palette of \a type, or 0 if \a type isn't known
+ */
+int LVOverlay::get_palette_size(const int type) {
+    switch(type) {
+        case 1:
+        case 2:
+        case 4:     return 16 * 4;
+        case 3:     return 256 * 4;
+        default:    return 0;
+    }
+}
+
+/**
+ * @brief Set the palette used to decode the bitmap
+ *
+ * Rebuilds the RGBA and RGB565 tables, unless \a type and \a palette are the
+ * same as last time.  Call it for every frame; it costs a \c memcmp when
+ * nothing changed.
+ *
+ * @param[in] type    The palette type, from \c lv_data_header::palette_type
+ * @param[in] palette The palette data (\c LVOverlay::get_palette_size bytes)
+ * @return True if the tables were rebuilt
+ * @exception ERR_LVDATA_BAD_FORMAT If \a type isn't one we know
+ */
+bool LVOverlay::set_palette(const int type, const uint8_t * palette) {
+    int size = LVOverlay::get_palette_size(type);
+    if(size == 0) {
+        throw ERR_LVDATA_BAD_FORMAT;
+        return false;
+    }
+
+    if(type == this->palette_type && std::memcmp(this->palette, palette, size) == 0) {
+        return false;   // Same as last frame
+    }
+
+    this->palette_type = type;
+    std::memcpy(this->palette, palette, size);
+
+    for(int i = 0; i < 256; i++) {
+        const uint8_t * entry = this->palette + (i & 0xF) * 4;
+        uint8_t y = 0;
+        int8_t u = 0, v = 0;
+        int a = 0;
+
+        switch(type) {
+            case 1: {
+                // AYUV, with the two nibbles of the pixel averaged
+                const uint8_t * other = this->palette + (i >> 4) * 4;
+                a = (((entry[0] & 3) + (other[0] & 3)) >> 1) * 85;
+                y = (entry[1] + other[1]) >> 1;
+                u = ((int8_t)entry[2] + (int8_t)other[2]) >> 1;
+                v = ((int8_t)entry[3] + (int8_t)other[3]) >> 1;
+                break;
+            }
+            case 2:
+                v = entry[0];
+                u = entry[1];
+                y = entry[2];
+                a = (i & 0xF) == 0 ? 0 : 255;
+                break;
+            case 3:
+                entry = this->palette + i * 4;
+                v = entry[0];
+                u = entry[1];
+                y = entry[2];
+                a = i == 0 ? 0 : entry[3];
+                break;
+            case 4:
+                v = entry[0];
+                u = entry[1];
+                y = entry[2];
+                a = (i & 0xF) == 0 ? 0 : lv_alpha2[entry[3] & 3];
+                break;
+        }
+
+        uint8_t * rgba = this->rgba + i * 4;
+        if(a == 0) {
+            std::memset(rgba, 0, 4);
+        } else {
+            LVConverter::convert_pixel(y, u, v, rgba);
+            rgba[3] = a;
+        }
+        this->color[i] = ((rgba[0] & 0xF8) << 8) | ((rgba[1] & 0xFC) << 3) | (rgba[2] >> 3);
+        this->alpha[i] = a + (a >> 7);     // 255 becomes 256, so opaque pixels replace the frame
+    }
+
+    return true;
+}
+
+/**
+ * @brief Retrieve the type of the current palette, or 0 if none has been set
+ */
+int LVOverlay::get_palette_type() const {
+    return this->palette_type;
+}
+
+/**
+ * @brief Retrieve the decoded palette: R, G, B and A bytes for each of the 256 bitmap values
+ */
+const uint8_t * LVOverlay::get_rgba() const {
+    return this->rgba;
+}
+
+/**
+ * @brief Blend a bitmap over an RGB565 frame, scaling it to fit
+ *
+ * @param[in]     bitmap     The first byte of the first bitmap row
+ * @param[in]     bm_width   The visible width of the bitmap, in pixels
+ * @param[in]     bm_height  The number of bitmap rows
+ * @param[in]     bm_pitch   The number of bytes from the start of one bitmap row to the next
+ * @param[in,out] out        The first byte of the first frame row, RGB565 in native byte order
+ * @param[in]     out_width  The width of the frame, in pixels
+ * @param[in]     out_height The height of the frame, in pixels
+ * @param[in]     out_pitch  The number of bytes from the start of one frame row to the next
+ * @note Does nothing until a palette has been set.
+ */
+void LVOverlay::composite(const uint8_t * bitmap, const int bm_width, const int bm_height, const int bm_pitch,
+                          uint8_t * out, const int out_width, const int out_height, const int out_pitch) {
+    if(this->palette_type == 0 || bm_width <= 0 || bm_height <= 0 || out_width <= 0 || out_height <= 0) {
+        return;
+    }
+
+    this->setup(bm_width, out_width);
+
+    int last_row = -1;
+    bool visible = false;
+    for(int y = 0; y < out_height; y++) {
+        int row = (int)(((2LL * y + 1) * bm_height) / (2LL * out_height));   // Nearest bitmap row to this one's centre
+        if(row != last_row) {
+            visible = this->build_row(bitmap + (long)row * bm_pitch);
+            last_row = row;
+        }
+        if(visible) {
+            LVOverlay::blend_row(&this->row_color[0], &this->row_alpha[0], (uint16_t *)(out + (long)y * out_pitch), out_width);
+        }
+    }
+}
+
+/**
+ * @brief Build the column table and row buffers for a new size
+ */
+void LVOverlay::setup(const int bm_width, const int out_width) {
+    if(bm_width == this->bm_width && out_width == this->out_width) {
+        return;
+    }
+
+    this->x_index.resize(out_width);
+    for(int x = 0; x < out_width; x++) {
+        this->x_index[x] = (int)(((2LL * x + 1) * bm_width) / (2LL * out_width));
+    }
+    this->row_color.resize(out_width);
+    this->row_alpha.resize(out_width);
+    this->bm_width = bm_width;
+    this->out_width = out_width;
+}
+
+/**
+ * @brief Look up one bitmap row, scaled to the output width
+ *
+ * @return False if the whole row is transparent
+ */
+bool LVOverlay::build_row(const uint8_t * bitmap) {
+    uint16_t visible = 0;
+
+    for(int x = 0; x < this->out_width; x++) {
+        uint8_t value = bitmap[this->x_index[x]];
+        this->row_color[x] = this->color[value];
+        this->row_alpha[x] = this->alpha[value];
+        visible |= this->alpha[value];
+    }
+
+    return visible != 0;
+}
+
+/**
+ * @brief Blend a row of overlay pixels onto a row of the frame, with the fastest code this CPU supports
+ *
+ * @param[in]     color The overlay's RGB565 pixels
+ * @param[in]     alpha The overlay's weight at each pixel, out of 256
+ * @param[in,out] out   The frame row to blend onto
+ * @param[in]     count The number of pixels
+ * @see LVOverlay::blend_row_scalar
+ */
+void LVOverlay::blend_row(const uint16_t * color, const uint16_t * alpha, uint16_t * out, const int count) {
+    typedef void (*BlendFunction)(const uint16_t *, const uint16_t *, uint16_t *, const int);
+    static BlendFunction blend = NULL;
+
+    if(blend == NULL) {
+        if(LVConverter::is_supported(LVConverter::KERNEL_NEON)) {
+            blend = LVOverlay::blend_row_neon;
+        } else if(LVConverter::is_supported(LVConverter::KERNEL_SSE2)) {
+            blend = LVOverlay::blend_row_sse2;
+        } else {
+            blend = LVOverlay::blend_row_scalar;
+        }
+    }
+
+    blend(color, alpha, out, count);
+}
+
+/**
+ * @brief Blend a row of overlay pixels onto a row of the frame using plain C++
+ *
+ * Each channel is (out * (256 - alpha) + color * alpha + 128) >> 8, the same
+ * as \c LVScaler::blend_rows_scalar but with a weight per pixel.
+ */
+void LVOverlay::blend_row_scalar(const uint16_t * color, const uint16_t * alpha, uint16_t * out, const int count) {
+    for(int i = 0; i < count; i++) {
+        int weight = alpha[i];
+        if(weight == 0) continue;
+
+        int inverse = 256 - weight;
+        uint16_t a = out[i], b = color[i];
+        int red = ((a >> 11) * inverse + (b >> 11) * weight + 128) >> 8;
+        int green = (((a >> 5) & 0x3F) * inverse + ((b >> 5) & 0x3F) * weight + 128) >> 8;
+        int blue = ((a & 0x1F) * inverse + (b & 0x1F) * weight + 128) >> 8;
+        out[i] = (red << 11) | (green << 5) | blue;
+    }
+}
+
+#ifdef LV_X86
+
+/**
+ * @brief Blend a row of overlay pixels onto a row of the frame using SSE2
+ * @see LVOverlay::blend_row_scalar
+ */
+LV_TARGET_SSE2 void LVOverlay::blend_row_sse2(const uint16_t * color, const uint16_t * alpha, uint16_t * out, const int count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(256);
+    const __m128i round = _mm_set1_epi16(128);
+    const __m128i mask6 = _mm_set1_epi16(0x3F);
+    const __m128i mask5 = _mm_set1_epi16(0x1F);
+    int i = 0;
+
+    for(; i + 8 <= count; i += 8) {
+        __m128i forward = _mm_loadu_si128((const __m128i *)(alpha + i));
+        if(_mm_movemask_epi8(_mm_cmpeq_epi16(forward, zero)) == 0xFFFF) {
+            continue;   // All transparent
+        }
+        __m128i inverse = _mm_sub_epi16(full, forward);
+        __m128i a = _mm_loadu_si128((const __m128i *)(out + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(color + i));
+
+        __m128i red = _mm_add_epi16(_mm_mullo_epi16(_mm_srli_epi16(a, 11), inverse),
+                                    _mm_mullo_epi16(_mm_srli_epi16(b, 11), forward));
+        __m128i green = _mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(a, 5), mask6), inverse),
+                                      _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(b, 5), mask6), forward));
+        __m128i blue = _mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(a, mask5), inverse),
+                                     _mm_mullo_epi16(_mm_and_si128(b, mask5), forward));
+
+        red = _mm_srli_epi16(_mm_add_epi16(red, round), 8);
+        green = _mm_srli_epi16(_mm_add_epi16(green, round), 8);
+        blue = _mm_srli_epi16(_mm_add_epi16(blue, round), 8);
+
+        __m128i pixels = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(red, 11), _mm_slli_epi16(green, 5)), blue);
+        _mm_storeu_si128((__m128i *)(out + i), pixels);
+    }
+
+    LVOverlay::blend_row_scalar(color + i, alpha + i, out + i, count - i);
+}
+
+#else
+
+void LVOverlay::blend_row_sse2(const uint16_t * color, const uint16_t * alpha, uint16_t * out, const int count) {
+    LVOverlay::blend_row_scalar(color, alpha, out, count);
+}
+
+#endif /* LV_X86 */
+
+} /* namespace PTP */
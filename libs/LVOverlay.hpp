@@ -0,0 +1,60 @@
+#ifndef LIBPTP_PP_LVOVERLAY_H_
+#define LIBPTP_PP_LVOVERLAY_H_
+
+#include <vector>
+#include <stdint.h>
+
+namespace PTP {
+
+    /**
+     * @class LVOverlay
+     * @brief Decodes CHDK's paletted bitmap overlay and blends it onto RGB565 frames
+     *
+     * The bitmap overlay (the camera's own on screen display) is 8 bit
+     * paletted.  \c LVOverlay::set_palette turns the camera's palette into
+     * 256 entry RGBA and RGB565 tables, and only rebuilds them when the
+     * palette actually changes, which is rarely.  \c LVOverlay::composite
+     * then scales the bitmap (nearest neighbour) over a frame, and blends it
+     * in with SIMD where available.  Fully transparent rows, which is most of
+     * them, are skipped.
+     *
+     * Palette types, from live_view.h 2.1:
+     *  - 1: 16 AYUV entries, A 0-3.  Each pixel is two 4 bit indexes, which are averaged.
+     *  - 2: 16 VUYA entries.  Index 0 is transparent, the rest are opaque.
+     *  - 3: 256 VUYA entries, A 0-255.  Index 0 is transparent.
+     *  - 4: 16 VUYA entries, 2 bit A.  Index 0 is transparent.
+     */
+    class LVOverlay {
+        public:
+            LVOverlay();
+            bool set_palette(const int type, const uint8_t * palette);
+            int get_palette_type() const;
+            const uint8_t * get_rgba() const;
+            void composite(const uint8_t * bitmap, const int bm_width, const int bm_height, const int bm_pitch,
+                           uint8_t * out, const int out_width, const int out_height, const int out_pitch);
+            static int get_palette_size(const int type);
+
+            static void blend_row(const uint16_t * color, const uint16_t * alpha, uint16_t * out, const int count);
+            static void blend_row_scalar(const uint16_t * color, const uint16_t * alpha, uint16_t * out, const int count);
+            static void blend_row_sse2(const uint16_t * color, const uint16_t * alpha, uint16_t * out, const int count);
+            static void blend_row_neon(const uint16_t * color, const uint16_t * alpha, uint16_t * out, const int count);
+
+        private:
+            int palette_type;                   // 0 until a palette is set
+            uint8_t palette[256 * 4];           // The palette the tables were built from
+            uint8_t rgba[256 * 4];              // R, G, B, A for each bitmap value
+            uint16_t color[256];                // RGB565 for each bitmap value
+            uint16_t alpha[256];                // Weight of the overlay for each bitmap value, out of 256
+            int bm_width;
+            int out_width;
+            std::vector<int> x_index;           // Bitmap column for each output pixel
+            std::vector<uint16_t> row_color;    // One row of the overlay, scaled to the output
+            std::vector<uint16_t> row_alpha;
+
+            void setup(const int bm_width, const int out_width);
+            bool build_row(const uint8_t * bitmap);
+    };
+
+}
+
+#endif /* LIBPTP_PP_LVOVERLAY_H_ */
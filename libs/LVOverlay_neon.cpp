@@ -0,0 +1,66 @@
+/**
+ * @file LVOverlay_neon.cpp
+ *
+ * @brief NEON overlay blending for \c LVOverlay
+ *
+ * Built with \c -mfpu=neon like LVConverter_neon.cpp, and only used when
+ * \c LVConverter reports NEON is available.
+ */
+
+#include <stdint.h>
+
+#include "LVOverlay.hpp"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define LV_NEON 1
+#endif
+
+namespace PTP {
+
+#ifdef LV_NEON
+
+/**
+ * @brief Blend a row of overlay pixels onto a row of the frame using NEON
+ * @see LVOverlay::blend_row_scalar
+ */
+void LVOverlay::blend_row_neon(const uint16_t * color, const uint16_t * alpha, uint16_t * out, const int count) {
+    const uint16x8_t full = vdupq_n_u16(256);
+    const uint16x8_t round = vdupq_n_u16(128);
+    const uint16x8_t mask6 = vdupq_n_u16(0x3F);
+    const uint16x8_t mask5 = vdupq_n_u16(0x1F);
+    int i = 0;
+
+    for(; i + 8 <= count; i += 8) {
+        uint16x8_t forward = vld1q_u16(alpha + i);
+        uint64x2_t any = vreinterpretq_u64_u16(forward);
+        if((vgetq_lane_u64(any, 0) | vgetq_lane_u64(any, 1)) == 0) {
+            continue;   // All transparent
+        }
+        uint16x8_t inverse = vsubq_u16(full, forward);
+        uint16x8_t a = vld1q_u16(out + i);
+        uint16x8_t b = vld1q_u16(color + i);
+
+        uint16x8_t red = vmlaq_u16(vmlaq_u16(round, vshrq_n_u16(a, 11), inverse), vshrq_n_u16(b, 11), forward);
+        uint16x8_t green = vmlaq_u16(vmlaq_u16(round, vandq_u16(vshrq_n_u16(a, 5), mask6), inverse),
+                                     vandq_u16(vshrq_n_u16(b, 5), mask6), forward);
+        uint16x8_t blue = vmlaq_u16(vmlaq_u16(round, vandq_u16(a, mask5), inverse), vandq_u16(b, mask5), forward);
+
+        uint16x8_t pixels = vshlq_n_u16(vshrq_n_u16(red, 8), 11);
+        pixels = vorrq_u16(pixels, vshlq_n_u16(vshrq_n_u16(green, 8), 5));
+        pixels = vorrq_u16(pixels, vshrq_n_u16(blue, 8));
+        vst1q_u16(out + i, pixels);
+    }
+
+    LVOverlay::blend_row_scalar(color + i, alpha + i, out + i, count - i);
+}
+
+#else
+
+void LVOverlay::blend_row_neon(const uint16_t * color, const uint16_t * alpha, uint16_t * out, const int count) {
+    LVOverlay::blend_row_scalar(color, alpha, out, count);
+}
+
+#endif /* LV_NEON */
+
+} /* namespace PTP */
@@ -0,0 +1,325 @@
+/**
+ * @file LVScaler.cpp
+ *
+ * @brief Single pass scaling of RGB565 live view frames
+ *
+ * Replaces converting a whole frame and then stretching it with
+ * \c SDL_SoftStretch: rows are converted (if needed) and scaled as they are
+ * needed, and each output pixel is written once.
+ */
+
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+
+#include "LVScaler.hpp"
+#include "LVConverter.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#define LV_X86 1
+#define LV_TARGET_SSE2 __attribute__((target("sse2")))
+#endif
+
+namespace PTP {
+
+/**
+ * @brief Blend two RGB565 pixels: (a * (256 - weight) + b * weight + 128) >> 8 per channel
+ */
+static inline uint16_t lv_blend565(const uint16_t a, const uint16_t b, const int weight) {
+    int inverse = 256 - weight;
+    int red = ((a >> 11) * inverse + (b >> 11) * weight + 128) >> 8;
+    int green = (((a >> 5) & 0x3F) * inverse + ((b >> 5) & 0x3F) * weight + 128) >> 8;
+    int blue = ((a & 0x1F) * inverse + (b & 0x1F) * weight + 128) >> 8;
+
+    return (red << 11) | (green << 5) | blue;
+}
+
+/**
+ * @brief The source for \c LVScaler::scale when the frame is already RGB565
+ */
+struct LVScaleFrame {
+    const uint8_t * src;
+    int pitch;
+};
+
+/**
+ * @brief A \c LVScaler::RowSource over an RGB565 frame, whose rows are used where they are, so \a scratch isn't needed
+ */
+static const uint16_t * lv_frame_row(void * context, const int row, uint16_t * /*scratch*/) {
+    const LVScaleFrame * frame = (const LVScaleFrame *)context;
+    return (const uint16_t *)(frame->src + (long)row * frame->pitch);
+}
+
+/**
+ * @brief Create a scaler
+ *
+ * @param[in] filter The filter to scale with
+ */
+LVScaler::LVScaler(const Filter filter) {
+    this->filter = filter;
+    this->tables_filter = filter;
+    this->src_width = 0;
+    this->dst_width = 0;
+    this->row_ids[0] = -1;
+    this->row_ids[1] = -1;
+}
+
+/**
+ * @brief Change the filter used to scale
+ */
+void LVScaler::set_filter(const Filter filter) {
+    this->filter = filter;
+}
+
+/**
+ * @brief Retrieve the filter used to scale
+ */
+LVScaler::Filter LVScaler::get_filter() const {
+    return this->filter;
+}
+
+/**
+ * @brief Scale an RGB565 frame into \a dst
+ *
+ * @param[in]  src        The first pixel of the source frame
+ * @param[in]  src_width  The width of the source, in pixels
+ * @param[in]  src_height The height of the source, in pixels
+ * @param[in]  src_pitch  The number of bytes from one source row to the next
+ * @param[out] dst        The first byte of the output (an \c SDL_Surface's \c pixels, for example)
+ * @param[in]  dst_width  The width of the output, in pixels
+ * @param[in]  dst_height The height of the output, in pixels
+ * @param[in]  dst_pitch  The number of bytes from one output row to the next
+ */
+void LVScaler::scale(const uint16_t * src, const int src_width, const int src_height, const int src_pitch,
+                     uint8_t * dst, const int dst_width, const int dst_height, const int dst_pitch) {
+    LVScaleFrame frame;
+    frame.src = (const uint8_t *)src;
+    frame.pitch = src_pitch;
+
+    this->scale(lv_frame_row, &frame, src_width, src_height, dst, dst_width, dst_height, dst_pitch);
+}
+
+/**
+ * @brief Scale a frame, fetching its rows from \a source, into \a dst
+ *
+ * Source rows are fetched in order, and each one at most once per frame.
+ *
+ * @param[in]  source     Called to get each source row
+ * @param[in]  context    Passed through to \a source
+ * @param[in]  src_width  The width of the source, in pixels
+ * @param[in]  src_height The height of the source, in pixels
+ * @param[out] dst        The first byte of the output
+ * @param[in]  dst_width  The width of the output, in pixels
+ * @param[in]  dst_height The height of the output, in pixels
+ * @param[in]  dst_pitch  The number of bytes from one output row to the next
+ */
+void LVScaler::scale(RowSource source, void * context, const int src_width, const int src_height,
+                     uint8_t * dst, const int dst_width, const int dst_height, const int dst_pitch) {
+    if(src_width <= 0 || src_height <= 0 || dst_width <= 0 || dst_height <= 0) return;
+
+    this->setup(src_width, dst_width);
+    this->row_ids[0] = -1;  // New frame, so nothing cached is any good
+    this->row_ids[1] = -1;
+
+    int last_row = -1;
+    uint16_t * last_out = NULL;
+    for(int y = 0; y < dst_height; y++) {
+        uint16_t * out = (uint16_t *)(dst + (long)y * dst_pitch);
+        int weight;
+        int row = LVScaler::map(y, dst_height, src_height, this->filter == FILTER_BILINEAR ? &weight : NULL);
+
+        if(this->filter == FILTER_NEAREST || weight == 0) {
+            if(row == last_row) {
+                std::memcpy(out, last_out, dst_width * 2);  // Repeated row, when scaling up
+            } else if(this->filter == FILTER_NEAREST) {
+                this->scale_row(source(context, row, &this->scratch[0]), out);
+            } else {
+                std::memcpy(out, this->get_scaled_row(source, context, row), dst_width * 2);
+            }
+            last_row = row;
+            last_out = out;
+            continue;
+        }
+
+        const uint16_t * top = this->get_scaled_row(source, context, row);
+        const uint16_t * bottom = this->get_scaled_row(source, context, row + 1);
+        LVScaler::blend_rows(top, bottom, out, dst_width, weight);
+        last_row = -1;  // Blended rows are never repeated exactly
+    }
+}
+
+/**
+ * @brief Blend two rows of RGB565 pixels, with the fastest code this CPU supports
+ *
+ * @param[in]  top    The first row
+ * @param[in]  bottom The second row
+ * @param[out] out    Where to write the blended row (may be \a top or \a bottom)
+ * @param[in]  count  The number of pixels in each row
+ * @param[in]  weight How much of \a bottom to use, out of 256
+ * @see LVScaler::blend_rows_scalar
+ */
+void LVScaler::blend_rows(const uint16_t * top, const uint16_t * bottom, uint16_t * out, const int count, const int weight) {
+    typedef void (*BlendFunction)(const uint16_t *, const uint16_t *, uint16_t *, const int, const int);
+    static BlendFunction blend = NULL;
+
+    if(blend == NULL) {
+        if(LVConverter::is_supported(LVConverter::KERNEL_NEON)) {
+            blend = LVScaler::blend_rows_neon;
+        } else if(LVConverter::is_supported(LVConverter::KERNEL_SSE2)) {
+            blend = LVScaler::blend_rows_sse2;
+        } else {
+            blend = LVScaler::blend_rows_scalar;
+        }
+    }
+
+    blend(top, bottom, out, count, weight);
+}
+
+/**
+ * @brief Blend two rows of RGB565 pixels using plain C++
+ *
+ * Each channel is (top * (256 - weight) + bottom * weight + 128) >> 8, which
+ * fits in 16 bits, so the SIMD versions give exactly the same result.
+ */
+void LVScaler::blend_rows_scalar(const uint16_t * top, const uint16_t * bottom, uint16_t * out, const int count, const int weight) {
+    for(int i = 0; i < count; i++) {
+        out[i] = lv_blend565(top[i], bottom[i], weight);
+    }
+}
+
+#ifdef LV_X86
+
+/**
+ * @brief Blend two rows of RGB565 pixels using SSE2
+ * @see LVScaler::blend_rows_scalar
+ */
+LV_TARGET_SSE2 void LVScaler::blend_rows_sse2(const uint16_t * top, const uint16_t * bottom, uint16_t * out, const int count, const int weight) {
+    const __m128i inverse = _mm_set1_epi16(256 - weight);
+    const __m128i forward = _mm_set1_epi16(weight);
+    const __m128i round = _mm_set1_epi16(128);
+    const __m128i mask6 = _mm_set1_epi16(0x3F);
+    const __m128i mask5 = _mm_set1_epi16(0x1F);
+    int i = 0;
+
+    for(; i + 8 <= count; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(top + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(bottom + i));
+
+        __m128i red = _mm_add_epi16(_mm_mullo_epi16(_mm_srli_epi16(a, 11), inverse),
+                                    _mm_mullo_epi16(_mm_srli_epi16(b, 11), forward));
+        __m128i green = _mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(a, 5), mask6), inverse),
+                                      _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(b, 5), mask6), forward));
+        __m128i blue = _mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(a, mask5), inverse),
+                                     _mm_mullo_epi16(_mm_and_si128(b, mask5), forward));
+
+        red = _mm_srli_epi16(_mm_add_epi16(red, round), 8);
+        green = _mm_srli_epi16(_mm_add_epi16(green, round), 8);
+        blue = _mm_srli_epi16(_mm_add_epi16(blue, round), 8);
+
+        __m128i pixels = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(red, 11), _mm_slli_epi16(green, 5)), blue);
+        _mm_storeu_si128((__m128i *)(out + i), pixels);
+    }
+
+    LVScaler::blend_rows_scalar(top + i, bottom + i, out + i, count - i, weight);
+}
+
+#else
+
+void LVScaler::blend_rows_sse2(const uint16_t * top, const uint16_t * bottom, uint16_t * out, const int count, const int weight) {
+    LVScaler::blend_rows_scalar(top, bottom, out, count, weight);
+}
+
+#endif /* LV_X86 */
+
+/**
+ * @brief Build the horizontal tables and row buffers for a new size or filter
+ */
+void LVScaler::setup(const int src_width, const int dst_width) {
+    if(src_width == this->src_width && dst_width == this->dst_width && this->filter == this->tables_filter) {
+        return;
+    }
+
+    this->x_index.resize(dst_width);
+    this->x_weight.resize(dst_width);
+    for(int x = 0; x < dst_width; x++) {
+        int weight;
+        this->x_index[x] = LVScaler::map(x, dst_width, src_width, this->filter == FILTER_BILINEAR ? &weight : NULL);
+        this->x_weight[x] = this->filter == FILTER_BILINEAR ? weight : 0;
+    }
+
+    this->scratch.resize(src_width);
+    this->rows[0].resize(dst_width);
+    this->rows[1].resize(dst_width);
+    this->src_width = src_width;
+    this->dst_width = dst_width;
+    this->tables_filter = this->filter;
+}
+
+/**
+ * @brief Retrieve source row \a row, scaled horizontally, fetching it if it isn't cached
+ */
+const uint16_t * LVScaler::get_scaled_row(RowSource source, void * context, const int row) {
+    if(this->row_ids[0] == row) return &this->rows[0][0];
+    if(this->row_ids[1] == row) return &this->rows[1][0];
+
+    // Rows are fetched in order, so replace the older one
+    int slot = this->row_ids[0] < this->row_ids[1] ? 0 : 1;
+    this->scale_row(source(context, row, &this->scratch[0]), &this->rows[slot][0]);
+    this->row_ids[slot] = row;
+
+    return &this->rows[slot][0];
+}
+
+/**
+ * @brief Scale one row horizontally, from \c src_width to \c dst_width pixels
+ */
+void LVScaler::scale_row(const uint16_t * src, uint16_t * dst) const {
+    const int * index = &this->x_index[0];
+    const uint16_t * weight = &this->x_weight[0];
+
+    if(this->tables_filter == FILTER_NEAREST) {
+        for(int x = 0; x < this->dst_width; x++) {
+            dst[x] = src[index[x]];
+        }
+        return;
+    }
+
+    for(int x = 0; x < this->dst_width; x++) {
+        const uint16_t * p = src + index[x];
+        dst[x] = weight[x] == 0 ? p[0] : lv_blend565(p[0], p[1], weight[x]);
+    }
+}
+
+/**
+ * @brief Map output pixel \a dst to a source pixel, lining up pixel centres
+ *
+ * @param[in]  dst      The output pixel (column or row)
+ * @param[in]  dst_size The output size
+ * @param[in]  src_size The source size
+ * @param[out] weight   If not \c NULL, how much of the next source pixel to
+ *                      blend in, out of 256.  Always 0 at the last source pixel.
+ *                      If \c NULL, the nearest source pixel is returned.
+ * @return The source pixel
+ */
+int LVScaler::map(const int dst, const int dst_size, const int src_size, int * weight) {
+    if(weight == NULL) {
+        int nearest = (int)(((long long)(2 * dst + 1) * src_size) / (2 * dst_size));
+        return nearest < src_size ? nearest : src_size - 1;
+    }
+
+    // Source position of the output pixel's centre, in 16.16 fixed point
+    long long position = ((long long)(2 * dst + 1) * src_size * 32768) / dst_size - 32768;
+    if(position < 0) position = 0;
+
+    int index = position >> 16;
+    *weight = (position >> 8) & 0xFF;
+    if(index >= src_size - 1) {
+        index = src_size - 1;
+        *weight = 0;
+    }
+
+    return index;
+}
+
+} /* namespace PTP */
@@ -0,0 +1,68 @@
+#ifndef LIBPTP_PP_LVSCALER_H_
+#define LIBPTP_PP_LVSCALER_H_
+
+#include <vector>
+#include <stdint.h>
+
+namespace PTP {
+
+    /**
+     * @class LVScaler
+     * @brief Scales RGB565 frames to a display size in a single pass
+     *
+     * Each output pixel is written exactly once.  Source rows are fetched one
+     * at a time through a \c LVScaler::RowSource, so they can be converted
+     * from YUV just before they are scaled (see \c LVData::get_rgb_scaled),
+     * rather than converting the whole frame and then stretching it.
+     *
+     * Bilinear filtering scales each source row horizontally once, keeps the
+     * two most recent rows, and blends them vertically with SIMD where
+     * available.  An \c LVScaler keeps its tables and row buffers between
+     * frames, so reusing one for a stream of same-sized frames doesn't
+     * allocate.
+     */
+    class LVScaler {
+        public:
+            enum Filter {
+                FILTER_NEAREST = 0,
+                FILTER_BILINEAR
+            };
+            /**
+             * Return source row \a row, either by filling in \a scratch (which
+             * holds a full source row) or by pointing at the row directly.
+             */
+            typedef const uint16_t * (*RowSource)(void * context, const int row, uint16_t * scratch);
+
+            LVScaler(const Filter filter=FILTER_BILINEAR);
+            void set_filter(const Filter filter);
+            Filter get_filter() const;
+            void scale(const uint16_t * src, const int src_width, const int src_height, const int src_pitch,
+                       uint8_t * dst, const int dst_width, const int dst_height, const int dst_pitch);
+            void scale(RowSource source, void * context, const int src_width, const int src_height,
+                       uint8_t * dst, const int dst_width, const int dst_height, const int dst_pitch);
+
+            static void blend_rows(const uint16_t * top, const uint16_t * bottom, uint16_t * out, const int count, const int weight);
+            static void blend_rows_scalar(const uint16_t * top, const uint16_t * bottom, uint16_t * out, const int count, const int weight);
+            static void blend_rows_sse2(const uint16_t * top, const uint16_t * bottom, uint16_t * out, const int count, const int weight);
+            static void blend_rows_neon(const uint16_t * top, const uint16_t * bottom, uint16_t * out, const int count, const int weight);
+
+        private:
+            Filter filter;
+            int src_width;
+            int dst_width;
+            Filter tables_filter;
+            std::vector<int> x_index;           // Leftmost source pixel for each output pixel
+            std::vector<uint16_t> x_weight;     // Weight of the pixel to its right, out of 256
+            std::vector<uint16_t> scratch;      // One source row
+            std::vector<uint16_t> rows[2];      // Horizontally scaled source rows
+            int row_ids[2];                     // Which source row is in each of rows[], or -1
+
+            void setup(const int src_width, const int dst_width);
+            const uint16_t * get_scaled_row(RowSource source, void * context, const int row);
+            void scale_row(const uint16_t * src, uint16_t * dst) const;
+            static int map(const int dst, const int dst_size, const int src_size, int * weight);
+    };
+
+}
+
+#endif /* LIBPTP_PP_LVSCALER_H_ */
@@ -0,0 +1,61 @@
+/**
+ * @file LVScaler_neon.cpp
+ *
+ * @brief NEON row blending for \c LVScaler
+ *
+ * Built with \c -mfpu=neon like LVConverter_neon.cpp, and only used when
+ * \c LVConverter reports NEON is available.
+ */
+
+#include <stdint.h>
+
+#include "LVScaler.hpp"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define LV_NEON 1
+#endif
+
+namespace PTP {
+
+#ifdef LV_NEON
+
+/**
+ * @brief Blend two rows of RGB565 pixels using NEON
+ * @see LVScaler::blend_rows_scalar
+ */
+void LVScaler::blend_rows_neon(const uint16_t * top, const uint16_t * bottom, uint16_t * out, const int count, const int weight) {
+    const uint16x8_t inverse = vdupq_n_u16(256 - weight);
+    const uint16x8_t forward = vdupq_n_u16(weight);
+    const uint16x8_t round = vdupq_n_u16(128);
+    const uint16x8_t mask6 = vdupq_n_u16(0x3F);
+    const uint16x8_t mask5 = vdupq_n_u16(0x1F);
+    int i = 0;
+
+    for(; i + 8 <= count; i += 8) {
+        uint16x8_t a = vld1q_u16(top + i);
+        uint16x8_t b = vld1q_u16(bottom + i);
+
+        uint16x8_t red = vmlaq_u16(vmlaq_u16(round, vshrq_n_u16(a, 11), inverse), vshrq_n_u16(b, 11), forward);
+        uint16x8_t green = vmlaq_u16(vmlaq_u16(round, vandq_u16(vshrq_n_u16(a, 5), mask6), inverse),
+                                     vandq_u16(vshrq_n_u16(b, 5), mask6), forward);
+        uint16x8_t blue = vmlaq_u16(vmlaq_u16(round, vandq_u16(a, mask5), inverse), vandq_u16(b, mask5), forward);
+
+        uint16x8_t pixels = vshlq_n_u16(vshrq_n_u16(red, 8), 11);
+        pixels = vorrq_u16(pixels, vshlq_n_u16(vshrq_n_u16(green, 8), 5));
+        pixels = vorrq_u16(pixels, vshrq_n_u16(blue, 8));
+        vst1q_u16(out + i, pixels);
+    }
+
+    LVScaler::blend_rows_scalar(top + i, bottom + i, out + i, count - i, weight);
+}
+
+#else
+
+void LVScaler::blend_rows_neon(const uint16_t * top, const uint16_t * bottom, uint16_t * out, const int count, const int weight) {
+    LVScaler::blend_rows_scalar(top, bottom, out, count, weight);
+}
+
+#endif /* LV_NEON */
+
+} /* namespace PTP */
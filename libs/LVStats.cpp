@@ -0,0 +1,308 @@
+/**
+ * @file LVStats.cpp
+ *
+ * @brief Luma statistics for exposure and focus assist
+ *
+ * Each kernel takes a run of Y samples (at most a row, since sharpness
+ * compares neighbours), counts them into the histogram, and folds them into
+ * the minimum, maximum, sum and gradient.  The SSE2 kernel gets the sums from
+ * \c _mm_sad_epu8: against zero for the sum, and against the same samples one
+ * along for the gradient.
+ */
+
+#include <cstring>
+#include <stdint.h>
+
+#include "LVStats.hpp"
+#include "LVConverter.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#define LV_X86 1
+#define LV_TARGET_SSE2 __attribute__((target("sse2")))
+#endif
+
+namespace PTP {
+
+static const int lv_stats_chunk = 256;  // Groups extracted at a time by LVStats::add_row
+
+/**
+ * @brief Start out with no samples
+ */
+LVStats::LVStats() {
+    this->reset();
+}
+
+/**
+ * @brief Forget every sample added so far, to start on a new frame
+ */
+void LVStats::reset() {
+    std::memset(this->histogram, 0, sizeof(this->histogram));
+    this->sum = 0;
+    this->gradient = 0;
+    this->count = 0;
+    this->pairs = 0;
+    this->min = 255;
+    this->max = 0;
+}
+
+/**
+ * @brief Add the Y samples of a row of UYVYYY groups
+ *
+ * The samples are copied out with \c LVConverter::extract_luma_row a few
+ * hundred groups at a time, into a buffer that stays in cache.  Call this
+ * right after converting the row, while it's still in cache too.
+ *
+ * @param[in] yuv    The first byte of the first group
+ * @param[in] groups The number of groups (four pixels each) in the row
+ * @param[in] skip   If true, only add Y0 and Y1 of each group
+ */
+void LVStats::add_row(const uint8_t * yuv, const int groups, const bool skip) {
+    uint8_t luma[lv_stats_chunk * 4];
+    int per_group = skip ? 2 : 4;
+    int last = 0;
+
+    for(int i = 0; i < groups; i += lv_stats_chunk, yuv += lv_stats_chunk * 6) {
+        int n = groups - i < lv_stats_chunk ? groups - i : lv_stats_chunk;
+        LVConverter::extract_luma_row(yuv, luma, n, skip, false);
+        if(i > 0) {
+            // The pair straddling the chunks
+            this->gradient += luma[0] > last ? luma[0] - last : last - luma[0];
+            this->pairs++;
+        }
+        this->add_luma(luma, n * per_group);
+        last = luma[n * per_group - 1];
+    }
+}
+
+/**
+ * @brief Add a run of Y samples, with the fastest kernel this CPU supports
+ *
+ * @param[in] luma  The first sample
+ * @param[in] count The number of samples.  They're taken to be neighbours in
+ *                  a row (for sharpness), so don't run past the end of one.
+ * @see LVStats::add_luma_scalar
+ */
+void LVStats::add_luma(const uint8_t * luma, const int count) {
+    typedef void (LVStats::*AddFunction)(const uint8_t *, const int);
+    static AddFunction add = NULL;
+
+    if(add == NULL) {
+        if(LVConverter::is_supported(LVConverter::KERNEL_NEON)) {
+            add = &LVStats::add_luma_neon;
+        } else if(LVConverter::is_supported(LVConverter::KERNEL_SSE2)) {
+            add = &LVStats::add_luma_sse2;
+        } else {
+            add = &LVStats::add_luma_scalar;
+        }
+    }
+
+    (this->*add)(luma, count);
+}
+
+/**
+ * @brief Add the samples gathered by \a other, e.g. from another band of the same frame
+ */
+void LVStats::merge(const LVStats& other) {
+    for(int i = 0; i < 4; i++) {
+        for(int j = 0; j < 256; j++) {
+            this->histogram[i][j] += other.histogram[i][j];
+        }
+    }
+    this->sum += other.sum;
+    this->gradient += other.gradient;
+    this->count += other.count;
+    this->pairs += other.pairs;
+    if(other.min < this->min) this->min = other.min;
+    if(other.max > this->max) this->max = other.max;
+}
+
+/**
+ * @brief Retrieve the number of samples added
+ */
+uint32_t LVStats::get_count() const {
+    return this->count;
+}
+
+/**
+ * @brief Retrieve the darkest sample, or 0 if there are none
+ */
+uint8_t LVStats::get_min() const {
+    return this->count > 0 ? this->min : 0;
+}
+
+/**
+ * @brief Retrieve the brightest sample, or 0 if there are none
+ */
+uint8_t LVStats::get_max() const {
+    return this->max;
+}
+
+/**
+ * @brief Retrieve the mean sample, rounded, or 0 if there are none
+ */
+uint8_t LVStats::get_mean() const {
+    return this->count > 0 ? (this->sum + this->count / 2) / this->count : 0;
+}
+
+/**
+ * @brief Retrieve the mean absolute difference between neighbouring samples, in 256ths
+ *
+ * Higher is sharper.  Only compare it between frames of the same scene.
+ */
+uint32_t LVStats::get_sharpness() const {
+    return this->pairs > 0 ? (this->gradient * 256 + this->pairs / 2) / this->pairs : 0;
+}
+
+/**
+ * @brief Retrieve the number of samples at or below \a level
+ */
+uint32_t LVStats::get_clipped_low(const int level) const {
+    uint32_t clipped = 0;
+    for(int i = 0; i <= level && i < 256; i++) {
+        clipped += this->histogram[0][i] + this->histogram[1][i] + this->histogram[2][i] + this->histogram[3][i];
+    }
+    return clipped;
+}
+
+/**
+ * @brief Retrieve the number of samples at or above \a level
+ */
+uint32_t LVStats::get_clipped_high(const int level) const {
+    uint32_t clipped = 0;
+    for(int i = level > 0 ? level : 0; i < 256; i++) {
+        clipped += this->histogram[0][i] + this->histogram[1][i] + this->histogram[2][i] + this->histogram[3][i];
+    }
+    return clipped;
+}
+
+/**
+ * @brief Retrieve the histogram, with \a bins equal ranges of Y
+ *
+ * @param[out] out  Where to write the number of samples in each bin
+ * @param[in]  bins The number of bins, from 1 to 256
+ */
+void LVStats::get_histogram(uint32_t * out, const int bins) const {
+    std::memset(out, 0, bins * sizeof(uint32_t));
+    for(int i = 0; i < 256; i++) {
+        out[i * bins / 256] += this->histogram[0][i] + this->histogram[1][i] + this->histogram[2][i] + this->histogram[3][i];
+    }
+}
+
+/**
+ * @brief Count every sample of a run into the histogram
+ */
+void LVStats::add_histogram(const uint8_t * luma, const int count) {
+    int i = 0;
+
+    for(; i + 4 <= count; i += 4) {
+        this->histogram[0][luma[i]]++;
+        this->histogram[1][luma[i + 1]]++;
+        this->histogram[2][luma[i + 2]]++;
+        this->histogram[3][luma[i + 3]]++;
+    }
+    for(; i < count; i++) {
+        this->histogram[i & 3][luma[i]]++;
+    }
+
+    this->count += count;
+}
+
+/**
+ * @brief Fold samples [start, count) of a run into the minimum, maximum, sum and gradient
+ *
+ * The gradient's pairs before \a start must already have been added.
+ */
+void LVStats::add_tail(const uint8_t * luma, const int start, const int count) {
+    for(int i = start; i < count; i++) {
+        if(luma[i] < this->min) this->min = luma[i];
+        if(luma[i] > this->max) this->max = luma[i];
+        this->sum += luma[i];
+        if(i + 1 < count) {
+            this->gradient += luma[i + 1] > luma[i] ? luma[i + 1] - luma[i] : luma[i] - luma[i + 1];
+            this->pairs++;
+        }
+    }
+}
+
+/**
+ * @brief Add a run of Y samples using plain C++
+ *
+ * This is the reference the SIMD kernels must match.
+ *
+ * @param[in] luma  The first sample
+ * @param[in] count The number of samples, neighbours in a row
+ */
+void LVStats::add_luma_scalar(const uint8_t * luma, const int count) {
+    if(count <= 0) {
+        return;
+    }
+
+    this->add_histogram(luma, count);
+    this->add_tail(luma, 0, count);
+}
+
+#ifdef LV_X86
+
+/**
+ * @brief Add a run of Y samples using SSE2
+ * @see LVStats::add_luma_scalar
+ */
+LV_TARGET_SSE2 void LVStats::add_luma_sse2(const uint8_t * luma, const int count) {
+    if(count <= 0) {
+        return;
+    }
+
+    this->add_histogram(luma, count);
+
+    const __m128i zero = _mm_setzero_si128();
+    __m128i low = _mm_set1_epi8((char)0xFF);
+    __m128i high = zero;
+    __m128i sum = zero;
+    __m128i gradient = zero;
+    int i = 0;
+
+    // Each step reads one sample past the sixteen, for the last one's neighbour
+    for(; i + 17 <= count; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(luma + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(luma + i + 1));
+        low = _mm_min_epu8(low, a);
+        high = _mm_max_epu8(high, a);
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(a, zero));
+        gradient = _mm_add_epi64(gradient, _mm_sad_epu8(a, b));
+    }
+
+    if(i > 0) {
+        low = _mm_min_epu8(low, _mm_srli_si128(low, 8));
+        low = _mm_min_epu8(low, _mm_srli_si128(low, 4));
+        low = _mm_min_epu8(low, _mm_srli_si128(low, 2));
+        low = _mm_min_epu8(low, _mm_srli_si128(low, 1));
+        high = _mm_max_epu8(high, _mm_srli_si128(high, 8));
+        high = _mm_max_epu8(high, _mm_srli_si128(high, 4));
+        high = _mm_max_epu8(high, _mm_srli_si128(high, 2));
+        high = _mm_max_epu8(high, _mm_srli_si128(high, 1));
+        uint8_t min = _mm_cvtsi128_si32(low) & 0xFF;
+        uint8_t max = _mm_cvtsi128_si32(high) & 0xFF;
+        if(min < this->min) this->min = min;
+        if(max > this->max) this->max = max;
+
+        uint64_t sums[2], gradients[2];
+        _mm_storeu_si128((__m128i *)sums, sum);
+        _mm_storeu_si128((__m128i *)gradients, gradient);
+        this->sum += sums[0] + sums[1];
+        this->gradient += gradients[0] + gradients[1];
+        this->pairs += i;
+    }
+
+    this->add_tail(luma, i, count);
+}
+
+#else
+
+void LVStats::add_luma_sse2(const uint8_t * luma, const int count) {
+    this->add_luma_scalar(luma, count);
+}
+
+#endif /* LV_X86 */
+
+} /* namespace PTP */
@@ -0,0 +1,69 @@
+#ifndef LIBPTP_PP_LVSTATS_H_
+#define LIBPTP_PP_LVSTATS_H_
+
+#include <stdint.h>
+
+namespace PTP {
+
+    /**
+     * @class LVStats
+     * @brief Exposure and focus statistics of a frame's luma
+     *
+     * Gathered a row at a time, while the row is being converted (see
+     * \c LVData::set_stats), so the frame is only read once: a histogram of
+     * Y, its minimum, maximum and mean, how much of it is clipped at either
+     * end, and how sharp it is.
+     *
+     * Sharpness is the mean absolute difference between horizontally
+     * neighbouring samples.  It means nothing on its own (it depends on the
+     * scene), but rises as the picture comes into focus, so it's good for
+     * focus assist, or for telling how murky the water is.
+     *
+     * Everything but the histogram uses SIMD where the CPU has it.  Scatters
+     * don't vectorize, so the histogram is counted into four interleaved
+     * tables instead, to keep neighbouring samples from waiting on each
+     * other's counters, and folded when read.  Statistics from several bands
+     * of a frame can be combined with \c LVStats::merge.
+     */
+    class LVStats {
+        public:
+            enum {
+                CLIPPED_LOW = 4,        // Samples at or below this are clipped black
+                CLIPPED_HIGH = 251      // Samples at or above this are clipped white
+            };
+
+            LVStats();
+            void reset();
+            void add_row(const uint8_t * yuv, const int groups, const bool skip);
+            void add_luma(const uint8_t * luma, const int count);
+            void merge(const LVStats& other);
+
+            uint32_t get_count() const;
+            uint8_t get_min() const;
+            uint8_t get_max() const;
+            uint8_t get_mean() const;
+            uint32_t get_sharpness() const;
+            uint32_t get_clipped_low(const int level=CLIPPED_LOW) const;
+            uint32_t get_clipped_high(const int level=CLIPPED_HIGH) const;
+            void get_histogram(uint32_t * out, const int bins) const;
+
+            void add_luma_scalar(const uint8_t * luma, const int count);
+            void add_luma_sse2(const uint8_t * luma, const int count);
+            void add_luma_neon(const uint8_t * luma, const int count);
+
+        private:
+            uint32_t histogram[4][256]; // Sample i is counted in histogram[i % 4]
+            uint64_t sum;
+            uint64_t gradient;          // Sum of |Y[i + 1] - Y[i]| along each row
+            uint32_t count;
+            uint32_t pairs;             // Neighbouring pairs in gradient
+            uint8_t min;
+            uint8_t max;
+
+            void add_histogram(const uint8_t * luma, const int count);
+            void add_tail(const uint8_t * luma, const int start, const int count);
+    };
+
+}
+
+#endif /* LIBPTP_PP_LVSTATS_H_ */
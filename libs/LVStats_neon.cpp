@@ -0,0 +1,78 @@
+/**
+ * @file LVStats_neon.cpp
+ *
+ * @brief NEON kernel for \c LVStats
+ *
+ * Built with \c -mfpu=neon like LVConverter_neon.cpp, and only used when
+ * \c LVConverter reports NEON is available.
+ */
+
+#include <stdint.h>
+
+#include "LVStats.hpp"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define LV_NEON 1
+#endif
+
+namespace PTP {
+
+#ifdef LV_NEON
+
+/**
+ * @brief Add a run of Y samples using NEON
+ * @see LVStats::add_luma_scalar
+ */
+void LVStats::add_luma_neon(const uint8_t * luma, const int count) {
+    if(count <= 0) {
+        return;
+    }
+
+    this->add_histogram(luma, count);
+
+    uint8x16_t low = vdupq_n_u8(0xFF);
+    uint8x16_t high = vdupq_n_u8(0);
+    uint32x4_t sum = vdupq_n_u32(0);
+    uint32x4_t gradient = vdupq_n_u32(0);
+    int i = 0;
+
+    // Each step reads one sample past the sixteen, for the last one's neighbour
+    for(; i + 17 <= count; i += 16) {
+        uint8x16_t a = vld1q_u8(luma + i);
+        uint8x16_t b = vld1q_u8(luma + i + 1);
+        low = vminq_u8(low, a);
+        high = vmaxq_u8(high, a);
+        sum = vpadalq_u16(sum, vpaddlq_u8(a));
+        gradient = vpadalq_u16(gradient, vpaddlq_u8(vabdq_u8(a, b)));
+    }
+
+    if(i > 0) {
+        uint8x8_t min = vpmin_u8(vget_low_u8(low), vget_high_u8(low));
+        uint8x8_t max = vpmax_u8(vget_low_u8(high), vget_high_u8(high));
+        for(int j = 0; j < 3; j++) {
+            min = vpmin_u8(min, min);
+            max = vpmax_u8(max, max);
+        }
+        if(vget_lane_u8(min, 0) < this->min) this->min = vget_lane_u8(min, 0);
+        if(vget_lane_u8(max, 0) > this->max) this->max = vget_lane_u8(max, 0);
+
+        uint64x2_t sums = vpaddlq_u32(sum);
+        uint64x2_t gradients = vpaddlq_u32(gradient);
+        this->sum += vgetq_lane_u64(sums, 0) + vgetq_lane_u64(sums, 1);
+        this->gradient += vgetq_lane_u64(gradients, 0) + vgetq_lane_u64(gradients, 1);
+        this->pairs += i;
+    }
+
+    this->add_tail(luma, i, count);
+}
+
+#else
+
+void LVStats::add_luma_neon(const uint8_t * luma, const int count) {
+    this->add_luma_scalar(luma, count);
+}
+
+#endif /* LV_NEON */
+
+} /* namespace PTP */
@@ -46,17 +46,51 @@ PTPContainer::PTPContainer(uint16_t type, uint16_t op_code) {
  */
 PTPContainer::PTPContainer(const unsigned char * data) {
     // This is essentially lv_framebuffer_desc .unpack() function, in the form of a constructor
+    this->init();
     this->unpack(data);
 }
 
 /**
- * @brief Frees up memory malloc()ed by \c PTPContainer
+ * @brief Gives the payload buffer back to its pool
  */
 PTPContainer::~PTPContainer() {
-    if(this->payload != NULL) {
-        delete[] this->payload;    // Be sure to free up this memory
-        this->payload = NULL;
-    }
+}
+
+/**
+ * @brief Empty this \c PTPContainer, and make it a new one of \a type and \a op_code
+ *
+ * Like constructing a new container, except that the payload buffer is
+ * kept, so a container reused for every frame (or every command) doesn't
+ * go back to the pool for one.
+ *
+ * @param[in] type A \c PTP_CONTAINER_TYPE for this \c PTPContainer
+ * @param[in] op_code The operation for this \c PTPContainer
+ */
+void PTPContainer::reset(const uint16_t type, const uint16_t op_code) {
+    this->length = this->default_length;
+    this->type = type;
+    this->code = op_code;
+    this->transaction_id = 0;
+}
+
+/**
+ * @brief Trade contents (payload buffers included) with \a other, without copying either
+ */
+void PTPContainer::swap(PTPContainer& other) {
+    uint32_t length = this->length;
+    uint16_t type = this->type;
+    uint16_t code = this->code;
+    uint32_t transaction_id = this->transaction_id;
+    
+    this->length = other.length;
+    this->type = other.type;
+    this->code = other.code;
+    this->transaction_id = other.transaction_id;
+    other.length = length;
+    other.type = type;
+    other.code = code;
+    other.transaction_id = transaction_id;
+    this->payload.swap(other.payload);
 }
 
 /**
@@ -64,7 +98,22 @@ PTPContainer::~PTPContainer() {
  */
 void PTPContainer::init() {
     this->length = this->default_length; // Length is at least the sum of the header parts
-    this->payload = NULL;
+}
+
+/**
+ * @brief Make sure the payload buffer can hold at least \a capacity bytes
+ *
+ * The buffer only ever grows, so a container that is reused (for example, for
+ * every live view frame) stops allocating once it has seen the largest
+ * payload.  It comes from \c FrameBufferPool::get_default, so even containers
+ * made afresh for every frame reuse the same buffers.
+ *
+ * @param[in] capacity The number of payload bytes needed
+ * @param[in] keep     If true, keep the current payload contents when growing
+ */
+void PTPContainer::reserve_payload(const uint32_t capacity, const bool keep) {
+    // Leave room for the header in front, for PTPContainer::get_packed
+    this->payload.reserve(this->default_length + capacity, keep ? this->length : 0);
 }
 
 /**
@@ -78,21 +127,19 @@ void PTPContainer::init() {
  * @param[in] param The parameter to be added
  */
 void PTPContainer::add_param(const uint32_t param) {
-    // Allocate new memory for the payload
     uint32_t old_length = (this->length)-(this->default_length);
-    uint32_t new_length = this->length + sizeof(uint32_t);
-    unsigned char * new_payload = new unsigned char[new_length];
-    
-    // Copy old payload into new payload
-    std::memcpy(new_payload, this->payload, old_length);
-    // Copy new data into new payload
-    std::memcpy(new_payload + old_length, &param, sizeof(uint32_t));
-    // Free up old payload memory
-	delete[] this->payload;
-    // Change payload pointer to new payload
-    this->payload = new_payload;
+    
+    // Grow the payload by at least a few parameters at a time
+    if(this->payload.get() == NULL || old_length + sizeof(uint32_t) > this->get_payload_capacity()) {
+        uint32_t capacity = 2 * this->get_payload_capacity();
+        if(capacity < old_length + 4 * sizeof(uint32_t)) capacity = old_length + 4 * sizeof(uint32_t);
+        this->reserve_payload(capacity, true);
+    }
+    
+    // Copy new data into the end of the payload
+    std::memcpy(this->get_payload_data() + old_length, &param, sizeof(uint32_t));
     // Update length
-    this->length = new_length;
+    this->length = this->length + sizeof(uint32_t);
 }
 
 /**
@@ -107,19 +154,27 @@ void PTPContainer::add_param(const uint32_t param) {
  * @param[in] payload_length The amount of data to read from \a payload
  */
 void PTPContainer::set_payload(const void * payload, int payload_length) {
-    // Allocate new memory to copy the payload into
-    // This way, we can ensure that we always want to free() the memory
-    uint32_t new_length = this->default_length + payload_length;
-	unsigned char * new_payload = new unsigned char[payload_length];
-    
-    // Copy the payload over
-    std::memcpy(new_payload, payload, payload_length);
-    // Free up the old payload
-	delete[] this->payload;
-    // Change payload pointer to new payload
-    this->payload = new_payload;
-    // Update length
-    this->length = new_length;
+    // Copy the payload over, reusing our buffer if it's big enough
+    std::memcpy(this->resize_payload(payload_length), payload, payload_length);
+}
+
+/**
+ * @brief Set the payload size, and return the payload for the caller to fill in
+ *
+ * This lets large payloads (like live view frames) be written directly into
+ * the container, instead of being built elsewhere and copied in by
+ * \c PTPContainer::set_payload.  The buffer is reused if it is already big
+ * enough, so the payload's previous contents are only kept when it shrinks
+ * (handy for filling in a worst case size, then trimming it).
+ *
+ * @param[in] payload_length The number of bytes the payload should hold
+ * @return The address of the first byte of the payload
+ */
+unsigned char * PTPContainer::resize_payload(const int payload_length) {
+    this->reserve_payload(payload_length, false);
+    this->length = this->default_length + payload_length;
+    
+    return this->get_payload_data();
 }
 
 /**
@@ -138,15 +193,68 @@ void PTPContainer::set_payload(const void * payload, int payload_length) {
 unsigned char * PTPContainer::pack() const {
 	unsigned char * packed = new unsigned char[this->length];
     
-    uint32_t header_size = (sizeof this->length)+(sizeof this->type)+(sizeof this->code)+(sizeof this->transaction_id);
+    this->pack_into(packed);
     
+    return packed;
+}
+
+/**
+ * @brief Pack \c PTPContainer data into \a out, a buffer from the frame pool
+ *
+ * Unlike \c PTPContainer::pack, nothing needs freeing, and packing every
+ * frame into the same \a out (or one made afresh each time) doesn't
+ * allocate once the pool has a buffer big enough.
+ *
+ * @param[out] out Where to pack the data.  Grown if it's too small.
+ * @return The first byte of the packed data, in \a out
+ * @see PTPContainer::get_length
+ */
+unsigned char * PTPContainer::pack(FrameBuffer& out) const {
+    unsigned char * packed = out.reserve(this->length);
+    
+    this->pack_into(packed);
+    
+    return packed;
+}
+
+/**
+ * @brief Pack \c PTPContainer data in place, for sending without a copy
+ *
+ * The payload is kept after room for the header, so packing it only means
+ * filling the header in.  Nothing is copied or allocated, however big the
+ * payload.
+ *
+ * @return The first byte of the packed data (\c PTPContainer::get_length bytes),
+ *         valid until this \c PTPContainer is changed, or NULL if it has never
+ *         had a payload (pack it with \c PTPContainer::pack instead)
+ */
+const unsigned char * PTPContainer::get_packed() const {
+    unsigned char * packed = this->payload.get();
+    
+    if(packed != NULL) {
+        this->pack_header(packed);
+    }
+    return packed;
+}
+
+/**
+ * @brief Pack \c PTPContainer data into \a packed, which must hold \c PTPContainer::get_length bytes
+ */
+void PTPContainer::pack_into(unsigned char * packed) const {
+    this->pack_header(packed);
+    if(this->length > this->default_length) {
+        std::memcpy(packed + 12, this->get_payload_data(), this->length - this->default_length);  // The rest of payload
+    }
+}
+
+/**
+ * @brief Pack the \c PTPContainer header into the first 12 bytes of \a packed
+ */
+void PTPContainer::pack_header(unsigned char * packed) const {
     std::memcpy(packed, &(this->length), sizeof this->length);      // Copy length
     std::memcpy(packed + 4, &(this->type), sizeof this->type);      // Type
     std::memcpy(packed + 6, &(this->code), sizeof this->code);      // Two bytes of code
     std::memcpy(packed + 8, &(this->transaction_id), sizeof this->transaction_id);  // Four bytes of transaction ID
-    std::memcpy(packed + 12, this->payload, this->length - header_size);    // The rest of payload
-    
-    return packed;
 }
 
 /**
@@ -161,11 +269,26 @@ unsigned char * PTPContainer::get_payload(int * size_out) {
     *size_out = this->length - this->default_length;
     
 	out = new unsigned char[*size_out];
-    std::memcpy(out, this->payload, *size_out);
+    std::memcpy(out, this->get_payload_data(), *size_out);
     
     return out;
 }
 
+/**
+ * @brief Retrieve the payload stored in this \c PTPContainer, without copying it
+ *
+ * @warning The pointer is only valid until this \c PTPContainer is changed
+ *          or destroyed.
+ *
+ * @param[out] size_out The size of the payload
+ * @return The address of the first byte of the payload
+ */
+const unsigned char * PTPContainer::get_payload_pointer(int * size_out) const {
+    *size_out = this->length - this->default_length;
+    
+    return this->get_payload_data();
+}
+
 /**
  * @brief Retrieve the size of all data stored in the payload
  *
@@ -191,12 +314,35 @@ uint32_t PTPContainer::get_length() const {
  *                 in length.
  */
 void PTPContainer::unpack(const unsigned char * data) {
-    // Free up our current payload
-	delete[] this->payload;
-    this->payload = NULL;
+    // Copy over the payload, into our old buffer if it fits
+    unsigned char * payload = this->unpack_header(data);
+    std::memcpy(payload, data + 12, this->length - 12);
+    
+    // Since we copied all of this data, the data passed in can be free()d
+}
+
+/**
+ * @brief Unpack just the header of a PTP message, and make room for its payload
+ *
+ * For reading a message straight into the container: the caller fills in
+ * the payload returned, rather than reading the whole message into a
+ * buffer of its own for \c PTPContainer::unpack to copy.
+ *
+ * @param[in] data The first 12 bytes of the message
+ * @return The first byte of the payload, to be filled in with
+ *         \c PTPContainer::get_length - 12 bytes
+ * @exception PTP::ERR_PTPCONTAINER_INVALID_PARAM If the length in the header is less than the header's
+ */
+unsigned char * PTPContainer::unpack_header(const unsigned char * data) {
+    uint32_t length;
     
     // First four bytes are the length
-    std::memcpy(&this->length, data, 4);
+    std::memcpy(&length, data, 4);
+    if(length < this->default_length) {
+        throw PTP::ERR_PTPCONTAINER_INVALID_PARAM;
+        return NULL;
+    }
+    this->length = length;
     // Next, container type
     std::memcpy(&this->type, data + 4, 2);
     // Copy over code
@@ -204,11 +350,8 @@ void PTPContainer::unpack(const unsigned char * data) {
     // And transaction ID...
     std::memcpy(&this->transaction_id, data + 8, 4);
     
-    // Finally, copy over the payload
-	this->payload = new unsigned char[this->length - 12];
-    std::memcpy(this->payload, data + 12, this->length - 12);
-    
-    // Since we copied all of this data, the data passed in can be free()d
+    this->reserve_payload(this->length - 12, false);
+    return this->get_payload_data();
 }
 
 /**
@@ -223,7 +366,7 @@ uint32_t PTPContainer::get_param_n(const uint32_t n) const {
     uint32_t out;
     uint32_t first_byte;
     
-    if(this->payload == NULL) {
+    if(this->payload.get() == NULL) {
         throw PTP::ERR_PTPCONTAINER_NO_PAYLOAD;
         return 0;
     }
@@ -238,18 +381,32 @@ uint32_t PTPContainer::get_param_n(const uint32_t n) const {
         return 0;
     }
     
-    std::memcpy(&out, payload + first_byte, 4); // Copy parameter into out
+    std::memcpy(&out, this->get_payload_data() + first_byte, 4); // Copy parameter into out
     
     return out; // Return parameter
 }
 
+/**
+ * @brief Retrieve the first byte of the payload, after the room kept for the header, or NULL if there's no buffer
+ */
+unsigned char * PTPContainer::get_payload_data() const {
+    return this->payload.get() != NULL ? this->payload.get() + this->default_length : NULL;
+}
+
+/**
+ * @brief Retrieve how many payload bytes fit in the buffer
+ */
+uint32_t PTPContainer::get_payload_capacity() const {
+    return this->payload.get_capacity() > this->default_length ? this->payload.get_capacity() - this->default_length : 0;
+}
+
 /**
  * @brief Determines if this PTPContainer contains data
  * 
- * @return True if payload is a null pointer
+ * @return True if there's no payload (never was, or it was \c PTPContainer::reset)
  */
 bool PTPContainer::is_empty() const {
-    return (this->payload == NULL);
+    return (this->payload.get() == NULL || this->length == this->default_length);
 }
 
 } /* namespace PTP */
@@ -1,14 +1,22 @@
 #ifndef LIBPTP_PP_PTPCONTAINER_H_
 #define LIBPTP_PP_PTPCONTAINER_H_
 
+#include "FrameBufferPool.hpp"
+
 namespace PTP {
 
     class PTPContainer {
         private:
             static const uint32_t default_length = sizeof(uint32_t)+sizeof(uint32_t)+sizeof(uint16_t)+sizeof(uint16_t);
             uint32_t length;
-            unsigned char * payload;    // We'll deal with this completely internally
+            FrameBuffer payload;        // We'll deal with this completely internally. Room for the header, then the
+                                        //  payload, and maybe more than we're using.
             void init();
+            void reserve_payload(const uint32_t capacity, const bool keep);
+            void pack_into(unsigned char * packed) const;
+            void pack_header(unsigned char * packed) const;
+            unsigned char * get_payload_data() const;
+            uint32_t get_payload_capacity() const;
         public:
             enum CONTAINER_TYPE {
                 CONTAINER_TYPE_COMMAND  = 1,
@@ -24,12 +32,19 @@ namespace PTP {
             PTPContainer(const uint16_t type, const uint16_t op_code);
             PTPContainer(const unsigned char * data);
             ~PTPContainer();
+            void reset(const uint16_t type=0, const uint16_t op_code=0);
+            void swap(PTPContainer& other);
             void add_param(const uint32_t param);
             void set_payload(const void * payload, const int payload_length);
+            unsigned char * resize_payload(const int payload_length);
             unsigned char * pack() const;
+            unsigned char * pack(FrameBuffer& out) const;
+            const unsigned char * get_packed() const;
             unsigned char * get_payload(int * size_out);  // This might end up being useful...
+            const unsigned char * get_payload_pointer(int * size_out) const;
             uint32_t get_length() const;  // So we can get, but not set
             void unpack(const unsigned char * data);
+            unsigned char * unpack_header(const unsigned char * data);
             uint32_t get_param_n(const uint32_t n) const;
             bool is_empty() const;
     };
@@ -11,9 +11,15 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <time.h>
+#include <netinet/tcp.h>
 
 namespace PTP {
 
+std::map<std::string, PTPNetwork::ResolvedHost> PTPNetwork::resolve_cache;
+
 PTPNetwork::PTPNetwork() {
     this->init();
 }
@@ -29,12 +35,7 @@ PTPNetwork::PTPNetwork(int port) {
 }
 
 PTPNetwork::~PTPNetwork() {
-    if(this->is_server()) {
-        ::close(this->client_sock);
-        ::close(this->server_sock);
-    } else {
-        ::close(this->client_sock);
-    }
+    this->close();
 }
 
 void PTPNetwork::init() {
@@ -42,110 +43,387 @@ void PTPNetwork::init() {
     this->server_sock = -1;
 }
 
-bool PTPNetwork::connect(std::string server, int port) {
-    this->client_sock = ::socket(AF_INET, SOCK_STREAM, 0); 
-    if (this->client_sock == -1)
-    {
-        throw PTPNetwork::ERR_CONNECT;
-        return false;
+/**
+ * @brief Close \a sock (if it is open) and mark it as closed
+ */
+void PTPNetwork::close_socket(int * sock) {
+    if(*sock != -1) {
+        ::close(*sock);
+        *sock = -1;
+    }
+}
+
+/**
+ * @brief Turn off Nagle's algorithm on the connected socket
+ *
+ * A PTP transaction is several small writes in a row (command, then data).
+ * With Nagle, each small write after the first waits for the other end to
+ * ACK the previous one, adding a delayed-ACK timeout to every transaction.
+ */
+void PTPNetwork::set_nodelay() {
+    int on = 1;
+    setsockopt(this->client_sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+}
+
+/**
+ * @brief Drop the connection to the other end, but keep listening if we are
+ *        a server.  A server can then call \c PTPNetwork::accept_client to
+ *        wait for the other end to come back.
+ */
+void PTPNetwork::close_client() {
+    this->close_socket(&this->client_sock);
+}
+
+/**
+ * @brief Close all sockets held by this \c PTPNetwork
+ */
+void PTPNetwork::close() {
+    this->close_socket(&this->client_sock);
+    this->close_socket(&this->server_sock);
+}
+
+/**
+ * @brief Look up every address (IPv4 and IPv6) for \a host
+ *
+ * Results are cached for \c resolve_cache_ttl_s seconds, so retrying a
+ * connection in a loop doesn't repeat the (blocking) lookup every time.
+ *
+ * @param[in] host The hostname or numeric address to look up
+ * @param[in] port The port to fill in to the returned addresses
+ * @return The cached lookup result
+ * @exception PTPNetwork::ERR_IP if the host has no addresses
+ */
+const PTPNetwork::ResolvedHost& PTPNetwork::resolve(const std::string& host, const int port) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    
+    char key_port[16];
+    snprintf(key_port, sizeof key_port, "%d", port);
+    std::string key = host + "/" + key_port;
+    
+    std::map<std::string, ResolvedHost>::iterator cached = PTPNetwork::resolve_cache.find(key);
+    if(cached != PTPNetwork::resolve_cache.end() &&
+        now.tv_sec - cached->second.resolved_at < PTPNetwork::resolve_cache_ttl_s) {
+        return cached->second;
     }
     
-    // Perform a lookup of the hostname
-    struct hostent *he;
-    he = ::gethostbyname(server.c_str());
-    if(he == NULL || he->h_length == 0) {
+    struct addrinfo hints;
+    struct addrinfo * results = NULL;
+    std::memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;        // IPv4 or IPv6, whichever the host has
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_ADDRCONFIG;
+    // getaddrinfo is reentrant, unlike gethostbyname
+    if(::getaddrinfo(host.c_str(), key_port, &hints, &results) != 0 || results == NULL) {
         throw PTPNetwork::ERR_IP;
-        return false;
     }
+    
+    ResolvedHost resolved;
+    for(struct addrinfo * ai = results; ai != NULL; ai = ai->ai_next) {
+        struct sockaddr_storage addr;
+        std::memset(&addr, 0, sizeof addr);
+        std::memcpy(&addr, ai->ai_addr, ai->ai_addrlen);
+        resolved.addrs.push_back(addr);
+        resolved.addr_lens.push_back(ai->ai_addrlen);
+    }
+    resolved.resolved_at = now.tv_sec;
+    ::freeaddrinfo(results);
+    
+    PTPNetwork::resolve_cache[key] = resolved;
+    return PTPNetwork::resolve_cache[key];
+}
+
+/**
+ * @brief Forget all cached host lookups (e.g. after changing /etc/hosts)
+ */
+void PTPNetwork::flush_resolve_cache() {
+    PTPNetwork::resolve_cache.clear();
+}
+
+/**
+ * @brief Format \a addr as a numeric IPv4 or IPv6 address
+ */
+std::string PTPNetwork::address_string(const struct sockaddr_storage * addr) {
+    char host[NI_MAXHOST];
+    if(::getnameinfo((const struct sockaddr *)addr, sizeof(struct sockaddr_storage), host, sizeof host, NULL, 0, NI_NUMERICHOST) != 0) {
+        return "?";
+    }
+    return host;
+}
 
-    std::memset(&this->server, 0, sizeof(this->server));  
-    this->server.sin_family = AF_INET;
-    std::memcpy(&this->server.sin_addr, he->h_addr_list[0], he->h_length);
-    this->server.sin_port = htons(port);
+/**
+ * @brief Connect to \a server on \a port
+ *
+ * Every address \a server resolves to is tried at the same time with
+ * non-blocking connects, and the first one to connect wins.  This way, a
+ * host with an unreachable IPv6 (or IPv4) address doesn't stall us.
+ *
+ * @param[in] server The hostname or address to connect to
+ * @param[in] port The port to connect to
+ * @param[in] timeout_ms (optional) How long to wait for any address to connect
+ * @return true on success
+ * @exception PTPNetwork::ERR_IP if \a server can't be resolved
+ * @exception PTPNetwork::ERR_CONNECT if no address connected in time
+ */
+bool PTPNetwork::connect(std::string server, int port, const int timeout_ms) {
+    // Connecting again (after losing the link) replaces the old socket
+    this->close_socket(&this->client_sock);
     
-    // TODO: Move timeout set to a different location
-    /*
-    struct timeval tv;
-    tv.tv_sec = 1;
-    tv.tv_usec = 0;
-    if(setsockopt(this->client_sock, SOL_SOCKET, SO_RCVTIMEO, (char *)&tv, sizeof tv))
-    {
-        throw PTPNetwork::ERR_SET_RECV_TIMEOUT;
-        return false;
-	}
-    if(setsockopt(this->client_sock, SOL_SOCKET, SO_SNDTIMEO, (char *)&tv,  sizeof tv))
-    {
-        throw PTPNetwork::ERR_SET_SEND_TIMEOUT;
-        return false;
+    const ResolvedHost& host = PTPNetwork::resolve(server, port);
+    int count = host.addrs.size();
+    std::vector<struct pollfd> pfds(count);
+    int pending = 0;
+    
+    // Start connecting to every address at once
+    for(int i = 0; i < count; i++) {
+        pfds[i].fd = -1;
+        pfds[i].events = POLLOUT;
+        pfds[i].revents = 0;
+        
+        int sock = ::socket(host.addrs[i].ss_family, SOCK_STREAM, 0);
+        if(sock == -1) continue;
+        ::fcntl(sock, F_SETFL, ::fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+        
+        if(::connect(sock, (const struct sockaddr *)&host.addrs[i], host.addr_lens[i]) == 0 || errno == EINPROGRESS) {
+            pfds[i].fd = sock;
+            pending++;
+        } else {
+            ::close(sock);
+        }
     }
-    * */
     
-    std::cout << "Host: " << server << " PORT: " << port << std::endl;
-    if(::connect(this->client_sock, (struct sockaddr*)&this->server, sizeof(this->server)) != 0 )
-    {
-        ::close(this->client_sock);
+    // Wait for the first one to finish connecting
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int remaining_ms = timeout_ms;
+    int winner = -1;
+    while(winner == -1 && pending > 0 && remaining_ms >= 0) {
+        if(::poll(&pfds[0], count, remaining_ms) < 0 && errno != EINTR) {
+            break;
+        }
+        
+        for(int i = 0; i < count && winner == -1; i++) {
+            if(pfds[i].fd == -1 || pfds[i].revents == 0) continue;
+            
+            int err = 0;
+            socklen_t err_len = sizeof err;
+            ::getsockopt(pfds[i].fd, SOL_SOCKET, SO_ERROR, &err, &err_len);
+            if(err == 0) {
+                winner = i;
+            } else {
+                // This address refused us -- keep waiting on the others
+                ::close(pfds[i].fd);
+                pfds[i].fd = -1;
+                pending--;
+            }
+        }
+        
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        remaining_ms = timeout_ms - ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000);
+    }
+    
+    // Drop the losers
+    for(int i = 0; i < count; i++) {
+        if(i != winner && pfds[i].fd != -1) {
+            ::close(pfds[i].fd);
+        }
+    }
+    
+    if(winner == -1) {
 		throw PTPNetwork::ERR_CONNECT;
         return false;
     }
+    
+    // Back to blocking -- timeouts are set once connected with PTPNetwork::set_timeout
+    this->client_sock = pfds[winner].fd;
+    ::fcntl(this->client_sock, F_SETFL, ::fcntl(this->client_sock, F_GETFL, 0) & ~O_NONBLOCK);
+    std::memcpy(&this->server, &host.addrs[winner], sizeof this->server);
+    this->set_nodelay();
+    
+    std::cout << "Host: " << server << " (" << PTPNetwork::address_string(&this->server) << ") PORT: " << port << std::endl;
     return true;
 }
 
 bool PTPNetwork::listen(int port) {
-    this->server_sock = socket(AF_INET, SOCK_STREAM, 0); 
-    if (this->server_sock == -1)
-    {
-        throw PTPNetwork::ERR_CREATE;
-        return false;
+    socklen_t server_len;
+    memset(&this->server, 0, sizeof(this->server));
+    
+    // Prefer a dual-stack IPv6 socket, which takes IPv4 clients too
+    this->server_sock = socket(AF_INET6, SOCK_STREAM, 0);
+    if(this->server_sock != -1) {
+        int v6only = 0;
+        setsockopt(this->server_sock, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof v6only);
+        
+        struct sockaddr_in6 * server6 = (struct sockaddr_in6 *)&this->server;
+        server6->sin6_family = AF_INET6;
+        server6->sin6_addr = in6addr_any;
+        server6->sin6_port = htons(port);
+        server_len = sizeof(struct sockaddr_in6);
+    } else {
+        // No IPv6 on this system
+        this->server_sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (this->server_sock == -1)
+        {
+            throw PTPNetwork::ERR_CREATE;
+            return false;
+        }
+        
+        struct sockaddr_in * server4 = (struct sockaddr_in *)&this->server;
+        server4->sin_family = AF_INET;
+        server4->sin_addr.s_addr = INADDR_ANY;
+        server4->sin_port = htons(port);
+        server_len = sizeof(struct sockaddr_in);
     }
-    memset(&this->server, 0, sizeof(this->server));  
-    this->server.sin_family = AF_INET;
-    this->server.sin_addr.s_addr = INADDR_ANY;  
-    this->server.sin_port = htons(port);  
-    if (::bind(this->server_sock, (struct sockaddr*)&this->server, sizeof(this->server)) != 0)
+    
+    // Let us bind again right away if we restart while the old socket is in TIME_WAIT
+    int reuse = 1;
+    setsockopt(this->server_sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof reuse);
+    
+    if (::bind(this->server_sock, (struct sockaddr*)&this->server, server_len) != 0)
     {
-        ::close(this->server_sock);
+        this->close_socket(&this->server_sock);
         throw PTPNetwork::ERR_CONNECT;
         return false;
     }
     
     if (::listen(this->server_sock, 20) != 0)
     {
-        ::close(this->server_sock);
+        this->close_socket(&this->server_sock);
         throw PTPNetwork::ERR_LISTEN;
         return false;
     }
     
+    std::cout << "Server running on PORT: " << port << std::endl;
+    
+    return this->accept_client();
+}
+
+/**
+ * @brief Wait for a client to connect to our listening socket
+ *
+ * Any client we are currently connected to is dropped first, so this can be
+ * used to pick the other end back up after the link was lost.
+ *
+ * @param[in] timeout_ms The maximum number of milliseconds to wait for a
+ *                       client, or -1 to wait forever.
+ * @return true if a client connected, false if we timed out.
+ * @exception PTPNetwork::ERR_ACCEPT if we aren't listening, or accept fails.
+ */
+bool PTPNetwork::accept_client(const int timeout_ms) {
+    this->close_client();
+    
+    if(this->server_sock == -1) {
+        throw PTPNetwork::ERR_ACCEPT;
+        return false;
+    }
+    
+    if(timeout_ms >= 0) {
+        struct pollfd pfd;
+        pfd.fd = this->server_sock;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if(::poll(&pfd, 1, timeout_ms) <= 0) {
+            return false;   // Nobody showed up (or a signal woke us up)
+        }
+    }
+    
     memset(&this->client, 0, sizeof(this->client));  
     socklen_t len = sizeof(this->client);
     this->client_sock = accept(this->server_sock, (struct sockaddr*)&this->client, &len);  
     if (this->client_sock == -1)
     {
-        ::close(this->client_sock);
-        ::close(this->server_sock);
-        throw ERR_ACCEPT;
-        return 0;
+        throw PTPNetwork::ERR_ACCEPT;
+        return false;
     }
     
-    /*
+    this->set_nodelay();
+    std::cout << "Client connected: " << PTPNetwork::address_string(&this->client) << std::endl;
+    return true;
+}
+
+/**
+ * @brief Set the send and receive timeout of the connected socket
+ *
+ * Once set, a \c PTPNetwork::_bulk_read or \c PTPNetwork::_bulk_write that
+ * can't make progress for \a timeout_ms throws \c PTPNetwork::ERR_TIMEOUT
+ * instead of blocking forever.
+ *
+ * @param[in] timeout_ms The timeout in milliseconds, or 0 to block forever.
+ * @return true on success
+ * @exception PTPNetwork::ERR_SET_RECV_TIMEOUT, PTPNetwork::ERR_SET_SEND_TIMEOUT
+ */
+bool PTPNetwork::set_timeout(const int timeout_ms) {
     struct timeval tv;
-    tv.tv_sec = 1;
-    tv.tv_usec = 0;
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
     if(setsockopt(this->client_sock, SOL_SOCKET, SO_RCVTIMEO, (char *)&tv, sizeof tv))
     {
         throw PTPNetwork::ERR_SET_RECV_TIMEOUT;
         return false;
-	}
+    }
     if(setsockopt(this->client_sock, SOL_SOCKET, SO_SNDTIMEO, (char *)&tv,  sizeof tv))
     {
         throw PTPNetwork::ERR_SET_SEND_TIMEOUT;
         return false;
     }
-    * */
+    return true;
+}
+
+/**
+ * @brief Tune TCP keepalive on the connected socket
+ *
+ * Keepalive probes catch a dead link while neither side has anything to
+ * send.  \a user_timeout_ms (\c TCP_USER_TIMEOUT) bounds how long sent data
+ * may stay unacknowledged before the kernel gives up on the connection, which
+ * catches a dead link while we are sending.
+ *
+ * @param[in] idle_s Seconds of idle time before the first probe
+ * @param[in] interval_s Seconds between probes
+ * @param[in] count Number of unanswered probes before the link is dropped
+ * @param[in] user_timeout_ms (optional) Milliseconds sent data may stay unacknowledged, 0 for the kernel default
+ * @return true on success
+ * @exception PTPNetwork::ERR_SOCKOPT if the socket rejects an option
+ */
+bool PTPNetwork::set_keepalive(const int idle_s, const int interval_s, const int count, const int user_timeout_ms) {
+    int on = 1;
+    if(setsockopt(this->client_sock, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof on) ||
+        setsockopt(this->client_sock, IPPROTO_TCP, TCP_KEEPIDLE, &idle_s, sizeof idle_s) ||
+        setsockopt(this->client_sock, IPPROTO_TCP, TCP_KEEPINTVL, &interval_s, sizeof interval_s) ||
+        setsockopt(this->client_sock, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof count)) {
+        throw PTPNetwork::ERR_SOCKOPT;
+        return false;
+    }
+    
+#ifdef TCP_USER_TIMEOUT
+    if(user_timeout_ms > 0) {
+        unsigned int user_timeout = user_timeout_ms;
+        if(setsockopt(this->client_sock, IPPROTO_TCP, TCP_USER_TIMEOUT, &user_timeout, sizeof user_timeout)) {
+            throw PTPNetwork::ERR_SOCKOPT;
+            return false;
+        }
+    }
+#endif
     
-    std::cout << "Server running on PORT: " << port << std::endl;
     return true;
 }
 
+/**
+ * @brief Wait until there is data to read from the other end
+ *
+ * @param[in] timeout_ms The maximum number of milliseconds to wait
+ * @return true if a \c PTPNetwork::_bulk_read won't block, false on timeout.
+ *         A closed connection counts as readable, so the following read can
+ *         report it.
+ */
+bool PTPNetwork::wait_readable(const int timeout_ms) {
+    struct pollfd pfd;
+    pfd.fd = this->client_sock;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    
+    return (::poll(&pfd, 1, timeout_ms) > 0);
+}
+
 bool PTPNetwork::is_server() {
     return (this->client_sock != -1 && this->server_sock != -1);
 }
@@ -161,8 +439,14 @@ bool PTPNetwork::_bulk_write(const unsigned char * bytestr, const int length, co
     while(sent < length) 
     {
         int bytes_sent = 0;
-        bytes_sent = ::send(this->client_sock, bytestr + sent, length - sent, 0);
+        // MSG_NOSIGNAL: a dropped link should throw, not kill us with SIGPIPE
+        bytes_sent = ::send(this->client_sock, bytestr + sent, length - sent, MSG_NOSIGNAL);
         if(bytes_sent == -1) {
+            if(errno == EINTR) continue;
+            if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                throw PTPNetwork::ERR_TIMEOUT;
+                return false;
+            }
             throw PTPNetwork::ERR_SEND;
             return false;
         }
@@ -175,12 +459,26 @@ bool PTPNetwork::_bulk_read(unsigned char * data_out, const int size, int * tran
     // TODO: Obey timeout
     
     int recvd = 0;
-    recvd = ::recv(this->client_sock, data_out, size, 0);
+    do {
+        recvd = ::recv(this->client_sock, data_out, size, 0);
+    } while(recvd == -1 && errno == EINTR);
+    
     if(recvd == -1) {
+        if(errno == EAGAIN || errno == EWOULDBLOCK) {
+            throw PTPNetwork::ERR_TIMEOUT;
+            return false;
+        }
         throw PTPNetwork::ERR_RECV;
         return false;
     }
+    if(recvd == 0 && size > 0) {
+        // The other end hung up. Without this, callers waiting for the rest
+        //  of a message would spin on zero-length reads forever.
+        throw PTPNetwork::ERR_CLOSED;
+        return false;
+    }
     *transferred = recvd;
+    return true;
 }
 
 bool PTPNetwork::is_open() {
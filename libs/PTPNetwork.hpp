@@ -2,10 +2,13 @@
 #define LIBPTP_PP_PTPNETWORK_H_
 
 #include <string>
+#include <vector>
+#include <map>
 #include <stdint.h>
 #include <sys/socket.h>  
 #include <netinet/in.h>  
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
 #include "IPTPComm.hpp"
 
 /**
@@ -17,11 +20,26 @@ namespace PTP {
     
     class PTPNetwork : public IPTPComm {
         private:
-            struct sockaddr_in client;
-            struct sockaddr_in server;
+            /**
+             * A resolved address for a host, and when we resolved it
+             */
+            struct ResolvedHost {
+                std::vector<struct sockaddr_storage> addrs;
+                std::vector<socklen_t> addr_lens;
+                long resolved_at;
+            };
+            static std::map<std::string, ResolvedHost> resolve_cache;
+            static const int resolve_cache_ttl_s = 60;
+            
+            struct sockaddr_storage client;
+            struct sockaddr_storage server;
             int server_sock;
             int client_sock;
             void init();
+            void close_socket(int * sock);
+            void set_nodelay();
+            static const ResolvedHost& resolve(const std::string& host, const int port);
+            static std::string address_string(const struct sockaddr_storage * addr);
             
         public:
             enum NetworkErrors {
@@ -34,14 +52,24 @@ namespace PTP {
                 ERR_SET_RECV_TIMEOUT,
                 ERR_SEND,
                 ERR_RECV,
-                ERR_IP
+                ERR_IP,
+                ERR_TIMEOUT,
+                ERR_CLOSED,
+                ERR_SOCKOPT
             };
             PTPNetwork();
             PTPNetwork(std::string server, int port);
             PTPNetwork(int port);
             ~PTPNetwork();
-            bool connect(std::string server, int port);
+            bool connect(std::string server, int port, const int timeout_ms=1000);
+            static void flush_resolve_cache();
             bool listen(int port);
+            bool accept_client(const int timeout_ms=-1);
+            void close_client();
+            void close();
+            bool set_timeout(const int timeout_ms);
+            bool set_keepalive(const int idle_s, const int interval_s, const int count, const int user_timeout_ms=0);
+            bool wait_readable(const int timeout_ms);
             bool is_client();
             bool is_server();
             virtual bool _bulk_write(const unsigned char * bytestr, const int length, const int timeout);
@@ -187,14 +187,13 @@ bool PTPUSB::_bulk_write(const unsigned char * bytestr, const int length, const
         return 0;
     }
     
-    unsigned char * write_data = new unsigned char[length];
+    FrameBuffer buffer;     // libusb wants a buffer it may write to
+    unsigned char * write_data = buffer.reserve(length);
     std::copy(bytestr, bytestr + length, write_data);
     
     // TODO: Return the amount of data transferred? Check it here? What should we do if not enough was sent?
     bool ret = (libusb_bulk_transfer(this->handle, this->ep_out, write_data, length, &transferred, timeout) == 0);
     
-    delete[] write_data;
-    
     return ret;
 }
 
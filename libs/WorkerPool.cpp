@@ -0,0 +1,204 @@
+/**
+ * @file WorkerPool.cpp
+ *
+ * @brief A persistent thread pool for processing frames in bands
+ *
+ * Used to spread per-frame work (like converting live view data) across the
+ * Pi's cores, without paying to create threads for every frame.
+ */
+
+#include <unistd.h>
+#include <pthread.h>
+
+#include "WorkerPool.hpp"
+
+namespace PTP {
+
+/**
+ * @brief Create a pool which runs jobs on \a threads threads (including the caller)
+ * @see WorkerPool::set_threads
+ */
+WorkerPool::WorkerPool(const int threads) {
+    pthread_mutex_init(&this->run_lock, NULL);
+    pthread_mutex_init(&this->lock, NULL);
+    pthread_cond_init(&this->start_cond, NULL);
+    pthread_cond_init(&this->done_cond, NULL);
+    this->generation = 0;
+    this->pending = 0;
+    this->bands = 1;
+    this->quit = false;
+    this->function = NULL;
+    this->context = NULL;
+    this->count = 0;
+
+    this->set_threads(threads);
+}
+
+/**
+ * @brief Stops and joins all the worker threads
+ */
+WorkerPool::~WorkerPool() {
+    this->stop_threads();
+
+    pthread_cond_destroy(&this->done_cond);
+    pthread_cond_destroy(&this->start_cond);
+    pthread_mutex_destroy(&this->lock);
+    pthread_mutex_destroy(&this->run_lock);
+}
+
+/**
+ * @brief Change how many threads jobs are split across
+ *
+ * @param[in] threads The number of threads, counting the one calling
+ *                    \c WorkerPool::run.  1 runs everything on the caller;
+ *                    0 or less uses one thread per online CPU.
+ */
+void WorkerPool::set_threads(const int threads) {
+    int wanted = threads > 0 ? threads : WorkerPool::get_cpu_count();
+
+    if(wanted == this->get_threads()) return;
+
+    pthread_mutex_lock(&this->run_lock);    // Wait for any running job
+    this->stop_threads();
+    this->start_threads(wanted - 1);
+    pthread_mutex_unlock(&this->run_lock);
+}
+
+/**
+ * @brief Retrieve how many threads jobs are split across, counting the caller
+ */
+int WorkerPool::get_threads() const {
+    return this->threads.size() + 1;
+}
+
+/**
+ * @brief Run \a function over [0, \a count), split into one band per thread
+ *
+ * Each band is a contiguous range, and \a function is called once per band
+ * with its start (inclusive) and end (exclusive).  This returns once every
+ * band is done.
+ *
+ * @param[in] function The function to call for each band
+ * @param[in] context  Passed through to \a function
+ * @param[in] count    The size of the range to split up (rows, for example)
+ * @param[in] min_band The smallest band worth waking a thread for
+ */
+void WorkerPool::run(BandFunction function, void * context, const int count, const int min_band) {
+    pthread_mutex_lock(&this->run_lock);
+
+    int bands = this->get_threads();
+    if(min_band > 0 && count / min_band < bands) {
+        bands = count / min_band;
+    }
+
+    if(bands <= 1) {
+        function(context, 0, count);   // Not worth the wakeups
+        pthread_mutex_unlock(&this->run_lock);
+        return;
+    }
+
+    pthread_mutex_lock(&this->lock);
+    this->function = function;
+    this->context = context;
+    this->count = count;
+    this->bands = bands;
+    this->pending = bands - 1;
+    this->generation++;
+    pthread_cond_broadcast(&this->start_cond);
+    pthread_mutex_unlock(&this->lock);
+
+    this->run_band(0);
+
+    pthread_mutex_lock(&this->lock);
+    while(this->pending > 0) {
+        pthread_cond_wait(&this->done_cond, &this->lock);
+    }
+    pthread_mutex_unlock(&this->lock);
+
+    pthread_mutex_unlock(&this->run_lock);
+}
+
+/**
+ * @brief Retrieve the number of online CPUs
+ */
+int WorkerPool::get_cpu_count() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? cpus : 1;
+}
+
+/**
+ * @brief Start \a count worker threads
+ *
+ * If a thread can't be created, the pool carries on with the ones that were.
+ */
+void WorkerPool::start_threads(const int count) {
+    this->quit = false;
+    this->workers.resize(count > 0 ? count : 0);  // Must not move once the threads have pointers into it
+
+    for(int i = 0; i < count; i++) {
+        pthread_t thread;
+        this->workers[i].pool = this;
+        this->workers[i].index = i + 1;     // Band 0 belongs to the caller
+        this->workers[i].seen = this->generation;
+        if(pthread_create(&thread, NULL, WorkerPool::worker_main, &this->workers[i]) != 0) {
+            break;
+        }
+        this->threads.push_back(thread);
+    }
+}
+
+/**
+ * @brief Tell the worker threads to quit, and wait for them
+ */
+void WorkerPool::stop_threads() {
+    pthread_mutex_lock(&this->lock);
+    this->quit = true;
+    pthread_cond_broadcast(&this->start_cond);
+    pthread_mutex_unlock(&this->lock);
+
+    for(unsigned int i = 0; i < this->threads.size(); i++) {
+        pthread_join(this->threads[i], NULL);
+    }
+
+    this->threads.clear();
+    this->workers.clear();
+}
+
+void WorkerPool::run_band(const int band) {
+    int start = (long long)this->count * band / this->bands;
+    int end = (long long)this->count * (band + 1) / this->bands;
+
+    if(start < end) {
+        this->function(this->context, start, end);
+    }
+}
+
+void * WorkerPool::worker_main(void * arg) {
+    Worker * worker = (Worker *)arg;
+    WorkerPool * pool = worker->pool;
+
+    pthread_mutex_lock(&pool->lock);
+
+    while(true) {
+        while(pool->quit == false && pool->generation == worker->seen) {
+            pthread_cond_wait(&pool->start_cond, &pool->lock);
+        }
+        if(pool->quit) break;
+
+        worker->seen = pool->generation;
+        if(worker->index >= pool->bands) continue;  // Not needed for this job
+
+        pthread_mutex_unlock(&pool->lock);
+        pool->run_band(worker->index);
+        pthread_mutex_lock(&pool->lock);
+
+        if(--pool->pending == 0) {
+            pthread_cond_signal(&pool->done_cond);
+        }
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+} /* namespace PTP */
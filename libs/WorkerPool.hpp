@@ -0,0 +1,59 @@
+#ifndef LIBPTP_PP_WORKERPOOL_H_
+#define LIBPTP_PP_WORKERPOOL_H_
+
+#include <vector>
+#include <pthread.h>
+
+namespace PTP {
+
+    /**
+     * @class WorkerPool
+     * @brief A persistent set of threads for splitting work into bands
+     *
+     * \c WorkerPool::run splits a range into one band per thread, and runs
+     * the bands in parallel, with the calling thread taking the first one.
+     * The threads are created once (by \c WorkerPool::set_threads), and wait
+     * between jobs, so running a job costs a wakeup rather than a thread.
+     */
+    class WorkerPool {
+        public:
+            typedef void (*BandFunction)(void * context, const int start, const int end);
+
+            WorkerPool(const int threads=1);
+            ~WorkerPool();
+            void set_threads(const int threads);
+            int get_threads() const;
+            void run(BandFunction function, void * context, const int count, const int min_band=1);
+            static int get_cpu_count();
+
+        private:
+            struct Worker {
+                WorkerPool * pool;
+                int index;
+                unsigned long seen;     // The last job generation this worker saw
+            };
+
+            std::vector<pthread_t> threads;
+            std::vector<Worker> workers;
+            pthread_mutex_t run_lock;       // Only one job at a time
+            pthread_mutex_t lock;
+            pthread_cond_t start_cond;
+            pthread_cond_t done_cond;
+            unsigned long generation;
+            int pending;
+            int bands;
+            bool quit;
+
+            BandFunction function;
+            void * context;
+            int count;
+
+            void start_threads(const int count);
+            void stop_threads();
+            void run_band(const int band);
+            static void * worker_main(void * arg);
+    };
+
+}
+
+#endif /* LIBPTP_PP_WORKERPOOL_H_ */
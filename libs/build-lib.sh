@@ -4,6 +4,20 @@
 # will only be run on the Pi, so we are free to perform build optimizations.
 
 pwd
-g++ -shared -fPIC -O2 CameraBase.cpp CHDKCamera.cpp LVData.cpp PTPCamera.cpp PTPContainer.cpp PTPUSB.cpp PTPNetwork.cpp -o libptp++.so -lusb-1.0
+
+# The NEON kernels are built on their own, so the rest of the library still runs
+# on a Pi without NEON.  LVConverter checks for it at runtime.
+NEON_FLAGS=""
+case "$(uname -m)" in
+    armv6*|armv7*) NEON_FLAGS="-march=armv7-a -mfpu=neon" ;;
+esac
+g++ -c -fPIC -O2 $NEON_FLAGS LVConverter_neon.cpp -o LVConverter_neon.o
+g++ -c -fPIC -O2 $NEON_FLAGS LVScaler_neon.cpp -o LVScaler_neon.o
+g++ -c -fPIC -O2 $NEON_FLAGS LVOverlay_neon.cpp -o LVOverlay_neon.o
+g++ -c -fPIC -O2 $NEON_FLAGS LVDeltaCodec_neon.cpp -o LVDeltaCodec_neon.o
+g++ -c -fPIC -O2 $NEON_FLAGS LVFrameView_neon.cpp -o LVFrameView_neon.o
+g++ -c -fPIC -O2 $NEON_FLAGS LVStats_neon.cpp -o LVStats_neon.o
+
+g++ -shared -fPIC -O2 CameraBase.cpp CHDKCamera.cpp LVFrameView.cpp LVData.cpp LVConverter.cpp LVScaler.cpp LVOverlay.cpp LVDeltaCodec.cpp LVDCTCodec.cpp LVStats.cpp FrameBufferPool.cpp FDDataSink.cpp PTPCamera.cpp PTPContainer.cpp PTPUSB.cpp PTPNetwork.cpp WorkerPool.cpp LVConverter_neon.o LVScaler_neon.o LVOverlay_neon.o LVDeltaCodec_neon.o LVFrameView_neon.o LVStats_neon.o -o libptp++.so -lusb-1.0 -lpthread
 
 echo "g++ status: $?"
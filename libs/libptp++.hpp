@@ -93,10 +93,22 @@ libusb_exit(NULL);
 //  headers, too
 #include "CameraBase.hpp"
 #include "CHDKCamera.hpp"
+#include "LVFrameView.hpp"
 #include "LVData.hpp"
+#include "LVConverter.hpp"
+#include "LVScaler.hpp"
+#include "LVOverlay.hpp"
+#include "LVDeltaCodec.hpp"
+#include "LVDCTCodec.hpp"
+#include "LVStats.hpp"
+#include "WorkerPool.hpp"
+#include "FrameBufferPool.hpp"
 #include "PTPCamera.hpp"
 #include "PTPContainer.hpp"
 #include "IPTPComm.hpp"
+#include "ITransferProgress.hpp"
+#include "IDataSink.hpp"
+#include "FDDataSink.hpp"
 #include "PTPUSB.hpp"
 #include "PTPNetwork.hpp"
 
@@ -120,7 +132,18 @@ namespace PTP {
         ERR_PTPCONTAINER_NO_PAYLOAD,
         ERR_PTPCONTAINER_INVALID_PARAM,
         
-        ERR_LVDATA_NOT_ENOUGH_DATA
+        ERR_LVDATA_NOT_ENOUGH_DATA,
+        ERR_LVDATA_BAD_PITCH,
+        ERR_LVDATA_BAD_FORMAT,
+        ERR_LVDATA_MISALIGNED,
+        
+        ERR_LVDELTA_BAD_DATA,
+        ERR_LVDELTA_NEED_KEYFRAME,
+        ERR_LVDCT_BAD_DATA,
+        
+        ERR_DATASINK_FAILED,
+        
+        ERR_CANNOT_SEND
     };
     
     // Picked out of CHDK source in a header we don't want to include
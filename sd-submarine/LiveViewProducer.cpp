@@ -0,0 +1,237 @@
+#include <unistd.h>
+#include <iostream>
+#include <libptp++/libptp++.hpp>
+
+#include "LiveViewProducer.hpp"
+#include "../common/SDDefines.hpp"
+
+/**
+* Create a producer for \a cam.  Nothing is fetched until start().
+*/
+LiveViewProducer::LiveViewProducer(PTP::CHDKCamera& cam) : cam(cam), history(SD_LV_HISTORY_FRAMES, 0) {
+    this->running = 0;
+    this->options = 0;
+    this->roi = 0;
+    this->stats.fetched = 0;
+    this->stats.unchanged = 0;
+    this->stats.published = 0;
+    this->stats.errors = 0;
+    this->last_fingerprint = 0;
+    this->last_options = 0;
+    this->last_roi = 0;
+    this->sequence = 0;
+}
+
+LiveViewProducer::~LiveViewProducer() {
+    this->stop();
+}
+
+/**
+* Start fetching frames, once the camera is set up.  Does nothing if we
+* already have.
+* @return false if the thread couldn't be started
+*/
+bool LiveViewProducer::start() {
+    if(this->running) {
+        return true;
+    }
+
+    this->running = 1;
+    if(pthread_create(&this->thread, NULL, LiveViewProducer::run, this) != 0) {
+        this->running = 0;
+        std::cout << "Error: unable to start the live view thread" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+* Stop fetching frames, and wait for the thread to finish the one it's on.
+*/
+void LiveViewProducer::stop() {
+    if(this->running == 0) {
+        return;
+    }
+
+    __sync_lock_test_and_set(&this->running, 0);
+    pthread_join(this->thread, NULL);
+}
+
+bool LiveViewProducer::is_running() {
+    return this->running != 0;
+}
+
+/**
+* Set what the surface wants in its frames (SD_LV_FLAGS).  Only
+* SD_LV_FRAME_FLAGS matter here; the next frame fetched is made with them.
+* @param[in] roi With SD_LV_ROI, the region to send (SD_LV_ROI_PACK)
+*/
+void LiveViewProducer::set_options(uint32_t flags, uint32_t roi) {
+    __sync_lock_test_and_set(&this->roi, (flags & SD_LV_ROI) ? roi : 0);
+    __sync_lock_test_and_set(&this->options, flags & SD_LV_FRAME_FLAGS);
+}
+
+/**
+* Get the latest frame, waiting up to \a timeout_ms for the first one.  Only
+* call this from one thread.  The frame stays valid (and unchanged) until the
+* next call.
+* @return The latest frame (the same one as last time if the camera hasn't
+*         refreshed since), or NULL if there still isn't one
+*/
+const LiveViewProducer::Frame * LiveViewProducer::get_frame(int timeout_ms) {
+    const Frame * frame = this->mailbox.acquire();
+
+    for(int waited = 0; frame == NULL && waited < timeout_ms && this->is_running(); waited++) {
+        usleep(1000);
+        frame = this->mailbox.acquire();
+    }
+
+    return frame;
+}
+
+/**
+* How the producer is doing, since it was created.
+*/
+LiveViewProducer::Stats LiveViewProducer::get_stats() {
+    Stats stats;
+    stats.fetched = __sync_fetch_and_add(&this->stats.fetched, 0);
+    stats.unchanged = __sync_fetch_and_add(&this->stats.unchanged, 0);
+    stats.published = __sync_fetch_and_add(&this->stats.published, 0);
+    stats.errors = __sync_fetch_and_add(&this->stats.errors, 0);
+    return stats;
+}
+
+/**
+* When the last few frames published were captured, by sequence number (see
+* FrameRing::get_info).  Safe to read from any thread while the producer runs.
+*/
+const FrameRing& LiveViewProducer::get_history() {
+    return this->history;
+}
+
+void * LiveViewProducer::run(void * producer) {
+    ((LiveViewProducer *)producer)->produce();
+    return NULL;
+}
+
+/**
+* The producer thread: fetch frames until stop().  When the camera hasn't
+* refreshed its frame yet, wait a moment before asking again, rather than
+* keep the USB bus (and the camera) busy.
+*/
+void LiveViewProducer::produce() {
+    while(this->running) {
+        try {
+            if(this->produce_frame() == false) {
+                usleep(SD_LV_POLL_MS * 1000);
+            }
+        } catch(PTP::LIBPTP_PP_ERRORS e) {
+            if(__sync_add_and_fetch(&this->stats.errors, 1) == 1) {
+                std::cout << "Error fetching live view: " << e << std::endl;
+            }
+            usleep(SD_LV_RETRY_MS * 1000);
+        } catch(...) {
+            __sync_add_and_fetch(&this->stats.errors, 1);
+            usleep(SD_LV_RETRY_MS * 1000);
+        }
+    }
+}
+
+/**
+* Fetch a frame, and if it's new, convert it into the mailbox's free slot
+* and publish it.
+* @return false if the frame was the same as the last one
+*/
+bool LiveViewProducer::produce_frame() {
+    uint32_t options = this->options;
+    uint32_t roi = (options & SD_LV_ROI) ? this->roi : 0;
+    bool want_overlay = (options & SD_LV_OVERLAY) != 0 && (options & SD_LV_LUMA) == 0 && roi == 0;
+
+    // Get the live view data (and the camera's display, if asked for)
+    this->cam.get_live_view_data(this->lv, true, want_overlay, want_overlay);
+    uint64_t capture_ns = FrameRing::now_ns();
+    __sync_add_and_fetch(&this->stats.fetched, 1);
+
+    // The camera refreshes at its own rate, so we often get the same frame twice
+    uint64_t fingerprint = this->lv.get_view().get_fingerprint(want_overlay, SD_LV_FINGERPRINT_ROW_STEP);
+    if(this->sequence > 0 && fingerprint == this->last_fingerprint && options == this->last_options &&
+       roi == this->last_roi) {
+        __sync_add_and_fetch(&this->stats.unchanged, 1);
+        return false;
+    }
+
+    // Only convert the region the surface wants a close look at, and don't
+    //  throw half of its pixels away
+    bool skip = true;
+    this->lv.clear_roi();
+    if(roi != 0) {
+        int full_width, full_height;
+        this->lv.get_rgb_size(&full_width, &full_height);
+        this->lv.set_roi(SD_LV_ROI_X(roi) * full_width / 256, SD_LV_ROI_Y(roi) * full_height / 256,
+                         SD_LV_ROI_WIDTH(roi) * full_width / 256, SD_LV_ROI_HEIGHT(roi) * full_height / 256);
+        skip = false;
+    }
+
+    // The luma statistics come from the conversion itself, rather than another
+    //  pass over the frame
+    Frame& frame = this->mailbox.get_back();
+    frame.luma.reset();
+    this->lv.set_stats((options & SD_LV_STATS) ? &frame.luma : NULL);
+    int width, height;
+    this->lv.get_rgb_size(&width, &height, skip);
+    if(options & SD_LV_LUMA) {
+        // Grayscale only: a third of the viewport, or a twelfth halved
+        bool half = (options & SD_LV_HALF) != 0;
+        this->lv.get_luma_size(&width, &height, half, skip);
+        this->lv.get_luma(frame.data.resize_payload(width * height), width, half, skip);
+        frame.row_bytes = width;
+        frame.encoding = SD_LV_Y8;
+    } else if(options & SD_LV_RAW) {
+        // Pass the camera's YUV on, and let the surface convert it. This is
+        //  12 bpp rather than 16, and keeps our CPU for the motors.
+        int size = this->lv.get_viewport_size(want_overlay, skip);
+        this->lv.get_viewport(frame.data.resize_payload(size), want_overlay, skip);
+        frame.row_bytes = (width / 4) * 6;
+        frame.encoding = SD_LV_YUV;
+    } else {
+        // Convert straight into the payload we're going to send
+        uint8_t * rgb = frame.data.resize_payload(width * height * 2);
+        this->lv.get_rgb(rgb, width * 2, skip);
+        if(want_overlay) {
+            this->lv.composite_overlay(rgb, width * 2, width, height, this->overlay);
+        }
+        frame.row_bytes = width * 2;
+        frame.encoding = SD_LV_RGB565;
+    }
+    frame.data.type = PTP::PTPContainer::CONTAINER_TYPE_DATA;
+    frame.data.code = SD_MAGIC;
+    frame.width = width;
+    frame.height = height;
+    frame.options = options;
+    frame.roi = roi;
+    frame.sequence = ++this->sequence;
+    this->record(frame, capture_ns);
+
+    this->last_fingerprint = fingerprint;
+    this->last_options = options;
+    this->last_roi = roi;
+    this->mailbox.publish();
+    __sync_add_and_fetch(&this->stats.published, 1);
+    return true;
+}
+
+/**
+* Note in the history when \a frame was captured, and what it is.  Not its
+* data: that's in the mailbox already.
+*/
+void LiveViewProducer::record(const Frame& frame, uint64_t capture_ns) {
+    FrameRing::FrameInfo info;
+    info.sequence = frame.sequence;
+    info.capture_ns = capture_ns;
+    info.desc = this->lv.get_view().get_viewport_desc();
+    info.width = frame.width;
+    info.height = frame.height;
+    info.encoding = frame.encoding;
+    info.size = 0;
+    this->history.record(info);
+}
@@ -0,0 +1,85 @@
+#ifndef LIVEVIEWPRODUCER_HPP_
+#define LIVEVIEWPRODUCER_HPP_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <libptp++/libptp++.hpp>
+
+#include "../common/TripleBuffer.hpp"
+#include "../common/FrameRing.hpp"
+
+/**
+ * Fetches live view from the camera on a thread of its own, as fast as the
+ * camera refreshes it, and converts each new frame so it's ready to send the
+ * moment the surface asks.  Frames go through a TripleBuffer, so the surface
+ * always gets the latest one, and frames nobody asked for are overwritten
+ * rather than queued.  Frames the camera hands back unchanged (same
+ * fingerprint) aren't converted or published again.
+ *
+ * When each of the last few frames was captured is kept in a FrameRing, for
+ * anything that wants to know how fresh the frames are.  The frames
+ * themselves only live in the mailbox.
+ *
+ * The camera may be used from other threads meanwhile:
+ * PTP::CameraBase::ptp_transaction takes turns.
+ */
+class LiveViewProducer {
+public:
+    struct Frame {
+        PTP::PTPContainer data; // Ready to send: RGB565, a compact viewport (LVData::get_viewport) or luma
+        uint32_t width;
+        uint32_t height;
+        uint32_t encoding;      // SD_LV_ENCODINGS
+        int row_bytes;          // For delta coding
+        uint32_t options;       // The SD_LV_FLAGS it was made with (see set_options)
+        uint32_t roi;           // With SD_LV_ROI, the region it holds (SD_LV_ROI_PACK)
+        uint32_t sequence;      // Counts up from 1 with each new frame
+        PTP::LVStats luma;      // With SD_LV_STATS, gathered while it was converted
+    };
+    struct Stats {
+        uint32_t fetched;       // Frames fetched from the camera
+        uint32_t unchanged;     // ... that were the same as the last one
+        uint32_t published;     // ... that were converted and published
+        uint32_t errors;        // Failed fetches
+    };
+
+    LiveViewProducer(PTP::CHDKCamera& cam);
+    ~LiveViewProducer();
+
+    bool start();
+    void stop();
+    bool is_running();
+    void set_options(uint32_t flags, uint32_t roi=0);
+    const Frame * get_frame(int timeout_ms);
+    Stats get_stats();
+    const FrameRing& get_history();
+
+private:
+    PTP::CHDKCamera& cam;
+    TripleBuffer<Frame> mailbox;
+    pthread_t thread;
+    volatile int running;
+    volatile uint32_t options;  // Set by the consumer, read by the producer
+    volatile uint32_t roi;
+    Stats stats;                // Counted by the producer, read by the consumer
+    FrameRing history;          // Written by the producer, read by anyone (no frame data, just FrameInfo)
+
+    // Only touched by the producer thread, kept between frames
+    PTP::LVData lv;
+    PTP::LVOverlay overlay;
+    uint64_t last_fingerprint;
+    uint32_t last_options;
+    uint32_t last_roi;
+    uint32_t sequence;
+
+    static void * run(void * producer);
+    void produce();
+    bool produce_frame();
+    void record(const Frame& frame, uint64_t capture_ns);
+
+    // Not copyable
+    LiveViewProducer(const LiveViewProducer&);
+    LiveViewProducer& operator=(const LiveViewProducer&);
+};
+
+#endif /* LIVEVIEWPRODUCER_HPP_ */
@@ -5,6 +5,6 @@
 # optimizations we want.
 
 pwd
-g++ -o sd-submarine -O2 submarine.cpp Motor.cpp ../common/SignalHandler.cpp -lusb-1.0 -lptp++ -lbcm2835
+g++ -o sd-submarine -O2 submarine.cpp Motor.cpp LiveViewProducer.cpp ../common/SignalHandler.cpp ../common/LinkMonitor.cpp ../common/FrameRing.cpp -lusb-1.0 -lptp++ -lbcm2835 -lrt -lpthread
 
 echo "g++ status: $?"
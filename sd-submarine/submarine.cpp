@@ -1,5 +1,6 @@
 #include <iostream>
 #include <unistd.h>
+#include <ctime>
 #include <libptp++/libptp++.hpp>
 #include <libusb-1.0/libusb.h>
 #include <bcm2835.h>
@@ -8,6 +9,8 @@
 #include "../sd-surface/SubJoystick.hpp"
 #include "Motor.hpp"
 #include "../common/SignalHandler.hpp"
+#include "../common/LinkMonitor.hpp"
+#include "LiveViewProducer.hpp"
 #include "submarine.hpp"
 #include "../common/SDDefines.hpp"
 
@@ -23,16 +26,22 @@ int main(int argc, char * argv[]) {
     PTP::CHDKCamera cam;
     Motor subMotors[4]; // We need to control 4 motors
     SignalHandler signalHandler;
-    int8_t * joy_data = NULL;
-    uint32_t joy_data_len;
-    int cmd;
     int8_t sub_state[SubJoystick::COMMAND_LENGTH]; // The current state of the submarine
     PTP::PTPNetwork subServerBackend;
     PTP::CameraBase subServer;
     int mode = 0; // 0 = picture currently, 1 = video currently
+    LinkMonitor link;
+    bool camera_ready = false;
+    LiveViewProducer producer(cam);
+    // Lets the surface tell whether it's resuming a session with the same
+    //  submarine process (camera still set up), or whether we restarted
+    uint32_t session_id = (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16);
     
     bzero(sub_state, SubJoystick::COMMAND_LENGTH);
     
+    // Spread live view conversion over all of the Pi's cores
+    PTP::LVConverter::set_threads(0);
+    
     // Set up our signal handler(s)
     try {
         signalHandler.setupSignalHandlers();
@@ -42,9 +51,11 @@ int main(int argc, char * argv[]) {
     }
     
     try {
-        subServerBackend.listen(50000);
+        subServerBackend.listen(SD_PORT);
         subServer.set_protocol(&subServerBackend);
-	} catch(int e) {
+        link.tune(subServerBackend);
+        link.connected();
+	} catch(PTP::PTPNetwork::NetworkErrors e) {
 		std::cout << "Fatal Error: Unable to set up socket. Ex: " << e << std::endl;
 	}
     
@@ -69,6 +80,34 @@ int main(int argc, char * argv[]) {
     
     // TODO: Signal handler to allow us to quit loop when we receive SIGUSR1
     while(signalHandler.gotAnySignal() == false) {
+        if(link.get_state() == LinkMonitor::LINK_LOST) {
+            // Never keep driving on the last joystick state without a surface
+            failsafe_stop(sub_state, subMotors, cam, camera_ready);
+            subServerBackend.close_client();
+            link = LinkMonitor(link.get_heartbeat(), link.get_timeout());
+        }
+        
+        if(subServerBackend.is_open() == false) {
+            // Wait for the surface to come back. Time out now and then so we
+            //  notice signals.
+            try {
+                if(subServerBackend.accept_client(SD_LINK_TIMEOUT_MS)) {
+                    link.tune(subServerBackend);
+                    link.connected();
+                }
+            } catch(PTP::PTPNetwork::NetworkErrors e) {
+                std::cout << "Error accepting surface: " << e << std::endl;
+                sleep(1);
+            }
+            continue;
+        }
+        
+        // Wake up at least once per heartbeat to check on the link
+        if(subServerBackend.wait_readable(link.get_heartbeat()) == false) {
+            link.update();
+            continue;
+        }
+        
         // Receive a PTP container
         PTP::PTPContainer container_in;
         try {
@@ -76,7 +115,12 @@ int main(int argc, char * argv[]) {
         } catch(PTP::LIBPTP_PP_ERRORS e) {
             std::cout << "Error: PTP error. Code: " << e << std::endl;
             continue;
+        } catch(PTP::PTPNetwork::NetworkErrors e) {
+            std::cout << "Error: Network error. Code: " << e << std::endl;
+            link.lost();
+            continue;
         }
+        link.heard();
         
         std::cout << "Received container" << std::endl;
         
@@ -94,50 +138,83 @@ int main(int argc, char * argv[]) {
         
         // OK... we MUST have received a command.  Let's check what its param is
         uint32_t param = container_in.get_param_n(0);
+        try {
         switch(param) {
             case SD_REQ_CONNECTED: {
-                bool setup = setup_camera(cam, proto, &error);
+                // The camera stays set up across reconnects -- only set it up once
+                if(camera_ready == false) {
+                    camera_ready = setup_camera(cam, proto, &error);
+                }
+                if(camera_ready == true) {
+                    // Have a frame ready by the time the surface asks for one
+                    producer.start();
+                }
+                set_heartbeat(link, subServerBackend, container_in);
                 
                 PTP::PTPContainer response(PTP::PTPContainer::CONTAINER_TYPE_RESPONSE, SD_MAGIC);
-                if(setup == true) {
+                if(camera_ready == true) {
                     response.add_param(SD_IS_CONNECTED);
                 } else {
                     response.add_param(SD_NOT_CONNECTED);
                 }
+                response.add_param(session_id);
                 
                 subServer.send_ptp_message(response);
                 std::cout << "Sent connection status" << std::endl;
                 break;
             }
-            case SD_JOYDATA: {
-                std::cout << "Got SD_JOYDATA" << std::endl;
-                // Ah-ha! We've received joystick data! Let's extract it and parse it
-                // First, receive the data container
-                PTP::PTPContainer data;
-                
+            case SD_RESUME: {
+                // The surface lost the link and wants to pick up where it left
+                //  off. We can only do that if we're the same process it was
+                //  talking to, and the camera is still set up.
+                uint32_t resume_id = 0;
                 try {
-                    subServer.recv_ptp_message(data);
+                    resume_id = container_in.get_param_n(1);
                 } catch(PTP::LIBPTP_PP_ERRORS e) {
-                    std::cout << "Error getting data: " << e << std::endl;
-                    break;
+                    ;
                 }
-                std::cout << "Got data -- " << data.type << std::endl;
+                set_heartbeat(link, subServerBackend, container_in, 2);
+                
+                PTP::PTPContainer response(PTP::PTPContainer::CONTAINER_TYPE_RESPONSE, SD_MAGIC);
+                if(resume_id == session_id && camera_ready == true) {
+                    response.add_param(SD_OK);
+                    response.add_param(mode);
+                    std::cout << "Resumed session" << std::endl;
+                } else {
+                    response.add_param(SD_NOT_CONNECTED);
+                }
+                subServer.send_ptp_message(response);
+                break;
+            }
+            case SD_HEARTBEAT: {
+                PTP::PTPContainer response(PTP::PTPContainer::CONTAINER_TYPE_RESPONSE, SD_MAGIC);
+                response.add_param(SD_OK);
+                response.add_param(mode);
+                subServer.send_ptp_message(response);
+                break;
+            }
+            case SD_JOYDATA:
+            case SD_JOYDATA_LV: {
+                std::cout << "Got SD_JOYDATA" << std::endl;
+                // Ah-ha! We've received joystick data! Let's extract it and parse it
+                bool got_joy_data = recv_joy_data(subServer, sub_state, subMotors, cam, &mode);
+                link.heard();
                 
-                // TODO: Check transaction ID, also
-                if(data.type != PTP::PTPContainer::CONTAINER_TYPE_DATA) {
-                    std::cout << "Got SD_JOYDATA, but no data" << std::endl;
+                if(got_joy_data == false) {
+                    PTP::PTPContainer response(PTP::PTPContainer::CONTAINER_TYPE_RESPONSE, SD_MAGIC);
+                    response.add_param(SD_ERROR);
+                    subServer.send_ptp_message(response);
                     break;
                 }
                 
-                if(joy_data != NULL) {
-                    std::cout << "Deleting joy_data" << std::endl;
-                    delete[] joy_data; // Need to delete old joy_data before allocating more memory
+                if(param == SD_JOYDATA_LV) {
+                    // The surface wants the next frame in the same round trip
+                    send_live_view(subServer, producer, mode, get_optional_param(container_in, 1, 0),
+                               get_optional_param(container_in, 2, SD_LV_DELTA_THRESHOLD),
+                               get_optional_param(container_in, 3, SD_LV_DCT_QUALITY),
+                               get_optional_param(container_in, 4, 0));
+                    break;
                 }
-                std::cout << "About to get payload" << std::endl;
-                joy_data = (int8_t *)data.get_payload((int *)&joy_data_len);
-                std::cout << "Got payload, updating motors" << std::endl;
-                update_motors(sub_state, joy_data, joy_data_len, subMotors, cam, &mode);
-                std::cout << "Updated motors" << std::endl;
                 
                 // TODO: Error checking
                 // Everything should have gone OK, so send SD_OK response
@@ -146,44 +223,15 @@ int main(int argc, char * argv[]) {
                 response.add_param(mode);
                 
                 subServer.send_ptp_message(response);
-                std::cout << "Sent OK" << std::cout;
+                std::cout << "Sent OK" << std::endl;
                 break;
             }
             case SD_LVDATA: {
                 // We want live view data! Let's pack it up and send it off!
-                
-                // First, get the live view data
-                PTP::LVData lv;
-                cam.get_live_view_data(lv, true);
-                std::cout << "Got live view from camera" << std::endl;
-                
-                uint8_t * lv_rgb;
-                int size, width, height;
-                uint32_t size_out, width_out, height_out;
-                lv_rgb = lv.get_rgb(&size, &width, &height, true);
-                std::cout << "Got lv_rgb -- " << size << std::endl;
-                size_out = size;
-                width_out = width;
-                height_out = height;
-                std::cout << "size_out -- " << size_out << std::endl;
-                
-                // For whatever reason... send data first.
-                PTP::PTPContainer out_data(PTP::PTPContainer::CONTAINER_TYPE_DATA, SD_MAGIC);
-                out_data.set_payload(lv_rgb, size_out);
-                subServer.send_ptp_message(out_data);
-                std::cout << "Sent lv_rgb" << std::endl;
-                
-                // Now, send our response
-                PTP::PTPContainer response(PTP::PTPContainer::CONTAINER_TYPE_RESPONSE, SD_MAGIC);
-                // Param 0 is "OK", param 1 is width, param 2 is height
-                response.add_param(SD_OK);
-                response.add_param(width_out);
-                response.add_param(height_out);
-                subServer.send_ptp_message(response);
-                std::cout << "Sent SD_OK" << std::endl;
-                
-                delete[] lv_rgb;
-                
+                send_live_view(subServer, producer, mode, get_optional_param(container_in, 1, 0),
+                               get_optional_param(container_in, 2, SD_LV_DELTA_THRESHOLD),
+                               get_optional_param(container_in, 3, SD_LV_DCT_QUALITY),
+                               get_optional_param(container_in, 4, 0));
                 break;
             }
             case SD_UPDATE:
@@ -210,8 +258,19 @@ int main(int argc, char * argv[]) {
                 break;
             }
         }
+        } catch(PTP::PTPNetwork::NetworkErrors e) {
+            std::cout << "Error: Network error while handling command. Code: " << e << std::endl;
+            link.lost();
+            continue;
+        } catch(PTP::LIBPTP_PP_ERRORS e) {
+            std::cout << "Error: PTP error while handling command. Code: " << e << std::endl;
+        }
+        link.sent();
     }
     
+    producer.stop();
+    failsafe_stop(sub_state, subMotors, cam, camera_ready);
+    
     // Deconstructor will automatically take care of closing network connection
     // TODO: Make PTPNetwork a pointer instead, so we can control when destruction happens?
     
@@ -226,6 +285,209 @@ int main(int argc, char * argv[]) {
     return 0;
 }
 
+/**
+ * Receive the data phase of SD_JOYDATA/SD_JOYDATA_LV and update the motors
+ * with it.
+ * @return true if we got joystick data and applied it
+ */
+bool recv_joy_data(PTP::CameraBase& subServer, int8_t * sub_state, Motor * subMotors, PTP::CHDKCamera& cam, int * mode) {
+    // First, receive the data container
+    PTP::PTPContainer data;
+    
+    try {
+        subServer.recv_ptp_message(data);
+    } catch(PTP::LIBPTP_PP_ERRORS e) {
+        std::cout << "Error getting data: " << e << std::endl;
+        return false;
+    }
+    std::cout << "Got data -- " << data.type << std::endl;
+    
+    // TODO: Check transaction ID, also
+    if(data.type != PTP::PTPContainer::CONTAINER_TYPE_DATA) {
+        std::cout << "Got SD_JOYDATA, but no data" << std::endl;
+        return false;
+    }
+    
+    int joy_data_len;
+    int8_t * joy_data = (int8_t *)data.get_payload(&joy_data_len);
+    if(joy_data_len < SubJoystick::COMMAND_LENGTH) {
+        std::cout << "Got SD_JOYDATA, but only " << joy_data_len << " bytes" << std::endl;
+        delete[] joy_data;
+        return false;
+    }
+    
+    update_motors(sub_state, joy_data, joy_data_len, subMotors, cam, mode);
+    std::cout << "Updated motors" << std::endl;
+    delete[] joy_data;
+    
+    return true;
+}
+
+/**
+ * Send the producer's latest live view frame to the surface, as the data and
+ * response phases of SD_LVDATA (or SD_JOYDATA_LV).
+ */
+void send_live_view(PTP::CameraBase& subServer, LiveViewProducer& producer, int mode, uint32_t flags, uint32_t threshold, uint32_t quality, uint32_t roi) {
+    // Kept between frames, so its buffer is reused instead of reallocated
+    static PTP::PTPContainer encoded_data(PTP::PTPContainer::CONTAINER_TYPE_DATA, SD_MAGIC);
+    // Keeps what the surface has, to send it only what changed
+    static PTP::LVDeltaCodec delta(SD_LV_DELTA_THRESHOLD, SD_LV_KEYFRAME_INTERVAL);
+    // Keeps its tables and planes between frames
+    static PTP::LVDCTCodec dct(SD_LV_DCT_QUALITY);
+    
+    // The producer fetches and converts frames on its own thread; ask for
+    //  what we want next time, and take the latest one it has
+    producer.set_options(flags, roi);
+    const LiveViewProducer::Frame * frame = producer.get_frame(SD_LV_FIRST_FRAME_MS);
+    if(frame == NULL) {
+        PTP::PTPContainer response(PTP::PTPContainer::CONTAINER_TYPE_RESPONSE, SD_MAGIC);
+        response.add_param(SD_ERROR);
+        subServer.send_ptp_message(response);
+        std::cout << "No live view yet. Sent SD_ERROR" << std::endl;
+        return;
+    }
+    
+    // The surface polls faster than the camera refreshes, so we often still
+    //  have the frame we sent last time. If the surface still shows it, and
+    //  it's made the way the surface asks (not from before it changed its
+    //  mind), don't send it again. How often that happens is printed every stats_frames frames.
+    static uint32_t last_sequence = 0, last_codec_flags = 0, last_threshold = 0, last_quality = 0;
+    static const int stats_frames = 100;
+    static int stats_count = 0, stats_unchanged = 0, stats_skipped = 0;
+    // And how old the frames we send are, since the camera gave them to us
+    //  (the producer remembers when it captured its last few)
+    static uint64_t stats_age_ns = 0;
+    static int stats_aged = 0;
+    const FrameRing& history = producer.get_history();
+    FrameRing::FrameInfo captured;
+    uint32_t codec_flags = flags & (SD_LV_DELTA | SD_LV_DCT);
+    uint32_t frame_roi = (flags & SD_LV_ROI) ? roi : 0;
+    bool unchanged = frame->sequence == last_sequence && frame->options == (flags & SD_LV_FRAME_FLAGS) &&
+                     frame->roi == frame_roi && codec_flags == last_codec_flags &&
+                     threshold == last_threshold && quality == last_quality;
+    bool skip = unchanged && (flags & SD_LV_SKIP_UNCHANGED) && (flags & SD_LV_KEYFRAME) == 0;
+    stats_count++;
+    if(unchanged) stats_unchanged++;
+    if(skip) stats_skipped++;
+    else if(history.get_info(frame->sequence, &captured)) {
+        stats_age_ns += FrameRing::now_ns() - captured.capture_ns;
+        stats_aged++;
+    }
+    if(stats_count == stats_frames) {
+        LiveViewProducer::Stats stats = producer.get_stats();
+        // How often the camera refreshes, from the oldest frame the producer
+        //  remembers to the newest
+        FrameRing::FrameInfo oldest;
+        uint32_t latest = history.get_latest();
+        uint32_t first = latest > (uint32_t)history.get_capacity() ? latest - history.get_capacity() + 1 : 1;
+        uint64_t refresh_ms = 0;
+        if(latest > first && history.get_info(first, &oldest) && history.get_info(latest, &captured)) {
+            refresh_ms = (captured.capture_ns - oldest.capture_ns) / (latest - first) / 1000000;
+        }
+        std::cout << "Live view: " << stats_unchanged << " of " << stats_count << " frames unchanged, "
+                  << stats_skipped << " not sent, "
+                  << (stats_aged > 0 ? stats_age_ns / stats_aged / 1000000 : 0) << " ms old when sent; camera: " << stats.fetched << " fetched, "
+                  << stats.unchanged << " unchanged, " << stats.published << " converted, "
+                  << stats.errors << " errors, a new frame every " << refresh_ms << " ms" << std::endl;
+        stats_count = stats_unchanged = stats_skipped = stats_aged = 0;
+        stats_age_ns = 0;
+    }
+    
+    if(skip) {
+        // No data phase, just the response
+        PTP::PTPContainer response(PTP::PTPContainer::CONTAINER_TYPE_RESPONSE, SD_MAGIC);
+        response.add_param(SD_LV_UNCHANGED);
+        response.add_param(mode);
+        subServer.send_ptp_message(response);
+        std::cout << "Sent SD_LV_UNCHANGED" << std::endl;
+        return;
+    }
+    last_sequence = frame->sequence;
+    last_codec_flags = codec_flags;
+    last_threshold = threshold;
+    last_quality = quality;
+    
+    int size;
+    const uint8_t * payload = frame->data.get_payload_pointer(&size);
+    
+    // Compress the viewport, or only send the tiles the surface doesn't already
+    //  have. This stays here rather than in the producer: the delta coder has
+    //  to track what the surface was actually sent.
+    uint32_t codec = SD_LV_CODEC_NONE;
+    const PTP::PTPContainer * out_data = &frame->data;
+    uint32_t tiles = 0, tiles_sent = 0;
+    if(frame->encoding == SD_LV_YUV && (flags & SD_LV_DCT)) {
+        // Every frame stands alone, so there is nothing to lose track of
+        dct.set_quality(quality);
+        uint8_t * encoded = encoded_data.resize_payload(dct.get_max_size(payload, size));
+        size = dct.encode(payload, size, encoded);
+        encoded_data.resize_payload(size);
+        out_data = &encoded_data;
+        codec = SD_LV_CODEC_DCT;
+    } else if(flags & SD_LV_DELTA) {
+        delta.set_threshold(threshold);
+        if(flags & SD_LV_KEYFRAME) {
+            delta.request_keyframe();
+        }
+        uint8_t * encoded = encoded_data.resize_payload(delta.get_max_size(size, frame->row_bytes));
+        size = delta.encode(payload, size, frame->row_bytes, encoded);
+        encoded_data.resize_payload(size);   // Shrinking keeps what we wrote
+        out_data = &encoded_data;
+        codec = SD_LV_CODEC_DELTA;
+        tiles = delta.get_stats().tiles;
+        tiles_sent = delta.get_stats().tiles_sent;
+    }
+    std::cout << "Got lv data -- " << size << std::endl;
+    
+    // For whatever reason... send data first.
+    subServer.send_ptp_message(*out_data);
+    std::cout << "Sent lv data" << std::endl;
+    
+    // Now, send our response
+    PTP::PTPContainer response(PTP::PTPContainer::CONTAINER_TYPE_RESPONSE, SD_MAGIC);
+    // Param 0 is "OK", param 1 is width, param 2 is height, param 3 is mode,
+    //  param 4 is how the data is encoded, param 5 how it is compressed, and
+    //  params 6 to 8 are the bytes sent, tiles and tiles sent
+    response.add_param(SD_OK);
+    response.add_param(frame->width);
+    response.add_param(frame->height);
+    response.add_param(mode);
+    response.add_param(frame->encoding);
+    response.add_param(codec);
+    response.add_param(size);
+    response.add_param(tiles);
+    response.add_param(tiles_sent);
+    if(frame->options & SD_LV_STATS) {
+        // Params 9 on are the luma statistics (SD_LV_STATS_PARAMS)
+        uint32_t histogram[SD_LV_STATS_BINS];
+        frame->luma.get_histogram(histogram, SD_LV_STATS_BINS);
+        response.add_param(frame->luma.get_mean());
+        response.add_param(frame->luma.get_min());
+        response.add_param(frame->luma.get_max());
+        response.add_param(frame->luma.get_clipped_low());
+        response.add_param(frame->luma.get_clipped_high());
+        response.add_param(frame->luma.get_sharpness());
+        response.add_param(frame->luma.get_count());
+        for(int i = 0; i < SD_LV_STATS_BINS; i++) {
+            response.add_param(histogram[i]);
+        }
+    }
+    subServer.send_ptp_message(response);
+    std::cout << "Sent SD_OK" << std::endl;
+}
+
+/**
+ * Retrieve optional parameter \a n of \a cmd, or \a fallback if the sender
+ * didn't send it (like older surfaces, which don't send SD_LV_FLAGS).
+ */
+uint32_t get_optional_param(PTP::PTPContainer& cmd, uint32_t n, uint32_t fallback) {
+    try {
+        return cmd.get_param_n(n);
+    } catch(PTP::LIBPTP_PP_ERRORS e) {
+        return fallback;
+    }
+}
+
 bool setup_camera(PTP::CHDKCamera& cam, PTP::PTPUSB& proto, int * error) {
     // TODO: try/catch
     try {
@@ -243,12 +505,58 @@ bool setup_camera(PTP::CHDKCamera& cam, PTP::PTPUSB& proto, int * error) {
     sleep(1);   // Sleep for half a second -- TODO: Block instead?
     cam.execute_lua("set_prop(143, 2)", NULL); // Set flash mode to off
     sleep(1);
-    cam.execute_lua("loadfile('A/CHDK/SCRIPTS/sd-sub.lua')()", NULL); // Load up our script
+    // Make sure the camera has this build's script. It's only written to the
+    //  camera's card when it's changed.
+    bool uploaded = false;
+    if(cam.upload_file_if_changed(SD_SUB_SCRIPT_LOCAL, SD_SUB_SCRIPT_REMOTE, &uploaded) == false) {
+        std::cout << "Couldn't upload " << SD_SUB_SCRIPT_LOCAL << " -- using the camera's copy" << std::endl;
+    } else if(uploaded) {
+        std::cout << "Uploaded " << SD_SUB_SCRIPT_LOCAL << std::endl;
+    }
+    cam.execute_lua("loadfile('" SD_SUB_SCRIPT_REMOTE "')()", NULL); // Load up our script
     sleep(1);
     
     return true;
 }
 
+/**
+ * Read the heartbeat interval the surface asked for out of parameter \a n of
+ * \a cmd (if it sent one), and apply it to our link.
+ */
+void set_heartbeat(LinkMonitor& link, PTP::PTPNetwork& net, PTP::PTPContainer& cmd, uint32_t n) {
+    try {
+        uint32_t heartbeat_ms = cmd.get_param_n(n);
+        if(heartbeat_ms > 0 && (int)heartbeat_ms != link.get_heartbeat()) {
+            link.set_heartbeat(heartbeat_ms);
+            link.tune(net);
+            std::cout << "Heartbeat: " << heartbeat_ms << " ms" << std::endl;
+        }
+    } catch(PTP::LIBPTP_PP_ERRORS e) {
+        ;   // Older surfaces don't send a heartbeat -- keep the default
+    }
+}
+
+/**
+ * Stop every motor and forget the joystick state.  Used whenever we lose the
+ * surface, so the submarine doesn't keep driving blind.
+ */
+void failsafe_stop(int8_t * sub_state, Motor * subMotors, PTP::CHDKCamera& cam, bool camera_ready) {
+    for(int i = 0; i < 4; i++) {
+        subMotors[i].stop();
+    }
+    
+    if(camera_ready && sub_state[SubJoystick::ZOOM] != 0) {
+        try {
+            cam.write_script_message("zstop");
+        } catch(PTP::LIBPTP_PP_ERRORS e) {
+            std::cout << "Failsafe: unable to stop zoom: " << e << std::endl;
+        }
+    }
+    
+    bzero(sub_state, SubJoystick::COMMAND_LENGTH);
+    std::cout << "Failsafe: motors stopped" << std::endl;
+}
+
 void setup_motors(Motor * subMotors) {
     int i;
     
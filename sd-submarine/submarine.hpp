@@ -5,6 +5,10 @@ int MOTOR_PINS[4][2] = {
     {27, 17} //P1-11, P1-13 (TOP_REAR)
 };
 
+// The camera script, where update.sh installs it, and where the camera runs it from
+#define SD_SUB_SCRIPT_LOCAL "/usr/share/sd-submarine/sd-sub.lua"
+#define SD_SUB_SCRIPT_REMOTE "A/CHDK/SCRIPTS/sd-sub.lua"
+
 enum Submarine_Motors {
     MOTOR_LEFT,
     MOTOR_RIGHT,
@@ -14,8 +18,15 @@ enum Submarine_Motors {
 
 class SubServer;
 class SignalHandler;
+class LinkMonitor;
+class LiveViewProducer;
 
+bool recv_joy_data(PTP::CameraBase& subServer, int8_t * sub_state, Motor * subMotors, PTP::CHDKCamera& cam, int * mode);
+void send_live_view(PTP::CameraBase& subServer, LiveViewProducer& producer, int mode, uint32_t flags, uint32_t threshold, uint32_t quality, uint32_t roi);
+uint32_t get_optional_param(PTP::PTPContainer& cmd, uint32_t n, uint32_t fallback);
 bool setup_camera(PTP::CHDKCamera& cam, PTP::PTPUSB& proto, int * error);
+void set_heartbeat(LinkMonitor& link, PTP::PTPNetwork& net, PTP::PTPContainer& cmd, uint32_t n=1);
+void failsafe_stop(int8_t * sub_state, Motor * subMotors, PTP::CHDKCamera& cam, bool camera_ready);
 void setup_motors(Motor * subMotors);
 bool compare_states(int8_t * sub_state, int8_t * joy_data);
 void update_motors(int8_t * sub_state, int8_t * joy_data, uint32_t joy_data_len, Motor * subMotors, PTP::CHDKCamera& cam, int * mode);
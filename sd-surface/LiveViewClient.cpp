@@ -0,0 +1,241 @@
+#include <iostream>
+#include <libptp++/libptp++.hpp>
+
+#include "LiveViewClient.hpp"
+
+static const int stats_frames = 100;
+
+/**
+* Create a client with nothing on screen yet.  The buffers are sized for the
+* largest frame now, so they never grow mid-stream.
+*/
+LiveViewClient::LiveViewClient() : scaler(PTP::LVScaler::FILTER_BILINEAR) {
+    this->rgb_buffer.reserve(SD_LV_MAX_FRAME_BYTES);
+    this->dct_buffer.reserve(SD_LV_MAX_FRAME_BYTES);
+    for(int i = 0; i < 256; i++) {
+        this->gray565[i] = ((i & 0xF8) << 8) | ((i & 0xFC) << 3) | (i >> 3);
+    }
+    this->need_keyframe = true;
+    this->have_frame = false;
+    this->frame = NULL;
+    this->frame_size = 0;
+    this->width = 0;
+    this->height = 0;
+    this->encoding = SD_LV_RGB565;
+    this->stats_count = 0;
+    this->stats_bytes = this->stats_tiles = this->stats_tiles_sent = this->stats_unchanged = 0;
+}
+
+/**
+* Send the joystick's state, and get the next frame back in the same round
+* trip: command and data go out back to back, and the submarine answers with
+* live view data and its response.  Every exchange doubles as a heartbeat.
+* @param[in] nav_data The joystick's state (SubJoystick::get_data)
+* @param[in] flags What to ask for (SD_LV_FLAGS).  SD_LV_KEYFRAME and
+*                  SD_LV_SKIP_UNCHANGED are added as needed.
+* @param[in] roi With SD_LV_ROI, the region to ask for (SD_LV_ROI_PACK)
+* @return What came back.  Network and protocol errors are thrown, as
+*         CameraBase::ptp_transaction throws them.
+*/
+LiveViewClient::Result LiveViewClient::fetch(PTP::CameraBase& client, const int8_t * nav_data, int nav_length, uint32_t flags,
+                                             uint32_t threshold, uint32_t quality, uint32_t roi) {
+    this->joy_cmd.reset(PTP::PTPContainer::CONTAINER_TYPE_COMMAND, SD_MAGIC);
+    this->joy_cmd.add_param(SD_JOYDATA_LV);
+    this->joy_cmd.add_param(flags | (this->need_keyframe ? SD_LV_KEYFRAME : 0) |
+                            (this->have_frame ? SD_LV_SKIP_UNCHANGED : 0));
+    this->joy_cmd.add_param(threshold);
+    this->joy_cmd.add_param(quality);
+    this->joy_cmd.add_param(roi);
+    this->joy_data.reset(PTP::PTPContainer::CONTAINER_TYPE_DATA, SD_MAGIC);
+    this->joy_data.set_payload(nav_data, nav_length);
+    client.ptp_transaction(this->joy_cmd, this->joy_data, true, this->lv_resp, this->lv_data);
+
+    if(this->lv_resp.code == SD_MAGIC && this->lv_resp.get_param_n(0) == SD_LV_UNCHANGED) {
+        // Still on screen from last time
+        this->stats_unchanged++;
+        return LV_UNCHANGED;
+    }
+
+    this->have_frame = false;   // Until this one is on screen
+
+    if(this->lv_resp.code != SD_MAGIC || this->lv_resp.get_param_n(0) != SD_OK || this->lv_data.code != SD_MAGIC) {
+        std::cout << "Error: something went wrong receiving live view data." << std::endl;
+        std::cout << "       lv_resp.code: " << this->lv_resp.code << std::endl;
+        std::cout << "       lv_resp[0]:   " << this->lv_resp.get_param_n(0) << std::endl;
+        std::cout << "       lv_data.code: " << this->lv_data.code << std::endl;
+        return LV_BAD_FRAME;
+    }
+
+    this->frame = this->lv_data.get_payload_pointer(&this->frame_size);    // No copy -- lv_data owns this
+    this->width = this->lv_resp.get_param_n(1);
+    this->height = this->lv_resp.get_param_n(2);
+    this->encoding = SD_LV_RGB565;  // All an older submarine knows how to send
+    uint32_t codec = SD_LV_CODEC_NONE;
+    try {
+        this->encoding = this->lv_resp.get_param_n(4);
+        codec = this->lv_resp.get_param_n(5);
+        this->stats_bytes += this->lv_resp.get_param_n(6);
+        this->stats_tiles += this->lv_resp.get_param_n(7);
+        this->stats_tiles_sent += this->lv_resp.get_param_n(8);
+        this->stats_count++;
+    } catch(PTP::LIBPTP_PP_ERRORS e) {
+        ;
+    }
+    if(this->stats_count == stats_frames) {
+        std::cout << "Live view: " << this->stats_bytes / this->stats_count << " bytes/frame, "
+                  << (this->stats_tiles ? 100 - this->stats_tiles_sent * 100 / this->stats_tiles : 0) << "% of tiles skipped, "
+                  << this->stats_unchanged << " unchanged frames not sent" << std::endl;
+        this->stats_count = 0;
+        this->stats_bytes = this->stats_tiles = this->stats_tiles_sent = this->stats_unchanged = 0;
+    }
+
+    if(codec == SD_LV_CODEC_DELTA) {
+        try {
+            this->frame = this->delta.decode(this->frame, this->frame_size, &this->frame_size);
+            this->need_keyframe = false;
+        } catch(PTP::LIBPTP_PP_ERRORS e) {
+            std::cout << "Error: can't decode live view delta (" << e << "), asking for a keyframe" << std::endl;
+            this->need_keyframe = true;
+            return LV_BAD_FRAME;
+        }
+    } else if(codec == SD_LV_CODEC_DCT) {
+        try {
+            int decoded_size = this->dct.get_decoded_size(this->frame, this->frame_size);
+            this->dct.decode(this->frame, this->frame_size, this->dct_buffer.reserve(decoded_size));
+            this->frame = this->dct_buffer.get();
+            this->frame_size = decoded_size;
+        } catch(PTP::LIBPTP_PP_ERRORS e) {
+            std::cout << "Error: can't decode live view frame (" << e << ")" << std::endl;
+            return LV_BAD_FRAME;
+        }
+    } else if(codec != SD_LV_CODEC_NONE) {
+        std::cout << "Error: unknown live view codec " << codec << std::endl;
+        return LV_BAD_FRAME;
+    }
+
+    if(this->encoding == SD_LV_YUV) {
+        try {
+            this->lv.read_in_place(this->frame, this->frame_size);  // No copy, and already skipped if the camera needs it
+        } catch(PTP::LIBPTP_PP_ERRORS e) {
+            std::cout << "Error: bad live view data: " << e << std::endl;
+            return LV_BAD_FRAME;
+        }
+        return LV_FRAME;
+    } else if(this->encoding == SD_LV_Y8) {
+        if(this->frame_size < (int)(this->width * this->height)) {
+            std::cout << "Error: luma is " << this->frame_size << " bytes, too small for "
+                      << this->width << "x" << this->height << std::endl;
+            return LV_BAD_FRAME;
+        }
+
+        // Expand to RGB565, then draw it like any other frame
+        uint16_t * rgb = (uint16_t *)this->rgb_buffer.reserve(this->width * this->height * 2);
+        for(uint32_t i = 0; i < this->width * this->height; i++) {
+            rgb[i] = this->gray565[this->frame[i]];
+        }
+        this->frame = this->rgb_buffer.get();
+        this->frame_size = this->width * this->height * 2;
+        this->encoding = SD_LV_RGB565;
+    } else if(this->encoding != SD_LV_RGB565) {
+        std::cout << "Error: unknown live view encoding " << this->encoding << std::endl;
+        return LV_BAD_FRAME;
+    }
+
+    if(this->frame_size < (int)(this->width * this->height * 2)) {
+        std::cout << "Error: live view data is " << this->frame_size << " bytes, too small for "
+                  << this->width << "x" << this->height << std::endl;
+        return LV_BAD_FRAME;
+    }
+    return LV_FRAME;
+}
+
+/**
+* Scale the frame fetch() got to fill an RGB565 screen, straight into its
+* pixels: no intermediate frame.
+* @return false if the frame couldn't be converted (already reported)
+*/
+bool LiveViewClient::draw(uint8_t * screen, int pitch, int width, int height) {
+    if(this->encoding == SD_LV_YUV) {
+        try {
+            this->lv.get_rgb_scaled(screen, pitch, width, height, this->scaler);
+            this->lv.composite_overlay(screen, pitch, width, height, this->overlay);
+        } catch(PTP::LIBPTP_PP_ERRORS e) {
+            std::cout << "Error: bad live view data: " << e << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    this->scaler.scale((const uint16_t *)this->frame, this->width, this->height, this->width * 2,
+                       screen, width, height, pitch);
+    return true;
+}
+
+/**
+* Get the frame fetch() got as RGB565 at its own size, for screens draw()
+* can't fill.  It stays valid until the next fetch().
+* @return The frame's pixels, or NULL if it couldn't be converted (already
+*         reported)
+*/
+const uint8_t * LiveViewClient::get_rgb(int * width, int * height) {
+    if(this->encoding == SD_LV_YUV) {
+        try {
+            int rgb_width, rgb_height;
+            this->lv.get_rgb_size(&rgb_width, &rgb_height);
+            this->lv.get_rgb(this->rgb_buffer.reserve(rgb_width * rgb_height * 2), rgb_width * 2);
+            this->lv.composite_overlay(this->rgb_buffer.get(), rgb_width * 2, rgb_width, rgb_height, this->overlay);
+            this->frame = this->rgb_buffer.get();
+            this->frame_size = rgb_width * rgb_height * 2;
+            this->width = rgb_width;
+            this->height = rgb_height;
+            this->encoding = SD_LV_RGB565;
+        } catch(PTP::LIBPTP_PP_ERRORS e) {
+            std::cout << "Error: bad live view data: " << e << std::endl;
+            return NULL;
+        }
+    }
+
+    *width = this->width;
+    *height = this->height;
+    return this->frame;
+}
+
+/**
+* Read the luma statistics off the end of the last frame's response.
+* @return false if the submarine didn't send any (it's older, or the frame
+*         was made before it saw SD_LV_STATS)
+*/
+bool LiveViewClient::get_luma_stats(LumaStats * stats) {
+    try {
+        stats->mean = this->lv_resp.get_param_n(SD_LV_STATS_MEAN);
+        stats->min = this->lv_resp.get_param_n(SD_LV_STATS_MIN);
+        stats->max = this->lv_resp.get_param_n(SD_LV_STATS_MAX);
+        stats->clipped_low = this->lv_resp.get_param_n(SD_LV_STATS_CLIPPED_LOW);
+        stats->clipped_high = this->lv_resp.get_param_n(SD_LV_STATS_CLIPPED_HIGH);
+        stats->sharpness = this->lv_resp.get_param_n(SD_LV_STATS_SHARPNESS);
+        stats->count = this->lv_resp.get_param_n(SD_LV_STATS_COUNT);
+        for(int i = 0; i < SD_LV_STATS_BINS; i++) {
+            stats->histogram[i] = this->lv_resp.get_param_n(SD_LV_STATS_HISTOGRAM + i);
+        }
+    } catch(PTP::LIBPTP_PP_ERRORS e) {
+        return false;
+    }
+    return true;
+}
+
+/**
+* Say the frame is on screen, so the submarine needn't send it again if the
+* camera hasn't refreshed it.
+*/
+void LiveViewClient::drawn() {
+    this->have_frame = true;
+}
+
+/**
+* Start the stream over, after the link dropped: the submarine may have
+* restarted, and lost track of what we have.
+*/
+void LiveViewClient::reset() {
+    this->need_keyframe = true;
+    this->have_frame = false;
+}
@@ -0,0 +1,78 @@
+#ifndef LIVEVIEWCLIENT_HPP_
+#define LIVEVIEWCLIENT_HPP_
+
+#include <stdint.h>
+#include <libptp++/libptp++.hpp>
+
+#include "../common/SDDefines.hpp"
+
+// The statistics of a frame's luma the submarine sends with SD_LV_STATS
+struct LumaStats {
+    uint32_t mean;
+    uint32_t min;
+    uint32_t max;
+    uint32_t clipped_low;       // Samples clipped black
+    uint32_t clipped_high;      // ... and white
+    uint32_t sharpness;         // In 256ths (see PTP::LVStats::get_sharpness)
+    uint32_t count;             // Samples
+    uint32_t histogram[SD_LV_STATS_BINS];
+};
+
+/**
+ * The surface's end of the live view round trip: send the joystick's state
+ * with SD_JOYDATA_LV, and get the next frame back in the same round trip,
+ * decoded and ready to draw.  Everything it needs is made once and reused, so
+ * once it's streaming, a frame doesn't touch the heap.
+ *
+ * It keeps track of what the submarine needs to know about our copy of the
+ * stream (whether we lost track of the deltas, whether a frame is on screen),
+ * so the caller only says what it wants to see.
+ */
+class LiveViewClient {
+public:
+    enum Result {
+        LV_FRAME = 0,   // A new frame, ready to draw
+        LV_UNCHANGED,   // The frame on screen is still the latest
+        LV_BAD_FRAME    // Something was wrong with the frame (already reported); ask again
+    };
+
+    LiveViewClient();
+
+    Result fetch(PTP::CameraBase& client, const int8_t * nav_data, int nav_length, uint32_t flags,
+                 uint32_t threshold, uint32_t quality, uint32_t roi);
+    bool draw(uint8_t * screen, int pitch, int width, int height);
+    const uint8_t * get_rgb(int * width, int * height);
+    bool get_luma_stats(LumaStats * stats);
+    void drawn();
+    void reset();
+
+private:
+    PTP::PTPContainer joy_cmd, joy_data, lv_resp, lv_data;
+    PTP::LVData lv;
+    PTP::LVOverlay overlay;
+    PTP::LVScaler scaler;
+    PTP::LVDeltaCodec delta;        // The submarine only sends the tiles that changed since our copy
+    PTP::LVDCTCodec dct;            // Or compresses each frame, which we decode into dct_buffer
+    PTP::FrameBuffer dct_buffer;
+    PTP::FrameBuffer rgb_buffer;    // Frames that weren't RGB565, converted
+    uint16_t gray565[256];          // Expands SD_LV_Y8 to RGB565
+    bool need_keyframe;
+    bool have_frame;                // Whether the last frame is on screen
+
+    // The frame fetch() got, decoded
+    const uint8_t * frame;
+    int frame_size;
+    uint32_t width;
+    uint32_t height;
+    uint32_t encoding;              // SD_LV_YUV (in lv) or SD_LV_RGB565
+
+    // How well the stream is going, printed every stats_frames frames
+    int stats_count;
+    long stats_bytes, stats_tiles, stats_tiles_sent, stats_unchanged;
+
+    // Not copyable
+    LiveViewClient(const LiveViewClient&);
+    LiveViewClient& operator=(const LiveViewClient&);
+};
+
+#endif /* LIVEVIEWCLIENT_HPP_ */
@@ -139,6 +139,15 @@ void SubJoystick::handle_input(SDL_Event event)
         {
             commands[MODE] = 1; //change mode
         }
+        else if (event.jbutton.button == B_BUTTON) {
+            commands[OSD] = 1; //toggle the camera's OSD
+        }
+        else if (event.jbutton.button == X_BUTTON) {
+            commands[INSPECT] = 1; //toggle the close up
+        }
+        else if (event.jbutton.button == LS_BUTTON) {
+            commands[QUALITY] = 1; //next live view quality
+        }
         //option button always works
         if (event.jbutton.button == BACK_BUTTON) {
 			commands[OPTION] = 1;
@@ -161,6 +170,15 @@ void SubJoystick::handle_input(SDL_Event event)
         else if (event.jbutton.button == RL_BUTTON) {
             commands[MODE] = 0; //mode released
         }
+        else if (event.jbutton.button == B_BUTTON) {
+            commands[OSD] = 0; //OSD released
+        }
+        else if (event.jbutton.button == X_BUTTON) {
+            commands[INSPECT] = 0; //inspect released
+        }
+        else if (event.jbutton.button == LS_BUTTON) {
+            commands[QUALITY] = 0; //quality released
+        }
         //option button always works
         if (event.jbutton.button == BACK_BUTTON) {
             commands[OPTION] = 0; //option released
@@ -176,3 +194,9 @@ int8_t *SubJoystick::get_data() {
     
     return to_send;
 }
+
+//this one copies it into the caller's array instead, so the main loop doesn't
+//allocate every pass
+void SubJoystick::get_data(int8_t out[]) const {
+    memcpy(out, commands, COMMAND_LENGTH);
+}
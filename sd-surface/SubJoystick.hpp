@@ -8,7 +8,8 @@ class SubJoystick
 {
     public:
     SubJoystick(); //Initializes
-    int8_t * get_data(); //gets data to send
+    int8_t * get_data(); //gets data to send (a new copy, for the caller to delete[])
+    void get_data(int8_t out[]) const; //copies data to send into out (COMMAND_LENGTH bytes)
     void handle_input(SDL_Event myevent); //Handles joystick
     enum SubCommand {
 		FORWARD = 0, // 1 for forward, -1 for backward, 0 for neither 
@@ -21,6 +22,9 @@ class SubJoystick
 		QUIT, //1 when we want to quit
 		OPTION, //Hold Select and different things might happen!
         MODE, // 1 when we want to switch mode
+        OSD, // 1 while the OSD button is held (the surface toggles the camera's overlay)
+        INSPECT, // 1 while the inspect button is held (the surface toggles a close up of the middle of the frame)
+        QUALITY, // 1 while the quality button is held (the surface steps through live view qualities)
         COMMAND_LENGTH  // A field to denote how many fields we have
 	};
     
@@ -28,13 +32,15 @@ class SubJoystick
     int8_t commands[COMMAND_LENGTH];
     enum SubButtons {
 		A_BUTTON = 0, // A Button (Descend)
-		B_BUTTON, // B Button (Does Nothing)
-		X_BUTTON, // X Button (Does Nothing)
+		B_BUTTON, // B Button (Toggles the camera's OSD)
+		X_BUTTON, // X Button (Toggles inspecting the middle of the frame)
 		Y_BUTTON, // Y Button (Ascend)
 		RL_BUTTON, // RL Button (Switches Mode)
 		RB_BUTTON, // RB Button (Takes pictures)
 		BACK_BUTTON, // Back Button (Does nothing)
-		START_BUTTON // Start Button (Shuts down)
+		START_BUTTON, // Start Button (Shuts down)
+		GUIDE_BUTTON, // Guide Button (Does nothing)
+		LS_BUTTON // Left Stick Button (Steps through live view qualities)
 	};
 
 };
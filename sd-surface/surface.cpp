@@ -5,8 +5,11 @@
 
 #include "../common/SignalHandler.hpp"
 #include "surface.hpp"
+#include "LiveViewClient.hpp"
 #include "SubJoystick.hpp"
 #include "../common/SDDefines.hpp"
+#include "../common/LinkMonitor.hpp"
+#include "../common/Backoff.hpp"
 
 int main(int argc, char * argv[]) {
     // These variables can be used as dummy placeholders when we don't need a parameter to ptp_transaction
@@ -74,63 +77,118 @@ int main(int argc, char * argv[]) {
     
     //Create a Client
     PTP::PTPNetwork surfaceClientBackend;
+    PTP::CameraBase surfaceClient(&surfaceClientBackend);
     
-    //Connect to server -- TODO: Move to an FSM implementaiton in the main SDL loop and move this code below?
-    //  This would allow us to exit this portion of the code cleanly using the joystick
-    bool connected = false;
-    while(connected == false && signalHandler.gotAnySignal() == false) {
-        try {
-            std::string host = "pi-submarine";
-            if(argc > 1) {
-                host = argv[1];
-            }
-            surfaceClientBackend.connect(host,50000);
-            connected = true;
-        } catch(PTP::PTPNetwork::NetworkErrors e) {
-            std::cout << "Error: Could not connect to socket. Trying again. Exception: " << e << std::endl;
-        } catch(...) {
-            std::cout << "Caught some other exception.  Trying again." << std::endl;
-        }
+    std::string host = "pi-submarine";
+    if(argc > 1) {
+        host = argv[1];
     }
-    
-    if(signalHandler.gotAnySignal() == true) {
-        clean_up(NULL);
-        if(signalHandler.gotExitSignal() == true && debug == false) {
-            system ("sudo shutdown -h now");
-        }
-        return 1;
+    int heartbeat_ms = SD_HEARTBEAT_MS;
+    if(argc > 2) {
+        heartbeat_ms = atoi(argv[2]);
     }
-        
+    LinkMonitor link(heartbeat_ms);
+    int delta_threshold = SD_LV_DELTA_THRESHOLD;
+    if(argc > 3) {
+        delta_threshold = atoi(argv[3]);
+    }
+    // A quality (1-100) has the submarine compress each frame instead of
+    //  sending deltas; 0 keeps the deltas. The left stick button steps
+    //  through a few, to trade detail for frame rate as the tether allows.
+    int dct_quality = 0;
+    if(argc > 4) {
+        dct_quality = atoi(argv[4]);
+    }
+    const int dct_qualities[] = {0, 30, 50, SD_LV_DCT_QUALITY, 90};
+    const int dct_quality_count = sizeof(dct_qualities) / sizeof(dct_qualities[0]);
+    int8_t last_quality = 0;
+    // For a poor tether: 1 asks for grayscale only (about half the bytes of
+    //  YUV), 2 for grayscale at half the size each way. Deltas, never DCT.
+    int luma_mode = 0;
+    if(argc > 5) {
+        luma_mode = atoi(argv[5]);
+    }
+    // 1 shows the frame's histogram, mean and sharpness over it, for judging
+    //  exposure and focus. The submarine works them out as it converts.
+    bool show_hud = false;
+    if(argc > 6) {
+        show_hud = atoi(argv[6]) != 0;
+    }
+    // Set once the submarine has set up the camera for us, so we can resume
+    //  this session if the link drops
+    uint32_t session_id = 0;
+    bool have_session = false;
     
-	std::cout << "Connection Successful" << std::endl;
-    PTP::CameraBase surfaceClient(&surfaceClientBackend);
+    // Frames are RGB565, so if the screen is too we can scale straight into it
+    bool screen_is_rgb565 = screen->format->BitsPerPixel == 16 && screen->format->Rmask == 0xF800 &&
+                            screen->format->Gmask == 0x07E0 && screen->format->Bmask == 0x001F;
+    // The B button toggles the camera's own display (OSD) on top of the frame
+    bool show_osd = false;
+    int8_t last_osd = 0;
+    // The X button toggles a close up of the middle of the frame, at the
+    //  camera's full resolution
+    bool inspect = false;
+    int8_t last_inspect = 0;
+    // We ask for the camera's YUV and convert it here, which is less to send
+    //  and spares the submarine's CPU
+    PTP::LVConverter::set_threads(0);
+    LiveViewClient live_view;
+    // Everything each pass of the loop needs is made here, once, and reused,
+    //  so once it's streaming the loop doesn't touch the heap (test/surfaceloop
+    //  checks LiveViewClient for that).
+    int8_t nav_data[SubJoystick::COMMAND_LENGTH];
+    PTP::PTPContainer heartbeat_cmd;
     
-    // Make sure we're connected to the camera
-    show_image_status("/usr/share/sd-surface/camera.bmp", screen);
-    bool camera_connected = false;
-    while(camera_connected == false) {
-        PTP::PTPContainer connect_cmd(PTP::PTPContainer::CONTAINER_TYPE_COMMAND, SD_MAGIC);
-        connect_cmd.add_param(SD_REQ_CONNECTED);
-        try {
-            surfaceClient.ptp_transaction(connect_cmd, in_data, false, out_resp, out_data);
-        } catch(PTP::LIBPTP_PP_ERRORS e) {
-            std::cout << "Error in ptp_transaction: " << e << std::endl;
-            continue;
-        } catch(PTP::PTPNetwork::NetworkErrors e) {
-            // TODO -- this is probably a fatal error
-            std::cout << "Network error in ptp_transaction: " << e << std::endl;
+    //While the user hasn't quit
+    while( signalHandler.gotAnySignal() == false && quit == false )
+    {
+        if(link.get_state() == LinkMonitor::LINK_DOWN || link.get_state() == LinkMonitor::LINK_LOST) {
+            show_image_status("/usr/share/sd-surface/connecting.bmp", screen);
+            if(connect_to_submarine(surfaceClientBackend, host, signalHandler) == false) {
+                break;  // We got a signal while trying
+            }
+            std::cout << "Connection Successful" << std::endl;
+            link.tune(surfaceClientBackend);
+            link.connected();
+            live_view.reset();      // The submarine may have restarted
+            
+            try {
+                if(have_session == false || resume_session(surfaceClient, link, session_id) == false) {
+                    // Make sure we're connected to the camera
+                    show_image_status("/usr/share/sd-surface/camera.bmp", screen);
+                    have_session = start_session(surfaceClient, surfaceClientBackend, link, &session_id, signalHandler);
+                }
+            } catch(PTP::LIBPTP_PP_ERRORS e) {
+                std::cout << "Error starting session: " << e << std::endl;
+                link.lost();
+            } catch(PTP::PTPNetwork::NetworkErrors e) {
+                std::cout << "Network error starting session: " << e << std::endl;
+                link.lost();
+            }
             continue;
         }
         
-        if(out_resp.code == SD_MAGIC && out_resp.get_param_n(0) == SD_IS_CONNECTED) {
-            camera_connected = true;
+        if(link.heartbeat_due()) {
+            // Every exchange below doubles as a heartbeat. If we fell behind
+            //  (slow frame, retries), send one on its own so the submarine
+            //  doesn't give up on us.
+            heartbeat_cmd.reset(PTP::PTPContainer::CONTAINER_TYPE_COMMAND, SD_MAGIC);
+            heartbeat_cmd.add_param(SD_HEARTBEAT);
+            try {
+                surfaceClient.ptp_transaction(heartbeat_cmd, in_data, false, out_resp, out_data);
+            } catch(PTP::LIBPTP_PP_ERRORS e) {
+                std::cout << "Error sending heartbeat: " << e << std::endl;
+                link.lost();
+                continue;
+            } catch(PTP::PTPNetwork::NetworkErrors e) {
+                std::cout << "Network error sending heartbeat: " << e << std::endl;
+                link.lost();
+                continue;
+            }
+            link.sent();
+            link.heard();
         }
-    }
-    
-
-    //While the user hasn't quit
-    while( signalHandler.gotAnySignal() == false && quit == false )
-    {
+        
         //While there's events to handle
         while( SDL_PollEvent( &event ) )
         {
@@ -145,7 +203,7 @@ int main(int argc, char * argv[]) {
             }
         }
         
-        int8_t *nav_data = mySubJoystick.get_data();
+        mySubJoystick.get_data(nav_data);
         
         if(nav_data[SubJoystick::OPTION] == 1) {
             // If you hold select, different things may happen
@@ -157,63 +215,90 @@ int main(int argc, char * argv[]) {
             break;
         }
         
-        // Send data
-        PTP::PTPContainer joy_cmd(PTP::PTPContainer::CONTAINER_TYPE_COMMAND, SD_MAGIC);
-        joy_cmd.add_param(SD_JOYDATA);
-        PTP::PTPContainer joy_data(PTP::PTPContainer::CONTAINER_TYPE_DATA, SD_MAGIC);
-        joy_data.set_payload(nav_data, SubJoystick::COMMAND_LENGTH);
+        if(nav_data[SubJoystick::OSD] == 1 && last_osd == 0) {
+            show_osd = !show_osd;
+        }
+        last_osd = nav_data[SubJoystick::OSD];
+        
+        if(nav_data[SubJoystick::INSPECT] == 1 && last_inspect == 0) {
+            inspect = !inspect;
+        }
+        last_inspect = nav_data[SubJoystick::INSPECT];
+        
+        if(nav_data[SubJoystick::QUALITY] == 1 && last_quality == 0) {
+            // The next quality up from where we are, round to deltas again
+            int next = 0;
+            for(int i = 0; i < dct_quality_count; i++) {
+                if(dct_qualities[i] > dct_quality) {
+                    next = dct_qualities[i];
+                    break;
+                }
+            }
+            dct_quality = next;
+            std::cout << "Live view quality: " << dct_quality << (dct_quality > 0 ? "" : " (deltas)") << std::endl;
+        }
+        last_quality = nav_data[SubJoystick::QUALITY];
+        
+        // Send joystick data, and get the next frame back in the same round trip
+        uint32_t lv_flags = SD_LV_RAW | (show_osd ? SD_LV_OVERLAY : 0) |
+                            (inspect ? SD_LV_ROI : 0) | (show_hud ? SD_LV_STATS : 0);
+        if(luma_mode > 0) {
+            lv_flags |= SD_LV_LUMA | SD_LV_DELTA | (luma_mode > 1 ? SD_LV_HALF : 0);
+        } else {
+            lv_flags |= dct_quality > 0 ? SD_LV_DCT : SD_LV_DELTA;
+        }
+        LiveViewClient::Result result;
         try {
-            surfaceClient.ptp_transaction(joy_cmd, joy_data, false, out_resp, out_data);
+            result = live_view.fetch(surfaceClient, nav_data, SubJoystick::COMMAND_LENGTH, lv_flags,
+                                     delta_threshold, dct_quality, SD_LV_INSPECT_ROI);
         } catch(PTP::LIBPTP_PP_ERRORS e) {
             std::cout << "Error in ptp_transaction: " << e << std::endl;
-            break;
+            link.lost();
+            continue;
         } catch(PTP::PTPNetwork::NetworkErrors e) {
             std::cout << "Network error in ptp_transaction: " << e << std::endl;
-            break;
-        }
-        
-        // Check response
-        if(out_resp.code != SD_MAGIC || out_resp.get_param_n(0) != SD_OK) {
-            std::cout << "Error: Did not send joystick data." << std::endl;
-            // Something seems to be wrong -- let's continue so that we just try again
+            link.lost();
             continue;
         }
+        link.sent();
+        link.heard();
         
-        int mode = out_resp.get_param_n(1);
-        
-        //std::cout << "Sent joystick data" << std::endl;
-        
-        delete[] nav_data;
-        
-        // Receive live view data, process, display
-        uint8_t * lv_rgb;
-        int lv_size;
-        uint32_t width, height;
-        PTP::PTPContainer lv_cmd(PTP::PTPContainer::CONTAINER_TYPE_COMMAND, SD_MAGIC);
-        lv_cmd.add_param(SD_LVDATA);
-        PTP::PTPContainer lv_resp, lv_data;
-        surfaceClient.ptp_transaction(lv_cmd, in_data, true, lv_resp, lv_data);
-        
-        // Put our live view data, width, height and size in the right place
-        if(lv_resp.code != SD_MAGIC || lv_resp.get_param_n(0) != SD_OK || lv_data.code != SD_MAGIC) {
-            std::cout << "Error: something went wrong receiving live view data." << std::endl;
-            std::cout << "       lv_resp.code: " << lv_resp.code << std::endl;
-            std::cout << "       lv_resp[0]:   " << lv_resp.get_param_n(0) << std::endl;
-            std::cout << "       lv_data.code: " << lv_data.code << std::endl;
-            // Again, something went wrong... let's just start over and try again
-            continue;
+        if(result != LiveViewClient::LV_FRAME) {
+            continue;   // Still on screen from last time, or try again
         }
         
-        lv_rgb = lv_data.get_payload(&lv_size);
-        width = lv_resp.get_param_n(1);
-        height = lv_resp.get_param_n(2);
+        LumaStats luma_stats;
+        bool have_stats = show_hud && live_view.get_luma_stats(&luma_stats);
         
         //std::cout << "Received data -- displaying" << std::endl;
-        surf_lv = SDL_CreateRGBSurfaceFrom(lv_rgb, width, height, 16, width * 2, 0xF800, 0x03E0, 0x001F, 0);
-        
-        SDL_SoftStretch(surf_lv, NULL, screen, NULL);
+        if(screen_is_rgb565) {
+            // Scale straight into the screen -- no intermediate surface or stretch
+            if(SDL_MUSTLOCK(screen)) SDL_LockSurface(screen);
+            bool drawn = live_view.draw((uint8_t *)screen->pixels, screen->pitch, screen->w, screen->h);
+            if(SDL_MUSTLOCK(screen)) SDL_UnlockSurface(screen);
+            if(drawn == false) {
+                continue;
+            }
+        } else {
+            int width, height;
+            const uint8_t * lv_rgb = live_view.get_rgb(&width, &height);
+            if(lv_rgb == NULL) {
+                continue;
+            }
+            // Keep one surface, and just point it at each frame's pixels
+            if(surf_lv == NULL || surf_lv->w != width || surf_lv->h != height) {
+                if(surf_lv != NULL) SDL_FreeSurface(surf_lv);
+                surf_lv = SDL_CreateRGBSurfaceFrom((void *)lv_rgb, width, height, 16, width * 2, 0xF800, 0x07E0, 0x001F, 0);
+            }
+            surf_lv->pixels = (void *)lv_rgb;
+            SDL_SoftStretch(surf_lv, NULL, screen, NULL);
+        }
+        if(have_stats) {
+            draw_luma_hud(screen, luma_stats);
+        }
 
         SDL_Flip(screen);
+        live_view.drawn();
         
         /*
         if(mode == 1) {
@@ -221,10 +306,6 @@ int main(int argc, char * argv[]) {
         } else {
             draw_bmp_location("/usr/share/sd-submarine/mode-picture.bmp", screen, 50, 50);
         }*/
-        
-        SDL_FreeSurface(surf_lv);
-            
-        delete[] lv_rgb;
     }
     
     // Send stop command to submarine
@@ -234,10 +315,21 @@ int main(int argc, char * argv[]) {
     } else {
         quit_cmd.add_param(SD_QUIT);
     }
-    surfaceClient.ptp_transaction(quit_cmd, in_data, false, out_resp, out_data);
+    if(link.get_state() == LinkMonitor::LINK_UP || link.get_state() == LinkMonitor::LINK_SUSPECT) {
+        try {
+            surfaceClient.ptp_transaction(quit_cmd, in_data, false, out_resp, out_data);
+        } catch(PTP::LIBPTP_PP_ERRORS e) {
+            std::cout << "Error sending quit: " << e << std::endl;
+        } catch(PTP::PTPNetwork::NetworkErrors e) {
+            std::cout << "Network error sending quit: " << e << std::endl;
+        }
+    }
     // TODO: Check response
 
     //Clean up
+    if(surf_lv != NULL) {
+        SDL_FreeSurface(surf_lv);
+    }
     clean_up(stick);
     if(select == false && signalHandler.gotUpdateSignal() == false && debug == false) {
         // Only shutdown if we aren't holding select, and haven't received an "update" signal
@@ -246,6 +338,85 @@ int main(int argc, char * argv[]) {
     return 0;
 }
 
+/**
+ * Keep trying to connect to the submarine until we succeed, or get a signal.
+ * @return true if connected, false if we got a signal first
+ */
+bool connect_to_submarine(PTP::PTPNetwork& net, const std::string& host, SignalHandler& signalHandler) {
+    // Retry quickly at first, so we connect soon after the submarine starts
+    //  listening, but back off so we don't spin while it boots
+    Backoff backoff(SD_CONNECT_BACKOFF_MIN_MS, SD_CONNECT_BACKOFF_MAX_MS);
+    
+    while(signalHandler.gotAnySignal() == false) {
+        try {
+            net.connect(host, SD_PORT, SD_CONNECT_TIMEOUT_MS);
+            return true;
+        } catch(PTP::PTPNetwork::NetworkErrors e) {
+            if(backoff.should_report()) {
+                std::cout << "Error: Could not connect to socket (attempt " << backoff.get_attempts() + 1 << "). Trying again. Exception: " << e << std::endl;
+            }
+        } catch(...) {
+            std::cout << "Caught some other exception.  Trying again." << std::endl;
+        }
+        backoff.wait();
+    }
+    
+    return false;
+}
+
+/**
+ * Ask the submarine to set up the camera, and wait until it has.  This starts
+ * a new session, which we can resume if the link drops.
+ * @return true once the camera is ready, false if we got a signal first
+ */
+bool start_session(PTP::CameraBase& client, PTP::PTPNetwork& net, LinkMonitor& link, uint32_t * session_id, SignalHandler& signalHandler) {
+    PTP::PTPContainer in_data, out_resp, out_data;
+    
+    // Setting up the camera takes the submarine a few seconds, so don't
+    //  mistake that for the link going down
+    net.set_timeout(SD_CAMERA_SETUP_MS);
+    while(signalHandler.gotAnySignal() == false) {
+        PTP::PTPContainer connect_cmd(PTP::PTPContainer::CONTAINER_TYPE_COMMAND, SD_MAGIC);
+        connect_cmd.add_param(SD_REQ_CONNECTED);
+        connect_cmd.add_param(link.get_heartbeat());
+        client.ptp_transaction(connect_cmd, in_data, false, out_resp, out_data);
+        link.sent();
+        link.heard();
+        
+        if(out_resp.code == SD_MAGIC && out_resp.get_param_n(0) == SD_IS_CONNECTED) {
+            *session_id = out_resp.get_param_n(1);
+            link.tune(net);
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+/**
+ * Try to pick up the session we had before the link dropped, so the
+ * submarine doesn't have to set the camera up again.
+ * @return true if the submarine resumed our session
+ */
+bool resume_session(PTP::CameraBase& client, LinkMonitor& link, uint32_t session_id) {
+    PTP::PTPContainer in_data, out_resp, out_data;
+    PTP::PTPContainer resume_cmd(PTP::PTPContainer::CONTAINER_TYPE_COMMAND, SD_MAGIC);
+    resume_cmd.add_param(SD_RESUME);
+    resume_cmd.add_param(session_id);
+    resume_cmd.add_param(link.get_heartbeat());
+    client.ptp_transaction(resume_cmd, in_data, false, out_resp, out_data);
+    link.sent();
+    link.heard();
+    
+    if(out_resp.code == SD_MAGIC && out_resp.get_param_n(0) == SD_OK) {
+        std::cout << "Resumed session" << std::endl;
+        return true;
+    }
+    
+    std::cout << "Submarine did not resume session -- starting a new one" << std::endl;
+    return false;
+}
+
 bool init()
 {
     //Initialize all SDL subsystems
@@ -306,3 +477,57 @@ void draw_bmp_location(const char * image_path, SDL_Surface * screen, int x, int
     
     SDL_UpdateRects(screen, 1, &dest);
 }
+
+/**
+ * Draw the luma statistics over the bottom left of the frame: the histogram,
+ * with a yellow line at the mean, and its end bars red when more than 1% of
+ * the frame is clipped there, and under it a green bar that grows as the
+ * frame gets sharper, for focusing.
+ */
+void draw_luma_hud(SDL_Surface * screen, const LumaStats& stats) {
+    const int bar_width = 8, graph_height = 48, margin = 8, border = 2;
+    const int graph_width = SD_LV_STATS_BINS * bar_width;
+    const int sharpness_height = 4;
+    const int sharpness_full = 32;  // The sharpness that fills the bar, in levels
+    Uint32 background = SDL_MapRGB(screen->format, 0, 0, 0);
+    Uint32 bar = SDL_MapRGB(screen->format, 192, 192, 192);
+    Uint32 clipped = SDL_MapRGB(screen->format, 255, 0, 0);
+    Uint32 mean = SDL_MapRGB(screen->format, 255, 255, 0);
+    Uint32 sharp = SDL_MapRGB(screen->format, 0, 255, 0);
+    int left = margin + border;
+    int bottom = screen->h - margin - border - sharpness_height - border;   // Of the graph
+    SDL_Rect rect;
+    
+    rect.x = margin;
+    rect.y = bottom - graph_height - border;
+    rect.w = graph_width + 2 * border;
+    rect.h = graph_height + 3 * border + sharpness_height;
+    SDL_FillRect(screen, &rect, background);
+    
+    uint32_t tallest = 1;
+    for(int i = 0; i < SD_LV_STATS_BINS; i++) {
+        if(stats.histogram[i] > tallest) tallest = stats.histogram[i];
+    }
+    for(int i = 0; i < SD_LV_STATS_BINS; i++) {
+        bool is_clipped = (i == 0 && stats.clipped_low * 100 > stats.count) ||
+                          (i == SD_LV_STATS_BINS - 1 && stats.clipped_high * 100 > stats.count);
+        rect.h = (uint64_t)stats.histogram[i] * graph_height / tallest;
+        rect.x = left + i * bar_width;
+        rect.y = bottom - rect.h;
+        rect.w = bar_width - 1;
+        SDL_FillRect(screen, &rect, is_clipped ? clipped : bar);
+    }
+    
+    rect.x = left + stats.mean * graph_width / 256;
+    rect.y = bottom - graph_height;
+    rect.w = 2;
+    rect.h = graph_height;
+    SDL_FillRect(screen, &rect, mean);
+    
+    int length = stats.sharpness * graph_width / (sharpness_full * 256);
+    rect.x = left;
+    rect.y = bottom + border;
+    rect.w = length < graph_width ? length : graph_width;
+    rect.h = sharpness_height;
+    SDL_FillRect(screen, &rect, sharp);
+}
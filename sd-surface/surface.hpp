@@ -1,9 +1,25 @@
 #include <SDL/SDL.h>
 
+#include <string>
+#include <stdint.h>
+
+#include "../common/SDDefines.hpp"
+#include "LiveViewClient.hpp"
+
 class SurfaceClient;
 class SignalHandler;
+class LinkMonitor;
+namespace PTP {
+    class PTPNetwork;
+    class CameraBase;
+    class PTPContainer;
+}
 
 bool init();
+bool connect_to_submarine(PTP::PTPNetwork& net, const std::string& host, SignalHandler& signalHandler);
+bool start_session(PTP::CameraBase& client, PTP::PTPNetwork& net, LinkMonitor& link, uint32_t * session_id, SignalHandler& signalHandler);
+bool resume_session(PTP::CameraBase& client, LinkMonitor& link, uint32_t session_id);
 void clean_up(SDL_Joystick *stick);
 void show_image_status(const char * image, SDL_Surface * screen);
 void draw_bmp_location(const char * image_path, SDL_Surface * screen, int x, int y);
+void draw_luma_hud(SDL_Surface * screen, const LumaStats& stats);
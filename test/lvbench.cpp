@@ -0,0 +1,315 @@
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <stdint.h>
+#include <time.h>
+#include <libptp++/libptp++.hpp>
+
+// Time LVData::get_rgb() with every YUV to RGB kernel this machine supports.
+//  Then time the fastest kernel on 1 to N threads.
+//  Then time every output format, luma extraction, luma statistics,
+//  fingerprinting, and the delta and DCT codecs, the latter on a recorded live
+//  view payload if given one (noise doesn't compress), or a smooth synthetic
+//  scene.
+//  Usage: lvbench [frames] [width] [height] [max threads] [payload file]
+
+double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// The floating point conversion get_rgb() used before LVConverter, for comparison
+uint8_t clip(const double v) {
+    if (v<0) return 0;
+    if (v>255) return 255;
+    return v;
+}
+
+void convert_row_double(const uint8_t * yuv, uint16_t * rgb, const int groups, const bool skip) {
+    for(int i = 0; i < groups; i++, yuv += 6) {
+        int8_t u = yuv[0], v = yuv[2];
+        int count = skip ? 2 : 4;
+        const uint8_t ys[4] = { yuv[1], yuv[3], yuv[4], yuv[5] };
+        for(int j = 0; j < count; j++) {
+            uint8_t red = clip(ys[j] + 1.402 * v);
+            uint8_t green = clip(ys[j] - 0.34414 * u - 0.71414 * v);
+            uint8_t blue = clip(ys[j] + 1.772 * u);
+            *(rgb++) = ((red & 0xF8) << 8) | ((green & 0xFC) << 3) | (blue >> 3);
+        }
+    }
+}
+
+int main(int argc, char * argv[]) {
+    int frames = argc > 1 ? atoi(argv[1]) : 200;
+    int width = argc > 2 ? atoi(argv[2]) : 720;
+    int height = argc > 3 ? atoi(argv[3]) : 240;
+    int max_threads = argc > 4 ? atoi(argv[4]) : PTP::WorkerPool::get_cpu_count();
+
+    // Build a live view payload with noise in the viewport
+    int header_size = sizeof(PTP::lv_data_header) + sizeof(PTP::lv_framebuffer_desc);
+    int row_bytes = width * 12 / 8;
+    int payload_size = header_size + row_bytes * height;
+    uint8_t * payload = new uint8_t[payload_size];
+    PTP::lv_data_header head;
+    std::memset(&head, 0, sizeof(head));
+    head.version_major = 2;
+    head.vp_desc_start = sizeof(head);
+    PTP::lv_framebuffer_desc desc;
+    std::memset(&desc, 0, sizeof(desc));
+    desc.data_start = header_size;
+    desc.buffer_width = width;
+    desc.visible_width = width;
+    desc.visible_height = height;
+    std::memcpy(payload, &head, sizeof(head));
+    std::memcpy(payload + sizeof(head), &desc, sizeof(desc));
+    srand(1);
+    for(int i = header_size; i < payload_size; i++) {
+        payload[i] = rand();
+    }
+
+    PTP::LVData lv(payload, payload_size);
+    std::cout << width << "x" << height << ", " << frames << " frames" << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+
+    // The old floating point path, a row at a time like get_rgb()
+    uint16_t * rgb = new uint16_t[width * height];
+    double start = now_ms();
+    for(int f = 0; f < frames; f++) {
+        for(int row = 0; row < height; row++) {
+            convert_row_double(payload + header_size + row * row_bytes, rgb + row * width, width / 4, false);
+        }
+    }
+    double elapsed = (now_ms() - start) / frames;
+    std::cout << std::setw(8) << "double" << ": " << elapsed << " ms/frame" << std::endl;
+    delete[] rgb;
+
+    for(int k = PTP::LVConverter::KERNEL_SCALAR; k < PTP::LVConverter::KERNEL_COUNT; k++) {
+        PTP::LVConverter::Kernel kernel = (PTP::LVConverter::Kernel)k;
+        if(PTP::LVConverter::is_supported(kernel) == false) continue;
+        PTP::LVConverter::set_kernel(kernel);
+
+        int size, out_width, out_height;
+        start = now_ms();
+        for(int f = 0; f < frames; f++) {
+            delete[] lv.get_rgb(&size, &out_width, &out_height);
+        }
+        elapsed = (now_ms() - start) / frames;
+
+        std::cout << std::setw(8) << PTP::LVConverter::get_kernel_name(kernel) << ": " << elapsed << " ms/frame, "
+            << (width * height) / (elapsed * 1000.0) << " Mpixel/s" << std::endl;
+    }
+
+    // Scaling with threads, using the fastest kernel
+    PTP::LVConverter::set_kernel(PTP::LVConverter::KERNEL_AUTO);
+    double serial = 0;
+    for(int threads = 1; threads <= max_threads; threads++) {
+        PTP::LVConverter::set_threads(threads);
+
+        int size, out_width, out_height;
+        delete[] lv.get_rgb(&size, &out_width, &out_height);   // Let the threads settle in
+        start = now_ms();
+        for(int f = 0; f < frames; f++) {
+            delete[] lv.get_rgb(&size, &out_width, &out_height);
+        }
+        elapsed = (now_ms() - start) / frames;
+        if(threads == 1) serial = elapsed;
+
+        std::cout << PTP::LVConverter::get_kernel_name(PTP::LVConverter::get_kernel()) << ", " << threads
+            << " thread(s): " << elapsed << " ms/frame, " << serial / elapsed << "x" << std::endl;
+    }
+
+    // Every output format, on one thread
+    PTP::LVConverter::set_threads(1);
+    uint8_t * pixels = new uint8_t[width * height * 4];
+    for(int f = 0; f < PTP::LVConverter::FORMAT_COUNT; f++) {
+        PTP::LVConverter::Format format = (PTP::LVConverter::Format)f;
+        int pitches[3] = { width * PTP::LVConverter::get_bytes_per_pixel(format), width / 2, width / 2 };
+        uint8_t * planes[3] = { pixels, pixels + width * height, pixels + width * height + width * height / 4 };
+        if(format == PTP::LVConverter::FORMAT_NV12) pitches[1] = width;
+
+        start = now_ms();
+        for(int i = 0; i < frames; i++) {
+            if(PTP::LVConverter::is_planar(format)) {
+                lv.get_planes(format, planes, pitches);
+            } else {
+                lv.get_pixels(format, pixels, pitches[0]);
+            }
+        }
+        elapsed = (now_ms() - start) / frames;
+        std::cout << std::setw(8) << PTP::LVConverter::get_format_name(format) << ": " << elapsed << " ms/frame" << std::endl;
+    }
+
+    // Grayscale live view, full size and halved
+    for(int half = 0; half < 2; half++) {
+        int luma_width, luma_height;
+        lv.get_luma_size(&luma_width, &luma_height, half);
+
+        start = now_ms();
+        for(int i = 0; i < frames; i++) {
+            lv.get_luma(pixels, luma_width, half);
+        }
+        elapsed = (now_ms() - start) / frames;
+        std::cout << "luma" << (half ? " / 2" : "") << ": " << elapsed << " ms/frame, "
+            << luma_width * luma_height << " bytes" << std::endl;
+    }
+
+    // Luma statistics, gathered during conversion, against the conversion alone
+    PTP::LVStats stats;
+    for(int gather = 0; gather < 2; gather++) {
+        lv.set_stats(gather ? &stats : NULL);
+
+        start = now_ms();
+        for(int i = 0; i < frames; i++) {
+            stats.reset();
+            lv.get_rgb(pixels, width * 2);
+        }
+        elapsed = (now_ms() - start) / frames;
+        std::cout << "rgb565" << (gather ? " + stats" : "") << ": " << elapsed << " ms/frame";
+        if(gather) {
+            std::cout << ", mean " << (int)stats.get_mean() << ", sharpness " << stats.get_sharpness() / 256.0;
+        }
+        std::cout << std::endl;
+    }
+    lv.set_stats(NULL);
+    delete[] pixels;
+
+    // Converting and scaling to the surface's screen in one pass
+    const int screen_width = 640, screen_height = 480;
+    uint8_t * screen = new uint8_t[screen_width * screen_height * 2];
+    PTP::LVScaler::Filter filters[] = { PTP::LVScaler::FILTER_NEAREST, PTP::LVScaler::FILTER_BILINEAR };
+    const char * filter_names[] = { "nearest", "bilinear" };
+    for(int f = 0; f < 2; f++) {
+        PTP::LVScaler scaler(filters[f]);
+        lv.get_rgb_scaled(screen, screen_width * 2, screen_width, screen_height, scaler);
+
+        start = now_ms();
+        for(int i = 0; i < frames; i++) {
+            lv.get_rgb_scaled(screen, screen_width * 2, screen_width, screen_height, scaler);
+        }
+        elapsed = (now_ms() - start) / frames;
+        std::cout << "convert + " << filter_names[f] << " to " << screen_width << "x" << screen_height
+            << ": " << elapsed << " ms/frame" << std::endl;
+    }
+    delete[] screen;
+
+    // Fingerprinting the viewport, to skip converting and sending a frame the camera hasn't refreshed
+    PTP::LVFrameView view(payload, payload_size);
+    const int row_steps[] = { 1, 4 };
+    for(int s = 0; s < 2; s++) {
+        start = now_ms();
+        for(int i = 0; i < frames; i++) {
+            view.get_fingerprint(false, row_steps[s]);
+        }
+        elapsed = (now_ms() - start) / frames;
+        std::cout << "fingerprint, 1 row in " << row_steps[s] << ": " << elapsed << " ms/frame" << std::endl;
+    }
+
+    // Delta coding the YUV viewport, when nothing changes and when a quarter of it does
+    int viewport_size = lv.get_viewport_size();
+    int viewport_row_bytes = (width / 4) * 6;
+    uint8_t * viewport = new uint8_t[viewport_size];
+    lv.get_viewport(viewport);
+    PTP::LVDeltaCodec delta(2, frames + 1);
+    uint8_t * encoded = new uint8_t[delta.get_max_size(viewport_size, viewport_row_bytes)];
+    const char * scene_names[] = { "static", "moving" };
+    int quarter = viewport_row_bytes * height / 4;
+    uint8_t * noise = new uint8_t[quarter * 2];
+    for(int i = 0; i < quarter * 2; i++) {
+        noise[i] = rand();
+    }
+    for(int scene = 0; scene < 2; scene++) {
+        long bytes = 0, tiles = 0, tiles_sent = 0;
+        delta.request_keyframe();
+        delta.encode(viewport, viewport_size, viewport_row_bytes, encoded);
+
+        start = now_ms();
+        for(int i = 0; i < frames; i++) {
+            if(scene == 1) {
+                // Something moving through a quarter of the rows
+                int first_row = (i * 7) % (height * 3 / 4);
+                std::memcpy(viewport + viewport_size - viewport_row_bytes * (height - first_row), noise + (i * 131) % quarter, quarter);
+            }
+            bytes += delta.encode(viewport, viewport_size, viewport_row_bytes, encoded);
+            tiles += delta.get_stats().tiles;
+            tiles_sent += delta.get_stats().tiles_sent;
+        }
+        elapsed = (now_ms() - start) / frames;
+        std::cout << "delta, " << scene_names[scene] << ": " << elapsed << " ms/frame, " << bytes / frames << " of "
+            << viewport_size << " bytes/frame, " << 100.0 - tiles_sent * 100.0 / tiles << "% of tiles skipped" << std::endl;
+    }
+    delete[] noise;
+    delete[] encoded;
+
+    // DCT coding a frame at a few qualities
+    std::vector<uint8_t> frame;
+    if(argc > 5) {
+        FILE * file = fopen(argv[5], "rb");
+        if(file == NULL) {
+            std::cout << "Can't open " << argv[5] << std::endl;
+            return 1;
+        }
+        uint8_t buffer[4096];
+        size_t got;
+        while((got = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            frame.insert(frame.end(), buffer, buffer + got);
+        }
+        fclose(file);
+    } else {
+        frame.assign(viewport, viewport + viewport_size);
+        for(int row = 0; row < height; row++) {
+            uint8_t * yuv = &frame[header_size + row * viewport_row_bytes];
+            for(int g = 0; g < width / 4; g++, yuv += 6) {
+                yuv[0] = (int8_t)(g % 64 - 32);
+                yuv[2] = (int8_t)(row / 4 - 30);
+                for(int k = 0; k < 4; k++) {
+                    int x = g * 4 + k;
+                    yuv[k < 1 ? 1 : k + 2] = 128 + 100 * std::sin(x / 23.0) * std::cos(row / 17.0) + (x * row) % 7;
+                }
+            }
+        }
+    }
+    PTP::LVData original;
+    original.read(&frame[0], frame.size());
+    int frame_width, frame_height;
+    original.get_rgb_size(&frame_width, &frame_height);
+    std::vector<uint8_t> luma(frame_width * frame_height), decoded_luma(frame_width * frame_height);
+    original.get_pixels(PTP::LVConverter::FORMAT_Y8, &luma[0], frame_width);
+    const int qualities[] = { 25, 50, 75, 90 };
+    for(int q = 0; q < 4; q++) {
+        PTP::LVDCTCodec dct(qualities[q]);
+        std::vector<uint8_t> dct_encoded(dct.get_max_size(&frame[0], frame.size()));
+        std::vector<uint8_t> decoded(frame.size());
+        int encoded_size = 0;
+
+        start = now_ms();
+        for(int i = 0; i < frames; i++) {
+            encoded_size = dct.encode(&frame[0], frame.size(), &dct_encoded[0]);
+        }
+        double encode_ms = (now_ms() - start) / frames;
+        start = now_ms();
+        for(int i = 0; i < frames; i++) {
+            dct.decode(&dct_encoded[0], encoded_size, &decoded[0]);
+        }
+        double decode_ms = (now_ms() - start) / frames;
+
+        PTP::LVData result;
+        result.read(&decoded[0], decoded.size());
+        result.get_pixels(PTP::LVConverter::FORMAT_Y8, &decoded_luma[0], frame_width);
+        double error = 0;
+        for(size_t i = 0; i < luma.size(); i++) {
+            error += (luma[i] - decoded_luma[i]) * (luma[i] - decoded_luma[i]);
+        }
+        std::cout << "dct, quality " << qualities[q] << ": " << encode_ms << " ms to encode, " << decode_ms << " ms to decode, "
+            << encoded_size << " of " << frame.size() << " bytes, Y PSNR "
+            << (error == 0 ? 99 : 10 * std::log10(255.0 * 255.0 * luma.size() / error)) << " dB" << std::endl;
+    }
+    delete[] viewport;
+
+    delete[] payload;
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cstdio>
+#include <stdint.h>
+#include <unistd.h>
+#include <libptp++/libptp++.hpp>
+
+// Save live view payloads from the first camera found, exactly as CHDK sends
+//  them (viewport, OSD and palette), for lvgolden and lvbench to run over.
+//  Frames the camera hasn't refreshed yet are skipped, so every file differs.
+//
+//  Usage: lvcapture [frames] [prefix]
+//  Writes prefix-000.lv, prefix-001.lv, ... (frames defaults to 1, prefix to
+//  "capture"). Check the ones worth keeping into test/golden/, and rerun
+//  lvgolden -u to add their hashes.
+int main(int argc, char * argv[]) {
+    int frames = argc > 1 ? std::atoi(argv[1]) : 1;
+    std::string prefix = argc > 2 ? argv[2] : "capture";
+    PTP::PTPUSB proto;
+    PTP::CHDKCamera cam;
+
+    try {
+        proto.connect_to_first();
+    } catch(...) {
+        std::cout << "No camera found" << std::endl;
+        return 1;
+    }
+
+    cam.set_protocol(&proto);
+    cam.execute_lua("switch_mode_usb(1)", NULL);   // Live view only runs in record mode
+    sleep(1);
+
+    uint64_t last = 0;
+    for(int n = 0; n < frames; ) {
+        PTP::PTPContainer cmd(PTP::PTPContainer::CONTAINER_TYPE_COMMAND, 0x9999);
+        cmd.add_param(PTP::PTP_CHDK_GetDisplayData);
+        cmd.add_param(LV_TFR_VIEWPORT | LV_TFR_BITMAP | LV_TFR_PALETTE);
+
+        PTP::PTPContainer data, out_resp, out_data;
+        const uint8_t * payload;
+        int size;
+        PTP::LVFrameView view;
+        try {
+            cam.ptp_transaction(cmd, data, true, out_resp, out_data);
+            payload = out_data.get_payload_pointer(&size);
+            view.parse(payload, size);
+        } catch(PTP::LIBPTP_PP_ERRORS e) {
+            std::cout << "Couldn't get a frame: error " << e << std::endl;
+            return 1;
+        }
+
+        uint64_t fingerprint = view.get_fingerprint(true);
+        if(n > 0 && fingerprint == last) {
+            usleep(5000);
+            continue;
+        }
+        last = fingerprint;
+
+        char name[256];
+        std::snprintf(name, sizeof(name), "%s-%03d.lv", prefix.c_str(), n);
+        FILE * file = std::fopen(name, "wb");
+        if(file == NULL || std::fwrite(payload, 1, size, file) != (size_t)size) {
+            std::cout << "Couldn't write " << name << std::endl;
+            if(file != NULL) std::fclose(file);
+            return 1;
+        }
+        std::fclose(file);
+
+        const PTP::lv_framebuffer_desc& vp = view.get_viewport_desc();
+        const PTP::lv_framebuffer_desc * bm = view.get_bitmap_desc();
+        std::cout << name << ": " << size << " bytes, viewport " << vp.visible_width << "x" << vp.visible_height
+            << " (buffer " << vp.buffer_width << "), aspect " << view.get_header().lcd_aspect_ratio;
+        if(bm != NULL) {
+            std::cout << ", OSD " << bm->visible_width << "x" << bm->visible_height << " (buffer " << bm->buffer_width << ")";
+        }
+        std::cout << std::endl;
+        n++;
+    }
+
+    return 0;
+}
@@ -0,0 +1,469 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <iterator>
+#include <new>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <stdint.h>
+#include <time.h>
+#include <libptp++/libptp++.hpp>
+
+// Run every LVData conversion over a corpus of live view payloads, and check
+//  each output against its golden hash, with every kernel this machine
+//  supports and on several threads. Then time each one, and count what it
+//  allocates.
+//
+//  The corpus is a few synthetic payloads, in both aspect ratios, with and
+//  without padding (buffer_width > visible_width) and the OSD, plus any
+//  payloads captured from a camera with lvcapture. Captured payloads are
+//  named after their file, so keep the names when checking them in.
+//
+//  Usage: lvgolden [-u] [-n frames] [golden file] [payload files...]
+//    -u  (Re)write the golden file from this run, instead of checking it
+//    -n  How many frames to time each conversion over (default 20)
+//  The golden file defaults to test/golden/lvgolden.txt. Timings are in ns per
+//  pixel of the frame (of the screen, when scaling) and MB/s of output.
+
+// Count every allocation, so we can tell what a conversion costs besides time.
+//  Kept out of line, or GCC takes the free()s for mismatched deletes.
+static unsigned long allocations = 0;
+
+#if __cplusplus >= 201103L
+#define LV_THROW_BAD_ALLOC
+#else
+#define LV_THROW_BAD_ALLOC throw(std::bad_alloc)
+#endif
+
+__attribute__((noinline)) void * operator new(size_t size) LV_THROW_BAD_ALLOC {
+    allocations++;
+    void * p = malloc(size > 0 ? size : 1);
+    if(p == NULL) throw std::bad_alloc();
+    return p;
+}
+
+__attribute__((noinline)) void * operator new[](size_t size) LV_THROW_BAD_ALLOC {
+    allocations++;
+    void * p = malloc(size > 0 ? size : 1);
+    if(p == NULL) throw std::bad_alloc();
+    return p;
+}
+
+__attribute__((noinline)) void operator delete(void * p) throw() {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void * p) throw() {
+    free(p);
+}
+
+double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// 64-bit FNV-1a
+uint64_t hash_bytes(const uint8_t * data, const size_t size, uint64_t hash=0xCBF29CE484222325ULL) {
+    for(size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+struct Payload {
+    std::string name;
+    std::vector<uint8_t> data;
+};
+
+// Build a payload: a scene with smooth ramps, hard edges, and chroma and
+//  luma running right out to the ends of their ranges (so clipping gets
+//  exercised), and junk in the padding. With bm_width, a PAL8 OSD of that
+//  size (and a type 3 palette) is added, with opaque, translucent and
+//  transparent parts.
+Payload make_payload(const std::string& name, const int width, const int buffer_width, const int height,
+                     const int aspect, const int bm_width=0, const int bm_buffer_width=0, const int bm_height=0) {
+    int header_size = sizeof(PTP::lv_data_header) + sizeof(PTP::lv_framebuffer_desc);
+    int vp_size = (buffer_width * 12 / 8) * height;
+    int bm_desc_start = header_size + vp_size;
+    int palette_start = bm_desc_start + sizeof(PTP::lv_framebuffer_desc);
+    int bitmap_start = palette_start + 256 * 4;
+    Payload payload;
+    payload.name = name;
+    payload.data.assign(bm_width > 0 ? bitmap_start + bm_buffer_width * bm_height : bm_desc_start, 0);
+    uint8_t * data = &payload.data[0];
+
+    PTP::lv_data_header head;
+    std::memset(&head, 0, sizeof(head));
+    head.version_major = 2;
+    head.version_minor = 1;
+    head.lcd_aspect_ratio = aspect;
+    head.vp_desc_start = sizeof(head);
+    PTP::lv_framebuffer_desc desc;
+    std::memset(&desc, 0, sizeof(desc));
+    desc.fb_type = PTP::LV_FB_YUV8;
+    desc.data_start = header_size;
+    desc.buffer_width = buffer_width;
+    desc.visible_width = width;
+    desc.visible_height = height;
+
+    int row_bytes = buffer_width * 12 / 8;
+    for(int row = 0; row < height; row++) {
+        uint8_t * yuv = data + header_size + row * row_bytes;
+        std::memset(yuv, 0xEE, row_bytes);      // Padding, which mustn't show up
+        for(int g = 0; g < width / 4; g++, yuv += 6) {
+            yuv[0] = (int8_t)((g * 5 + row * 3) % 256 - 128);
+            yuv[2] = (int8_t)(127 - (g * 3 + row * 7) % 256);
+            for(int k = 0; k < 4; k++) {
+                int x = g * 4 + k;
+                int y = x * 255 / width;                        // Ramp
+                if((x / 32 + row / 32) % 2) y = 255 - y;        // Checkers, for edges
+                if(row < 8) y = 0;                              // Clipped black
+                if(row >= height - 8) y = 255;                  // Clipped white
+                yuv[k == 0 ? 1 : k == 1 ? 3 : k + 2] = y;
+            }
+        }
+    }
+
+    if(bm_width > 0) {
+        head.palette_type = 3;
+        head.palette_data_start = palette_start;
+        head.bm_desc_start = bm_desc_start;
+        PTP::lv_framebuffer_desc bm;
+        std::memset(&bm, 0, sizeof(bm));
+        bm.fb_type = PTP::LV_FB_PAL8;
+        bm.data_start = bitmap_start;
+        bm.buffer_width = bm_buffer_width;
+        bm.visible_width = bm_width;
+        bm.visible_height = bm_height;
+        std::memcpy(data + bm_desc_start, &bm, sizeof(bm));
+
+        // V, U, Y, A for an opaque white, a translucent red and an opaque blue
+        const uint8_t colours[3][4] = { { 0, 0, 235, 255 }, { 100, 200, 80, 128 }, { 200, 100, 40, 255 } };
+        for(int c = 0; c < 3; c++) {
+            std::memcpy(data + palette_start + (c + 1) * 4, colours[c], 4);
+        }
+        for(int y = 0; y < bm_height; y++) {
+            uint8_t * line = data + bitmap_start + y * bm_buffer_width;
+            for(int x = 0; x < bm_buffer_width; x++) {
+                line[x] = x >= bm_width ? 0xEE : (y / 16 + x / 16) % 4;     // 0 is transparent
+            }
+        }
+    }
+
+    std::memcpy(data, &head, sizeof(head));
+    std::memcpy(data + sizeof(head), &desc, sizeof(desc));
+    return payload;
+}
+
+// What we do with each payload
+enum PathKind {
+    PATH_RGB = 0,       // LVData::get_rgb
+    PATH_PIXELS,        // LVData::get_pixels, in format arg
+    PATH_PLANES,        // LVData::get_planes, in format arg
+    PATH_LUMA,          // LVData::get_luma, halved if arg
+    PATH_SCALED,        // LVData::get_rgb_scaled with filter arg, then the OSD
+    PATH_VIEWPORT,      // LVData::get_viewport, with the OSD
+    PATH_STATS          // LVData::get_rgb, gathering LVStats
+};
+
+struct Path {
+    const char * name;
+    PathKind kind;
+    int arg;
+};
+
+const Path paths[] = {
+    { "rgb565", PATH_RGB, 0 },
+    { "rgb565le", PATH_PIXELS, PTP::LVConverter::FORMAT_RGB565_LE },
+    { "rgb565be", PATH_PIXELS, PTP::LVConverter::FORMAT_RGB565_BE },
+    { "rgb888", PATH_PIXELS, PTP::LVConverter::FORMAT_RGB888 },
+    { "bgra8888", PATH_PIXELS, PTP::LVConverter::FORMAT_BGRA8888 },
+    { "y8", PATH_PIXELS, PTP::LVConverter::FORMAT_Y8 },
+    { "i420", PATH_PLANES, PTP::LVConverter::FORMAT_I420 },
+    { "nv12", PATH_PLANES, PTP::LVConverter::FORMAT_NV12 },
+    { "luma", PATH_LUMA, 0 },
+    { "luma/2", PATH_LUMA, 1 },
+    { "nearest", PATH_SCALED, PTP::LVScaler::FILTER_NEAREST },
+    { "bilinear", PATH_SCALED, PTP::LVScaler::FILTER_BILINEAR },
+    { "viewport", PATH_VIEWPORT, 0 },
+    { "stats", PATH_STATS, 0 },
+};
+const int path_count = sizeof(paths) / sizeof(paths[0]);
+const int screen_width = 640, screen_height = 480;    // The surface's
+
+// Everything a conversion writes into, kept between frames so the harness
+//  itself doesn't allocate while it's counting
+struct Buffers {
+    std::vector<uint8_t> out;
+    PTP::LVScaler scaler;
+    PTP::LVOverlay overlay;
+    PTP::LVStats stats;
+};
+
+// Run \a path once, and return how many bytes of out it wrote (and pixels it
+//  made, for the timings)
+size_t run_path(const Path& path, PTP::LVData& lv, const bool skip, Buffers& buffers, int * pixels) {
+    int width, height;
+    lv.get_rgb_size(&width, &height, skip);
+    uint8_t * out = &buffers.out[0];
+    *pixels = width * height;
+
+    switch(path.kind) {
+        case PATH_RGB:
+            lv.get_rgb(out, width * 2, skip);
+            return width * height * 2;
+        case PATH_PIXELS: {
+            PTP::LVConverter::Format format = (PTP::LVConverter::Format)path.arg;
+            int pitch = width * PTP::LVConverter::get_bytes_per_pixel(format);
+            lv.get_pixels(format, out, pitch, skip);
+            return pitch * height;
+        }
+        case PATH_PLANES: {
+            PTP::LVConverter::Format format = (PTP::LVConverter::Format)path.arg;
+            int chroma_height = (height + 1) / 2;
+            int pitches[3] = { width, width / 2, width / 2 };
+            if(format == PTP::LVConverter::FORMAT_NV12) pitches[1] = width / 2 * 2;
+            uint8_t * planes[3] = { out, out + width * height, out + width * height + pitches[1] * chroma_height };
+            lv.get_planes(format, planes, pitches, skip);
+            return width * height + pitches[1] * chroma_height +
+                   (format == PTP::LVConverter::FORMAT_I420 ? pitches[2] * chroma_height : 0);
+        }
+        case PATH_LUMA:
+            lv.get_luma_size(&width, &height, path.arg != 0, skip);
+            lv.get_luma(out, width, path.arg != 0, skip);
+            return width * height;
+        case PATH_SCALED:
+            buffers.scaler.set_filter((PTP::LVScaler::Filter)path.arg);
+            lv.get_rgb_scaled(out, screen_width * 2, screen_width, screen_height, buffers.scaler, skip);
+            lv.composite_overlay(out, screen_width * 2, screen_width, screen_height, buffers.overlay);
+            *pixels = screen_width * screen_height;
+            return screen_width * screen_height * 2;
+        case PATH_VIEWPORT: {
+            int size = lv.get_viewport_size(true, skip);
+            lv.get_viewport(out, true, skip);
+            return size;
+        }
+        case PATH_STATS: {
+            buffers.stats.reset();
+            lv.set_stats(&buffers.stats);
+            lv.get_rgb(out, width * 2, skip);
+            lv.set_stats(NULL);
+
+            // The statistics are the output here, not the pixels
+            uint32_t fields[7 + 16];
+            fields[0] = buffers.stats.get_count();
+            fields[1] = buffers.stats.get_min();
+            fields[2] = buffers.stats.get_max();
+            fields[3] = buffers.stats.get_mean();
+            fields[4] = buffers.stats.get_sharpness();
+            fields[5] = buffers.stats.get_clipped_low();
+            fields[6] = buffers.stats.get_clipped_high();
+            buffers.stats.get_histogram(fields + 7, 16);
+            std::memcpy(out, fields, sizeof(fields));
+            return sizeof(fields);
+        }
+    }
+    return 0;
+}
+
+std::string golden_key(const Payload& payload, const Path& path, const bool skip) {
+    return payload.name + " " + path.name + " " + (skip ? "1" : "0");
+}
+
+// Hash every path over every payload into \a hashes, and compare with \a golden
+//  (unless it's empty). \a label says what we ran with.
+bool check_all(const std::vector<Payload>& corpus, const std::map<std::string, uint64_t>& golden,
+               std::map<std::string, uint64_t>& hashes, const std::string& label) {
+    bool ok = true;
+    int checked = 0;
+
+    for(size_t p = 0; p < corpus.size(); p++) {
+        PTP::LVData lv(&corpus[p].data[0], corpus[p].data.size());
+        Buffers buffers;
+        buffers.out.resize(corpus[p].data.size() * 4 + screen_width * screen_height * 2);
+
+        for(int i = 0; i < path_count; i++) {
+            for(int skip = 0; skip < 2; skip++) {
+                int pixels;
+                size_t size = run_path(paths[i], lv, skip, buffers, &pixels);
+                std::string key = golden_key(corpus[p], paths[i], skip);
+                uint64_t hash = hash_bytes(&buffers.out[0], size);
+                hashes[key] = hash;
+
+                std::map<std::string, uint64_t>::const_iterator expected = golden.find(key);
+                if(golden.empty()) {
+                    continue;
+                } else if(expected == golden.end()) {
+                    std::cout << label << ": no golden hash for " << key << " (run with -u to add it)" << std::endl;
+                    ok = false;
+                } else if(expected->second != hash) {
+                    std::cout << label << ": " << key << " doesn't match its golden output" << std::endl;
+                    ok = false;
+                } else {
+                    checked++;
+                }
+            }
+        }
+    }
+
+    if(ok && golden.empty() == false) std::cout << label << ": " << checked << " outputs OK" << std::endl;
+    return ok;
+}
+
+// Time every path over every payload, with the kernel picked for this machine
+void benchmark(const std::vector<Payload>& corpus, const int frames) {
+    std::cout << std::endl << std::setw(14) << "payload" << std::setw(10) << "path" << std::setw(6) << "skip"
+        << std::setw(10) << "ns/pixel" << std::setw(10) << "MB/s" << std::setw(14) << "allocs/frame" << std::endl;
+
+    for(size_t p = 0; p < corpus.size(); p++) {
+        PTP::LVData lv(&corpus[p].data[0], corpus[p].data.size());
+        Buffers buffers;
+        buffers.out.resize(corpus[p].data.size() * 4 + screen_width * screen_height * 2);
+
+        for(int i = 0; i < path_count; i++) {
+            for(int skip = 0; skip < 2; skip++) {
+                int pixels;
+                size_t size = run_path(paths[i], lv, skip, buffers, &pixels);  // Settle the scaler's buffers in
+
+                unsigned long allocations_before = allocations;
+                double start = now_ms();
+                for(int f = 0; f < frames; f++) {
+                    run_path(paths[i], lv, skip, buffers, &pixels);
+                }
+                double elapsed = (now_ms() - start) / frames;
+                unsigned long allocated = allocations - allocations_before;
+
+                std::cout << std::setw(14) << corpus[p].name << std::setw(10) << paths[i].name << std::setw(6) << skip
+                    << std::setw(10) << std::fixed << std::setprecision(2) << elapsed * 1000000.0 / pixels
+                    << std::setw(10) << std::setprecision(1) << size / (elapsed * 1000.0)
+                    << std::setw(14) << std::setprecision(2) << (double)allocated / frames << std::endl;
+            }
+        }
+    }
+    std::cout.unsetf(std::ios::fixed);
+}
+
+bool read_golden(const std::string& file_name, std::map<std::string, uint64_t>& golden) {
+    std::ifstream file(file_name.c_str());
+    if(file.is_open() == false) {
+        return false;
+    }
+
+    std::string line;
+    while(std::getline(file, line)) {
+        if(line.empty() || line[0] == '#') continue;
+        std::istringstream fields(line);
+        std::string payload, path, skip, hash;
+        fields >> payload >> path >> skip >> hash;
+        golden[payload + " " + path + " " + skip] = strtoull(hash.c_str(), NULL, 16);
+    }
+    return true;
+}
+
+bool write_golden(const std::string& file_name, const std::map<std::string, uint64_t>& hashes) {
+    std::ofstream file(file_name.c_str());
+    if(file.is_open() == false) {
+        return false;
+    }
+
+    file << "# Golden outputs for lvgolden: payload, conversion, skip, and the FNV-1a hash of the output" << std::endl;
+    for(std::map<std::string, uint64_t>::const_iterator i = hashes.begin(); i != hashes.end(); ++i) {
+        char hash[17];
+        snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)i->second);
+        file << i->first << " " << hash << std::endl;
+    }
+    return true;
+}
+
+int main(int argc, char * argv[]) {
+    bool update = false;
+    int frames = 20;
+    std::string golden_file = "test/golden/lvgolden.txt";
+    std::vector<std::string> captures;
+    bool have_golden_file = false;
+
+    for(int i = 1; i < argc; i++) {
+        if(std::strcmp(argv[i], "-u") == 0) {
+            update = true;
+        } else if(std::strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+        } else if(have_golden_file == false) {
+            golden_file = argv[i];
+            have_golden_file = true;
+        } else {
+            captures.push_back(argv[i]);
+        }
+    }
+
+    // The synthetic corpus: 4:3 and 16:9, with and without padding and the OSD,
+    //  and a width that isn't a whole number of groups
+    std::vector<Payload> corpus;
+    corpus.push_back(make_payload("4x3", 720, 720, 240, PTP::LV_ASPECT_4_3));
+    corpus.push_back(make_payload("4x3-padded", 704, 720, 240, PTP::LV_ASPECT_4_3, 360, 368, 240));
+    corpus.push_back(make_payload("4x3-odd", 358, 384, 239, PTP::LV_ASPECT_4_3));
+    corpus.push_back(make_payload("16x9", 960, 960, 270, PTP::LV_ASPECT_16_9, 480, 480, 270));
+    corpus.push_back(make_payload("16x9-padded", 640, 720, 180, PTP::LV_ASPECT_16_9, 480, 496, 240));
+    for(size_t i = 0; i < captures.size(); i++) {
+        Payload payload;
+        std::ifstream file(captures[i].c_str(), std::ios::binary);
+        if(file.is_open() == false) {
+            std::cout << "Can't open " << captures[i] << std::endl;
+            return 1;
+        }
+        payload.data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        size_t slash = captures[i].find_last_of('/');
+        payload.name = slash == std::string::npos ? captures[i] : captures[i].substr(slash + 1);
+        corpus.push_back(payload);
+    }
+    for(size_t p = 0; p < corpus.size(); p++) {
+        try {
+            PTP::LVFrameView view(&corpus[p].data[0], corpus[p].data.size());
+        } catch(PTP::LIBPTP_PP_ERRORS e) {
+            std::cout << corpus[p].name << ": not a live view payload (" << e << ")" << std::endl;
+            return 1;
+        }
+    }
+
+    std::map<std::string, uint64_t> golden, hashes;
+    if(update == false && read_golden(golden_file, golden) == false) {
+        std::cout << "Can't read " << golden_file << " (run with -u to write it)" << std::endl;
+        return 1;
+    }
+
+    // Every kernel must give the golden output, as must any number of threads
+    bool ok = true;
+    for(int k = PTP::LVConverter::KERNEL_SCALAR; k < PTP::LVConverter::KERNEL_COUNT; k++) {
+        PTP::LVConverter::Kernel kernel = (PTP::LVConverter::Kernel)k;
+        if(PTP::LVConverter::is_supported(kernel) == false) continue;
+        PTP::LVConverter::set_kernel(kernel);
+        ok = check_all(corpus, golden, hashes, PTP::LVConverter::get_kernel_name(kernel)) && ok;
+        if(update) {
+            golden = hashes;    // The rest must agree with the first
+        }
+    }
+    PTP::LVConverter::set_kernel(PTP::LVConverter::KERNEL_AUTO);
+    PTP::LVConverter::set_threads(0);
+    ok = check_all(corpus, golden, hashes, "threads") && ok;
+    PTP::LVConverter::set_threads(1);
+
+    if(update) {
+        if(ok == false) {
+            std::cout << "Not writing " << golden_file << ": the kernels disagree" << std::endl;
+            return 1;
+        }
+        if(write_golden(golden_file, hashes) == false) {
+            std::cout << "Can't write " << golden_file << std::endl;
+            return 1;
+        }
+        std::cout << "Wrote " << hashes.size() << " golden outputs to " << golden_file << std::endl;
+    }
+
+    benchmark(corpus, frames);
+    return ok ? 0 : 1;
+}
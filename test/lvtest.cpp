@@ -0,0 +1,1067 @@
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <stdint.h>
+#include <libptp++/libptp++.hpp>
+
+// Check every YUV to RGB kernel this machine supports against the scalar one,
+//  for every possible (Y, U, V), with and without skip.
+bool check_kernel(PTP::LVConverter::Kernel kernel, PTP::LVConverter::RowFunction convert) {
+    const int groups = 256 + 7;     // Enough for the vector loops, plus a tail
+    uint8_t yuv[groups * 6];
+    uint16_t expected[groups * 4], actual[groups * 4];
+
+    for(int skip = 0; skip < 2; skip++) {
+        for(int u = 0; u < 256; u++) {
+            for(int v = 0; v < 256; v++) {
+                for(int i = 0; i < groups; i++) {
+                    yuv[i * 6 + 0] = u;
+                    yuv[i * 6 + 1] = i;
+                    yuv[i * 6 + 2] = v;
+                    yuv[i * 6 + 3] = 255 - i;
+                    yuv[i * 6 + 4] = i * 7;
+                    yuv[i * 6 + 5] = i * 13 + v;
+                }
+
+                std::memset(actual, 0xAA, sizeof(actual));
+                PTP::LVConverter::convert_row_scalar(yuv, expected, groups, skip);
+                convert(yuv, actual, groups, skip);
+
+                int count = groups * (skip ? 2 : 4);
+                if(std::memcmp(expected, actual, count * 2) != 0) {
+                    std::cout << PTP::LVConverter::get_kernel_name(kernel) << ": mismatch at u=" << u
+                        << ", v=" << v << ", skip=" << skip << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+
+    std::cout << PTP::LVConverter::get_kernel_name(kernel) << ": OK" << std::endl;
+    return true;
+}
+
+// Build a live view payload with a noisy viewport, buffer_width wide with
+//  width of it visible.
+uint8_t * make_payload(const int width, const int buffer_width, const int height, int * payload_size) {
+    int header_size = sizeof(PTP::lv_data_header) + sizeof(PTP::lv_framebuffer_desc);
+    *payload_size = header_size + (buffer_width * 12 / 8) * height;
+    uint8_t * payload = new uint8_t[*payload_size];
+    std::memset(payload, 0, *payload_size);
+
+    PTP::lv_data_header head;
+    std::memset(&head, 0, sizeof(head));
+    head.version_major = 2;
+    head.vp_desc_start = sizeof(head);
+    PTP::lv_framebuffer_desc desc;
+    std::memset(&desc, 0, sizeof(desc));
+    desc.data_start = header_size;
+    desc.buffer_width = buffer_width;
+    desc.visible_width = width;
+    desc.visible_height = height;
+    std::memcpy(payload, &head, sizeof(head));
+    std::memcpy(payload + sizeof(head), &desc, sizeof(desc));
+
+    for(int i = header_size; i < *payload_size; i++) {
+        payload[i] = (i * 31) ^ (i >> 5);
+    }
+
+    return payload;
+}
+
+// Build a viewport with padding at the end of each row, and check get_rgb()
+//  only converts the visible part.
+bool check_lvdata() {
+    const int width = 360, buffer_width = 384, height = 240;
+    int header_size = sizeof(PTP::lv_data_header) + sizeof(PTP::lv_framebuffer_desc);
+    int row_bytes = buffer_width * 12 / 8;
+    int payload_size;
+    uint8_t * payload = make_payload(width, buffer_width, height, &payload_size);
+
+    PTP::LVData lv(payload, payload_size);
+    bool ok = true;
+    for(int skip = 0; skip < 2 && ok; skip++) {
+        int size, out_width, out_height;
+        uint16_t * rgb = (uint16_t *)lv.get_rgb(&size, &out_width, &out_height, skip);
+        uint16_t * expected = new uint16_t[out_width];
+
+        if(out_width != width / (skip ? 2 : 1) || out_height != height || size != out_width * out_height * 2) {
+            std::cout << "get_rgb: bad size " << out_width << "x" << out_height << " (" << size << ")" << std::endl;
+            ok = false;
+        }
+
+        for(int row = 0; row < height && ok; row++) {
+            PTP::LVConverter::convert_row_scalar(payload + header_size + row * row_bytes, expected, width / 4, skip);
+            if(std::memcmp(expected, rgb + row * out_width, out_width * 2) != 0) {
+                std::cout << "get_rgb: mismatch in row " << row << ", skip=" << skip << std::endl;
+                ok = false;
+            }
+        }
+
+        // Same again, into a buffer with padding at the end of each row
+        int pitch = out_width * 2 + 64;
+        uint8_t * pitched = new uint8_t[pitch * out_height];
+        std::memset(pitched, 0xAA, pitch * out_height);
+        lv.get_rgb(pitched, pitch, skip);
+        for(int row = 0; row < height && ok; row++) {
+            uint8_t * padding = pitched + row * pitch + out_width * 2;
+            if(std::memcmp(pitched + row * pitch, rgb + row * out_width, out_width * 2) != 0 ||
+               padding[0] != 0xAA || padding[63] != 0xAA) {
+                std::cout << "get_rgb: pitched mismatch in row " << row << ", skip=" << skip << std::endl;
+                ok = false;
+            }
+        }
+
+        delete[] pitched;
+        delete[] expected;
+        delete[] rgb;
+    }
+
+    if(ok) std::cout << "get_rgb: OK" << std::endl;
+    delete[] payload;
+    return ok;
+}
+
+// Check every output format against the reference formula, pixel by pixel
+int clip(const int v) {
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+bool check_formats() {
+    const int width = 360, buffer_width = 384, height = 239;   // Odd height, for the 4:2:0 formats
+    int header_size = sizeof(PTP::lv_data_header) + sizeof(PTP::lv_framebuffer_desc);
+    int row_bytes = buffer_width * 12 / 8;
+    int payload_size;
+    uint8_t * payload = make_payload(width, buffer_width, height, &payload_size);
+    PTP::LVData lv(payload, payload_size);
+    bool ok = true;
+
+    for(int f = 0; f < PTP::LVConverter::FORMAT_COUNT && ok; f++) {
+        PTP::LVConverter::Format format = (PTP::LVConverter::Format)f;
+        for(int skip = 0; skip < 2 && ok; skip++) {
+            int out_width, out_height;
+            lv.get_rgb_size(&out_width, &out_height, skip);
+            int bpp = PTP::LVConverter::get_bytes_per_pixel(format);
+            int pitches[3] = { out_width * bpp + 8, out_width + 8, out_width / 2 + 8 };
+            int chroma_height = (out_height + 1) / 2;
+            uint8_t * buffer = new uint8_t[pitches[0] * out_height + (pitches[1] + pitches[2]) * chroma_height];
+            uint8_t * planes[3] = { buffer, buffer + pitches[0] * out_height, buffer + pitches[0] * out_height + pitches[1] * chroma_height };
+
+            if(PTP::LVConverter::is_planar(format)) {
+                lv.get_planes(format, planes, pitches, skip);
+            } else {
+                lv.get_pixels(format, buffer, pitches[0], skip);
+            }
+
+            for(int row = 0; row < out_height && ok; row++) {
+                const uint8_t * yuv = payload + header_size + row * row_bytes;
+                const uint8_t * below = row + 1 < out_height ? yuv + row_bytes : yuv;
+                for(int x = 0; x < out_width && ok; x++) {
+                    const uint8_t * group = yuv + (x / (skip ? 2 : 4)) * 6;
+                    const int y_offsets[4] = { 1, 3, 4, 5 };
+                    int y = group[y_offsets[x % (skip ? 2 : 4)]], u = (int8_t)group[0], v = (int8_t)group[2];
+                    int r = clip(((y << 12) + v * 5743 + 2048) >> 12);
+                    int g = clip(((y << 12) - u * 1411 - v * 2925 + 2048) >> 12);
+                    int b = clip(((y << 12) + u * 7258 + 2048) >> 12);
+                    int rgb565 = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+                    const uint8_t * p = planes[0] + row * pitches[0] + x * bpp;
+                    bool match = true;
+
+                    switch(format) {
+                        case PTP::LVConverter::FORMAT_RGB565_LE: match = p[0] == (rgb565 & 0xFF) && p[1] == (rgb565 >> 8); break;
+                        case PTP::LVConverter::FORMAT_RGB565_BE: match = p[1] == (rgb565 & 0xFF) && p[0] == (rgb565 >> 8); break;
+                        case PTP::LVConverter::FORMAT_RGB888:    match = p[0] == r && p[1] == g && p[2] == b; break;
+                        case PTP::LVConverter::FORMAT_BGRA8888:  match = p[0] == b && p[1] == g && p[2] == r && p[3] == 0xFF; break;
+                        default:                                 match = p[0] == y; break;
+                    }
+
+                    if(PTP::LVConverter::is_planar(format) && row % 2 == 0 && x % 2 == 0) {
+                        const uint8_t * group_below = below + (group - yuv);
+                        int cu = ((u + (int8_t)group_below[0] + 1) >> 1) + 128;
+                        int cv = ((v + (int8_t)group_below[2] + 1) >> 1) + 128;
+                        const uint8_t * chroma = planes[1] + (row / 2) * pitches[1];
+                        if(format == PTP::LVConverter::FORMAT_I420) {
+                            match = match && chroma[x / 2] == cu && planes[2][(row / 2) * pitches[2] + x / 2] == cv;
+                        } else {
+                            match = match && chroma[x] == cu && chroma[x + 1] == cv;
+                        }
+                    }
+
+                    if(match == false) {
+                        std::cout << PTP::LVConverter::get_format_name(format) << ": mismatch at " << x << "," << row
+                            << ", skip=" << skip << std::endl;
+                        ok = false;
+                    }
+                }
+            }
+
+            delete[] buffer;
+        }
+    }
+
+    if(ok) std::cout << "formats: OK" << std::endl;
+    delete[] payload;
+    return ok;
+}
+
+// Check the luma kernels against the payload itself, with every kernel this
+//  machine supports, halved or not, with and without skip.
+bool check_luma() {
+    const int width = 360, buffer_width = 384, height = 239;   // Odd height, for halving
+    int header_size = sizeof(PTP::lv_data_header) + sizeof(PTP::lv_framebuffer_desc);
+    int row_bytes = buffer_width * 12 / 8;
+    int payload_size;
+    uint8_t * payload = make_payload(width, buffer_width, height, &payload_size);
+    PTP::LVData lv(payload, payload_size);
+    const int y_offsets[4] = { 1, 3, 4, 5 };
+    bool ok = true;
+
+    for(int k = PTP::LVConverter::KERNEL_SCALAR; k < PTP::LVConverter::KERNEL_COUNT && ok; k++) {
+        PTP::LVConverter::Kernel kernel = (PTP::LVConverter::Kernel)k;
+        if(PTP::LVConverter::is_supported(kernel) == false) continue;
+        PTP::LVConverter::set_kernel(kernel);
+
+        for(int mode = 0; mode < 4 && ok; mode++) {
+            bool skip = mode & 1, half = (mode & 2) != 0;
+            int per_group = skip ? 2 : 4;
+            int out_width, out_height;
+            lv.get_luma_size(&out_width, &out_height, half, skip);
+            int pitch = out_width + 8;
+            uint8_t * luma = new uint8_t[pitch * out_height];
+            lv.get_luma(luma, pitch, half, skip);
+
+            for(int row = 0; row < out_height && ok; row++) {
+                const uint8_t * yuv = payload + header_size + row * (half ? 2 : 1) * row_bytes;
+                for(int x = 0; x < out_width && ok; x++) {
+                    int expected;
+                    if(half) {
+                        int first = 2 * x;
+                        const uint8_t * group = yuv + (first / per_group) * 6;
+                        expected = (group[y_offsets[first % per_group]] + group[y_offsets[first % per_group + 1]] + 1) >> 1;
+                    } else {
+                        expected = yuv[(x / per_group) * 6 + y_offsets[x % per_group]];
+                    }
+
+                    if(luma[row * pitch + x] != expected) {
+                        std::cout << "luma (" << PTP::LVConverter::get_kernel_name(kernel) << "): mismatch at "
+                            << x << "," << row << ", skip=" << skip << ", half=" << half << std::endl;
+                        ok = false;
+                    }
+                }
+            }
+
+            delete[] luma;
+        }
+    }
+
+    PTP::LVConverter::set_kernel(PTP::LVConverter::KERNEL_AUTO);
+    if(ok) std::cout << "luma: OK" << std::endl;
+    delete[] payload;
+    return ok;
+}
+
+// Whether two sets of statistics agree on everything they report
+bool same_stats(const PTP::LVStats& a, const PTP::LVStats& b) {
+    uint32_t ha[256], hb[256];
+    a.get_histogram(ha, 256);
+    b.get_histogram(hb, 256);
+    return a.get_count() == b.get_count() && a.get_min() == b.get_min() && a.get_max() == b.get_max() &&
+           a.get_mean() == b.get_mean() && a.get_sharpness() == b.get_sharpness() &&
+           a.get_clipped_low() == b.get_clipped_low() && a.get_clipped_high() == b.get_clipped_high() &&
+           std::memcmp(ha, hb, sizeof(ha)) == 0;
+}
+
+// Check the statistics kernels against the scalar one, for runs of every
+//  length around the vector width, and check each conversion gathers the same
+//  statistics as adding up its luma row by row.
+bool check_stats() {
+    uint8_t samples[1024];
+    bool ok = true;
+
+    srand(45);
+    for(int i = 0; i < 1024; i++) samples[i] = rand() & 0xFF;
+    samples[100] = 0;
+    samples[200] = 255;
+    for(int count = 0; count <= 1024 && ok; count += count < 40 ? 1 : 97) {
+        PTP::LVStats scalar, sse2, neon;
+        scalar.add_luma_scalar(samples, count);
+        sse2.add_luma_sse2(samples, count);
+        neon.add_luma_neon(samples, count);
+        if(same_stats(scalar, sse2) == false || same_stats(scalar, neon) == false) {
+            std::cout << "stats: kernels disagree over " << count << " samples" << std::endl;
+            ok = false;
+        }
+    }
+
+    PTP::LVStats scalar;
+    scalar.add_luma_scalar(samples, 1024);
+    uint32_t bins[16], total = 0;
+    scalar.get_histogram(bins, 16);
+    for(int i = 0; i < 16; i++) total += bins[i];
+    if(ok && (scalar.get_min() != 0 || scalar.get_max() != 255 || total != 1024 || scalar.get_count() != 1024)) {
+        std::cout << "stats: min " << (int)scalar.get_min() << ", max " << (int)scalar.get_max()
+            << ", histogram total " << total << std::endl;
+        ok = false;
+    }
+
+    const int width = 360, buffer_width = 384, height = 239;
+    int payload_size;
+    uint8_t * payload = make_payload(width, buffer_width, height, &payload_size);
+    PTP::LVData lv(payload, payload_size);
+    lv.set_roi(36, 20, 200, 150);
+
+    for(int skip = 0; skip < 2 && ok; skip++) {
+        // What every conversion should come up with: the luma, a row at a time
+        int luma_width, luma_height;
+        lv.get_luma_size(&luma_width, &luma_height, false, skip);
+        uint8_t * luma = new uint8_t[luma_width * luma_height];
+        lv.get_luma(luma, luma_width, false, skip);
+        PTP::LVStats expected;
+        for(int row = 0; row < luma_height; row++) {
+            expected.add_luma_scalar(luma + row * luma_width, luma_width);
+        }
+
+        PTP::LVStats stats;
+        lv.set_stats(&stats);
+        for(int mode = 0; mode < 5 && ok; mode++) {
+            stats.reset();
+            PTP::LVConverter::set_threads(mode == 1 ? 3 : 1);
+            uint8_t * out = new uint8_t[luma_width * luma_height * 4 + lv.get_viewport_size(false, skip)];
+            if(mode <= 1) {
+                lv.get_rgb(out, luma_width * 2, skip);
+            } else if(mode == 2) {
+                lv.get_luma(out, luma_width, false, skip);
+            } else if(mode == 3) {
+                uint8_t * planes[3] = { out, out + luma_width * luma_height, out + luma_width * luma_height * 2 };
+                int pitches[3] = { luma_width, luma_width / 2, luma_width / 2 };
+                lv.get_planes(PTP::LVConverter::FORMAT_I420, planes, pitches, skip);
+            } else {
+                lv.get_viewport(out, false, skip);
+            }
+            delete[] out;
+
+            if(same_stats(stats, expected) == false) {
+                std::cout << "stats: mode " << mode << ", skip=" << skip << " gathered " << stats.get_count()
+                    << " samples, mean " << (int)stats.get_mean() << ", sharpness " << stats.get_sharpness()
+                    << " (expected " << expected.get_count() << ", " << (int)expected.get_mean() << ", "
+                    << expected.get_sharpness() << ")" << std::endl;
+                ok = false;
+            }
+        }
+        lv.set_stats(NULL);
+        PTP::LVConverter::set_threads(1);
+        delete[] luma;
+    }
+
+    if(ok) std::cout << "stats: OK" << std::endl;
+    delete[] payload;
+    return ok;
+}
+
+// Check a region of interest converts (and relays) exactly that part of the
+//  whole frame, and is clipped to the viewport.
+bool check_roi() {
+    const int width = 360, buffer_width = 384, height = 240;
+    int payload_size;
+    uint8_t * payload = make_payload(width, buffer_width, height, &payload_size);
+    PTP::LVData lv(payload, payload_size);
+    uint16_t * whole = new uint16_t[width * height];
+    lv.get_rgb((uint8_t *)whole, width * 2);
+    // x and width get widened to whole groups; the last one runs off the edges
+    const int rois[][4] = { { 100, 50, 64, 32 }, { 102, 51, 61, 33 }, { 0, 0, width, height }, { 300, 200, 200, 100 } };
+    bool ok = true;
+
+    for(int r = 0; r < 4 && ok; r++) {
+        lv.set_roi(rois[r][0], rois[r][1], rois[r][2], rois[r][3]);
+        int x, y, roi_width, roi_height, rgb_width, rgb_height;
+        lv.get_roi(&x, &y, &roi_width, &roi_height);
+        lv.get_rgb_size(&rgb_width, &rgb_height);
+        int right = (rois[r][0] + rois[r][2] + 3) / 4 * 4;
+        if(right > width) right = width;
+        int bottom = rois[r][1] + rois[r][3] < height ? rois[r][1] + rois[r][3] : height;
+        if(x != rois[r][0] / 4 * 4 || y != rois[r][1] || roi_width != right - x || roi_height != bottom - y ||
+           rgb_width != roi_width || rgb_height != roi_height) {
+            std::cout << "roi: " << rois[r][0] << "," << rois[r][1] << " " << rois[r][2] << "x" << rois[r][3]
+                << " came out as " << x << "," << y << " " << roi_width << "x" << roi_height << std::endl;
+            ok = false;
+            break;
+        }
+
+        // Converted directly, and relayed then converted on the other end
+        uint16_t * direct = new uint16_t[roi_width * roi_height];
+        lv.get_rgb((uint8_t *)direct, roi_width * 2);
+        uint8_t * compact = new uint8_t[lv.get_viewport_size()];
+        lv.get_viewport(compact);
+        PTP::LVData relayed(compact, lv.get_viewport_size());
+        uint16_t * far = new uint16_t[roi_width * roi_height];
+        relayed.get_rgb((uint8_t *)far, roi_width * 2);
+
+        for(int row = 0; row < roi_height && ok; row++) {
+            if(std::memcmp(direct + row * roi_width, whole + (y + row) * width + x, roi_width * 2) != 0 ||
+               std::memcmp(far + row * roi_width, whole + (y + row) * width + x, roi_width * 2) != 0) {
+                std::cout << "roi: mismatch in row " << row << " of roi " << r << std::endl;
+                ok = false;
+            }
+        }
+
+        delete[] direct;
+        delete[] compact;
+        delete[] far;
+    }
+
+    lv.clear_roi();
+    int rgb_width, rgb_height;
+    lv.get_rgb_size(&rgb_width, &rgb_height);
+    if(ok && (rgb_width != width || rgb_height != height)) {
+        std::cout << "roi: still " << rgb_width << "x" << rgb_height << " after clear_roi()" << std::endl;
+        ok = false;
+    }
+
+    if(ok) std::cout << "roi: OK" << std::endl;
+    delete[] whole;
+    delete[] payload;
+    return ok;
+}
+
+// Check the scaler: same-size scaling is a copy, SIMD blending matches
+//  scalar, and converting while scaling matches converting then scaling.
+bool check_scaler() {
+    const int width = 360, height = 240, out_width = 640, out_height = 480;
+    bool ok = true;
+    int payload_size, size, rgb_width, rgb_height;
+    uint8_t * payload = make_payload(width, width, height, &payload_size);
+    PTP::LVData lv(payload, payload_size);
+    uint16_t * rgb = (uint16_t *)lv.get_rgb(&size, &rgb_width, &rgb_height);
+    uint16_t * fused = new uint16_t[out_width * out_height];
+    uint16_t * separate = new uint16_t[out_width * out_height];
+    PTP::LVScaler::Filter filters[] = { PTP::LVScaler::FILTER_NEAREST, PTP::LVScaler::FILTER_BILINEAR };
+
+    for(int f = 0; f < 2; f++) {
+        PTP::LVScaler scaler(filters[f]);
+
+        scaler.scale(rgb, rgb_width, rgb_height, rgb_width * 2, (uint8_t *)separate, rgb_width, rgb_height, rgb_width * 2);
+        if(std::memcmp(rgb, separate, size) != 0) {
+            std::cout << "scaler: filter " << f << " changes a same-size frame" << std::endl;
+            ok = false;
+        }
+
+        scaler.scale(rgb, rgb_width, rgb_height, rgb_width * 2, (uint8_t *)separate, out_width, out_height, out_width * 2);
+        lv.get_rgb_scaled((uint8_t *)fused, out_width * 2, out_width, out_height, scaler);
+        if(std::memcmp(fused, separate, out_width * out_height * 2) != 0) {
+            std::cout << "scaler: filter " << f << " fused conversion doesn't match" << std::endl;
+            ok = false;
+        }
+    }
+
+    for(int weight = 0; weight <= 256 && ok; weight++) {
+        PTP::LVScaler::blend_rows_scalar(rgb, rgb + width, separate, width, weight);
+        PTP::LVScaler::blend_rows(rgb, rgb + width, fused, width, weight);
+        if(std::memcmp(fused, separate, width * 2) != 0) {
+            std::cout << "scaler: blend mismatch at weight " << weight << std::endl;
+            ok = false;
+        }
+    }
+
+    if(ok) std::cout << "scaler: OK" << std::endl;
+    delete[] separate;
+    delete[] fused;
+    delete[] rgb;
+    delete[] payload;
+    return ok;
+}
+
+// Check the compact viewport: it drops the row padding, and converts to
+//  exactly what the original does.
+bool check_viewport() {
+    const int width = 358, buffer_width = 384, height = 240;  // Not whole groups, to check trimming
+    bool ok = true;
+    int payload_size, size, out_width, out_height, compact_size, compact_width, compact_height;
+    uint8_t * payload = make_payload(width, buffer_width, height, &payload_size);
+    PTP::LVData lv(payload, payload_size);
+
+    compact_size = lv.get_viewport_size();
+    uint8_t * compact = new uint8_t[compact_size];
+    lv.get_viewport(compact);
+    PTP::LVData relayed(compact, compact_size);
+
+    if(compact_size != (int)(sizeof(PTP::lv_data_header) + sizeof(PTP::lv_framebuffer_desc)) + (width / 4) * 6 * height) {
+        std::cout << "viewport: " << compact_size << " bytes, expected no padding" << std::endl;
+        ok = false;
+    }
+
+    for(int skip = 0; skip < 2 && ok; skip++) {
+        int relayed_size;
+        uint8_t * rgb = lv.get_rgb(&size, &out_width, &out_height, skip);
+        uint8_t * relayed_rgb = relayed.get_rgb(&relayed_size, &compact_width, &compact_height, skip);
+        if(relayed_size != size || compact_width != out_width || compact_height != out_height ||
+           std::memcmp(rgb, relayed_rgb, size) != 0) {
+            std::cout << "viewport: converts differently, skip=" << skip << std::endl;
+            ok = false;
+        }
+        delete[] relayed_rgb;
+        delete[] rgb;
+    }
+
+    // With skip, the skipped luma is gone, and what's left converts without skip
+    int header_size = sizeof(PTP::lv_data_header) + sizeof(PTP::lv_framebuffer_desc);
+    int skipped_size = lv.get_viewport_size(false, true);
+    uint8_t * skipped = new uint8_t[skipped_size];
+    lv.get_viewport(skipped, false, true);
+    PTP::LVData skipped_lv(skipped, skipped_size);
+    skipped_lv.get_rgb_size(&compact_width, &compact_height);
+    lv.get_rgb_size(&out_width, &out_height, true);
+    uint8_t * luma = new uint8_t[out_width * out_height];
+    uint8_t * skipped_luma = new uint8_t[out_width * out_height];
+    lv.get_pixels(PTP::LVConverter::FORMAT_Y8, luma, out_width, true);
+    skipped_lv.get_pixels(PTP::LVConverter::FORMAT_Y8, skipped_luma, out_width);
+    if(skipped_size != header_size + (width / 8) * 6 * height || compact_width != (width / 8) * 4 || compact_height != height) {
+        std::cout << "viewport: skipped copy is the wrong size" << std::endl;
+        ok = false;
+    }
+    for(int row = 0; row < height && ok; row++) {
+        if(std::memcmp(luma + row * out_width, skipped_luma + row * out_width, compact_width) != 0) {
+            std::cout << "viewport: skipped copy doesn't match in row " << row << std::endl;
+            ok = false;
+        }
+    }
+    delete[] skipped_luma;
+    delete[] luma;
+    delete[] skipped;
+
+    if(ok) std::cout << "viewport: OK" << std::endl;
+    delete[] compact;
+    delete[] payload;
+    return ok;
+}
+
+// Check LVFrameView: reading in place converts the same as reading a copy,
+//  and truncated, out of bounds or misaligned payloads are rejected.
+bool check_view() {
+    const int width = 358, buffer_width = 384, height = 240;
+    bool ok = true;
+    int payload_size, size, in_place_size, out_width, out_height;
+    uint8_t * payload = make_payload(width, buffer_width, height, &payload_size);
+    PTP::LVData copied(payload, payload_size), in_place;
+    in_place.read_in_place(payload, payload_size);
+
+    const PTP::LVFrameView& view = in_place.get_view();
+    if(view.get_payload() != payload || view.get_viewport_groups() != width / 4 || view.get_viewport_rows() != height ||
+       view.get_viewport_pitch() != buffer_width * 12 / 8 || view.get_bitmap_data() != NULL || view.get_palette() != NULL ||
+       view.get_lv_version() != 2) {
+        std::cout << "view: wrong accessors" << std::endl;
+        ok = false;
+    }
+    uint8_t * rgb = copied.get_rgb(&size, &out_width, &out_height);
+    uint8_t * in_place_rgb = in_place.get_rgb(&in_place_size, &out_width, &out_height);
+    if(size != in_place_size || std::memcmp(rgb, in_place_rgb, size) != 0) {
+        std::cout << "view: reading in place converts differently" << std::endl;
+        ok = false;
+    }
+    delete[] in_place_rgb;
+    delete[] rgb;
+
+    // Every truncation leaves nothing to convert
+    for(int cut = 0; cut < payload_size && ok; cut += 37) {
+        try {
+            in_place.read_in_place(payload, cut);
+            std::cout << "view: payload cut to " << cut << " bytes accepted" << std::endl;
+            ok = false;
+        } catch(PTP::LIBPTP_PP_ERRORS e) {
+            in_place.get_rgb_size(&out_width, &out_height);
+            if(out_width != 0 || out_height != 0 || in_place.get_view().is_valid()) {
+                std::cout << "view: rejected payload left behind" << std::endl;
+                ok = false;
+            }
+        }
+    }
+
+    // Offsets and sizes that point outside the payload, or can't be read
+    PTP::lv_data_header * head = (PTP::lv_data_header *)payload;
+    PTP::lv_framebuffer_desc * desc = (PTP::lv_framebuffer_desc *)(payload + head->vp_desc_start);
+    int * fields[] = { &head->vp_desc_start, &head->vp_desc_start, &head->vp_desc_start, &head->bm_desc_start,
+                       &desc->data_start, &desc->data_start, &desc->buffer_width, &desc->visible_height, &desc->fb_type };
+    int values[] = { -4, payload_size, 2, payload_size - 8, -1, 100, width - 4, height + 1, PTP::LV_FB_PAL8 };
+    for(int i = 0; i < (int)(sizeof(values) / sizeof(values[0])) && ok; i++) {
+        int kept = *fields[i];
+        *fields[i] = values[i];
+        try {
+            in_place.read_in_place(payload, payload_size);
+            std::cout << "view: bad field " << i << " accepted" << std::endl;
+            ok = false;
+        } catch(PTP::LIBPTP_PP_ERRORS e) {
+            ;
+        }
+        *fields[i] = kept;
+    }
+
+    uint8_t * shifted = new uint8_t[payload_size + 1];
+    std::memcpy(shifted + 1, payload, payload_size);
+    try {
+        in_place.read_in_place(shifted + 1, payload_size);
+        std::cout << "view: misaligned payload accepted" << std::endl;
+        ok = false;
+    } catch(PTP::LIBPTP_PP_ERRORS e) {
+        if(e != PTP::ERR_LVDATA_MISALIGNED) {
+            std::cout << "view: misaligned payload gave error " << e << std::endl;
+            ok = false;
+        }
+    }
+    delete[] shifted;
+
+    if(ok) std::cout << "view: OK" << std::endl;
+    delete[] payload;
+    return ok;
+}
+
+// Check the fingerprint: every hash function agrees with the scalar one, a
+//  change in a sampled row is noticed, and the overlay only counts if asked for.
+bool check_fingerprint() {
+    const int width = 358, buffer_width = 384, height = 240;
+    bool ok = true;
+    int payload_size;
+    uint8_t * payload = make_payload(width, buffer_width, height, &payload_size);
+
+    for(int bytes = 0; bytes <= 70 && ok; bytes++) {
+        uint32_t scalar[4] = { 1, 2, 3, 4 }, lanes[4] = { 1, 2, 3, 4 };
+        PTP::LVFrameView::hash_rows_scalar(payload + 3, 97, bytes, 5, scalar);
+        PTP::LVFrameView::hash_rows(payload + 3, 97, bytes, 5, lanes);
+        if(std::memcmp(scalar, lanes, sizeof(lanes)) != 0) {
+            std::cout << "fingerprint: hash mismatch at " << bytes << " bytes" << std::endl;
+            ok = false;
+        }
+    }
+
+    PTP::LVFrameView view(payload, payload_size);
+    uint64_t fingerprint = view.get_fingerprint(false, 4);
+    if(fingerprint != view.get_fingerprint(false, 4) || fingerprint == view.get_fingerprint(false, 1)) {
+        std::cout << "fingerprint: not repeatable" << std::endl;
+        ok = false;
+    }
+    for(int bit = 0; bit < 8 && ok; bit++) {
+        uint8_t * sample = payload + (view.get_viewport_data() - payload) + 8 * view.get_viewport_pitch() + 5 * bit;
+        *sample ^= 1 << bit;
+        if(view.get_fingerprint(false, 4) == fingerprint) {
+            std::cout << "fingerprint: missed a change to bit " << bit << std::endl;
+            ok = false;
+        }
+        *sample ^= 1 << bit;
+    }
+
+    if(ok) std::cout << "fingerprint: OK" << std::endl;
+    delete[] payload;
+    return ok;
+}
+
+// Check the overlay: only opaque bitmap pixels replace the frame, the
+//  palette is only decoded when it changes, and SIMD blending matches scalar.
+bool check_overlay() {
+    const int width = 360, height = 240, bm_width = 360, bm_buffer_width = 368, bm_height = 240;
+    bool ok = true;
+    int vp_size;
+    uint8_t * vp = make_payload(width, width, height, &vp_size);
+
+    // Append a bitmap descriptor, a type 3 palette and the bitmap itself
+    int bm_desc_start = vp_size;
+    int palette_start = bm_desc_start + sizeof(PTP::lv_framebuffer_desc);
+    int bitmap_start = palette_start + 256 * 4;
+    int payload_size = bitmap_start + bm_buffer_width * bm_height;
+    uint8_t * payload = new uint8_t[payload_size];
+    std::memset(payload, 0, payload_size);
+    std::memcpy(payload, vp, vp_size);
+
+    PTP::lv_data_header * head = (PTP::lv_data_header *)payload;
+    head->palette_type = 3;
+    head->palette_data_start = palette_start;
+    head->bm_desc_start = bm_desc_start;
+    PTP::lv_framebuffer_desc desc;
+    std::memset(&desc, 0, sizeof(desc));
+    desc.fb_type = PTP::LV_FB_PAL8;
+    desc.data_start = bitmap_start;
+    desc.buffer_width = bm_buffer_width;
+    desc.visible_width = bm_width;
+    desc.visible_height = bm_height;
+    std::memcpy(payload + bm_desc_start, &desc, sizeof(desc));
+
+    uint8_t * palette = payload + palette_start;
+    palette[5 * 4 + 0] = 0;     // V
+    palette[5 * 4 + 1] = 0;     // U
+    palette[5 * 4 + 2] = 200;   // Y
+    palette[5 * 4 + 3] = 255;   // A -- opaque
+    for(int y = 100; y < 120; y++) {
+        std::memset(payload + bitmap_start + y * bm_buffer_width + 50, 5, 20);
+    }
+
+    PTP::LVData plain(vp, vp_size);
+    PTP::LVData lv(payload, payload_size);
+    if(plain.has_overlay() == true || lv.has_overlay() == false) {
+        std::cout << "overlay: has_overlay is wrong" << std::endl;
+        ok = false;
+    }
+
+    // The fingerprint only covers the overlay if asked to
+    PTP::LVFrameView view(payload, payload_size);
+    uint64_t without = view.get_fingerprint(false), with = view.get_fingerprint(true);
+    payload[bitmap_start + 4 * bm_buffer_width + 7] ^= 1;
+    if(without == with || view.get_fingerprint(false) != without || view.get_fingerprint(true) == with) {
+        std::cout << "overlay: fingerprint doesn't follow the bitmap" << std::endl;
+        ok = false;
+    }
+    payload[bitmap_start + 4 * bm_buffer_width + 7] ^= 1;
+
+    // Composite at twice the bitmap's size, so each bitmap pixel covers 2x2
+    const int out_width = width * 2, out_height = height * 2;
+    uint16_t * frame = new uint16_t[out_width * out_height];
+    uint16_t * expected = new uint16_t[out_width * out_height];
+    PTP::LVScaler scaler;
+    PTP::LVOverlay overlay;
+    lv.get_rgb_scaled((uint8_t *)expected, out_width * 2, out_width, out_height, scaler);
+    std::memcpy(frame, expected, out_width * out_height * 2);
+    lv.composite_overlay((uint8_t *)frame, out_width * 2, out_width, out_height, overlay);
+
+    uint16_t grey = ((200 & 0xF8) << 8) | ((200 & 0xFC) << 3) | (200 >> 3);
+    for(int y = 0; y < out_height && ok; y++) {
+        for(int x = 0; x < out_width && ok; x++) {
+            bool inside = y >= 200 && y < 240 && x >= 100 && x < 140;
+            uint16_t want = inside ? grey : expected[y * out_width + x];
+            if(frame[y * out_width + x] != want) {
+                std::cout << "overlay: mismatch at " << x << ", " << y << std::endl;
+                ok = false;
+            }
+        }
+    }
+
+    // A compact copy carries the overlay too
+    int compact_size = lv.get_viewport_size(true);
+    uint8_t * compact = new uint8_t[compact_size];
+    lv.get_viewport(compact, true);
+    PTP::LVData relayed(compact, compact_size);
+    uint16_t * relayed_frame = new uint16_t[out_width * out_height];
+    std::memcpy(relayed_frame, expected, out_width * out_height * 2);
+    PTP::LVOverlay relayed_overlay;
+    if(relayed.composite_overlay((uint8_t *)relayed_frame, out_width * 2, out_width, out_height, relayed_overlay) == false ||
+       std::memcmp(relayed_frame, frame, out_width * out_height * 2) != 0) {
+        std::cout << "overlay: compact copy doesn't match" << std::endl;
+        ok = false;
+    }
+    delete[] relayed_frame;
+    delete[] compact;
+
+    // The palette was decoded by composite_overlay, so it's cached now
+    if(overlay.set_palette(3, palette) == true || overlay.get_rgba()[5 * 4 + 3] != 255) {
+        std::cout << "overlay: palette wasn't cached" << std::endl;
+        ok = false;
+    }
+
+    // Every weight, at every position in a vector
+    uint16_t alpha[257], color[257], scalar[257], blended[257];
+    for(int i = 0; i < 257; i++) {
+        alpha[i] = i;
+        color[i] = i * 2654435761u >> 16;
+        scalar[i] = blended[i] = expected[i];
+    }
+    PTP::LVOverlay::blend_row_scalar(color, alpha, scalar, 257);
+    PTP::LVOverlay::blend_row(color, alpha, blended, 257);
+    if(std::memcmp(scalar, blended, sizeof(scalar)) != 0 || scalar[256] != color[256]) {
+        std::cout << "overlay: blend mismatch" << std::endl;
+        ok = false;
+    }
+
+    if(ok) std::cout << "overlay: OK" << std::endl;
+    delete[] expected;
+    delete[] frame;
+    delete[] payload;
+    delete[] vp;
+    return ok;
+}
+
+// Check the delta codec: lossless at threshold 0, skips unchanged tiles,
+//  notices lost frames, and the SIMD comparisons match scalar.
+bool check_delta() {
+    const int row_bytes = 540, rows = 240, size = row_bytes * rows + 100;   // With a partial row
+    bool ok = true;
+    uint8_t * frame = new uint8_t[size];
+    for(int i = 0; i < size; i++) {
+        frame[i] = (i * 31) ^ (i >> 5);
+    }
+
+    PTP::LVDeltaCodec encoder(0, 10), decoder;
+    uint8_t * encoded = new uint8_t[encoder.get_max_size(size, row_bytes)];
+    int encoded_size, decoded_size;
+    const uint8_t * decoded;
+
+    for(int f = 0; f < 25 && ok; f++) {
+        // Change a pixel now and then, and the partial row every time
+        if(f % 3 == 1) frame[(f * 7919) % size] ^= 0x55;
+        frame[size - 1] = f;
+
+        encoded_size = encoder.encode(frame, size, row_bytes, encoded);
+        decoded = decoder.decode(encoded, encoded_size, &decoded_size);
+        const PTP::LVDeltaCodec::Stats& stats = encoder.get_stats();
+        int expected_tiles = (f % 10 == 0) ? stats.tiles : (f % 3 == 1 ? 1 : 0);
+        if(decoded_size != size || std::memcmp(decoded, frame, size) != 0 || stats.tiles_sent != expected_tiles ||
+           decoder.get_stats().tiles_sent != stats.tiles_sent) {
+            std::cout << "delta: frame " << f << " sent " << stats.tiles_sent << " tiles, expected " << expected_tiles << std::endl;
+            ok = false;
+        }
+    }
+
+    // Lose a frame
+    frame[0] ^= 0xFF;
+    encoder.encode(frame, size, row_bytes, encoded);
+    frame[0] ^= 0xFF;
+    encoded_size = encoder.encode(frame, size, row_bytes, encoded);
+    try {
+        decoder.decode(encoded, encoded_size, &decoded_size);
+        std::cout << "delta: lost frame wasn't noticed" << std::endl;
+        ok = false;
+    } catch(PTP::LIBPTP_PP_ERRORS e) {
+        if(e != PTP::ERR_LVDELTA_NEED_KEYFRAME) {
+            std::cout << "delta: lost frame gave error " << e << std::endl;
+            ok = false;
+        }
+    }
+    encoder.request_keyframe();
+    encoded_size = encoder.encode(frame, size, row_bytes, encoded);
+    decoded = decoder.decode(encoded, encoded_size, &decoded_size);
+    if(std::memcmp(decoded, frame, size) != 0) {
+        std::cout << "delta: keyframe didn't recover" << std::endl;
+        ok = false;
+    }
+
+    // Truncated frames are rejected, not read past
+    for(int cut = 0; cut < encoded_size && ok; cut += 997) {
+        try {
+            decoder.decode(encoded, cut, &decoded_size);
+            std::cout << "delta: truncated frame accepted" << std::endl;
+            ok = false;
+        } catch(PTP::LIBPTP_PP_ERRORS e) {
+            ;
+        }
+    }
+
+    for(int width = 1; width <= 70 && ok; width++) {
+        uint32_t scalar = PTP::LVDeltaCodec::tile_sad_scalar(frame, frame + 3 * row_bytes + 1, row_bytes, width, 5);
+        if(PTP::LVDeltaCodec::tile_sad(frame, frame + 3 * row_bytes + 1, row_bytes, width, 5) != scalar) {
+            std::cout << "delta: SAD mismatch at width " << width << std::endl;
+            ok = false;
+        }
+    }
+
+    if(ok) std::cout << "delta: OK" << std::endl;
+    delete[] encoded;
+    delete[] frame;
+    return ok;
+}
+
+// Check the DCT codec: a smooth frame comes back close at high quality,
+//  everything around the viewport comes back exactly, lower quality is
+//  smaller, and truncated or corrupt frames are rejected, not read past.
+bool check_dct() {
+    const int width = 358, buffer_width = 384, height = 240, trailer = 50;
+    const int stride = buffer_width * 12 / 8;
+    bool ok = true;
+    int viewport_size;
+    uint8_t * viewport = make_payload(width, buffer_width, height, &viewport_size);
+    int header_size = sizeof(PTP::lv_data_header) + sizeof(PTP::lv_framebuffer_desc);
+    int size = viewport_size + trailer;
+    uint8_t * payload = new uint8_t[size];
+    std::memcpy(payload, viewport, viewport_size);
+    for(int i = viewport_size; i < size; i++) {
+        payload[i] = i;
+    }
+    for(int row = 0; row < height; row++) {
+        uint8_t * yuv = payload + header_size + row * stride;
+        for(int g = 0; g < width / 4; g++, yuv += 6) {
+            yuv[0] = (int8_t)(g - 40);
+            yuv[2] = (int8_t)(row / 4 - 30);
+            yuv[1] = 40 + (g * 4 + row) / 3;
+            yuv[3] = 40 + (g * 4 + 1 + row) / 3;
+            yuv[4] = 40 + (g * 4 + 2 + row) / 3;
+            yuv[5] = 40 + (g * 4 + 3 + row) / 3;
+        }
+        std::memset(yuv, 0, payload + header_size + (row + 1) * stride - yuv);
+    }
+
+    PTP::LVDCTCodec encoder(95), decoder;
+    uint8_t * encoded = new uint8_t[encoder.get_max_size(payload, size)];
+    int encoded_size = encoder.encode(payload, size, encoded);
+    int decoded_size = decoder.get_decoded_size(encoded, encoded_size);
+    uint8_t * decoded = new uint8_t[decoded_size];
+    decoder.decode(encoded, encoded_size, decoded);
+
+    double error = 0;
+    int luma = 0, worst_chroma = 0;
+    for(int row = 0; row < height; row++) {
+        const uint8_t * a = payload + header_size + row * stride;
+        const uint8_t * b = decoded + header_size + row * stride;
+        for(int i = 0; i < (width / 4) * 6; i++) {
+            if(i % 6 == 0 || i % 6 == 2) {
+                int difference = std::abs((int8_t)a[i] - (int8_t)b[i]);
+                if(difference > worst_chroma) worst_chroma = difference;
+            } else {
+                error += (a[i] - b[i]) * (a[i] - b[i]);
+                luma++;
+            }
+        }
+    }
+    double psnr = error == 0 ? 99 : 10 * std::log10(255.0 * 255.0 * luma / error);
+    if(decoded_size != size || std::memcmp(decoded, payload, header_size) != 0 ||
+       std::memcmp(decoded + viewport_size, payload + viewport_size, trailer) != 0 ||
+       std::memcmp(decoded + header_size + stride - 1, payload + header_size + stride - 1, 1) != 0) {
+        std::cout << "dct: data around the viewport changed" << std::endl;
+        ok = false;
+    }
+    if(psnr < 40 || worst_chroma > 4) {
+        std::cout << "dct: PSNR " << psnr << " dB, chroma off by up to " << worst_chroma << std::endl;
+        ok = false;
+    }
+
+    PTP::LVDCTCodec small(25);
+    uint8_t * small_encoded = new uint8_t[small.get_max_size(payload, size)];
+    int small_size = small.encode(payload, size, small_encoded);
+    if(small_size >= encoded_size || encoded_size >= size) {
+        std::cout << "dct: " << small_size << " bytes at quality 25, " << encoded_size << " at 95, from " << size << std::endl;
+        ok = false;
+    }
+    delete[] small_encoded;
+
+    for(int cut = 0; cut < encoded_size && ok; cut += 97) {
+        try {
+            decoder.decode(encoded, cut, decoded);
+            std::cout << "dct: truncated frame accepted" << std::endl;
+            ok = false;
+        } catch(PTP::LIBPTP_PP_ERRORS e) {
+            ;
+        }
+    }
+    // Corrupt coefficients may decode to nonsense, but mustn't overrun
+    for(int i = header_size + (int)sizeof(PTP::LVDCTCodec::Header); i < encoded_size - trailer; i += 101) {
+        encoded[i] ^= 0xA5;
+        try {
+            decoder.decode(encoded, encoded_size, decoded);
+        } catch(PTP::LIBPTP_PP_ERRORS e) {
+            ;
+        }
+    }
+
+    if(ok) std::cout << "dct: OK (" << encoded_size << " bytes, " << psnr << " dB)" << std::endl;
+    delete[] decoded;
+    delete[] encoded;
+    delete[] payload;
+    delete[] viewport;
+    return ok;
+}
+
+// Frame buffers come back aligned and big enough, keep what they're asked to
+//  when they grow, and once the pool has seen a size, streaming at it (with
+//  buffers and containers reused or made afresh every frame) doesn't go back
+//  to the system.
+bool check_pool() {
+    PTP::FrameBufferPool pool;
+    bool ok = true;
+
+    const size_t sizes[] = {0, 1, 63, 64, 65, 4095, 4096, 4097, 259200, 345600, 691200, (64 << 20) + 1};
+    for(unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        size_t capacity;
+        uint8_t * buffer = pool.acquire(sizes[i], &capacity);
+        if((uintptr_t)buffer % PTP::FrameBufferPool::ALIGNMENT != 0 || capacity < sizes[i] ||
+           capacity != PTP::FrameBufferPool::get_capacity(sizes[i])) {
+            std::cout << "pool: " << sizes[i] << " bytes came back at " << (void *)buffer << ", holding " << capacity << std::endl;
+            ok = false;
+        }
+        std::memset(buffer, 0xA5, sizes[i]);
+        pool.release(buffer, capacity);
+    }
+
+    PTP::FrameBuffer grow(&pool);
+    std::memset(grow.reserve(100), 7, 100);
+    uint8_t * grown = grow.reserve(100000, 100);
+    for(int i = 0; i < 100; i++) {
+        if(grown[i] != 7) {
+            std::cout << "pool: growing lost byte " << i << std::endl;
+            ok = false;
+            break;
+        }
+    }
+    if(grow.reserve(50) != grown) {
+        std::cout << "pool: a buffer big enough was swapped anyway" << std::endl;
+        ok = false;
+    }
+
+    // A frame's worth: the payload received, a copy for LVData, and the converted frame
+    PTP::FrameBufferPool& shared = PTP::FrameBufferPool::get_default();
+    PTP::LVData lv;
+    PTP::FrameBuffer rgb;
+    int viewport_size;
+    uint8_t * viewport = make_payload(720, 720, 240, &viewport_size);
+    unsigned long allocations = 0;
+    for(int frame = 0; frame < 20; frame++) {
+        if(frame == 2) allocations = shared.get_system_allocations() + pool.get_system_allocations();
+        PTP::PTPContainer container(PTP::PTPContainer::CONTAINER_TYPE_DATA, 0x9999);
+        container.set_payload(viewport, viewport_size);
+        lv.read(container);
+        int width, height;
+        lv.get_rgb_size(&width, &height);
+        lv.get_rgb(rgb.reserve(width * height * 2), width * 2);
+        PTP::FrameBuffer packed;
+        container.pack(packed);
+    }
+    if(shared.get_system_allocations() + pool.get_system_allocations() != allocations) {
+        std::cout << "pool: streaming still allocated " << shared.get_system_allocations() + pool.get_system_allocations() - allocations
+            << " buffers from the system" << std::endl;
+        ok = false;
+    }
+    delete[] viewport;
+
+    if(ok) std::cout << "pool: OK" << std::endl;
+    return ok;
+}
+
+int main(int argc, char * argv[]) {
+    PTP::LVConverter::RowFunction kernels[] = {
+        NULL,
+        PTP::LVConverter::convert_row_scalar,
+        PTP::LVConverter::convert_row_lut,
+        PTP::LVConverter::convert_row_sse2,
+        PTP::LVConverter::convert_row_avx2,
+        PTP::LVConverter::convert_row_neon
+    };
+    bool ok = true;
+
+    std::cout << "Default kernel: " << PTP::LVConverter::get_kernel_name(PTP::LVConverter::get_kernel()) << std::endl;
+
+    for(int k = PTP::LVConverter::KERNEL_SCALAR; k < PTP::LVConverter::KERNEL_COUNT; k++) {
+        PTP::LVConverter::Kernel kernel = (PTP::LVConverter::Kernel)k;
+        if(PTP::LVConverter::is_supported(kernel) == false) {
+            std::cout << PTP::LVConverter::get_kernel_name(kernel) << ": not supported" << std::endl;
+            continue;
+        }
+
+        ok = check_kernel(kernel, kernels[k]) && ok;
+    }
+
+    ok = check_lvdata() && ok;
+    ok = check_scaler() && ok;
+    ok = check_formats() && ok;
+    ok = check_luma() && ok;
+    ok = check_roi() && ok;
+    ok = check_stats() && ok;
+    ok = check_view() && ok;
+    ok = check_fingerprint() && ok;
+    ok = check_viewport() && ok;
+    ok = check_overlay() && ok;
+    ok = check_delta() && ok;
+    ok = check_dct() && ok;
+    ok = check_pool() && ok;
+
+    // The output mustn't depend on how many threads did the converting
+    for(int threads = 2; threads <= 4; threads++) {
+        PTP::LVConverter::set_threads(threads);
+        std::cout << threads << " threads, ";
+        ok = check_lvdata() && ok;
+    }
+    PTP::LVConverter::set_threads(1);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,293 @@
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "../common/FrameRing.hpp"
+#include "../common/TripleBuffer.hpp"
+
+// Check the submarine's two ways of handing frames between threads: the
+//  FrameRing (one writer, any number of readers, torn reads caught by each
+//  slot's generation) and the TripleBuffer mailbox (one producer, one
+//  consumer, who only wants the latest item).
+//
+//  Build it with ../common/FrameRing.cpp and -lpthread.
+//  Usage: ringtest [frames]
+
+static const int ring_capacity = 2, ring_slot_bytes = 64 * 1024, reader_threads = 3;
+static int frames = 2000;
+
+struct RingShared {
+    FrameRing * ring;
+    volatile int done;
+    // Per reader
+    long valid[reader_threads];
+    long torn[reader_threads];
+    long undetected[reader_threads];
+};
+
+struct ReaderArgs {
+    RingShared * shared;
+    int id;
+};
+
+// Each frame is its sequence number's low byte, all the way through
+void * ring_writer(void * arg) {
+    RingShared * shared = (RingShared *)arg;
+    FrameRing::FrameInfo info;
+    std::memset(&info, 0, sizeof(info));
+
+    for(uint32_t sequence = 1; sequence <= (uint32_t)frames; sequence++) {
+        uint8_t * slot = shared->ring->begin_write(sequence, ring_slot_bytes);
+        std::memset(slot, sequence & 0xFF, ring_slot_bytes);
+        info.capture_ns = sequence;
+        info.size = ring_slot_bytes;
+        shared->ring->commit(info);
+        sched_yield();      // Let the readers at it, even on one core
+    }
+    shared->done = 1;
+    return NULL;
+}
+
+// Look at the latest frame (or the one before) in place, and check that
+//  whenever validate() says it's good, it is
+void * ring_reader(void * arg) {
+    ReaderArgs * args = (ReaderArgs *)arg;
+    RingShared * shared = args->shared;
+    uint32_t pass = 0;
+
+    while(shared->done == 0) {
+        // The one before the latest is in the slot the writer is at next
+        uint32_t sequence = shared->ring->get_latest() - (pass++ & 1);
+        FrameRing::FrameInfo info;
+        uint32_t ticket;
+        const uint8_t * frame = shared->ring->peek(sequence, &info, &ticket);
+        if(frame == NULL) {
+            continue;
+        }
+
+        bool whole = info.sequence == sequence && info.capture_ns == sequence && info.size == ring_slot_bytes;
+        for(int i = 0; i < ring_slot_bytes; i++) {
+            whole = frame[i] == (sequence & 0xFF) && whole;
+        }
+        if(shared->ring->validate(sequence, ticket) == false) {
+            shared->torn[args->id]++;
+        } else if(whole == false) {
+            shared->undetected[args->id]++;
+        } else {
+            shared->valid[args->id]++;
+        }
+    }
+
+    return NULL;
+}
+
+bool check_torn_reads() {
+    FrameRing ring(ring_capacity, ring_slot_bytes);
+    RingShared shared;
+    std::memset(&shared, 0, sizeof(shared));
+    shared.ring = &ring;
+
+    pthread_t readers[reader_threads], writer;
+    ReaderArgs args[reader_threads];
+    for(int i = 0; i < reader_threads; i++) {
+        args[i].shared = &shared;
+        args[i].id = i;
+        pthread_create(&readers[i], NULL, ring_reader, &args[i]);
+    }
+    pthread_create(&writer, NULL, ring_writer, &shared);
+    pthread_join(writer, NULL);
+    for(int i = 0; i < reader_threads; i++) {
+        pthread_join(readers[i], NULL);
+    }
+
+    long valid = 0, torn = 0, undetected = 0;
+    for(int i = 0; i < reader_threads; i++) {
+        valid += shared.valid[i];
+        torn += shared.torn[i];
+        undetected += shared.undetected[i];
+    }
+    bool ok = undetected == 0 && ring.get_latest() == (uint32_t)frames;
+    if(undetected > 0) {
+        std::cout << "torn reads: " << undetected << " frames changed under a reader without validate() noticing" << std::endl;
+    }
+    if(ok) std::cout << "torn reads: OK (" << valid << " good reads, " << torn << " torn ones caught)" << std::endl;
+    return ok;
+}
+
+bool check_wrap() {
+    bool ok = true;
+    FrameRing ring(2, 64, 0xFFFFFFFC);     // Both slots two writes short of wrapping
+    FrameRing::FrameInfo info;
+    std::memset(&info, 0, sizeof(info));
+    uint32_t ticket, wrapped_ticket;
+
+    // A slot's generation wraps from odd 0xFFFFFFFF to even 0 on commit
+    ok = ring.begin_write(1, 64) != NULL && ok;
+    ring.commit(info);
+    ok = ring.peek(1, NULL, &ticket) != NULL && ticket == 0xFFFFFFFE && ok;
+    ok = ring.begin_write(3, 64) != NULL && ok;
+    ok = ring.peek(3, NULL, &wrapped_ticket) == NULL && ok;     // Being written (0xFFFFFFFF)
+    ok = ring.validate(1, ticket) == false && ok;
+    ring.commit(info);
+    ok = ring.peek(3, NULL, &wrapped_ticket) != NULL && wrapped_ticket == 0 && ok;
+    ok = ring.validate(3, wrapped_ticket) && ring.validate(1, ticket) == false && ok;
+    // And past a write that was never committed, in the other slot
+    ok = ring.begin_write(2, 64) != NULL && ok;     // 0xFFFFFFFD, abandoned
+    ok = ring.begin_write(4, 64) != NULL && ok;     // 0xFFFFFFFF
+    ring.commit(info);
+    ok = ring.peek(4, NULL, &ticket) != NULL && ticket == 0 && ok;
+    if(ok == false) {
+        std::cout << "wrap: generation didn't wrap cleanly" << std::endl;
+        return false;
+    }
+
+    // Sequence numbers wrap too, past 0 (which is never a frame)
+    FrameRing history(8, 0);
+    info.sequence = 0xFFFFFFFE;
+    history.record(info);
+    info.sequence = 0xFFFFFFFF;
+    history.record(info);
+    info.sequence = 0;
+    history.record(info);
+    ok = history.get_latest() == 0xFFFFFFFF && ok;
+    info.sequence = 1;
+    history.record(info);
+    ok = history.get_latest() == 1 && ok;
+    ok = history.get_info(0xFFFFFFFE, &info) && info.sequence == 0xFFFFFFFE && ok;
+    ok = history.get_info(0xFFFFFFFF, &info) && info.sequence == 0xFFFFFFFF && ok;
+    ok = history.get_info(0, &info) == false && history.get_info(2, &info) == false && ok;
+    if(ok == false) {
+        std::cout << "wrap: sequence numbers didn't wrap cleanly" << std::endl;
+        return false;
+    }
+
+    std::cout << "wrap: OK" << std::endl;
+    return true;
+}
+
+bool check_oversize() {
+    bool ok = true;
+    FrameRing ring(2, 100);
+    FrameRing::FrameInfo info;
+    std::memset(&info, 0, sizeof(info));
+    uint32_t ticket;
+
+    ok = ring.begin_write(1, 101) == NULL && ring.get_latest() == 0 && ok;
+    ok = ring.begin_write(1, 100) != NULL && ok;
+    info.size = 100;
+    ring.commit(info);
+    ok = ring.peek(1, NULL, &ticket) != NULL && ok;
+    // A frame too big is turned away without disturbing the ring
+    ok = ring.begin_write(3, 1000) == NULL && ok;
+    ok = ring.get_latest() == 1 && ring.validate(1, ticket) && ok;
+    // Even one that fits isn't copied out into a buffer too small for it
+    uint8_t small[50];
+    ok = ring.read(1, &info, small, sizeof(small)) == false && ok;
+
+    // A ring without slot bytes only records
+    FrameRing history(2, 0);
+    ok = history.begin_write(1, 0) == NULL && history.get_latest() == 0 && ok;
+    info.sequence = 1;
+    info.capture_ns = 12345;
+    info.size = 100;
+    history.record(info);
+    ok = history.peek(1, NULL, &ticket) == NULL && ok;
+    ok = history.get_info(1, &info) && info.capture_ns == 12345 && info.size == 0 && ok;
+
+    if(ok) std::cout << "oversize: OK" << std::endl;
+    else std::cout << "oversize: a frame that doesn't fit wasn't handled" << std::endl;
+    return ok;
+}
+
+struct Item {
+    uint32_t value;
+    uint32_t check[64];     // value * 7 + i, so a half-published item shows
+};
+
+struct MailboxShared {
+    TripleBuffer<Item> mailbox;
+    volatile int done;
+};
+
+void * mailbox_producer(void * arg) {
+    MailboxShared * shared = (MailboxShared *)arg;
+    for(uint32_t value = 1; value <= (uint32_t)frames; value++) {
+        Item& item = shared->mailbox.get_back();
+        item.value = value;
+        for(int i = 0; i < 64; i++) {
+            item.check[i] = value * 7 + i;
+        }
+        shared->mailbox.publish();
+        sched_yield();
+    }
+    shared->done = 1;
+    return NULL;
+}
+
+bool check_mailbox() {
+    bool ok = true;
+    TripleBuffer<Item> mailbox;
+
+    // Nothing until the first publish, and then always the latest
+    ok = mailbox.acquire() == NULL && mailbox.is_fresh() == false && ok;
+    mailbox.get_back().value = 1;
+    mailbox.publish();
+    mailbox.get_back().value = 2;
+    mailbox.publish();
+    ok = mailbox.is_fresh() && ok;
+    Item * item = mailbox.acquire();
+    ok = item != NULL && item->value == 2 && mailbox.is_fresh() == false && ok;
+    item = mailbox.acquire();
+    ok = item != NULL && item->value == 2 && ok;
+    if(ok == false) {
+        std::cout << "mailbox: acquire() didn't give the latest item" << std::endl;
+        return false;
+    }
+
+    // Across threads, items only ever move forward, and arrive whole
+    MailboxShared shared;
+    shared.done = 0;
+    pthread_t producer;
+    pthread_create(&producer, NULL, mailbox_producer, &shared);
+    uint32_t last = 0;
+    long seen = 0, backwards = 0, partial = 0;
+    while(shared.done == 0 || shared.mailbox.is_fresh()) {
+        item = shared.mailbox.acquire();
+        if(item == NULL) {
+            continue;
+        }
+        if(item->value < last) backwards++;
+        if(item->value != last) seen++;
+        last = item->value;
+        for(int i = 0; i < 64; i++) {
+            if(item->check[i] != last * 7 + i) {
+                partial++;
+                break;
+            }
+        }
+    }
+    pthread_join(producer, NULL);
+    item = shared.mailbox.acquire();
+    ok = backwards == 0 && partial == 0 && item->value == (uint32_t)frames;
+    if(ok) std::cout << "mailbox: OK (" << seen << " of " << frames << " items seen)" << std::endl;
+    else std::cout << "mailbox: " << backwards << " items went backwards, " << partial << " arrived partial, last "
+                   << item->value << std::endl;
+    return ok;
+}
+
+int main(int argc, char * argv[]) {
+    bool ok = true;
+    if(argc > 1) {
+        frames = atoi(argv[1]);
+    }
+
+    ok = check_wrap() && ok;
+    ok = check_oversize() && ok;
+    ok = check_torn_reads() && ok;
+    ok = check_mailbox() && ok;
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,192 @@
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <libptp++/libptp++.hpp>
+
+#include "../common/SDDefines.hpp"
+#include "../common/AllocCounter.hpp"
+#include "../sd-surface/LiveViewClient.hpp"
+
+// Run the surface's end of the live view round trip (LiveViewClient, as
+//  sd-surface's main loop uses it: SD_JOYDATA_LV, deltas of raw YUV, converted
+//  and scaled to the screen) against a stand-in submarine over loopback. Once
+//  it's warmed up, no frame may make a heap allocation (AllocCounter) or take
+//  a new buffer from the frame pool. Both ends run in this process, so the
+//  stand-in's receive and send paths are held to that too.
+//
+//  Build it with ../sd-surface/LiveViewClient.cpp, and
+//  ../common/AllocCounter.cpp, which counts operator new.
+//  Usage: surfaceloop [frames] [port]
+
+static const int width = 720, height = 240, warmup_frames = 10;
+static const int screen_width = 640, screen_height = 480;
+static bool submarine_ok = true;
+
+// A live view payload of width x height YUV, with no padding or OSD
+uint8_t * make_payload(int * payload_size) {
+    int header_size = sizeof(PTP::lv_data_header) + sizeof(PTP::lv_framebuffer_desc);
+    *payload_size = header_size + (width / 4) * 6 * height;
+    uint8_t * payload = new uint8_t[*payload_size];
+    std::memset(payload, 0, *payload_size);
+
+    PTP::lv_data_header head;
+    std::memset(&head, 0, sizeof(head));
+    head.version_major = 2;
+    head.vp_desc_start = sizeof(head);
+    PTP::lv_framebuffer_desc desc;
+    std::memset(&desc, 0, sizeof(desc));
+    desc.data_start = header_size;
+    desc.buffer_width = width;
+    desc.visible_width = width;
+    desc.visible_height = height;
+    std::memcpy(payload, &head, sizeof(head));
+    std::memcpy(payload + sizeof(head), &desc, sizeof(desc));
+
+    for(int i = header_size; i < *payload_size; i++) {
+        payload[i] = (i * 31) ^ (i >> 5);
+    }
+    return payload;
+}
+
+// Answer SD_JOYDATA_LV like the submarine does, with a bar sweeping across
+//  the frame so there are always tiles to send, until SD_QUIT
+void * run_submarine(void * arg) {
+    PTP::PTPNetwork net;
+    PTP::CameraBase submarine(&net);
+    PTP::PTPContainer cmd, joy_data, encoded, response;
+    PTP::LVDeltaCodec delta(SD_LV_DELTA_THRESHOLD, SD_LV_KEYFRAME_INTERVAL);
+    int size;
+    uint8_t * frame = make_payload(&size);
+    const int header_size = sizeof(PTP::lv_data_header) + sizeof(PTP::lv_framebuffer_desc);
+    const int row_bytes = (width / 4) * 6;
+
+    try {
+        net.listen(*(int *)arg);    // Waits for the surface to connect
+        for(int n = 0; ; n++) {
+            submarine.recv_ptp_message(cmd);
+            if(cmd.get_param_n(0) == SD_QUIT) break;
+            submarine.recv_ptp_message(joy_data);
+
+            for(int row = 0; row < height; row++) {
+                frame[header_size + row * row_bytes + (n * 6) % row_bytes + 1] += 64;
+            }
+            if(cmd.get_param_n(1) & SD_LV_KEYFRAME) {
+                delta.request_keyframe();
+            }
+            encoded.reset(PTP::PTPContainer::CONTAINER_TYPE_DATA, SD_MAGIC);
+            uint8_t * out = encoded.resize_payload(delta.get_max_size(size, row_bytes));
+            int sent = delta.encode(frame, size, row_bytes, out);
+            encoded.resize_payload(sent);
+            submarine.send_ptp_message(encoded);
+
+            response.reset(PTP::PTPContainer::CONTAINER_TYPE_RESPONSE, SD_MAGIC);
+            response.add_param(SD_OK);
+            response.add_param(width);
+            response.add_param(height);
+            response.add_param(0);
+            response.add_param(SD_LV_YUV);
+            response.add_param(SD_LV_CODEC_DELTA);
+            response.add_param(sent);
+            response.add_param(delta.get_stats().tiles);
+            response.add_param(delta.get_stats().tiles_sent);
+            submarine.send_ptp_message(response);
+        }
+    } catch(PTP::LIBPTP_PP_ERRORS e) {
+        std::cout << "submarine: error " << e << std::endl;
+        submarine_ok = false;
+    } catch(PTP::PTPNetwork::NetworkErrors e) {
+        std::cout << "submarine: network error " << e << std::endl;
+        submarine_ok = false;
+    }
+
+    delete[] frame;
+    return NULL;
+}
+
+int main(int argc, char * argv[]) {
+    int frames = argc > 1 ? std::atoi(argv[1]) : 200;
+    int port = argc > 2 ? std::atoi(argv[2]) : SD_PORT + 1;
+    PTP::LVConverter::set_threads(0);
+
+    // Both ends share the frame pool, so how many buffers they need at once
+    //  depends on how their threads interleave. Fill it up front, rather than
+    //  count on the warmup happening to see the worst case.
+    PTP::FrameBufferPool& pool = PTP::FrameBufferPool::get_default();
+    pool.reserve(sizeof(PTP::lv_data_header) + sizeof(PTP::lv_framebuffer_desc) + (width / 4) * 6 * height + 12, 4);
+    pool.reserve(64, 4);
+
+    pthread_t submarine;
+    pthread_create(&submarine, NULL, run_submarine, &port);
+
+    PTP::PTPNetwork surface_net;
+    PTP::CameraBase surface(&surface_net);
+    PTP::PTPContainer quit_cmd;
+    int8_t nav_data[16];
+    std::memset(nav_data, 0, sizeof(nav_data));
+    LiveViewClient live_view;
+    PTP::FrameBuffer screen;
+    screen.reserve(screen_width * screen_height * 2);
+    bool ok = true;
+
+    AllocCounter allocations;
+    unsigned long pool_allocations = 0;
+    int frame = 0;
+    try {
+        // Give the submarine a moment to start listening
+        for(int attempt = 0; ; attempt++) {
+            try {
+                surface_net.connect("127.0.0.1", port);
+                break;
+            } catch(PTP::PTPNetwork::NetworkErrors e) {
+                if(attempt == 50) throw;
+                usleep(20000);
+            }
+        }
+        for(; frame < frames; frame++) {
+            if(frame == warmup_frames) {
+                allocations.reset();
+                pool_allocations = pool.get_system_allocations();
+            }
+
+            nav_data[0] = frame & 1;
+            LiveViewClient::Result result = live_view.fetch(surface, nav_data, sizeof(nav_data), SD_LV_RAW | SD_LV_DELTA,
+                                                            SD_LV_DELTA_THRESHOLD, 0, 0);
+            if(result != LiveViewClient::LV_FRAME ||
+               live_view.draw(screen.get(), screen_width * 2, screen_width, screen_height) == false) {
+                std::cout << "frame " << frame << ": bad reply" << std::endl;
+                ok = false;
+                break;
+            }
+            live_view.drawn();
+        }
+    } catch(PTP::LIBPTP_PP_ERRORS e) {
+        std::cout << "frame " << frame << ": error " << e << std::endl;
+        ok = false;
+    } catch(PTP::PTPNetwork::NetworkErrors e) {
+        std::cout << "frame " << frame << ": network error " << e << std::endl;
+        ok = false;
+    }
+    unsigned long heap = allocations.get_count();
+    unsigned long pooled = pool.get_system_allocations() - pool_allocations;
+
+    try {
+        quit_cmd.reset(PTP::PTPContainer::CONTAINER_TYPE_COMMAND, SD_MAGIC);
+        quit_cmd.add_param(SD_QUIT);
+        surface.send_ptp_message(quit_cmd);
+    } catch(...) {
+        ;
+    }
+    pthread_join(submarine, NULL);
+
+    if(frame > warmup_frames && (heap > 0 || pooled > 0)) {
+        std::cout << "surfaceloop: " << frame - warmup_frames << " frames made " << heap << " heap allocations, and took "
+            << pooled << " new buffers from the pool" << std::endl;
+        ok = false;
+    }
+    ok = ok && submarine_ok;
+    if(ok) std::cout << "surfaceloop: OK (" << frames - warmup_frames << " frames without allocating)" << std::endl;
+    return ok ? 0 : 1;
+}
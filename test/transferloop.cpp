@@ -0,0 +1,335 @@
+#include <iostream>
+#include <string>
+#include <map>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <libptp++/libptp++.hpp>
+
+// Download a file through CHDKCamera::download_file from a stand-in camera
+//  over loopback, with another thread fetching "live view" from the same
+//  camera the whole time. Checks the file arrives intact (and is streamed,
+//  with progress along the way), that a file the camera doesn't have leaves
+//  nothing behind, and that a sink giving up doesn't leave the camera out of
+//  step. Then uploads it back with CHDKCamera::upload_file, and checks
+//  CHDKCamera::upload_file_if_changed only uploads what the camera doesn't
+//  have already, and that an upload whose write fails partway throws
+//  ERR_CANNOT_SEND instead of waiting for an answer that won't come.
+//
+//  Usage: transferloop [megabytes] [port]
+
+static const std::string remote_name = "A/DCIM/100CANON/IMG_0001.JPG";
+static const int lv_size = 64 * 1024;
+static uint8_t * file_data = NULL;
+static uint32_t file_size = 0;
+static bool camera_ok = true;
+static volatile bool downloading = true;
+static volatile int lv_frames = 0;
+static std::map<std::string, std::string> camera_files;    // The stand-in camera's card
+static int uploads = 0;
+
+// Answer just enough of CHDK's PTP extension: TempData, DownloadFile,
+//  UploadFile and GetDisplayData, until the connection closes
+void * run_camera(void * arg) {
+    PTP::PTPNetwork net;
+    PTP::CameraBase camera(&net);
+    PTP::PTPContainer cmd, data, out, resp;
+    std::string named;
+
+    try {
+        net.listen(*(int *)arg);    // Waits for the test to connect
+        while(true) {
+            camera.recv_ptp_message(cmd);
+            uint32_t op = cmd.get_param_n(0);
+            uint16_t code = PTP::CHDK_PTP_RC_OK;
+
+            if(op == PTP::PTP_CHDK_TempData) {
+                camera.recv_ptp_message(data);
+                int size;
+                const uint8_t * name = data.get_payload_pointer(&size);
+                named.assign((const char *)name, size);
+            } else if(op == PTP::PTP_CHDK_DownloadFile) {
+                if(camera_files.count(named) > 0) {
+                    out.reset(PTP::PTPContainer::CONTAINER_TYPE_DATA, 0x9999);
+                    out.set_payload(camera_files[named].data(), camera_files[named].size());
+                    out.transaction_id = cmd.transaction_id;
+                    camera.send_ptp_message(out);
+                } else {
+                    code = PTP::CHDK_PTP_RC_GeneralError;
+                }
+                named.clear();
+            } else if(op == PTP::PTP_CHDK_UploadFile) {
+                camera.recv_ptp_message(data);
+                int size;
+                const uint8_t * upload = data.get_payload_pointer(&size);
+                uint32_t name_length;
+                std::memcpy(&name_length, upload, 4);
+                camera_files[std::string((const char *)upload + 4, name_length)] =
+                    std::string((const char *)upload + 4 + name_length, size - 4 - name_length);
+                uploads++;
+            } else if(op == PTP::PTP_CHDK_GetDisplayData) {
+                out.reset(PTP::PTPContainer::CONTAINER_TYPE_DATA, 0x9999);
+                std::memset(out.resize_payload(lv_size), op, lv_size);
+                out.transaction_id = cmd.transaction_id;
+                camera.send_ptp_message(out);
+            } else {
+                code = PTP::CHDK_PTP_RC_ParameterNotSupported;
+            }
+
+            resp.reset(PTP::PTPContainer::CONTAINER_TYPE_RESPONSE, code);
+            resp.transaction_id = cmd.transaction_id;
+            camera.send_ptp_message(resp);
+        }
+    } catch(PTP::LIBPTP_PP_ERRORS e) {
+        std::cout << "camera: error " << e << std::endl;
+        camera_ok = false;
+    } catch(PTP::PTPNetwork::NetworkErrors e) {
+        ;   // The test hung up
+    }
+    return NULL;
+}
+
+// Fetch live view for as long as the download runs
+void * run_live_view(void * arg) {
+    PTP::CHDKCamera * cam = (PTP::CHDKCamera *)arg;
+    PTP::PTPContainer cmd, data, out_resp, out_data;
+
+    try {
+        while(downloading) {
+            cmd.reset(PTP::PTPContainer::CONTAINER_TYPE_COMMAND, 0x9999);
+            cmd.add_param(PTP::PTP_CHDK_GetDisplayData);
+            cmd.add_param(LV_TFR_VIEWPORT);
+            cam->ptp_transaction(cmd, data, true, out_resp, out_data);
+            int size;
+            const uint8_t * frame = out_data.get_payload_pointer(&size);
+            if(out_resp.code != PTP::CHDK_PTP_RC_OK || size != lv_size || frame[0] != PTP::PTP_CHDK_GetDisplayData) {
+                std::cout << "live view: bad frame" << std::endl;
+                camera_ok = false;
+                break;
+            }
+            lv_frames++;
+        }
+    } catch(...) {
+        std::cout << "live view: error" << std::endl;
+        camera_ok = false;
+    }
+    return NULL;
+}
+
+// Prints the progress, and remembers how many times it was called
+class ProgressSink : public PTP::FDDataSink {
+    public:
+    ProgressSink(const int fd, const uint32_t give_up=0) : PTP::FDDataSink(fd) {
+        this->give_up = give_up;
+        this->calls = 0;
+    }
+    virtual bool write(const unsigned char * data, const int length) {
+        if(this->give_up > 0 && this->get_written() >= this->give_up) return false;
+        return PTP::FDDataSink::write(data, length);
+    }
+    virtual void progress(const uint32_t done, const uint32_t size, const uint32_t elapsed_ms) {
+        this->calls++;
+        if(done % (1024 * 1024) >= 128 * 1024 && done != size) return;   // About once a MB is plenty
+        std::printf("\r%u / %u KB, %.1f MB/s   ", done / 1024, size / 1024, elapsed_ms > 0 ? done / 1000.0 / elapsed_ms : 0.0);
+        std::fflush(stdout);
+    }
+    uint32_t give_up;
+    int calls;
+};
+
+// Passes everything through to another IPTPComm, except that once fail_after
+//  bytes have been written, every write fails, like a cable pulled mid-upload
+class FailingComm : public PTP::IPTPComm {
+    public:
+    FailingComm(PTP::IPTPComm * comm) {
+        this->comm = comm;
+        this->fail_after = -1;
+        this->written = 0;
+        this->reads = 0;
+    }
+    int get_min_read() { return this->comm->get_min_read(); }
+    bool is_open() { return this->comm->is_open(); }
+    bool _bulk_write(const unsigned char * bytestr, const int length, const int timeout=0) {
+        if(this->fail_after >= 0 && this->written + length > this->fail_after) return false;
+        this->written += length;
+        return this->comm->_bulk_write(bytestr, length, timeout);
+    }
+    bool _bulk_read(unsigned char * data_out, const int size, int * transferred, const int timeout=0) {
+        this->reads++;
+        return this->comm->_bulk_read(data_out, size, transferred, timeout);
+    }
+    PTP::IPTPComm * comm;
+    long fail_after;
+    long written;
+    int reads;
+};
+
+std::string read_file(const char * name) {
+    std::string contents;
+    FILE * file = std::fopen(name, "rb");
+    if(file == NULL) return contents;
+
+    char buffer[64 * 1024];
+    size_t size;
+    while((size = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        contents.append(buffer, size);
+    }
+    std::fclose(file);
+    return contents;
+}
+
+bool same_as_file(const char * name) {
+    return read_file(name) == std::string((const char *)file_data, file_size);
+}
+
+int main(int argc, char * argv[]) {
+    int megabytes = argc > 1 ? std::atoi(argv[1]) : 8;
+    int port = argc > 2 ? std::atoi(argv[2]) : 50078;
+    char local_name[] = "/tmp/downloadloop-XXXXXX";
+    int fd = mkstemp(local_name);
+    close(fd);
+    bool ok = true;
+
+    file_size = megabytes * 1024 * 1024 + 123;     // Not a whole number of chunks
+    file_data = new uint8_t[file_size];
+    for(uint32_t i = 0; i < file_size; i++) {
+        file_data[i] = (i * 31) ^ (i >> 11);
+    }
+    camera_files[remote_name] = std::string((const char *)file_data, file_size);
+
+    pthread_t camera;
+    pthread_create(&camera, NULL, run_camera, &port);
+
+    PTP::PTPNetwork net;
+    PTP::CHDKCamera cam(&net);
+    try {
+        // Give the camera a moment to start listening
+        for(int attempt = 0; ; attempt++) {
+            try {
+                net.connect("127.0.0.1", port);
+                break;
+            } catch(PTP::PTPNetwork::NetworkErrors e) {
+                if(attempt == 50) throw;
+                usleep(20000);
+            }
+        }
+
+        pthread_t live_view;
+        pthread_create(&live_view, NULL, run_live_view, &cam);
+        usleep(10000);
+        int frames_before = lv_frames;
+
+        fd = open(local_name, O_WRONLY | O_TRUNC);
+        ProgressSink sink(fd);
+        bool downloaded = cam.download_file(remote_name, sink);
+        close(fd);
+        std::cout << std::endl;
+        downloading = false;
+        pthread_join(live_view, NULL);
+
+        if(downloaded == false || same_as_file(local_name) == false) {
+            std::cout << "Downloaded file doesn't match" << std::endl;
+            ok = false;
+        }
+        if(sink.calls < 2) {
+            std::cout << "Only " << sink.calls << " progress reports" << std::endl;
+            ok = false;
+        }
+        std::cout << lv_frames - frames_before << " live view frames during the download" << std::endl;
+
+        // A file the camera doesn't have
+        if(cam.download_file("A/NOT_THERE.JPG", std::string(local_name)) == true || access(local_name, F_OK) == 0) {
+            std::cout << "Missing file didn't fail cleanly" << std::endl;
+            ok = false;
+        }
+
+        // A sink that gives up partway, and the camera still answers after
+        fd = open(local_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        ProgressSink quitter(fd, 1024 * 1024);
+        bool threw = false;
+        try {
+            cam.download_file(remote_name, quitter);
+        } catch(PTP::LIBPTP_PP_ERRORS e) {
+            threw = (e == PTP::ERR_DATASINK_FAILED);
+        }
+        close(fd);
+        std::cout << std::endl;
+        if(threw == false) {
+            std::cout << "Failing sink didn't throw ERR_DATASINK_FAILED" << std::endl;
+            ok = false;
+        }
+        if(cam.download_file(remote_name, std::string(local_name)) == false || same_as_file(local_name) == false) {
+            std::cout << "Download after a failing sink doesn't match" << std::endl;
+            ok = false;
+        }
+
+        // Upload it back under another name, then again only if it's changed
+        const std::string upload_name = "A/CHDK/SCRIPTS/UPLOAD.BIN";
+        ProgressSink upload_progress(-1);  // Only for its progress
+        bool uploaded = false;
+        if(cam.upload_file(local_name, upload_name, 0, &upload_progress) == false ||
+           camera_files[upload_name] != read_file(local_name) || upload_progress.calls < 2) {
+            std::cout << std::endl << "Upload doesn't match" << std::endl;
+            ok = false;
+        }
+        std::cout << std::endl;
+        int uploads_before = uploads;
+        if(cam.upload_file_if_changed(local_name, upload_name, &uploaded) == false || uploaded || uploads != uploads_before) {
+            std::cout << "Unchanged file was uploaded again" << std::endl;
+            ok = false;
+        }
+        FILE * file = std::fopen(local_name, "ab");
+        std::fputc('!', file);
+        std::fclose(file);
+        if(cam.upload_file_if_changed(local_name, upload_name, &uploaded) == false || uploaded == false ||
+           camera_files[upload_name] != read_file(local_name)) {
+            std::cout << "Changed file wasn't uploaded" << std::endl;
+            ok = false;
+        }
+        if(cam.upload_file_if_changed(local_name, "A/CHDK/SCRIPTS/NEW.BIN", &uploaded) == false || uploaded == false) {
+            std::cout << "File the camera doesn't have wasn't uploaded" << std::endl;
+            ok = false;
+        }
+        if(cam.upload_file("/nonexistent/file", upload_name) == true) {
+            std::cout << "Missing local file didn't fail" << std::endl;
+            ok = false;
+        }
+
+        // A write that fails partway through the upload, last, since the
+        //  camera is left waiting for the rest of it
+        FailingComm failing(&net);
+        PTP::CHDKCamera failing_cam(&failing);
+        failing.fail_after = 1024 * 1024;
+        uploads_before = uploads;
+        threw = false;
+        try {
+            failing_cam.upload_file(local_name, "A/CHDK/SCRIPTS/CUT.BIN");
+        } catch(PTP::LIBPTP_PP_ERRORS e) {
+            threw = (e == PTP::ERR_CANNOT_SEND);
+        }
+        if(threw == false || failing.reads != 0 || uploads != uploads_before) {
+            std::cout << "Upload cut short didn't throw ERR_CANNOT_SEND without reading a response" << std::endl;
+            ok = false;
+        }
+    } catch(PTP::LIBPTP_PP_ERRORS e) {
+        std::cout << "error " << e << std::endl;
+        ok = false;
+    } catch(PTP::PTPNetwork::NetworkErrors e) {
+        std::cout << "network error " << e << std::endl;
+        ok = false;
+    }
+
+    net.close();
+    pthread_join(camera, NULL);
+    unlink(local_name);
+    delete[] file_data;
+
+    ok = ok && camera_ok;
+    if(ok) std::cout << "transferloop: OK" << std::endl;
+    return ok ? 0 : 1;
+}
@@ -53,6 +53,9 @@ sudo cp ./utils/sd-startup /etc/init.d/
 # Image files
 sudo mkdir -p /usr/share/sd-surface/
 sudo cp ./images/*.bmp /usr/share/sd-surface/
+# Camera script, uploaded to the camera by sd-submarine
+sudo mkdir -p /usr/share/sd-submarine/
+sudo cp ./camera/sd-sub.lua /usr/share/sd-submarine/
 
 # Update init.d files
 echo "Reloading init.d rules"
@@ -85,6 +88,7 @@ mkdir -p /tmp/update/etc/udev/rules.d/
 mkdir -p /tmp/update/usr/sbin/
 mkdir -p /tmp/update/etc/init.d/
 mkdir -p /tmp/update/usr/share/sd-surface/
+mkdir -p /tmp/update/usr/share/sd-submarine/
 EOF1
 
 # TODO: Set up public key authentication so that we can SFTP/SSH
@@ -107,6 +111,7 @@ put /usr/sbin/sd-stop-update /tmp/update/usr/sbin/
 put /usr/sbin/sd-update /tmp/update/usr/sbin/
 put /etc/init.d/sd-startup /tmp/update/etc/init.d/
 put /usr/share/sd-surface/* /tmp/update/usr/share/sd-surface/
+put /usr/share/sd-submarine/* /tmp/update/usr/share/sd-submarine/
 EOF2
 
 # User pi will need sudo access with NOPASSWD, which is a security risk.
@@ -121,6 +126,7 @@ sudo /etc/init.d/sd-startup update
 sleep 2
 sudo mkdir -p /usr/include/libptp++/chdk/
 sudo mkdir -p /usr/share/sd-surface/
+sudo mkdir -p /usr/share/sd-submarine/
 sudo cp -r /tmp/update/* /
 sudo update-rc.d sd-startup defaults
 sudo udevadm control --reload-rules